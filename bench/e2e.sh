@@ -0,0 +1,39 @@
+#!/bin/sh
+# End-to-end streaming benchmark: runs the real client against the mock
+# server and prints TTFT, UI-update lag and dropped frames as JSON.
+#
+#   bench/e2e.sh <ganesha-mock-server> <ganesha> <report.json> [mock options...]
+#
+# Exits 77 (skipped) when there is no display to open the window on.
+set -eu
+
+MOCK=$1
+APP=$2
+REPORT=$3
+shift 3
+
+if [ -z "${WAYLAND_DISPLAY:-}" ] && [ -z "${DISPLAY:-}" ]; then
+  echo "e2e: no display, skipping" >&2
+  exit 77
+fi
+
+PORT=${GANESHA_E2E_PORT:-11435}
+rm -f "$REPORT"
+TMP=$(mktemp -d)
+trap 'kill "$MOCK_PID" 2>/dev/null || true; rm -rf "$TMP"' EXIT INT TERM
+
+"$MOCK" --port "$PORT" "$@" &
+MOCK_PID=$!
+sleep 0.5
+
+XDG_CONFIG_HOME="$TMP" \
+GANESHA_OLLAMA_URL="http://127.0.0.1:$PORT" \
+GANESHA_E2E_PROMPT="${GANESHA_E2E_PROMPT:-Explain how streaming works.}" \
+GANESHA_E2E_REPORT="$REPORT" \
+  timeout 300 "$APP"
+
+if [ ! -s "$REPORT" ]; then
+  echo "e2e: ganesha exited without a report" >&2
+  exit 1
+fi
+cat "$REPORT"
@@ -0,0 +1,476 @@
+/* Headless benchmarks for the hot paths of the chat engine.
+ *
+ * Links libganesha-core only, so it runs without a display.
+ *
+ *   ganesha-bench [--conversations N] [--messages M] [--iterations I] [--output FILE]
+ *
+ * Results are written as JSON so runs can be compared over time.
+ */
+#include "ganesha-core.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <string.h>
+
+typedef struct {
+  const gchar *name;
+  guint        iterations;
+  gdouble      min_ms;
+  gdouble      max_ms;
+  gdouble      total_ms;
+  gsize        bytes;      // Payload size processed per iteration
+} BenchResult;
+
+static gint     opt_conversations = 50;
+static gint     opt_messages      = 40;
+static gint     opt_iterations    = 5;
+static gchar   *opt_output        = NULL;
+
+static GOptionEntry bench_entries[] = {
+  { "conversations", 'c', 0, G_OPTION_ARG_INT, &opt_conversations, "Conversations in the corpus", "N" },
+  { "messages", 'm', 0, G_OPTION_ARG_INT, &opt_messages, "Messages per conversation", "M" },
+  { "iterations", 'i', 0, G_OPTION_ARG_INT, &opt_iterations, "Timed iterations per benchmark", "I" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output, "Write JSON results to FILE", "FILE" },
+  { NULL }
+};
+
+/* ---------- Synthetic corpus ---------- */
+
+static const char *WORDS[] = {
+  "model", "token", "stream", "latency", "buffer", "widget", "server", "context",
+  "memory", "thread", "request", "response", "markdown", "history", "budget", "cache"
+};
+
+static void append_sentence(GString *out, GRand *rand, guint words) {
+  for (guint i = 0; i < words; i++) {
+      if (i > 0) g_string_append_c(out, ' ');
+      g_string_append(out, WORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(WORDS))]);
+  }
+  g_string_append(out, ". ");
+}
+
+static gchar* make_assistant_text(GRand *rand) {
+  GString *out = g_string_new(NULL);
+
+  g_string_append(out, "## Overview\n\n");
+  for (guint p = 0; p < 3; p++) {
+      for (guint s = 0; s < 4; s++) append_sentence(out, rand, g_rand_int_range(rand, 6, 18));
+      g_string_append(out, "\n\n");
+  }
+  for (guint i = 0; i < 5; i++) {
+      g_string_append(out, "- ");
+      append_sentence(out, rand, 8);
+      g_string_append_c(out, '\n');
+  }
+  if (g_rand_boolean(rand)) {
+      g_string_append(out, "\n```c\n");
+      guint lines = g_rand_int_range(rand, 10, 60);
+      for (guint l = 0; l < lines; l++) {
+          g_string_append_printf(out, "  value_%u = compute(buffer[%u], `%s`);\n", l, l,
+                                 WORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(WORDS))]);
+      }
+      g_string_append(out, "```\n");
+  }
+  g_string_append(out, "\n> Note: ");
+  append_sentence(out, rand, 10);
+  return g_string_free(out, FALSE);
+}
+
+static gchar* make_image(GRand *rand, gsize size) {
+  guchar *raw = g_malloc(size);
+  for (gsize i = 0; i < size; i++) raw[i] = (guchar)g_rand_int(rand);
+  gchar *b64 = g_base64_encode(raw, size);
+  g_free(raw);
+  return b64;
+}
+
+static GPtrArray* generate_corpus(guint n_conversations, guint n_messages) {
+  GRand *rand = g_rand_new_with_seed(42);
+  GPtrArray *corpus = g_ptr_array_new_with_free_func((GDestroyNotify)conversation_free);
+
+  for (guint c = 0; c < n_conversations; c++) {
+      Conversation *conv = conversation_new();
+      for (guint m = 0; m < n_messages; m++) {
+          if (m % 2 == 0) {
+              GString *prompt = g_string_new(NULL);
+              append_sentence(prompt, rand, g_rand_int_range(rand, 5, 40));
+              conversation_add_message(conv, "user", prompt->str);
+              g_string_free(prompt, TRUE);
+
+              // Every tenth prompt carries a 48 KB image
+              if (m % 10 == 0) {
+                  Message *msg = g_ptr_array_index(conv->messages, conv->messages->len - 1);
+                  g_ptr_array_add(msg->images, make_image(rand, 48 * 1024));
+              }
+          } else {
+              gchar *text = make_assistant_text(rand);
+              conversation_add_message(conv, "assistant", text);
+              g_free(text);
+          }
+      }
+      g_ptr_array_add(corpus, conv);
+  }
+
+  g_rand_free(rand);
+  return corpus;
+}
+
+static gchar* make_ndjson_stream(guint tokens) {
+  GString *out = g_string_new(NULL);
+  GRand *rand = g_rand_new_with_seed(7);
+
+  for (guint i = 0; i < tokens; i++) {
+      g_string_append_printf(out,
+          "{\"model\":\"bench\",\"created_at\":\"2025-01-01T00:00:00Z\","
+          "\"message\":{\"role\":\"assistant\",\"content\":\"%s \"},\"done\":false}\n",
+          WORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(WORDS))]);
+  }
+  g_string_append(out,
+      "{\"model\":\"bench\",\"created_at\":\"2025-01-01T00:00:00Z\","
+      "\"message\":{\"role\":\"assistant\",\"content\":\"\"},\"done\":true,"
+      "\"total_duration\":1,\"eval_count\":1}\n");
+
+  g_rand_free(rand);
+  return g_string_free(out, FALSE);
+}
+
+static gchar* make_sse_stream(guint tokens) {
+  GString *out = g_string_new(NULL);
+  GRand *rand = g_rand_new_with_seed(7);
+
+  for (guint i = 0; i < tokens; i++) {
+      g_string_append_printf(out,
+          "data: {\"id\":\"chatcmpl-bench\",\"object\":\"chat.completion.chunk\",\"model\":\"bench\","
+          "\"choices\":[{\"index\":0,\"delta\":{\"content\":\"%s \"},\"finish_reason\":null}]}\n\n",
+          WORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(WORDS))]);
+  }
+  g_string_append(out,
+      "data: {\"id\":\"chatcmpl-bench\",\"object\":\"chat.completion.chunk\",\"model\":\"bench\","
+      "\"choices\":[{\"index\":0,\"delta\":{},\"finish_reason\":\"stop\"}]}\n\n"
+      "data: {\"id\":\"chatcmpl-bench\",\"object\":\"chat.completion.chunk\",\"choices\":[],"
+      "\"usage\":{\"prompt_tokens\":1,\"completion_tokens\":1,\"total_tokens\":2}}\n\n"
+      "data: [DONE]\n\n");
+
+  g_rand_free(rand);
+  return g_string_free(out, FALSE);
+}
+
+/* ---------- Timing ---------- */
+
+static void bench_begin(BenchResult *r, const gchar *name) {
+  memset(r, 0, sizeof(*r));
+  r->name = name;
+  r->min_ms = G_MAXDOUBLE;
+}
+
+static void bench_sample(BenchResult *r, gint64 start) {
+  gdouble ms = (g_get_monotonic_time() - start) / 1000.0;
+  r->iterations++;
+  r->total_ms += ms;
+  r->min_ms = MIN(r->min_ms, ms);
+  r->max_ms = MAX(r->max_ms, ms);
+}
+
+static void bench_build_body(GPtrArray *corpus, BenchResult *r, gboolean planned) {
+  bench_begin(r, planned ? "build_ollama_chat_body_planned" : "build_ollama_chat_body");
+
+  for (gint it = 0; it < opt_iterations; it++) {
+      gint64 start = g_get_monotonic_time();
+      for (guint c = 0; c < corpus->len; c++) {
+          Conversation *conv = g_ptr_array_index(corpus, c);
+          ContextPlan *plan = planned
+              ? context_plan_new(conv, conv->messages->len, NULL, DEFAULT_NUM_CTX)
+              : NULL;
+          GArray *snapshot = conversation_snapshot(conv, conv->messages->len);
+          gchar *body = build_ollama_chat_body("bench", snapshot, plan, KEEP_ALIVE);
+          if (it == 0) r->bytes += strlen(body);
+          g_free(body);
+          g_array_unref(snapshot);
+          context_plan_free(plan);
+      }
+      bench_sample(r, start);
+  }
+}
+
+static void bench_persistence(GPtrArray *corpus, BenchResult *save, BenchResult *load) {
+  bench_begin(save, "save_conversations");
+  for (gint it = 0; it < opt_iterations; it++) {
+      gint64 start = g_get_monotonic_time();
+      save_conversations(corpus);
+      bench_sample(save, start);
+  }
+
+  bench_begin(load, "load_conversations");
+  gchar *path = get_conversations_path();
+  GStatBuf st;
+  if (g_stat(path, &st) == 0) {
+      save->bytes = st.st_size;
+      load->bytes = st.st_size;
+  }
+  g_free(path);
+
+  for (gint it = 0; it < opt_iterations; it++) {
+      GPtrArray *loaded = g_ptr_array_new_with_free_func((GDestroyNotify)conversation_free);
+      gint64 start = g_get_monotonic_time();
+      load_conversations(loaded);
+      bench_sample(load, start);
+      if (loaded->len != corpus->len) {
+          g_printerr("load_conversations: expected %u conversations, got %u\n",
+                     corpus->len, loaded->len);
+      }
+      g_ptr_array_unref(loaded);
+  }
+}
+
+/* Same decode loop as the streaming legs in core/ollama.c, fed from memory. */
+static void bench_decode(BenchResult *r, const gchar *name, const ChatBackend *backend, gchar *stream_text) {
+  gsize stream_len = strlen(stream_text);
+
+  bench_begin(r, name);
+  r->bytes = stream_len;
+  for (gint it = 0; it < opt_iterations; it++) {
+      GInputStream *mem = g_memory_input_stream_new_from_data(stream_text, stream_len, NULL);
+      GDataInputStream *din = g_data_input_stream_new(mem);
+      g_data_input_stream_set_newline_type(din, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+      StreamDecoder *decoder = stream_decoder_new(backend);
+      gsize decoded = 0;
+
+      gint64 start = g_get_monotonic_time();
+      while (TRUE) {
+          gsize len = 0;
+          gchar *line = g_data_input_stream_read_line_utf8(din, &len, NULL, NULL);
+          if (!line) break;
+          StreamEvent event;
+          gboolean done = FALSE;
+          if (stream_decoder_feed(decoder, line, len, &event)) {
+              if (event.delta) decoded += strlen(event.delta);
+              done = event.done;
+          }
+          g_free(line);
+          if (done) break;
+      }
+      bench_sample(r, start);
+
+      if (decoded == 0) g_printerr("%s: no text decoded\n", name);
+      stream_decoder_free(decoder);
+      g_object_unref(din);
+      g_object_unref(mem);
+  }
+
+  g_free(stream_text);
+}
+
+/* Cold parses every assistant message; warm goes through the parse cache,
+ * as switching back to a conversation does. */
+static void bench_markdown(GPtrArray *corpus, BenchResult *cold, BenchResult *warm) {
+  bench_begin(cold, "markdown_parse");
+  bench_begin(warm, "markdown_parse_cached");
+
+  for (gint it = 0; it < opt_iterations; it++) {
+      gint64 start = g_get_monotonic_time();
+      for (guint c = 0; c < corpus->len; c++) {
+          Conversation *conv = g_ptr_array_index(corpus, c);
+          for (guint m = 0; m < conv->messages->len; m++) {
+              Message *msg = g_ptr_array_index(conv->messages, m);
+              if (g_strcmp0(msg->role, "assistant") != 0) continue;
+              if (it == 0) cold->bytes += strlen(msg->content);
+              md_doc_unref(md_parse(msg->content));
+          }
+      }
+      bench_sample(cold, start);
+  }
+
+  for (gint it = 0; it <= opt_iterations; it++) {
+      gint64 start = g_get_monotonic_time();
+      for (guint c = 0; c < corpus->len; c++) {
+          Conversation *conv = g_ptr_array_index(corpus, c);
+          for (guint m = 0; m < conv->messages->len; m++) {
+              Message *msg = g_ptr_array_index(conv->messages, m);
+              if (g_strcmp0(msg->role, "assistant") != 0) continue;
+              md_doc_unref(md_cache_get(msg->serial, msg->content));
+          }
+      }
+      if (it > 0) bench_sample(warm, start);   // The first pass fills the cache
+  }
+  warm->bytes = cold->bytes;
+  md_cache_clear();
+}
+
+#define VECTOR_DIM     384
+#define VECTOR_QUERIES 100
+#define VECTOR_TOP_K   5
+
+static void fill_unit_vector(gfloat *v, const gfloat *center, GRand *rand) {
+  for (guint k = 0; k < VECTOR_DIM; k++) {
+      v[k] = (center ? center[k] : 0.0f) + (gfloat)g_rand_double_range(rand, -0.5, 0.5);
+  }
+  gfloat norm = sqrtf(rag_dot(v, v, VECTOR_DIM));
+  for (guint k = 0; k < VECTOR_DIM; k++) v[k] /= norm;
+}
+
+/* VECTOR_QUERIES top-k searches of an index of n_chunks synthetic
+ * embeddings, clustered around topics as real documents are. Past
+ * RAG_IVF_MIN_CHUNKS the index is clustered and the recall of the top hit
+ * against an exact scan is checked. */
+static void bench_vector_search(BenchResult *r, const gchar *name, guint n_chunks) {
+  GRand *rand = g_rand_new_with_seed(n_chunks);
+  guint n_topics = MAX(n_chunks / 200, 1);
+  gfloat *topics = g_new(gfloat, (gsize)n_topics * VECTOR_DIM);
+  for (guint t = 0; t < n_topics; t++) fill_unit_vector(topics + (gsize)t * VECTOR_DIM, NULL, rand);
+
+  gfloat *vectors = g_new(gfloat, (gsize)n_chunks * VECTOR_DIM);
+  RagChunk *chunks = g_new0(RagChunk, n_chunks);
+  for (guint i = 0; i < n_chunks; i++) {
+      gfloat *v = vectors + (gsize)i * VECTOR_DIM;
+      fill_unit_vector(v, topics + (gsize)g_rand_int_range(rand, 0, n_topics) * VECTOR_DIM, rand);
+      chunks[i] = (RagChunk){ .source = "bench.txt", .line = i + 1, .text = "chunk", .len = 5, .vector = v };
+  }
+  gfloat *queries = g_new(gfloat, (gsize)VECTOR_QUERIES * VECTOR_DIM);
+  for (guint q = 0; q < VECTOR_QUERIES; q++) {
+      fill_unit_vector(queries + (gsize)q * VECTOR_DIM,
+                       topics + (gsize)g_rand_int_range(rand, 0, n_topics) * VECTOR_DIM, rand);
+  }
+
+  bench_begin(r, name);
+  r->bytes = (gsize)n_chunks * VECTOR_DIM * sizeof(gfloat);
+  gchar *path = get_documents_path();
+  GError *error = NULL;
+  RagIndex *index = rag_index_write(path, "bench", VECTOR_DIM, chunks, n_chunks, &error);
+  if (!index) {
+      g_printerr("%s: %s\n", name, error->message);
+      g_error_free(error);
+  }
+
+  RagHit hits[VECTOR_TOP_K];
+  guint found = 0;
+  for (gint it = 0; index && it < opt_iterations; it++) {
+      gint64 start = g_get_monotonic_time();
+      for (guint q = 0; q < VECTOR_QUERIES; q++) {
+          found += rag_index_search(index, queries + (gsize)q * VECTOR_DIM, VECTOR_TOP_K, hits);
+      }
+      bench_sample(r, start);
+  }
+  if (index && found == 0) g_printerr("%s: no hits\n", name);
+
+  if (index && n_chunks >= RAG_IVF_MIN_CHUNKS) {
+      guint agree = 0;
+      for (guint q = 0; q < VECTOR_QUERIES; q++) {
+          const gfloat *query = queries + (gsize)q * VECTOR_DIM;
+          gfloat best = -G_MAXFLOAT;
+          for (guint i = 0; i < n_chunks; i++) best = MAX(best, rag_dot(vectors + (gsize)i * VECTOR_DIM, query, VECTOR_DIM));
+          if (rag_index_search(index, query, 1, hits) == 1 && hits[0].score >= best - 1e-5f) agree++;
+      }
+      g_printerr("%s: top hit matches an exact scan for %u of %u queries\n", name, agree, VECTOR_QUERIES);
+  }
+
+  rag_index_unref(index);
+  g_unlink(path);
+  g_free(path);
+  g_free(queries);
+  g_free(chunks);
+  g_free(vectors);
+  g_free(topics);
+  g_rand_free(rand);
+}
+
+/* ---------- Report ---------- */
+
+static void add_result(JsonBuilder *b, const BenchResult *r) {
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "name");
+  json_builder_add_string_value(b, r->name);
+  if (r->iterations > 0) {
+      json_builder_set_member_name(b, "iterations");
+      json_builder_add_int_value(b, r->iterations);
+      json_builder_set_member_name(b, "mean_ms");
+      json_builder_add_double_value(b, r->total_ms / r->iterations);
+      json_builder_set_member_name(b, "min_ms");
+      json_builder_add_double_value(b, r->min_ms);
+      json_builder_set_member_name(b, "max_ms");
+      json_builder_add_double_value(b, r->max_ms);
+      json_builder_set_member_name(b, "bytes");
+      json_builder_add_int_value(b, r->bytes);
+      if (r->min_ms > 0) {
+          json_builder_set_member_name(b, "mb_per_s");
+          json_builder_add_double_value(b, r->bytes / (1024.0 * 1024.0) / (r->min_ms / 1000.0));
+      }
+  }
+  json_builder_end_object(b);
+}
+
+int main(int argc, char **argv) {
+  GError *error = NULL;
+  GOptionContext *ctx = g_option_context_new("- benchmark the Ganesha engine");
+  g_option_context_add_main_entries(ctx, bench_entries, NULL);
+  if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      g_option_context_free(ctx);
+      return 1;
+  }
+  g_option_context_free(ctx);
+  opt_iterations = MAX(opt_iterations, 1);
+
+  // Keep persistence away from the user's real history
+  gchar *config_dir = g_dir_make_tmp("ganesha-bench-XXXXXX", NULL);
+  g_setenv("XDG_CONFIG_HOME", config_dir, TRUE);
+
+  GPtrArray *corpus = generate_corpus(opt_conversations, opt_messages);
+  BenchResult results[10];
+
+  bench_build_body(corpus, &results[0], FALSE);
+  bench_build_body(corpus, &results[1], TRUE);
+  bench_persistence(corpus, &results[2], &results[3]);
+  bench_decode(&results[4], "ndjson_decode", &OLLAMA_BACKEND, make_ndjson_stream(20000));
+  bench_decode(&results[5], "sse_decode", &OPENAI_BACKEND, make_sse_stream(20000));
+  bench_markdown(corpus, &results[6], &results[7]);
+  bench_vector_search(&results[8], "vector_search_flat", 4000);
+  bench_vector_search(&results[9], "vector_search_ivf", 20000);
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "corpus");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "conversations");
+  json_builder_add_int_value(b, opt_conversations);
+  json_builder_set_member_name(b, "messages");
+  json_builder_add_int_value(b, opt_messages);
+  json_builder_end_object(b);
+  json_builder_set_member_name(b, "results");
+  json_builder_begin_array(b);
+  for (guint i = 0; i < G_N_ELEMENTS(results); i++) add_result(b, &results[i]);
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+
+  JsonGenerator *gen = json_generator_new();
+  json_generator_set_pretty(gen, TRUE);
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gchar *json_data = json_generator_to_data(gen, NULL);
+
+  if (opt_output) {
+      if (!g_file_set_contents(opt_output, json_data, -1, &error)) {
+          g_printerr("%s\n", error->message);
+          g_error_free(error);
+      }
+  }
+  g_print("%s\n", json_data);
+
+  // Clean up the temporary config dir
+  gchar *path = get_conversations_path();
+  g_unlink(path);
+  g_free(path);
+  gchar *app_dir = g_build_filename(config_dir, "ganesha", NULL);
+  g_rmdir(app_dir);
+  g_free(app_dir);
+  g_rmdir(config_dir);
+
+  g_free(json_data);
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(b);
+  g_ptr_array_unref(corpus);
+  g_free(config_dir);
+  g_free(opt_output);
+  return 0;
+}
@@ -0,0 +1,758 @@
+/* A stand-in Ollama server for deterministic streaming benchmarks.
+ *
+ * Implements /api/tags, /api/chat, /api/ps and /api/show on top of
+ * SoupServer, plus /v1/models and /v1/chat/completions (server-sent
+ * events) for the OpenAI-compatible backend, and /api/embed and
+ * /v1/embeddings with hashed bag-of-words vectors. Chat replies are synthesized
+ * (or replayed from a recorded NDJSON file, Ollama only) at a configurable
+ * token rate, with optional model-load delays, stalls and error injection.
+ *
+ *   ganesha-mock-server --port 11435 --tokens-per-sec 40 --ttft-ms 300 \
+ *                       --stall-every 50 --stall-ms 800 --error-rate 0.05
+ *
+ * With --socket it listens on a Unix socket instead (unix:// endpoints).
+ */
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+static gint     opt_port         = 11435;
+static gchar   *opt_socket       = NULL;
+static gint     opt_tokens       = 200;     // Tokens per synthesized reply
+static gdouble  opt_rate         = 50.0;    // Tokens per second
+static gint     opt_chunk_lines  = 1;       // NDJSON lines per HTTP write
+static gint     opt_ttft_ms      = 150;
+static gint     opt_load_ms      = 1500;    // Extra first-token delay for an unloaded model
+static gint     opt_stall_every  = 0;       // Stall after every N tokens (0 = never)
+static gint     opt_stall_ms     = 0;
+static gdouble  opt_error_rate   = 0.0;     // Requests answered with HTTP 500
+static gdouble  opt_abort_rate   = 0.0;     // Streams cut off halfway with an error line
+static gint     opt_max_loaded   = 2;
+static gint     opt_keep_alive_s = 300;
+static gchar   *opt_models       = NULL;
+static gchar   *opt_replay       = NULL;
+static gint     opt_seed         = 1;
+
+static GOptionEntry mock_entries[] = {
+  { "port", 'p', 0, G_OPTION_ARG_INT, &opt_port, "Port to listen on", "PORT" },
+  { "socket", 0, 0, G_OPTION_ARG_FILENAME, &opt_socket, "Listen on a Unix socket instead of a port", "PATH" },
+  { "tokens", 0, 0, G_OPTION_ARG_INT, &opt_tokens, "Tokens per synthesized reply", "N" },
+  { "tokens-per-sec", 'r', 0, G_OPTION_ARG_DOUBLE, &opt_rate, "Token rate", "RATE" },
+  { "chunk-lines", 0, 0, G_OPTION_ARG_INT, &opt_chunk_lines, "NDJSON lines per write", "N" },
+  { "ttft-ms", 0, 0, G_OPTION_ARG_INT, &opt_ttft_ms, "Delay before the first token", "MS" },
+  { "load-ms", 0, 0, G_OPTION_ARG_INT, &opt_load_ms, "Extra delay when the model is not loaded", "MS" },
+  { "stall-every", 0, 0, G_OPTION_ARG_INT, &opt_stall_every, "Stall after every N tokens", "N" },
+  { "stall-ms", 0, 0, G_OPTION_ARG_INT, &opt_stall_ms, "Length of each stall", "MS" },
+  { "error-rate", 0, 0, G_OPTION_ARG_DOUBLE, &opt_error_rate, "Share of requests failing with HTTP 500", "P" },
+  { "abort-rate", 0, 0, G_OPTION_ARG_DOUBLE, &opt_abort_rate, "Share of streams cut off halfway", "P" },
+  { "max-loaded", 0, 0, G_OPTION_ARG_INT, &opt_max_loaded, "Models kept in memory at once", "N" },
+  { "keep-alive", 0, 0, G_OPTION_ARG_INT, &opt_keep_alive_s, "Seconds a model stays loaded", "S" },
+  { "models", 'm', 0, G_OPTION_ARG_STRING, &opt_models, "Comma-separated model names", "LIST" },
+  { "replay", 0, 0, G_OPTION_ARG_FILENAME, &opt_replay, "Replay a recorded /api/chat NDJSON stream", "FILE" },
+  { "seed", 0, 0, G_OPTION_ARG_INT, &opt_seed, "Random seed for injected failures", "N" },
+  { NULL }
+};
+
+static const char *WORDS[] = {
+  "the", "model", "streams", "tokens", "over", "a", "local", "socket", "while",
+  "the", "client", "renders", "markdown", "into", "widgets", "quickly"
+};
+
+typedef struct {
+  gchar  *name;
+  gint64  size;
+  gint64  loaded_until;   // Monotonic µs, 0 when not resident
+  gint64  last_used;
+} MockModel;
+
+typedef struct {
+  GPtrArray  *models;
+  GRand      *rand;
+  gchar     **replay;     // Recorded NDJSON lines, NULL-terminated
+} MockState;
+
+typedef struct {
+  SoupServerMessage *msg;
+  MockState         *state;
+  gchar             *model;
+  gboolean           openai;        // SSE chunks instead of NDJSON
+  gboolean           include_usage;
+  guint              prompt_tokens;  // Reported with the usage chunk
+  guint              sent;
+  guint              total;
+  guint              abort_at;   // 0 = never
+  guint              source_id;
+} MockStream;
+
+/* ---------- Models ---------- */
+
+static MockModel* find_model(MockState *st, const gchar *name) {
+  for (guint i = 0; i < st->models->len; i++) {
+      MockModel *m = g_ptr_array_index(st->models, i);
+      if (g_strcmp0(m->name, name) == 0) return m;
+  }
+  return NULL;
+}
+
+static gboolean model_resident(MockModel *m) {
+  return m->loaded_until > g_get_monotonic_time();
+}
+
+/* Loads the model if needed and returns the load delay in ms. */
+static gint touch_model(MockState *st, MockModel *m) {
+  gint64 now = g_get_monotonic_time();
+  gint delay = 0;
+
+  if (!model_resident(m)) {
+      delay = opt_load_ms;
+
+      // Evict least recently used models beyond --max-loaded
+      guint resident = 0;
+      for (guint i = 0; i < st->models->len; i++) {
+          if (model_resident(g_ptr_array_index(st->models, i))) resident++;
+      }
+      while (opt_max_loaded > 0 && resident >= (guint)opt_max_loaded) {
+          MockModel *lru = NULL;
+          for (guint i = 0; i < st->models->len; i++) {
+              MockModel *c = g_ptr_array_index(st->models, i);
+              if (model_resident(c) && (!lru || c->last_used < lru->last_used)) lru = c;
+          }
+          if (!lru) break;
+          lru->loaded_until = 0;
+          resident--;
+      }
+  }
+
+  m->last_used = now;
+  m->loaded_until = now + (gint64)opt_keep_alive_s * G_USEC_PER_SEC;
+  return delay;
+}
+
+/* ---------- Helpers ---------- */
+
+static void respond_json(SoupServerMessage *msg, guint status, JsonBuilder *b) {
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gsize len = 0;
+  gchar *data = json_generator_to_data(gen, &len);
+
+  soup_server_message_set_status(msg, status, NULL);
+  soup_server_message_set_response(msg, "application/json", SOUP_MEMORY_TAKE, data, len);
+
+  json_node_free(root);
+  g_object_unref(gen);
+}
+
+static void respond_error(SoupServerMessage *msg, guint status, const gchar *error) {
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "error");
+  json_builder_add_string_value(b, error);
+  json_builder_end_object(b);
+  respond_json(msg, status, b);
+  g_object_unref(b);
+}
+
+static JsonObject* parse_request(SoupServerMessage *msg, JsonParser *parser) {
+  SoupMessageBody *body = soup_server_message_get_request_body(msg);
+  if (!body || !body->data) return NULL;
+  if (!json_parser_load_from_data(parser, body->data, body->length, NULL)) return NULL;
+  JsonNode *root = json_parser_get_root(parser);
+  return JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+}
+
+static gchar* iso8601_in(gint64 usec_from_now) {
+  GDateTime *now = g_date_time_new_now_utc();
+  GDateTime *then = g_date_time_add(now, usec_from_now);
+  gchar *text = g_date_time_format_iso8601(then);
+  g_date_time_unref(then);
+  g_date_time_unref(now);
+  return text;
+}
+
+/* ---------- /api/tags, /api/ps, /api/show ---------- */
+
+static void tags_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                         GHashTable *query, gpointer user_data) {
+  (void)server; (void)path; (void)query;
+  MockState *st = user_data;
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "models");
+  json_builder_begin_array(b);
+  for (guint i = 0; i < st->models->len; i++) {
+      MockModel *m = g_ptr_array_index(st->models, i);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "name");
+      json_builder_add_string_value(b, m->name);
+      json_builder_set_member_name(b, "model");
+      json_builder_add_string_value(b, m->name);
+      json_builder_set_member_name(b, "size");
+      json_builder_add_int_value(b, m->size);
+      json_builder_end_object(b);
+  }
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  respond_json(msg, SOUP_STATUS_OK, b);
+  g_object_unref(b);
+}
+
+static void models_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                           GHashTable *query, gpointer user_data) {
+  (void)server; (void)path; (void)query;
+  MockState *st = user_data;
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "object");
+  json_builder_add_string_value(b, "list");
+  json_builder_set_member_name(b, "data");
+  json_builder_begin_array(b);
+  for (guint i = 0; i < st->models->len; i++) {
+      MockModel *m = g_ptr_array_index(st->models, i);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "id");
+      json_builder_add_string_value(b, m->name);
+      json_builder_set_member_name(b, "object");
+      json_builder_add_string_value(b, "model");
+      json_builder_end_object(b);
+  }
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  respond_json(msg, SOUP_STATUS_OK, b);
+  g_object_unref(b);
+}
+
+static void ps_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                       GHashTable *query, gpointer user_data) {
+  (void)server; (void)path; (void)query;
+  MockState *st = user_data;
+  gint64 now = g_get_monotonic_time();
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "models");
+  json_builder_begin_array(b);
+  for (guint i = 0; i < st->models->len; i++) {
+      MockModel *m = g_ptr_array_index(st->models, i);
+      if (!model_resident(m)) continue;
+      gchar *expires = iso8601_in(m->loaded_until - now);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "name");
+      json_builder_add_string_value(b, m->name);
+      json_builder_set_member_name(b, "model");
+      json_builder_add_string_value(b, m->name);
+      json_builder_set_member_name(b, "size");
+      json_builder_add_int_value(b, m->size);
+      json_builder_set_member_name(b, "size_vram");
+      json_builder_add_int_value(b, m->size);
+      json_builder_set_member_name(b, "expires_at");
+      json_builder_add_string_value(b, expires);
+      json_builder_end_object(b);
+      g_free(expires);
+  }
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  respond_json(msg, SOUP_STATUS_OK, b);
+  g_object_unref(b);
+}
+
+static void show_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                         GHashTable *query, gpointer user_data) {
+  (void)server; (void)path; (void)query;
+  MockState *st = user_data;
+  JsonParser *parser = json_parser_new();
+  JsonObject *req = parse_request(msg, parser);
+  const gchar *name = req ? json_object_get_string_member_with_default(req, "model", NULL) : NULL;
+  gboolean verbose = req && json_object_get_boolean_member_with_default(req, "verbose", FALSE);
+  MockModel *m = name ? find_model(st, name) : NULL;
+
+  if (!m) {
+      respond_error(msg, SOUP_STATUS_NOT_FOUND, "model not found");
+      g_object_unref(parser);
+      return;
+  }
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "details");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "family");
+  json_builder_add_string_value(b, "llama");
+  json_builder_set_member_name(b, "parameter_size");
+  json_builder_add_string_value(b, "3.2B");
+  json_builder_set_member_name(b, "quantization_level");
+  json_builder_add_string_value(b, "Q4_K_M");
+  json_builder_end_object(b);
+  json_builder_set_member_name(b, "model_info");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "general.architecture");
+  json_builder_add_string_value(b, "llama");
+  json_builder_set_member_name(b, "general.parameter_count");
+  json_builder_add_int_value(b, 3200000000);
+  json_builder_set_member_name(b, "llama.context_length");
+  json_builder_add_int_value(b, 8192);
+  if (verbose) {
+      // A tiny byte-level vocabulary: every byte plus the reply words
+      json_builder_set_member_name(b, "tokenizer.ggml.model");
+      json_builder_add_string_value(b, "gpt2");
+      json_builder_set_member_name(b, "tokenizer.ggml.tokens");
+      json_builder_begin_array(b);
+      for (gunichar c = 33; c < 127; c++) {
+          gchar buf[8] = { 0 };
+          g_unichar_to_utf8(c, buf);
+          json_builder_add_string_value(b, buf);
+      }
+      for (guint i = 0; i < G_N_ELEMENTS(WORDS); i++) {
+          gchar *spaced = g_strconcat("\xc4\xa0", WORDS[i], NULL);   // "Ġword"
+          json_builder_add_string_value(b, spaced);
+          json_builder_add_string_value(b, WORDS[i]);
+          g_free(spaced);
+      }
+      json_builder_end_array(b);
+  }
+  json_builder_end_object(b);
+  json_builder_end_object(b);
+  respond_json(msg, SOUP_STATUS_OK, b);
+  g_object_unref(b);
+  g_object_unref(parser);
+}
+
+/* ---------- /api/embed, /v1/embeddings ----------
+ * Every word is hashed into one of EMBED_DIM buckets, so texts sharing
+ * words score as similar, for any model name. */
+
+#define EMBED_DIM 64
+
+static void add_embedding(JsonBuilder *b, const gchar *text) {
+  gdouble v[EMBED_DIM] = { 0 };
+  gchar *lower = g_utf8_strdown(text, -1);
+  gchar **words = g_regex_split_simple("[^[:alnum:]]+", lower, 0, 0);
+  for (gchar **w = words; *w; w++) {
+      if (**w) v[g_str_hash(*w) % EMBED_DIM] += 1.0;
+  }
+  g_strfreev(words);
+  g_free(lower);
+
+  json_builder_begin_array(b);
+  for (guint k = 0; k < EMBED_DIM; k++) json_builder_add_double_value(b, v[k]);
+  json_builder_end_array(b);
+}
+
+static void embed_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                          GHashTable *query, gpointer user_data) {
+  (void)server; (void)query; (void)user_data;
+  gboolean openai = g_strcmp0(path, "/v1/embeddings") == 0;
+
+  JsonParser *parser = json_parser_new();
+  JsonObject *req = parse_request(msg, parser);
+  JsonNode *input = req ? json_object_get_member(req, "input") : NULL;
+  if (!input) {
+      respond_error(msg, SOUP_STATUS_BAD_REQUEST, "missing input");
+      g_object_unref(parser);
+      return;
+  }
+
+  // input is a string or an array of them
+  GPtrArray *texts = g_ptr_array_new();
+  if (JSON_NODE_HOLDS_ARRAY(input)) {
+      JsonArray *arr = json_node_get_array(input);
+      for (guint i = 0; i < json_array_get_length(arr); i++) {
+          g_ptr_array_add(texts, (gpointer)json_array_get_string_element(arr, i));
+      }
+  } else {
+      g_ptr_array_add(texts, (gpointer)json_node_get_string(input));
+  }
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, openai ? "data" : "embeddings");
+  json_builder_begin_array(b);
+  for (guint i = 0; i < texts->len; i++) {
+      const gchar *text = g_ptr_array_index(texts, i);
+      if (openai) {
+          json_builder_begin_object(b);
+          json_builder_set_member_name(b, "index");
+          json_builder_add_int_value(b, i);
+          json_builder_set_member_name(b, "embedding");
+          add_embedding(b, text ? text : "");
+          json_builder_end_object(b);
+      } else {
+          add_embedding(b, text ? text : "");
+      }
+  }
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  respond_json(msg, SOUP_STATUS_OK, b);
+
+  g_object_unref(b);
+  g_ptr_array_unref(texts);
+  g_object_unref(parser);
+}
+
+/* ---------- /api/chat, /v1/chat/completions ---------- */
+
+static gchar* builder_to_string(JsonBuilder *b) {
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gchar *json = json_generator_to_data(gen, NULL);
+  json_node_free(root);
+  g_object_unref(gen);
+  return json;
+}
+
+/* A chat.completion.chunk as one server-sent event. Without text it is the
+ * closing chunk with finish_reason. */
+static gchar* make_openai_event(MockStream *s, const gchar *text) {
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "id");
+  json_builder_add_string_value(b, "chatcmpl-mock");
+  json_builder_set_member_name(b, "object");
+  json_builder_add_string_value(b, "chat.completion.chunk");
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, s->model);
+  json_builder_set_member_name(b, "choices");
+  json_builder_begin_array(b);
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "index");
+  json_builder_add_int_value(b, 0);
+  json_builder_set_member_name(b, "delta");
+  json_builder_begin_object(b);
+  if (text) {
+      json_builder_set_member_name(b, "content");
+      json_builder_add_string_value(b, text);
+  }
+  json_builder_end_object(b);
+  json_builder_set_member_name(b, "finish_reason");
+  if (text) json_builder_add_null_value(b);
+  else json_builder_add_string_value(b, "stop");
+  json_builder_end_object(b);
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+
+  gchar *json = builder_to_string(b);
+  gchar *event = g_strdup_printf("data: %s\n\n", json);
+  g_free(json);
+  g_object_unref(b);
+  return event;
+}
+
+static gchar* make_chunk_line(MockStream *s, guint index) {
+  if (s->openai) {
+      gchar *word = g_strconcat(index == 0 ? "" : " ", WORDS[index % G_N_ELEMENTS(WORDS)], NULL);
+      gchar *event = make_openai_event(s, word);
+      g_free(word);
+      return event;
+  }
+  if (s->state->replay) return g_strdup_printf("%s\n", s->state->replay[index]);
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, s->model);
+  json_builder_set_member_name(b, "message");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "role");
+  json_builder_add_string_value(b, "assistant");
+  json_builder_set_member_name(b, "content");
+  gchar *word = g_strconcat(index == 0 ? "" : " ", WORDS[index % G_N_ELEMENTS(WORDS)], NULL);
+  json_builder_add_string_value(b, word);
+  g_free(word);
+  json_builder_end_object(b);
+  json_builder_set_member_name(b, "done");
+  json_builder_add_boolean_value(b, FALSE);
+  json_builder_end_object(b);
+
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gchar *json = json_generator_to_data(gen, NULL);
+  gchar *line = g_strconcat(json, "\n", NULL);
+  g_free(json);
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(b);
+  return line;
+}
+
+static void mock_stream_free(MockStream *s) {
+  if (s->source_id) g_source_remove(s->source_id);
+  g_object_unref(s->msg);
+  g_free(s->model);
+  g_free(s);
+}
+
+static void on_stream_finished(SoupServerMessage *msg, gpointer user_data) {
+  (void)msg;
+  mock_stream_free(user_data);
+}
+
+static guint token_interval_ms(void) {
+  return (guint)(1000.0 * opt_chunk_lines / MAX(opt_rate, 0.001));
+}
+
+static gboolean stream_tick(gpointer data) {
+  MockStream *s = data;
+  SoupMessageBody *body = soup_server_message_get_response_body(s->msg);
+  s->source_id = 0;
+
+  for (gint i = 0; i < opt_chunk_lines && s->sent < s->total; i++) {
+      if (s->abort_at && s->sent == s->abort_at) {
+          const gchar *err = s->openai ? "data: {\"error\":{\"message\":\"injected abort\"}}\n\n"
+                                       : "{\"error\":\"injected abort\"}\n";
+          soup_message_body_append(body, SOUP_MEMORY_STATIC, err, strlen(err));
+          soup_message_body_complete(body);
+          soup_server_message_unpause(s->msg);
+          return G_SOURCE_REMOVE;
+      }
+      gchar *line = make_chunk_line(s, s->sent);
+      soup_message_body_append(body, SOUP_MEMORY_TAKE, line, strlen(line));
+      s->sent++;
+  }
+
+  if (s->sent >= s->total) {
+      if (s->openai) {
+          GString *tail = g_string_new(NULL);
+          gchar *finish = make_openai_event(s, NULL);
+          g_string_append(tail, finish);
+          g_free(finish);
+          if (s->include_usage) {
+              g_string_append_printf(tail, "data: {\"id\":\"chatcmpl-mock\",\"object\":\"chat.completion.chunk\","
+                                     "\"choices\":[],\"usage\":{\"prompt_tokens\":%u,\"completion_tokens\":%u,"
+                                     "\"total_tokens\":%u}}\n\n", s->prompt_tokens, s->total,
+                                     s->prompt_tokens + s->total);
+          }
+          g_string_append(tail, "data: [DONE]\n\n");
+          gsize len = tail->len;
+          soup_message_body_append(body, SOUP_MEMORY_TAKE, g_string_free(tail, FALSE), len);
+      } else if (!s->state->replay) {
+          gchar *done = g_strdup_printf(
+              "{\"model\":\"%s\",\"message\":{\"role\":\"assistant\",\"content\":\"\"},"
+              "\"done\":true,\"done_reason\":\"stop\",\"eval_count\":%u}\n", s->model, s->total);
+          soup_message_body_append(body, SOUP_MEMORY_TAKE, done, strlen(done));
+      }
+      soup_message_body_complete(body);
+      soup_server_message_unpause(s->msg);
+      return G_SOURCE_REMOVE;
+  }
+
+  guint delay = token_interval_ms();
+  if (opt_stall_every > 0 && s->sent % opt_stall_every == 0) delay += opt_stall_ms;
+  s->source_id = g_timeout_add(delay, stream_tick, s);
+  soup_server_message_unpause(s->msg);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean unpause_later(gpointer data) {
+  soup_server_message_unpause(data);
+  g_object_unref(data);
+  return G_SOURCE_REMOVE;
+}
+
+/* A non-streamed reply, in the format of the endpoint asked. */
+static void respond_reply(SoupServerMessage *msg, const gchar *model, const gchar *text,
+                          const gchar *reason, gboolean openai) {
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, model);
+  if (openai) {
+      json_builder_set_member_name(b, "object");
+      json_builder_add_string_value(b, "chat.completion");
+      json_builder_set_member_name(b, "choices");
+      json_builder_begin_array(b);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "index");
+      json_builder_add_int_value(b, 0);
+  }
+  json_builder_set_member_name(b, "message");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "role");
+  json_builder_add_string_value(b, "assistant");
+  json_builder_set_member_name(b, "content");
+  json_builder_add_string_value(b, text);
+  json_builder_end_object(b);
+  if (openai) {
+      json_builder_set_member_name(b, "finish_reason");
+      json_builder_add_string_value(b, reason);
+      json_builder_end_object(b);
+      json_builder_end_array(b);
+  } else {
+      json_builder_set_member_name(b, "done");
+      json_builder_add_boolean_value(b, TRUE);
+      json_builder_set_member_name(b, "done_reason");
+      json_builder_add_string_value(b, reason);
+  }
+  json_builder_end_object(b);
+  respond_json(msg, SOUP_STATUS_OK, b);
+  g_object_unref(b);
+}
+
+/* Roughly four bytes a token, as a stand-in for the prompt count. */
+static guint estimate_prompt_tokens(JsonArray *messages) {
+  gsize bytes = 0;
+  for (guint i = 0; i < json_array_get_length(messages); i++) {
+      JsonNode *node = json_array_get_element(messages, i);
+      JsonObject *m = JSON_NODE_HOLDS_OBJECT(node) ? json_node_get_object(node) : NULL;
+      JsonNode *content = m ? json_object_get_member(m, "content") : NULL;
+      const gchar *text = content && JSON_NODE_HOLDS_VALUE(content) ? json_node_get_string(content) : NULL;
+      if (text) bytes += strlen(text);
+  }
+  return (guint)(bytes / 4) + 1;
+}
+
+static void chat_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                         GHashTable *query, gpointer user_data) {
+  (void)server; (void)query;
+  MockState *st = user_data;
+  gboolean openai = g_strcmp0(path, "/v1/chat/completions") == 0;
+
+  if (g_strcmp0(soup_server_message_get_method(msg), "POST") != 0) {
+      soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+      return;
+  }
+
+  JsonParser *parser = json_parser_new();
+  JsonObject *req = parse_request(msg, parser);
+  const gchar *name = req ? json_object_get_string_member_with_default(req, "model", NULL) : NULL;
+  MockModel *m = name ? find_model(st, name) : NULL;
+  if (!m) {
+      respond_error(msg, SOUP_STATUS_NOT_FOUND, "model not found");
+      g_object_unref(parser);
+      return;
+  }
+  if (g_rand_double(st->rand) < opt_error_rate) {
+      respond_error(msg, SOUP_STATUS_INTERNAL_SERVER_ERROR, "injected error");
+      g_object_unref(parser);
+      return;
+  }
+
+  gint load_delay = touch_model(st, m);
+  JsonArray *messages = json_object_has_member(req, "messages")
+      ? json_object_get_array_member(req, "messages") : NULL;
+  gboolean stream = json_object_get_boolean_member_with_default(req, "stream", TRUE);
+
+  // Empty message list: a warm-up, answered once the model is loaded
+  if (!messages || json_array_get_length(messages) == 0 || !stream) {
+      gboolean summary = messages && json_array_get_length(messages) > 0;
+      respond_reply(msg, m->name, summary ? "A short synthesized summary." : "",
+                    summary ? "stop" : "load", openai);
+      if (load_delay > 0) {
+          soup_server_message_pause(msg);
+          g_timeout_add(load_delay, unpause_later, g_object_ref(msg));
+      }
+      g_object_unref(parser);
+      return;
+  }
+
+  MockStream *s = g_new0(MockStream, 1);
+  s->msg = g_object_ref(msg);
+  s->state = st;
+  s->model = g_strdup(m->name);
+  s->openai = openai;
+  if (openai) {
+      JsonNode *options = json_object_get_member(req, "stream_options");
+      s->include_usage = options && JSON_NODE_HOLDS_OBJECT(options) &&
+          json_object_get_boolean_member_with_default(json_node_get_object(options), "include_usage", FALSE);
+      s->prompt_tokens = estimate_prompt_tokens(messages);
+  }
+  s->total = st->replay && !openai ? g_strv_length(st->replay) : (guint)opt_tokens;
+  if (g_rand_double(st->rand) < opt_abort_rate) s->abort_at = MAX(s->total / 2, 1);
+
+  SoupMessageHeaders *headers = soup_server_message_get_response_headers(msg);
+  soup_message_headers_set_encoding(headers, SOUP_ENCODING_CHUNKED);
+  soup_message_headers_set_content_type(headers, openai ? "text/event-stream" : "application/x-ndjson", NULL);
+  soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+  g_signal_connect(msg, "finished", G_CALLBACK(on_stream_finished), s);
+
+  soup_server_message_pause(msg);
+  s->source_id = g_timeout_add(opt_ttft_ms + load_delay, stream_tick, s);
+  g_object_unref(parser);
+}
+
+/* ---------- main ---------- */
+
+static gchar** load_replay(const gchar *path) {
+  gchar *contents = NULL;
+  GError *error = NULL;
+  if (!g_file_get_contents(path, &contents, NULL, &error)) {
+      g_printerr("replay: %s\n", error->message);
+      g_error_free(error);
+      return NULL;
+  }
+
+  gchar **lines = g_strsplit(contents, "\n", -1);
+  GPtrArray *kept = g_ptr_array_new();
+  for (gchar **l = lines; *l; l++) {
+      if (**l) g_ptr_array_add(kept, g_strdup(*l));
+  }
+  g_ptr_array_add(kept, NULL);
+  g_strfreev(lines);
+  g_free(contents);
+  return (gchar**)g_ptr_array_free(kept, FALSE);
+}
+
+int main(int argc, char **argv) {
+  GError *error = NULL;
+  GOptionContext *ctx = g_option_context_new("- stand-in Ollama server");
+  g_option_context_add_main_entries(ctx, mock_entries, NULL);
+  if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      g_option_context_free(ctx);
+      return 1;
+  }
+  g_option_context_free(ctx);
+
+  MockState st = { 0 };
+  st.rand = g_rand_new_with_seed(opt_seed);
+  st.models = g_ptr_array_new();
+  gchar **names = g_strsplit(opt_models ? opt_models : "llama3.2:3b,llama3.2:1b,mistral:7b", ",", -1);
+  for (gchar **n = names; *n; n++) {
+      MockModel *m = g_new0(MockModel, 1);
+      m->name = g_strdup(g_strstrip(*n));
+      m->size = (gint64)(st.models->len + 2) * 1024 * 1024 * 1024;
+      g_ptr_array_add(st.models, m);
+  }
+  g_strfreev(names);
+  if (opt_replay) st.replay = load_replay(opt_replay);
+
+  SoupServer *server = soup_server_new("server-header", "ganesha-mock ", NULL);
+  soup_server_add_handler(server, "/api/tags", tags_handler, &st, NULL);
+  soup_server_add_handler(server, "/api/ps", ps_handler, &st, NULL);
+  soup_server_add_handler(server, "/api/show", show_handler, &st, NULL);
+  soup_server_add_handler(server, "/api/chat", chat_handler, &st, NULL);
+  soup_server_add_handler(server, "/api/embed", embed_handler, &st, NULL);
+  soup_server_add_handler(server, "/v1/models", models_handler, &st, NULL);
+  soup_server_add_handler(server, "/v1/chat/completions", chat_handler, &st, NULL);
+  soup_server_add_handler(server, "/v1/embeddings", embed_handler, &st, NULL);
+
+  gboolean listening;
+  if (opt_socket) {
+      g_unlink(opt_socket);
+      GSocketAddress *address = g_unix_socket_address_new(opt_socket);
+      listening = soup_server_listen(server, address, 0, &error);
+      g_object_unref(address);
+  } else {
+      listening = soup_server_listen_local(server, opt_port, SOUP_SERVER_LISTEN_IPV4_ONLY, &error);
+  }
+  if (!listening) {
+      g_printerr("listen: %s\n", error->message);
+      g_error_free(error);
+      return 1;
+  }
+  if (opt_socket) g_print("mock ollama listening on unix://%s\n", opt_socket);
+  else g_print("mock ollama listening on http://127.0.0.1:%d\n", opt_port);
+
+  GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+  g_main_loop_run(loop);
+  g_main_loop_unref(loop);
+  g_object_unref(server);
+  return 0;
+}
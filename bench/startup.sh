@@ -0,0 +1,69 @@
+#!/bin/sh
+# Startup benchmark: launches Ganesha on a large generated history and
+# checks that the first frame is painted within a fixed budget, measured
+# from process start. History loading happens after the window is shown,
+# so its size must not move the first frame.
+#
+#   bench/startup.sh <ganesha> <report.json>
+#
+# GANESHA_STARTUP_HISTORY_MB (default 1024) sets the history size and
+# GANESHA_STARTUP_BUDGET_MS (default 500) the budget. Exits 1 when the
+# budget is exceeded and 77 (skipped) when there is no display.
+set -eu
+
+APP=$1
+REPORT=$2
+
+if [ -z "${WAYLAND_DISPLAY:-}" ] && [ -z "${DISPLAY:-}" ]; then
+  echo "startup: no display, skipping" >&2
+  exit 77
+fi
+
+HISTORY_MB=${GANESHA_STARTUP_HISTORY_MB:-1024}
+BUDGET_MS=${GANESHA_STARTUP_BUDGET_MS:-500}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT INT TERM
+
+# One conversation per MiB: a short question and a 1 MiB answer
+mkdir -p "$TMP/ganesha"
+head -c 1048000 /dev/zero | tr '\0' 'a' > "$TMP/answer"
+{
+  printf '{"conversations": ['
+  i=0
+  while [ "$i" -lt "$HISTORY_MB" ]; do
+    [ "$i" -gt 0 ] && printf ','
+    printf '{"id": "conv-%d", "title": "Conversation %d", "timestamp": %d, "messages": [' "$i" "$i" "$i"
+    printf '{"role": "user", "content": "Question %d"}, {"role": "assistant", "content": "' "$i"
+    cat "$TMP/answer"
+    printf '"}]}'
+    i=$((i + 1))
+  done
+  printf ']}\n'
+} > "$TMP/ganesha/ganesha-conversations.json"
+
+LAUNCH_US=$(date +%s%6N)
+XDG_CONFIG_HOME="$TMP" \
+GANESHA_OLLAMA_URL="http://127.0.0.1:9" \
+GANESHA_STARTUP_REPORT="$TMP/startup.json" \
+  timeout 600 "$APP"
+
+if [ ! -s "$TMP/startup.json" ]; then
+  echo "startup: ganesha exited without a report" >&2
+  exit 1
+fi
+FIRST_FRAME_US=$(sed -n 's/.*"first_frame_unix_us" *: *\([0-9]*\).*/\1/p' "$TMP/startup.json")
+FIRST_FRAME_MS=$(( (FIRST_FRAME_US - LAUNCH_US) / 1000 ))
+
+sed -e '$d' "$TMP/startup.json" > "$REPORT"
+cat >> "$REPORT" <<EOF
+  ,"process_to_first_frame_ms" : $FIRST_FRAME_MS,
+  "history_mb" : $HISTORY_MB,
+  "budget_ms" : $BUDGET_MS
+}
+EOF
+cat "$REPORT"
+
+if [ "$FIRST_FRAME_MS" -gt "$BUDGET_MS" ]; then
+  echo "startup: first frame after $FIRST_FRAME_MS ms, budget $BUDGET_MS ms" >&2
+  exit 1
+fi
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Transport benchmark: runs the same batch of prompts through ganesha-batch
+# against the mock server over TCP loopback and over a Unix socket, and
+# prints both summaries as JSON.
+#
+#   bench/transport.sh <ganesha-mock-server> <ganesha-batch> <report.json> [mock options...]
+#
+# Token pacing is disabled by default so the transport dominates the timings.
+set -eu
+
+MOCK=$1
+BATCH=$2
+REPORT=$3
+shift 3
+
+PORT=${GANESHA_TRANSPORT_PORT:-11436}
+REQUESTS=${GANESHA_TRANSPORT_REQUESTS:-200}
+CONCURRENCY=${GANESHA_TRANSPORT_CONCURRENCY:-1}
+TMP=$(mktemp -d)
+TCP_PID=
+UNIX_PID=
+trap 'kill $TCP_PID $UNIX_PID 2>/dev/null || true; rm -rf "$TMP"' EXIT INT TERM
+
+i=0
+while [ "$i" -lt "$REQUESTS" ]; do
+  echo "{\"id\": \"$i\", \"prompt\": \"Explain how streaming works.\", \"model\": \"llama3.2:3b\"}"
+  i=$((i + 1))
+done > "$TMP/prompts.jsonl"
+
+MOCK_OPTS="--ttft-ms 0 --load-ms 0 --tokens 100 --tokens-per-sec 1000000"
+"$MOCK" --port "$PORT" $MOCK_OPTS "$@" &
+TCP_PID=$!
+"$MOCK" --socket "$TMP/ollama.sock" $MOCK_OPTS "$@" &
+UNIX_PID=$!
+sleep 0.5
+
+run() {
+  XDG_CONFIG_HOME="$TMP" "$BATCH" -i "$TMP/prompts.jsonl" -o /dev/null \
+    -e "$1" -j "$CONCURRENCY" --report "$TMP/$2.json"
+}
+
+run "http://127.0.0.1:$PORT" tcp
+run "unix://$TMP/ollama.sock" unix
+
+{
+  echo "{"
+  echo "\"tcp\": $(cat "$TMP/tcp.json"),"
+  echo "\"unix\": $(cat "$TMP/unix.json")"
+  echo "}"
+} > "$REPORT"
+cat "$REPORT"
@@ -0,0 +1,95 @@
+#!/bin/sh
+# Wakeup benchmark: counts how often Ganesha's threads wake up, while idle
+# and while a reply streams in from the mock server (normally and with
+# power-saver mode forced), and fails if the idle rate is over budget.
+#
+#   bench/wakeups.sh <ganesha-mock-server> <ganesha> <report.json> [mock options...]
+#
+# A wakeup is a context switch of any thread of the process, read from
+# /proc/<pid>/task/*/status, as powertop would attribute it. Each phase is
+# sampled for GANESHA_WAKEUP_SECONDS (default 10) after a short settle.
+# GANESHA_IDLE_WAKEUP_BUDGET (default 5 per second) is the idle budget.
+# Exits 77 (skipped) when there is no display or no /proc.
+set -eu
+
+MOCK=$1
+APP=$2
+REPORT=$3
+shift 3
+
+if [ -z "${WAYLAND_DISPLAY:-}" ] && [ -z "${DISPLAY:-}" ]; then
+  echo "wakeups: no display, skipping" >&2
+  exit 77
+fi
+if [ ! -r /proc/self/status ]; then
+  echo "wakeups: no /proc, skipping" >&2
+  exit 77
+fi
+
+PORT=${GANESHA_WAKEUP_PORT:-11437}
+SECONDS_PER_PHASE=${GANESHA_WAKEUP_SECONDS:-10}
+BUDGET=${GANESHA_IDLE_WAKEUP_BUDGET:-5}
+TMP=$(mktemp -d)
+APP_PID=
+trap 'kill "$MOCK_PID" $APP_PID 2>/dev/null || true; rm -rf "$TMP"' EXIT INT TERM
+
+# Long enough to still be streaming when the sample window closes
+TOKENS=$(( (SECONDS_PER_PHASE + 10) * 40 ))
+"$MOCK" --port "$PORT" --tokens "$TOKENS" --tokens-per-sec 40 "$@" &
+MOCK_PID=$!
+sleep 0.5
+
+switches() {
+  cat /proc/"$1"/task/*/status 2>/dev/null \
+    | awk '/^(voluntary|nonvoluntary)_ctxt_switches:/ { n += $2 } END { print n + 0 }'
+}
+
+# A sample is only valid if the app ran through all of it
+alive() {
+  if ! kill -0 "$APP_PID" 2>/dev/null; then
+    echo "wakeups: $1: ganesha exited before sampling ended" >&2
+    exit 1
+  fi
+}
+
+# measure <name> <settle seconds> [env assignments...]: prints wakeups per second
+measure() {
+  name=$1
+  settle=$2
+  shift 2
+  env XDG_CONFIG_HOME="$TMP/$name" GANESHA_OLLAMA_URL="http://127.0.0.1:$PORT" \
+      GANESHA_E2E_FRAMES=0 GANESHA_E2E_REPORT="$TMP/$name-e2e.json" "$@" \
+      "$APP" > /dev/null 2>&1 &
+  APP_PID=$!
+  sleep "$settle"
+  alive "$name"
+  before=$(switches "$APP_PID")
+  sleep "$SECONDS_PER_PHASE"
+  after=$(switches "$APP_PID")
+  alive "$name"
+  kill "$APP_PID" 2>/dev/null || true
+  wait "$APP_PID" 2>/dev/null || true
+  APP_PID=
+  awk -v a="$after" -v b="$before" -v s="$SECONDS_PER_PHASE" 'BEGIN { printf "%.1f", (a - b) / s }'
+}
+
+IDLE=$(measure idle 3)
+# The probe sends its prompt one second after the history is loaded
+STREAMING=$(measure streaming 3 GANESHA_E2E_PROMPT="Explain how streaming works.")
+POWER_SAVER=$(measure power-saver 3 GANESHA_E2E_PROMPT="Explain how streaming works." GANESHA_POWER_SAVER=1)
+
+cat > "$REPORT" <<EOF
+{
+  "sample_seconds" : $SECONDS_PER_PHASE,
+  "idle_wakeups_per_sec" : $IDLE,
+  "streaming_wakeups_per_sec" : $STREAMING,
+  "power_saver_streaming_wakeups_per_sec" : $POWER_SAVER,
+  "idle_budget_per_sec" : $BUDGET
+}
+EOF
+cat "$REPORT"
+
+if awk -v i="$IDLE" -v b="$BUDGET" 'BEGIN { exit !(i > b) }'; then
+  echo "wakeups: $IDLE wakeups/s while idle, budget $BUDGET" >&2
+  exit 1
+fi
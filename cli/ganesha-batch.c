@@ -0,0 +1,418 @@
+/* Runs JSONL prompt files through the chat engine without the GUI.
+ *
+ * Each input line is one request, either a single prompt or a whole
+ * conversation:
+ *
+ *   {"id": "q1", "prompt": "Why is the sky blue?", "model": "llama3.2:3b"}
+ *   {"id": "q2", "system": "Be brief.", "messages": [{"role": "user", "content": "Hi"}]}
+ *
+ * Every endpoint gets its own set of --concurrency workers, all pulling from
+ * one queue, so faster servers take more of the work. Results are written
+ * as JSONL in completion order, with per-request timing.
+ *
+ *   ganesha-batch -i prompts.jsonl -o results.jsonl -m llama3.2:3b \
+ *                 -e http://gpu1:11434 -e http://gpu2:11434 -j 4
+ */
+#include "ganesha-core.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static gchar   *opt_input       = NULL;
+static gchar   *opt_output      = NULL;
+static gchar   *opt_model       = NULL;
+static gchar  **opt_endpoints   = NULL;
+static gint     opt_concurrency = 4;
+static gint     opt_num_ctx     = 0;
+static gchar   *opt_keep_alive  = NULL;
+static gchar   *opt_report      = NULL;
+
+static GOptionEntry batch_entries[] = {
+  { "input", 'i', 0, G_OPTION_ARG_FILENAME, &opt_input, "JSONL requests (default: stdin)", "FILE" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output, "JSONL results (default: stdout)", "FILE" },
+  { "model", 'm', 0, G_OPTION_ARG_STRING, &opt_model, "Model for lines that don't name one", "NAME" },
+  { "endpoint", 'e', 0, G_OPTION_ARG_STRING_ARRAY, &opt_endpoints, "Ollama or OpenAI-compatible (/v1) URL, repeatable (default: configured server)", "URL" },
+  { "concurrency", 'j', 0, G_OPTION_ARG_INT, &opt_concurrency, "Requests in flight per endpoint", "N" },
+  { "num-ctx", 0, 0, G_OPTION_ARG_INT, &opt_num_ctx, "Fit conversations into N tokens (default: send everything)", "N" },
+  { "keep-alive", 0, 0, G_OPTION_ARG_STRING, &opt_keep_alive, "keep_alive sent with each request", "DURATION" },
+  { "report", 0, 0, G_OPTION_ARG_FILENAME, &opt_report, "Write a JSON summary with latency percentiles", "FILE" },
+  { NULL }
+};
+
+typedef struct {
+  guint         line;
+  gchar        *id;
+  gchar        *model;
+  Conversation *conv;
+  gchar        *error;      // Input problem; the request is not sent
+} BatchJob;
+
+typedef struct {
+  GAsyncQueue *jobs;
+  FILE        *out;
+  GMutex       out_lock;
+  guint        done;
+  guint        failed;
+  gint64       completion_tokens;
+  GArray      *ttft_ms;     // gdouble, successful requests only
+  GArray      *total_ms;
+} BatchRun;
+
+typedef struct {
+  BatchRun    *run;
+  const gchar *endpoint;
+} BatchWorker;
+
+typedef struct {
+  GString *text;
+  gint64   start;
+  gint64   first_token;
+  gint64   prompt_tokens;
+  gint64   completion_tokens;
+} JobProgress;
+
+static void batch_job_free(BatchJob *job) {
+  g_free(job->id);
+  g_free(job->model);
+  conversation_free(job->conv);
+  g_free(job->error);
+  g_free(job);
+}
+
+/* ---------- Input ---------- */
+
+static gboolean holds_string(JsonNode *node) {
+  return node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING;
+}
+
+/* FALSE if a message is not an object, its "role" or "content" is not a
+ * string, or its "images" is not an array of strings. */
+static gboolean add_messages(Conversation *conv, JsonArray *messages) {
+  for (guint i = 0; i < json_array_get_length(messages); i++) {
+      JsonNode *element = json_array_get_element(messages, i);
+      if (!JSON_NODE_HOLDS_OBJECT(element)) return FALSE;
+      JsonObject *m = json_node_get_object(element);
+      JsonNode *role = json_object_get_member(m, "role");
+      JsonNode *content = json_object_get_member(m, "content");
+      if ((role && !holds_string(role)) || (content && !holds_string(content))) return FALSE;
+      conversation_add_message(conv,
+          role ? json_node_get_string(role) : "user",
+          content ? json_node_get_string(content) : "");
+      JsonNode *node = json_object_get_member(m, "images");
+      if (!node) continue;
+      if (!JSON_NODE_HOLDS_ARRAY(node)) return FALSE;
+      Message *msg = g_ptr_array_index(conv->messages, conv->messages->len - 1);
+      JsonArray *images = json_node_get_array(node);
+      for (guint k = 0; k < json_array_get_length(images); k++) {
+          JsonNode *image = json_array_get_element(images, k);
+          if (!holds_string(image)) return FALSE;
+          g_ptr_array_add(msg->images, g_strdup(json_node_get_string(image)));
+      }
+  }
+  return TRUE;
+}
+
+static BatchJob* parse_job(const gchar *line, guint line_no) {
+  BatchJob *job = g_new0(BatchJob, 1);
+  job->line = line_no;
+  job->conv = conversation_new();
+
+  JsonParser *parser = json_parser_new();
+  GError *error = NULL;
+  if (!json_parser_load_from_data(parser, line, -1, &error)) {
+      job->error = g_strdup(error->message);
+      g_error_free(error);
+  } else if (!JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+      job->error = g_strdup("expected a JSON object");
+  } else {
+      JsonObject *obj = json_node_get_object(json_parser_get_root(parser));
+      JsonNode *id = json_object_get_member(obj, "id");
+      job->id = holds_string(id)
+          ? g_strdup(json_node_get_string(id))
+          : g_strdup_printf("%u", line_no);
+      job->model = g_strdup(json_object_get_string_member_with_default(obj, "model",
+                            opt_model ? opt_model : DEFAULT_MODEL));
+
+      const gchar *system = json_object_get_string_member_with_default(obj, "system", NULL);
+      if (system) conversation_add_message(job->conv, "system", system);
+      JsonNode *messages = json_object_get_member(obj, "messages");
+      if (messages && !JSON_NODE_HOLDS_ARRAY(messages)) {
+          job->error = g_strdup("\"messages\" must be an array");
+      } else if (messages && !add_messages(job->conv, json_node_get_array(messages))) {
+          job->error = g_strdup("malformed message in \"messages\"");
+      }
+      const gchar *prompt = json_object_get_string_member_with_default(obj, "prompt", NULL);
+      if (prompt) conversation_add_message(job->conv, "user", prompt);
+
+      if (!job->error && job->conv->messages->len == 0) job->error = g_strdup("no \"prompt\" or \"messages\"");
+  }
+  if (!job->id) job->id = g_strdup_printf("%u", line_no);
+
+  g_object_unref(parser);
+  return job;
+}
+
+/* ---------- Output ---------- */
+
+static void write_result(BatchRun *run, BatchJob *job, const gchar *endpoint,
+                         JobProgress *p, const gchar *error) {
+  gint64 now = g_get_monotonic_time();
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "id");
+  json_builder_add_string_value(b, job->id);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, job->model);
+  if (endpoint) {
+      json_builder_set_member_name(b, "endpoint");
+      json_builder_add_string_value(b, endpoint);
+  }
+  if (p) {
+      json_builder_set_member_name(b, "response");
+      json_builder_add_string_value(b, p->text->str);
+      json_builder_set_member_name(b, "ttft_ms");
+      json_builder_add_double_value(b, p->first_token ? (p->first_token - p->start) / 1000.0 : -1);
+      json_builder_set_member_name(b, "total_ms");
+      json_builder_add_double_value(b, (now - p->start) / 1000.0);
+      json_builder_set_member_name(b, "prompt_tokens");
+      json_builder_add_int_value(b, p->prompt_tokens);
+      json_builder_set_member_name(b, "completion_tokens");
+      json_builder_add_int_value(b, p->completion_tokens);
+      if (p->completion_tokens > 0 && p->first_token && now > p->first_token) {
+          json_builder_set_member_name(b, "tokens_per_s");
+          json_builder_add_double_value(b, p->completion_tokens * (gdouble)G_USEC_PER_SEC / (now - p->first_token));
+      }
+  }
+  if (error) {
+      json_builder_set_member_name(b, "error");
+      json_builder_add_string_value(b, error);
+  }
+  json_builder_end_object(b);
+
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gchar *line = json_generator_to_data(gen, NULL);
+
+  g_mutex_lock(&run->out_lock);
+  fprintf(run->out, "%s\n", line);
+  fflush(run->out);
+  run->done++;
+  if (error) run->failed++;
+  if (p && p->completion_tokens > 0) run->completion_tokens += p->completion_tokens;
+  if (p && !error && p->first_token) {
+      gdouble ttft = (p->first_token - p->start) / 1000.0;
+      gdouble total = (now - p->start) / 1000.0;
+      g_array_append_val(run->ttft_ms, ttft);
+      g_array_append_val(run->total_ms, total);
+  }
+  g_mutex_unlock(&run->out_lock);
+
+  g_free(line);
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(b);
+}
+
+static gint compare_double(gconstpointer a, gconstpointer b) {
+  gdouble x = *(const gdouble*)a, y = *(const gdouble*)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Sorts values in place. */
+static gdouble percentile(GArray *values, gdouble p) {
+  if (values->len == 0) return -1;
+  g_array_sort(values, compare_double);
+  return g_array_index(values, gdouble, (guint)((values->len - 1) * p + 0.5));
+}
+
+static void write_report(BatchRun *run, gdouble elapsed, guint n_endpoints) {
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "requests");
+  json_builder_add_int_value(b, run->done);
+  json_builder_set_member_name(b, "failed");
+  json_builder_add_int_value(b, run->failed);
+  json_builder_set_member_name(b, "endpoints");
+  json_builder_add_int_value(b, n_endpoints);
+  json_builder_set_member_name(b, "concurrency");
+  json_builder_add_int_value(b, opt_concurrency);
+  json_builder_set_member_name(b, "wall_s");
+  json_builder_add_double_value(b, elapsed);
+  json_builder_set_member_name(b, "requests_per_s");
+  json_builder_add_double_value(b, elapsed > 0 ? run->done / elapsed : 0);
+  json_builder_set_member_name(b, "tokens_per_s");
+  json_builder_add_double_value(b, elapsed > 0 ? run->completion_tokens / elapsed : 0);
+  json_builder_set_member_name(b, "ttft_p50_ms");
+  json_builder_add_double_value(b, percentile(run->ttft_ms, 0.50));
+  json_builder_set_member_name(b, "ttft_p95_ms");
+  json_builder_add_double_value(b, percentile(run->ttft_ms, 0.95));
+  json_builder_set_member_name(b, "total_p50_ms");
+  json_builder_add_double_value(b, percentile(run->total_ms, 0.50));
+  json_builder_set_member_name(b, "total_p95_ms");
+  json_builder_add_double_value(b, percentile(run->total_ms, 0.95));
+  json_builder_end_object(b);
+
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  json_generator_set_pretty(gen, TRUE);
+  GError *error = NULL;
+  if (!json_generator_to_file(gen, opt_report, &error)) {
+      g_printerr("%s: %s\n", opt_report, error->message);
+      g_error_free(error);
+  }
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(b);
+}
+
+/* ---------- Workers ---------- */
+
+static void on_batch_delta(const gchar *text, gpointer user_data) {
+  JobProgress *p = user_data;
+  if (!p->first_token) p->first_token = g_get_monotonic_time();
+  g_string_append(p->text, text);
+}
+
+static void on_batch_usage(gint64 prompt_tokens, gint64 completion_tokens, gpointer user_data) {
+  JobProgress *p = user_data;
+  p->prompt_tokens = prompt_tokens;
+  p->completion_tokens = completion_tokens;
+}
+
+static const StreamCallbacks batch_callbacks = {
+  .delta = on_batch_delta,
+  .usage = on_batch_usage,
+};
+
+static gpointer batch_worker(gpointer data) {
+  BatchWorker *w = data;
+  BatchRun *run = w->run;
+  BatchJob *job;
+
+  while ((job = g_async_queue_try_pop(run->jobs))) {
+      if (job->error) {
+          write_result(run, job, NULL, NULL, job->error);
+          batch_job_free(job);
+          continue;
+      }
+
+      ContextPlan *plan = opt_num_ctx > 0
+          ? context_plan_new(job->conv, job->conv->messages->len, NULL, opt_num_ctx)
+          : NULL;
+      StreamRequest req = {
+        .base_url = w->endpoint,
+        .model = g_strdup(job->model),
+        .keep_alive = opt_keep_alive,
+        .affinity_policy = AFFINITY_OFF,
+      };
+      JobProgress p = { .text = g_string_new(NULL), .start = g_get_monotonic_time(),
+                        .prompt_tokens = -1, .completion_tokens = -1 };
+      GArray *snapshot = conversation_snapshot(job->conv, job->conv->messages->len);
+      GError *error = NULL;
+
+      gboolean ok = ollama_stream_chat(&req, snapshot, plan, &batch_callbacks, &p, NULL, &error);
+      write_result(run, job, w->endpoint, &p, ok ? NULL : error->message);
+
+      if (error) g_error_free(error);
+      g_string_free(p.text, TRUE);
+      g_free(req.model);
+      g_array_unref(snapshot);
+      context_plan_free(plan);
+      batch_job_free(job);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  GError *error = NULL;
+  GOptionContext *ctx = g_option_context_new("- run JSONL prompts through Ganesha");
+  g_option_context_add_main_entries(ctx, batch_entries, NULL);
+  if (!g_option_context_parse(ctx, &argc, &argv, &error)) {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      g_option_context_free(ctx);
+      return 1;
+  }
+  g_option_context_free(ctx);
+  opt_concurrency = MAX(opt_concurrency, 1);
+  trace_init();
+
+  const gchar *env_url = g_getenv("GANESHA_OLLAMA_URL");
+  if (env_url && *env_url) OLLAMA_BASE_URL = env_url;
+  const gchar *env_backend = g_getenv("GANESHA_BACKEND");
+  if (env_backend && *env_backend) CHAT_BACKEND = env_backend;
+  if (!opt_keep_alive) opt_keep_alive = load_pref_string("keep_alive", KEEP_ALIVE);
+
+  // Read every request up front; the queue is then drained without locking input
+  GIOChannel *in = opt_input && g_strcmp0(opt_input, "-") != 0
+      ? g_io_channel_new_file(opt_input, "r", &error)
+      : g_io_channel_unix_new(0);
+  if (!in) {
+      g_printerr("%s: %s\n", opt_input, error->message);
+      g_error_free(error);
+      return 1;
+  }
+
+  BatchRun run = { 0 };
+  run.jobs = g_async_queue_new();
+  run.ttft_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  run.total_ms = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  g_mutex_init(&run.out_lock);
+  guint n_jobs = 0, line_no = 0;
+  gchar *line = NULL;
+  gsize len = 0;
+  while (g_io_channel_read_line(in, &line, &len, NULL, NULL) == G_IO_STATUS_NORMAL) {
+      line_no++;
+      g_strstrip(line);
+      if (*line) {
+          g_async_queue_push(run.jobs, parse_job(line, line_no));
+          n_jobs++;
+      }
+      g_free(line);
+  }
+  g_io_channel_unref(in);
+
+  run.out = opt_output && g_strcmp0(opt_output, "-") != 0 ? fopen(opt_output, "w") : stdout;
+  if (!run.out) {
+      g_printerr("%s: cannot open for writing\n", opt_output);
+      return 1;
+  }
+
+  const gchar *default_endpoints[] = { OLLAMA_BASE_URL, NULL };
+  const gchar * const *endpoints = opt_endpoints ? (const gchar * const *)opt_endpoints : default_endpoints;
+  guint n_endpoints = g_strv_length((gchar**)endpoints);
+  guint n_workers = MIN(n_endpoints * (guint)opt_concurrency, MAX(n_jobs, 1));
+
+  gint64 start = g_get_monotonic_time();
+  BatchWorker *workers = g_new0(BatchWorker, n_workers);
+  GThread **threads = g_new0(GThread*, n_workers);
+  for (guint i = 0; i < n_workers; i++) {
+      workers[i].run = &run;
+      workers[i].endpoint = endpoints[i % n_endpoints];
+      threads[i] = g_thread_new("ganesha-batch", batch_worker, &workers[i]);
+  }
+  for (guint i = 0; i < n_workers; i++) g_thread_join(threads[i]);
+  gdouble elapsed = (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC;
+
+  g_printerr("%u requests (%u failed) in %.1fs across %u endpoint(s) x %d: %.2f req/s",
+             run.done, run.failed, elapsed, n_endpoints, opt_concurrency,
+             elapsed > 0 ? run.done / elapsed : 0);
+  if (run.completion_tokens > 0 && elapsed > 0) {
+      g_printerr(", %.0f tokens/s", run.completion_tokens / elapsed);
+  }
+  g_printerr("\n");
+  if (opt_report) write_report(&run, elapsed, n_endpoints);
+  trace_shutdown();
+
+  if (run.out != stdout) fclose(run.out);
+  g_free(threads);
+  g_free(workers);
+  g_async_queue_unref(run.jobs);
+  g_array_unref(run.ttft_ms);
+  g_array_unref(run.total_ms);
+  g_mutex_clear(&run.out_lock);
+  return run.failed > 0 ? 2 : 0;
+}
@@ -0,0 +1,73 @@
+#include "ganesha-core.h"
+
+/* ================== Config ================== */
+const char *OLLAMA_BASE_URL = "http://192.168.0.3:11434";
+const char *CHAT_BACKEND    = "auto";  /* "ollama", "openai", or "auto" to go by the URL */
+const char *DEFAULT_MODEL   = "llama3.2:3b";
+const int   REQUEST_TIMEOUT = 300;
+const char *PREFS_FILE      = "ganesha-prefs.json";
+const char *CONVERSATIONS_FILE = "ganesha-conversations.json";
+const char *TELEMETRY_FILE  = "ganesha-telemetry.json";
+const char *KEEP_ALIVE      = "30m";   /* How long Ollama keeps the model loaded */
+
+/* Connection pool shared by every chat request in the process. Requests
+ * beyond the per-host limit wait for a free connection. */
+const guint  SESSION_MAX_CONNS          = 64;
+const guint  SESSION_MAX_CONNS_PER_HOST = 16;
+
+/* Local API: socket under $XDG_RUNTIME_DIR/ganesha/, enabled by "local_api". */
+const char  *API_SOCKET_NAME = "api.sock";
+
+/* Hedging: if no token arrives within the chosen TTFT percentile, the same
+ * request is raced against the "hedge_url" endpoint from the prefs file. */
+const double HEDGE_PERCENTILE       = 0.95;
+const gint64 HEDGE_DEFAULT_DELAY_MS = 2000;
+const gint64 HEDGE_MIN_DELAY_MS     = 250;
+const gint64 HEDGE_MAX_DELAY_MS     = 15000;
+const guint  HEDGE_MIN_SAMPLES      = 8;
+
+/* Model affinity: how long the "delay" policy may hold a request back while
+ * waiting for another model to unload from a shared server. */
+const gint64 AFFINITY_MAX_DELAY_S   = 120;
+
+/* Context planning: requests are fitted into num_ctx tokens, keeping room
+ * for the reply. */
+const gint   DEFAULT_NUM_CTX        = 4096;
+const gint   RESPONSE_RESERVE_TOKENS = 1024;
+const gint   MESSAGE_OVERHEAD_TOKENS = 4;
+const gint   IMAGE_TOKENS           = 768;
+
+/* Compaction: once the unsummarized history of a conversation passes this
+ * share of num_ctx, the "compaction_model" summarizes everything but the
+ * most recent turns. */
+const double COMPACTION_THRESHOLD   = 0.75;
+const guint  COMPACTION_KEEP_RECENT = 8;
+
+/* Rendering: parsed markdown is cached up to this many bytes, and the
+ * widgets of the last few conversations shown are kept for switching back. */
+const gsize  MARKDOWN_CACHE_BYTES   = 32 * 1024 * 1024;
+const guint  RENDERED_CONVERSATIONS = 3;
+/* Code blocks longer than this are filled in one chunk per frame. */
+const gsize  CODE_INSERT_CHUNK      = 16 * 1024;
+/* Messages over two pages of text are laid out a page at a time. */
+const gsize  MESSAGE_PAGE_BYTES     = 16 * 1024;
+/* In power-saver mode a streaming reply is redrawn at this interval. */
+const guint  STREAM_FLUSH_POWER_SAVER_MS = 250;
+
+/* Documents: files are split into chunks of whole lines, each repeating the
+ * last lines of the one before, and embedded a batch per request. The best
+ * few chunks above a similarity floor go into each chat request. Indexes
+ * this large are clustered into sqrt(n) lists, of which a search scans the
+ * nearest few. */
+const char  *DOCUMENTS_FILE         = "ganesha-documents.idx";
+const char  *EMBEDDING_MODEL        = "nomic-embed-text";
+const gsize  RAG_CHUNK_BYTES        = 1500;
+const guint  RAG_CHUNK_OVERLAP_LINES = 2;
+const gsize  RAG_MAX_FILE_BYTES     = 4 * 1024 * 1024;
+const guint  RAG_EMBED_BATCH        = 32;
+const guint  RAG_TOP_K              = 5;
+const double RAG_MIN_SCORE          = 0.3;
+const guint  RAG_IVF_MIN_CHUNKS     = 8192;
+const guint  RAG_IVF_PROBES         = 8;
+const guint  RAG_IVF_ITERATIONS     = 8;
+/* ============================================ */
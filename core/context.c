@@ -0,0 +1,328 @@
+#include "ganesha-core.h"
+
+#include <string.h>
+
+/* ---------- Context Planning ----------
+ * Every request must fit num_ctx or Ollama silently truncates it. Token
+ * counts are cached per Message; when the model's vocabulary is known (from
+ * /api/show verbose) they come from a longest-match tokenizer over it,
+ * otherwise from a 4-bytes-per-token estimate. The plan pins system
+ * messages and the new prompt, then adds turns newest-first until the
+ * budget is used up. */
+
+#define TOKEN_PIECE_MAX 48
+#define COMPACTION_PROMPT_TOKENS 80   // Instructions ollama_summarize() adds
+
+struct _Tokenizer {
+  GHashTable *pieces;        // Vocabulary strings (set)
+  guint       max_piece;     // Longest piece in bytes, capped at TOKEN_PIECE_MAX
+  gboolean    byte_level;    // GPT-2 style byte mapping instead of SentencePiece
+  gint        context_length;
+};
+
+static GHashTable *tokenizers;   // model name -> Tokenizer* (NULL while fetching)
+G_LOCK_DEFINE_STATIC(tokenizers);
+
+static gunichar byte_level_map[256];
+
+static void init_byte_level_map(void) {
+  static gsize initialized = 0;
+  if (g_once_init_enter(&initialized)) {
+      guint extra = 0;
+      for (guint b = 0; b < 256; b++) {
+          gboolean printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) || b >= 174;
+          byte_level_map[b] = printable ? b : 256 + extra++;
+      }
+      g_once_init_leave(&initialized, 1);
+  }
+}
+
+const Tokenizer* lookup_tokenizer(const gchar *model) {
+  const Tokenizer *tok = NULL;
+  G_LOCK(tokenizers);
+  if (tokenizers && model) tok = g_hash_table_lookup(tokenizers, model);
+  G_UNLOCK(tokenizers);
+  return tok;
+}
+
+static gint tokenizer_count(const Tokenizer *tok, const gchar *text) {
+  GString *norm = g_string_sized_new(strlen(text) + 8);
+  
+  if (tok->byte_level) {
+      init_byte_level_map();
+      for (const guchar *p = (const guchar*)text; *p; p++) {
+          g_string_append_unichar(norm, byte_level_map[*p]);
+      }
+  } else {
+      g_string_append(norm, "\xe2\x96\x81");   // U+2581, SentencePiece word boundary
+      for (const gchar *p = text; *p; p++) {
+          if (*p == ' ') g_string_append(norm, "\xe2\x96\x81");
+          else g_string_append_c(norm, *p);
+      }
+  }
+  
+  gchar piece[TOKEN_PIECE_MAX + 1];
+  gint count = 0;
+  const gchar *p = norm->str;
+  const gchar *end = norm->str + norm->len;
+  while (p < end) {
+      gsize avail = MIN((gsize)(end - p), tok->max_piece);
+      gsize match = 0;
+      for (gsize len = avail; len > 0; len--) {
+          if (p + len < end && (p[len] & 0xC0) == 0x80) continue;   // mid-character
+          memcpy(piece, p, len);
+          piece[len] = '\0';
+          if (g_hash_table_contains(tok->pieces, piece)) {
+              match = len;
+              break;
+          }
+      }
+      if (match == 0) {
+          // Unknown character: SentencePiece falls back to one token per byte
+          match = g_utf8_next_char(p) - p;
+          count += tok->byte_level ? 1 : (gint)match;
+      } else {
+          count++;
+      }
+      p += match;
+  }
+  
+  g_string_free(norm, TRUE);
+  return count;
+}
+
+gint message_token_count(Message *msg, const Tokenizer *tok) {
+  gsize len = msg->content ? strlen(msg->content) : 0;
+  
+  if (msg->tokens < 0 || msg->tokens_len != len || msg->tokens_tokenizer != (gconstpointer)tok) {
+      if (tok && tok->max_piece > 0 && msg->content) {
+          msg->tokens = tokenizer_count(tok, msg->content);
+      } else {
+          msg->tokens = (gint)((len + 3) / 4);
+      }
+      msg->tokens_len = len;
+      msg->tokens_tokenizer = tok;
+  }
+  
+  gint images = msg->images ? (gint)msg->images->len : 0;
+  return msg->tokens + MESSAGE_OVERHEAD_TOKENS + images * IMAGE_TOKENS;
+}
+
+void context_plan_free(ContextPlan *plan) {
+  if (!plan) return;
+  g_array_unref(plan->included);
+  g_free(plan->summary);
+  g_free(plan->retrieved);
+  g_free(plan);
+}
+
+ContextPlan* context_plan_new(Conversation *conv, guint n_messages,
+                              const Tokenizer *tok, gint num_ctx) {
+  ContextPlan *plan = g_new0(ContextPlan, 1);
+  plan->included = g_array_new(FALSE, FALSE, sizeof(guint));
+  plan->budget = (tok && tok->context_length > 0) ? MIN(num_ctx, tok->context_length) : num_ctx;
+  plan->considered = n_messages;
+  if (n_messages == 0) return plan;
+  
+  gint available = plan->budget - MIN(RESPONSE_RESERVE_TOKENS, plan->budget / 2);
+  gint *costs = g_new0(gint, n_messages);
+  gboolean *keep = g_new0(gboolean, n_messages);
+  
+  // A summary stands in for the oldest turns; the window starts after it
+  guint first = 0;
+  if (conv->summary && conv->summary_upto > 0 && conv->summary_upto < n_messages) {
+      plan->summary = g_strdup(conv->summary);
+      plan->summary_upto = conv->summary_upto;
+      plan->tokens += (gint)((strlen(conv->summary) + 3) / 4) + MESSAGE_OVERHEAD_TOKENS;
+      first = conv->summary_upto;
+  }
+  
+  // Pinned: system prompts and the message being answered
+  for (guint i = 0; i < n_messages; i++) {
+      Message *msg = g_ptr_array_index(conv->messages, i);
+      costs[i] = message_token_count(msg, tok);
+      if (g_strcmp0(msg->role, "system") == 0 || i == n_messages - 1) {
+          keep[i] = TRUE;
+          plan->tokens += costs[i];
+      }
+  }
+  
+  // Sliding window: newest turns first, stop at the first one that doesn't fit
+  for (guint i = n_messages - 1; i-- > first;) {
+      if (keep[i]) continue;
+      if (plan->tokens + costs[i] > available) break;
+      keep[i] = TRUE;
+      plan->tokens += costs[i];
+  }
+  
+  for (guint i = 0; i < n_messages; i++) {
+      if (keep[i]) g_array_append_val(plan->included, i);
+  }
+  
+  g_free(keep);
+  g_free(costs);
+  return plan;
+}
+
+static gpointer tokenizer_fetch_worker(gpointer data) {
+  gchar *model = (gchar*)data;
+  
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, model);
+  json_builder_set_member_name(b, "verbose");
+  json_builder_add_boolean_value(b, TRUE);
+  json_builder_end_object(b);
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gsize len = 0;
+  gchar *body_json = json_generator_to_data(gen, &len);
+  g_object_unref(gen);
+  json_node_free(root);
+  g_object_unref(b);
+  
+  gchar *url = ollama_url(OLLAMA_BASE_URL, "/api/show");
+  SoupSession *session = ollama_session_new(OLLAMA_BASE_URL, 60);
+  SoupMessage *msg = soup_message_new("POST", url);
+  GBytes *body = g_bytes_new_take(body_json, len);
+  soup_message_set_request_body_from_bytes(msg, "application/json", body);
+  g_bytes_unref(body);
+  GBytes *response_bytes = soup_session_send_and_read(session, msg, NULL, NULL);
+  
+  Tokenizer *tok = NULL;
+  if (response_bytes) {
+      gsize size;
+      gconstpointer data_ptr = g_bytes_get_data(response_bytes, &size);
+      JsonParser *parser = json_parser_new();
+      if (json_parser_load_from_data(parser, data_ptr, size, NULL)) {
+          JsonNode *show_root = json_parser_get_root(parser);
+          JsonObject *obj = JSON_NODE_HOLDS_OBJECT(show_root) ? json_node_get_object(show_root) : NULL;
+          if (obj && json_object_has_member(obj, "model_info")) {
+              JsonObject *mi = json_object_get_object_member(obj, "model_info");
+              tok = g_new0(Tokenizer, 1);
+              
+              const gchar *arch = json_object_get_string_member_with_default(mi, "general.architecture", NULL);
+              if (arch) {
+                  gchar *key = g_strdup_printf("%s.context_length", arch);
+                  tok->context_length = json_object_get_int_member_with_default(mi, key, 0);
+                  g_free(key);
+              }
+              
+              if (json_object_has_member(mi, "tokenizer.ggml.tokens")) {
+                  const gchar *kind = json_object_get_string_member_with_default(mi, "tokenizer.ggml.model", NULL);
+                  JsonArray *pieces = json_object_get_array_member(mi, "tokenizer.ggml.tokens");
+                  guint n = json_array_get_length(pieces);
+                  tok->byte_level = g_strcmp0(kind, "gpt2") == 0;
+                  tok->pieces = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+                  for (guint i = 0; i < n; i++) {
+                      const gchar *piece = json_array_get_string_element(pieces, i);
+                      gsize piece_len = piece ? strlen(piece) : 0;
+                      if (piece_len == 0 || piece_len > TOKEN_PIECE_MAX) continue;
+                      g_hash_table_add(tok->pieces, g_strdup(piece));
+                      tok->max_piece = MAX(tok->max_piece, (guint)piece_len);
+                  }
+                  if (tok->max_piece == 0) g_clear_pointer(&tok->pieces, g_hash_table_unref);
+              }
+          }
+      }
+      g_object_unref(parser);
+      g_bytes_unref(response_bytes);
+  }
+  
+  // A tokenizer without pieces still carries the context length; counts
+  // then fall back to the estimate.
+  G_LOCK(tokenizers);
+  if (tok && !tok->pieces) {
+      tok->pieces = g_hash_table_new(g_str_hash, g_str_equal);
+      tok->max_piece = 0;
+  }
+  if (tok) {
+      g_hash_table_replace(tokenizers, g_strdup(model), tok);
+  } else {
+      g_hash_table_remove(tokenizers, model);   // Allow a retry later
+  }
+  G_UNLOCK(tokenizers);
+  
+  g_object_unref(msg);
+  g_object_unref(session);
+  g_free(url);
+  g_free(model);
+  return NULL;
+}
+
+void start_tokenizer_fetch(const gchar *model) {
+  if (!model) return;
+  
+  G_LOCK(tokenizers);
+  if (!tokenizers) {
+      tokenizers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  }
+  gboolean known = g_hash_table_contains(tokenizers, model);
+  if (!known) g_hash_table_insert(tokenizers, g_strdup(model), NULL);
+  G_UNLOCK(tokenizers);
+  
+  if (!known) g_thread_unref(g_thread_new("ganesha-tokenizer", tokenizer_fetch_worker, g_strdup(model)));
+}
+
+
+/* ---------- Compaction ----------
+ * Long threads are summarized in the background by a small model. Only the
+ * turns that aged out since the last run are folded into the existing
+ * summary, which the context planner then sends instead of those turns.
+ * A run folds only as many turns as fit num_ctx next to the summary and
+ * the reply; the server would otherwise cut the request, and the turns it
+ * dropped would be marked summarized all the same. */
+
+gchar* compaction_request_new(Conversation *conv, const Tokenizer *tok, gint num_ctx, guint *upto) {
+  if (!conv || conv->compacting) return NULL;
+  
+  guint n = conv->messages->len;
+  if (n <= COMPACTION_KEEP_RECENT) return NULL;
+  guint end = n - COMPACTION_KEEP_RECENT;
+  guint from = MIN(conv->summary_upto, n);
+  if (end <= from) return NULL;
+  
+  gint pending = 0;
+  for (guint i = from; i < n; i++) {
+      pending += message_token_count(g_ptr_array_index(conv->messages, i), tok);
+  }
+  if (pending < num_ctx * COMPACTION_THRESHOLD) return NULL;
+  
+  gint budget = num_ctx - MIN(RESPONSE_RESERVE_TOKENS, num_ctx / 2) - COMPACTION_PROMPT_TOKENS
+               - (conv->summary ? (gint)((strlen(conv->summary) + 3) / 4) : 0);
+  if (budget <= MESSAGE_OVERHEAD_TOKENS) return NULL;
+  
+  // A copy, so the worker never touches the live conversation
+  GString *request = g_string_new(NULL);
+  g_string_append_printf(request, "Current summary:\n%s\n\nNew turns:\n",
+                         conv->summary ? conv->summary : "(none)");
+  gint used = 0;
+  guint stop = from;
+  for (; stop < end; stop++) {
+      Message *msg = g_ptr_array_index(conv->messages, stop);
+      if (g_strcmp0(msg->role, "system") == 0) continue;   // Pinned separately
+      
+      // Images are only mentioned, so they cost no image tokens here
+      message_token_count(msg, tok);
+      gint cost = msg->tokens + MESSAGE_OVERHEAD_TOKENS;
+      if (used + cost > budget) {
+          if (used > 0) break;
+          // A turn too long to fit alone is folded in cut short, at the estimate of 4 bytes per token
+          gsize keep = MIN(strlen(msg->content), (gsize)(budget - MESSAGE_OVERHEAD_TOKENS) * 4);
+          while (keep > 0 && (msg->content[keep] & 0xC0) == 0x80) keep--;
+          g_string_append_printf(request, "\n%s: %.*s [...]", msg->role, (gint)keep, msg->content);
+          stop++;
+          break;
+      }
+      g_string_append_printf(request, "\n%s: %s", msg->role, msg->content);
+      if (msg->images && msg->images->len > 0) {
+          g_string_append_printf(request, " [%u image(s)]", msg->images->len);
+      }
+      used += cost;
+  }
+  
+  *upto = stop;
+  return g_string_free(request, FALSE);
+}
@@ -0,0 +1,123 @@
+#include "ganesha-core.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* ---------- Message/Conversation helpers ---------- */
+
+static gint next_message_serial = 0;
+
+Message* message_new(const gchar *role, const gchar *content) {
+  Message *msg = g_new0(Message, 1);
+  msg->ref_count = 1;
+  msg->serial = (guint)g_atomic_int_add(&next_message_serial, 1) + 1;
+  msg->role = g_ref_string_new_intern(role);
+  msg->content = content ? g_ref_string_new(content) : NULL;
+  msg->images = g_ptr_array_new_with_free_func(g_free);
+  msg->tokens = -1;
+  return msg;
+}
+
+Message* message_ref(Message *msg) {
+  g_atomic_int_inc(&msg->ref_count);
+  return msg;
+}
+
+void message_unref(Message *msg) {
+  if (!msg || !g_atomic_int_dec_and_test(&msg->ref_count)) return;
+  g_clear_pointer(&msg->role, g_ref_string_release);
+  g_clear_pointer(&msg->content, g_ref_string_release);
+  if (msg->images) g_ptr_array_unref(msg->images);
+  g_free(msg);
+}
+
+void message_set_content(Message *msg, const gchar *content, gssize len) {
+  gchar *old = msg->content;
+  msg->content = len < 0 ? g_ref_string_new(content) : g_ref_string_new_len(content, len);
+  if (old) g_ref_string_release(old);
+}
+
+static void message_snapshot_clear(gpointer data) {
+  MessageSnapshot *snap = data;
+  g_clear_pointer(&snap->role, g_ref_string_release);
+  g_clear_pointer(&snap->content, g_ref_string_release);
+  g_clear_pointer(&snap->images, g_ptr_array_unref);
+}
+
+GArray* conversation_snapshot(Conversation *conv, guint n_messages) {
+  n_messages = MIN(n_messages, conv->messages->len);
+  GArray *snapshot = g_array_sized_new(FALSE, FALSE, sizeof(MessageSnapshot), n_messages);
+  g_array_set_clear_func(snapshot, message_snapshot_clear);
+  
+  for (guint i = 0; i < n_messages; i++) {
+      Message *msg = g_ptr_array_index(conv->messages, i);
+      MessageSnapshot snap = {
+        .role = g_ref_string_acquire(msg->role),
+        .content = msg->content ? g_ref_string_acquire(msg->content) : NULL,
+        .images = g_ptr_array_ref(msg->images),
+      };
+      g_array_append_val(snapshot, snap);
+  }
+  return snapshot;
+}
+
+Conversation* conversation_new(void) {
+  Conversation *conv = g_new0(Conversation, 1);
+  conv->id = g_uuid_string_random();
+  conv->title = NULL;
+  conv->messages = g_ptr_array_new_with_free_func((GDestroyNotify)message_unref);
+  conv->timestamp = g_get_real_time();
+  return conv;
+}
+
+Conversation* conversation_branch(Conversation *conv, guint upto) {
+  Conversation *branch = conversation_new();
+  branch->parent_id = g_strdup(conv->id);
+  branch->title = g_strdup(conv->title);
+  
+  upto = MIN(upto, conv->messages->len);
+  for (guint i = 0; i < upto; i++) {
+      g_ptr_array_add(branch->messages, message_ref(g_ptr_array_index(conv->messages, i)));
+  }
+  
+  // The summary still applies if everything it covers is shared
+  if (conv->summary && conv->summary_upto <= upto) {
+      branch->summary = g_strdup(conv->summary);
+      branch->summary_upto = conv->summary_upto;
+  }
+  return branch;
+}
+
+void conversation_free(Conversation *conv) {
+  if (!conv) return;
+  g_free(conv->id);
+  g_free(conv->title);
+  g_free(conv->parent_id);
+  g_free(conv->summary);
+  if (conv->spill_path) g_unlink(conv->spill_path);
+  g_free(conv->spill_path);
+  g_ptr_array_unref(conv->messages);
+  g_free(conv);
+}
+
+/* Titles an untitled conversation after its first prompt. */
+void conversation_set_title_from(Conversation *conv, const gchar *text) {
+  if (!conv || conv->title) return;
+  gchar *title = g_strdup(text);
+  if (strlen(title) > 50) {
+      title[47] = '.';
+      title[48] = '.';
+      title[49] = '.';
+      title[50] = '\0';
+  }
+  conv->title = title;
+}
+
+void conversation_add_message(Conversation *conv, const gchar *role, const gchar *content) {
+  if (!conv) return;
+  Message *msg = message_new(role, content);
+  g_ptr_array_add(conv->messages, msg);
+  
+  if (g_strcmp0(role, "user") == 0) conversation_set_title_from(conv, content);
+}
+
@@ -0,0 +1,534 @@
+/* libganesha-core: the GTK-free chat engine.
+ *
+ * Conversations, context planning, storage, telemetry and the Ollama
+ * client live here so they can be linked into the GTK frontend, the
+ * benchmarks and other headless tools. Nothing in this library touches GTK;
+ * functions documented as blocking are meant to run on worker threads.
+ */
+#ifndef GANESHA_CORE_H
+#define GANESHA_CORE_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+#include <json-glib/json-glib.h>
+
+G_BEGIN_DECLS
+
+/* ================== Config ================== */
+extern const char *OLLAMA_BASE_URL;   /* Overridable at startup (GANESHA_OLLAMA_URL) */
+extern const char *CHAT_BACKEND;      /* Overridable at startup (GANESHA_BACKEND) */
+extern const char *DEFAULT_MODEL;
+extern const int   REQUEST_TIMEOUT;
+extern const char *PREFS_FILE;
+extern const char *CONVERSATIONS_FILE;
+extern const char *TELEMETRY_FILE;
+extern const char *KEEP_ALIVE;
+
+extern const guint  SESSION_MAX_CONNS;
+extern const guint  SESSION_MAX_CONNS_PER_HOST;
+
+extern const char  *API_SOCKET_NAME;
+
+extern const double HEDGE_PERCENTILE;
+extern const gint64 HEDGE_DEFAULT_DELAY_MS;
+extern const gint64 HEDGE_MIN_DELAY_MS;
+extern const gint64 HEDGE_MAX_DELAY_MS;
+extern const guint  HEDGE_MIN_SAMPLES;
+
+extern const gint64 AFFINITY_MAX_DELAY_S;
+
+extern const gint   DEFAULT_NUM_CTX;
+extern const gint   RESPONSE_RESERVE_TOKENS;
+extern const gint   MESSAGE_OVERHEAD_TOKENS;
+extern const gint   IMAGE_TOKENS;
+
+extern const double COMPACTION_THRESHOLD;
+extern const guint  COMPACTION_KEEP_RECENT;
+
+extern const gsize  MARKDOWN_CACHE_BYTES;
+extern const guint  RENDERED_CONVERSATIONS;
+extern const gsize  CODE_INSERT_CHUNK;
+extern const gsize  MESSAGE_PAGE_BYTES;
+extern const guint  STREAM_FLUSH_POWER_SAVER_MS;
+
+extern const char  *DOCUMENTS_FILE;
+extern const char  *EMBEDDING_MODEL;   /* Overridable in prefs (embedding_model) */
+extern const gsize  RAG_CHUNK_BYTES;
+extern const guint  RAG_CHUNK_OVERLAP_LINES;
+extern const gsize  RAG_MAX_FILE_BYTES;
+extern const guint  RAG_EMBED_BATCH;
+extern const guint  RAG_TOP_K;
+extern const double RAG_MIN_SCORE;
+extern const guint  RAG_IVF_MIN_CHUNKS;
+extern const guint  RAG_IVF_PROBES;
+extern const guint  RAG_IVF_ITERATIONS;
+/* ============================================ */
+
+/* ---------- Tracing (trace.c) ---------- */
+
+/* TRUE once trace_init() found a consumer: Sysprof, or GANESHA_TRACE=file.json
+ * for a Chrome trace. Use the macros so disabled tracing costs one branch. */
+extern gboolean trace_active;
+
+void trace_init(void);
+/* Writes the Chrome trace, if any. Call once, after the last span. */
+void trace_shutdown(void);
+void trace_span(const gchar *name, gint64 begin, const gchar *detail);
+void trace_span_printf(const gchar *name, gint64 begin, const gchar *format, ...) G_GNUC_PRINTF(3, 4);
+void trace_instant(const gchar *name, const gchar *detail);
+
+#define TRACE_BEGIN() (G_UNLIKELY(trace_active) ? g_get_monotonic_time() : 0)
+#define TRACE_END(begin, name, detail) \
+  G_STMT_START { if (G_UNLIKELY(trace_active)) trace_span((name), (begin), (detail)); } G_STMT_END
+#define TRACE_ENDF(begin, name, ...) \
+  G_STMT_START { if (G_UNLIKELY(trace_active)) trace_span_printf((name), (begin), __VA_ARGS__); } G_STMT_END
+#define TRACE_INSTANT(name, detail) \
+  G_STMT_START { if (G_UNLIKELY(trace_active)) trace_instant((name), (detail)); } G_STMT_END
+
+/* ---------- Conversations (conversation.c) ---------- */
+
+/* Messages are reference counted: a branch holds the messages it shares
+ * with its parent, so a message in more than one conversation must not be
+ * modified (only a conversation's own trailing messages are appended to).
+ * role and content are GRefStrings that are never written in place: a
+ * streaming reply gets a new content string per update (see
+ * message_set_content), so whoever holds the old one can keep reading it. */
+typedef struct {
+  gint ref_count;
+  gchar *role;       // Interned
+  gchar *content;
+  GPtrArray *images; // Array de imagens em base64; fixed once the message is in a conversation
+  guint serial;      // Unique for the life of the process; keys render caches
+
+  // Token count cache, valid while content length and tokenizer match
+  gint          tokens;
+  gsize         tokens_len;
+  gconstpointer tokens_tokenizer;
+} Message;
+
+typedef struct {
+  gchar *id;
+  gchar *title;
+  GPtrArray *messages;
+  gint64 timestamp;
+  gchar *parent_id;     // Branches: the conversation whose messages this one started from
+
+  // Rolling summary of messages[0, summary_upto); the raw messages are kept
+  gchar *summary;
+  guint summary_upto;
+  gboolean compacting;
+  gboolean streaming;   // A reply is being streamed in (by the window or the local API)
+
+  // Under memory pressure the messages move to this file (NULL = in memory)
+  gchar *spill_path;
+  guint spilled_messages;
+} Conversation;
+
+Message*      message_new(const gchar *role, const gchar *content);
+Message*      message_ref(Message *msg);
+void          message_unref(Message *msg);
+/* Swaps in a new content string of len bytes (-1: up to the NUL). */
+void          message_set_content(Message *msg, const gchar *content, gssize len);
+Conversation* conversation_new(void);
+/* A new conversation sharing conv's messages[0, upto) by reference. */
+Conversation* conversation_branch(Conversation *conv, guint upto);
+void          conversation_free(Conversation *conv);
+void          conversation_add_message(Conversation *conv, const gchar *role, const gchar *content);
+void          conversation_set_title_from(Conversation *conv, const gchar *text);
+
+/* What a request is built from, so worker threads never read a live
+ * conversation. Each entry holds references to a message's strings and
+ * images; nothing is copied. */
+typedef struct {
+  gchar     *role;       // GRefString
+  gchar     *content;    // GRefString
+  GPtrArray *images;
+} MessageSnapshot;
+
+/* The first n_messages of conv as a GArray of MessageSnapshot. Take it on
+ * the thread that owns conv; after that any thread may read it. Release
+ * with g_array_unref(). */
+GArray*       conversation_snapshot(Conversation *conv, guint n_messages);
+
+/* ---------- Context planning (context.c) ---------- */
+
+typedef struct _Tokenizer Tokenizer;
+
+typedef struct {
+  GArray *included;    // guint indices into conv->messages, ascending
+  gchar  *summary;     // Sent in place of messages[0, summary_upto)
+  guint   summary_upto;
+  gint    tokens;
+  gint    budget;      // num_ctx sent with the request
+  guint   considered;  // Messages that were candidates
+  gchar  *retrieved;   // Document excerpts sent before the last message, or NULL
+} ContextPlan;
+
+/* NULL until start_tokenizer_fetch() has finished for the model. */
+const Tokenizer* lookup_tokenizer(const gchar *model);
+void             start_tokenizer_fetch(const gchar *model);
+gint             message_token_count(Message *msg, const Tokenizer *tok);
+
+/* Plans which of the first n_messages of conv fit into num_ctx. */
+ContextPlan*     context_plan_new(Conversation *conv, guint n_messages,
+                                  const Tokenizer *tok, gint num_ctx);
+void             context_plan_free(ContextPlan *plan);
+
+/* Returns the text to summarize when the unsummarized history of conv has
+ * outgrown COMPACTION_THRESHOLD of num_ctx, else NULL. The text is capped to
+ * fit num_ctx, and *upto receives the index the new summary will cover (it
+ * may stop short of the recent turns; the next run continues from there). */
+gchar*           compaction_request_new(Conversation *conv, const Tokenizer *tok,
+                                        gint num_ctx, guint *upto);
+
+/* ---------- Markdown (markdown.c) ---------- */
+
+typedef enum {
+  MD_PARAGRAPH,
+  MD_SPACER,        // Blank line
+  MD_HEADER_1,
+  MD_HEADER_2,
+  MD_HEADER_3,
+  MD_QUOTE,
+  MD_BULLET,
+  MD_NUMBERED,      // marker is the number with its dot, e.g. "3."
+  MD_INLINE_CODE,   // Line with backticks; split on them, odd parts are code
+  MD_CODE           // Fenced block; marker is the fence language
+} MdBlockType;
+
+typedef struct {
+  MdBlockType  type;
+  gchar       *text;
+  gchar       *marker;
+} MdBlock;
+
+/* Parsed message, immutable once built and shared by reference. */
+typedef struct {
+  gint    ref_count;
+  GArray *blocks;     // MdBlock
+  gsize   bytes;      // Footprint charged to the parse cache
+} MdDoc;
+
+MdDoc*   md_parse(const gchar *text);
+MdDoc*   md_doc_ref(MdDoc *doc);
+void     md_doc_unref(MdDoc *doc);
+
+/* Parsed documents keyed by message serial and content length (a message
+ * only grows while it streams), bounded by MARKDOWN_CACHE_BYTES. Returns a
+ * new reference, parsing on a miss. Any thread. */
+MdDoc*   md_cache_get(guint serial, const gchar *content);
+/* Parses the conversation's uncached assistant messages on a background
+ * thread. Each job holds a reference to its message's content string, so
+ * the conversation may change or be freed before the jobs run. */
+void     md_cache_prefetch(Conversation *conv);
+void     md_cache_clear(void);
+
+/* ---------- Memory accounting (memory.c) ---------- */
+
+typedef enum {
+  MEM_CONVERSATIONS,   // Conversation and Message structs, ids, titles
+  MEM_MESSAGE_TEXT,
+  MEM_IMAGES,          // Base64 payloads in Message->images
+  MEM_PARSE_CACHE,
+  MEM_WIDGETS,         // Filled in by the frontend
+  MEM_NETWORK,         // Request bodies and stream buffers in flight
+  MEM_DOCUMENTS,       // Mapped document index
+  MEM_N_CATEGORIES
+} MemCategory;
+
+#define MEMORY_REPORT_TOP 5
+
+typedef struct {
+  gchar  *title;
+  guint   messages;
+  gint64  bytes;
+} MemoryConversation;
+
+typedef struct {
+  gint64  bytes[MEM_N_CATEGORIES];
+  gint64  count[MEM_N_CATEGORIES];
+  GArray *top;         // MemoryConversation, largest first
+  gint64  pressure_events;   // Low-memory warnings handled so far
+  gint64  pressure_freed;    // Bytes those released, summed
+} MemoryReport;
+
+const gchar* memory_category_name(MemCategory category);
+/* Adjusts the live counters for buffers that are not part of a conversation. */
+void         memory_account(MemCategory category, gssize bytes, gint objects);
+/* Messages already in seen are skipped and the rest added to it, so shared
+ * branch prefixes count once (NULL counts every message). */
+void         conversation_memory(Conversation *conv, GHashTable *seen,
+                                 gint64 *structure, gint64 *text, gint64 *images);
+/* Counts a low-memory warning and the bytes shed in response to it. */
+void         memory_record_pressure(gint level, gint64 freed);
+
+void         memory_report_init(MemoryReport *report);
+void         memory_report_clear(MemoryReport *report);
+void         memory_report_add_conversations(MemoryReport *report, GPtrArray *conversations);
+void         memory_report_add_live(MemoryReport *report);
+gint64       memory_report_total(const MemoryReport *report);
+gchar*       memory_report_to_text(const MemoryReport *report);
+void         memory_report_to_json(const MemoryReport *report, JsonBuilder *b);
+
+/* ---------- Storage (storage.c) ---------- */
+
+gchar*    get_conversations_path(void);
+void      save_conversations(GPtrArray *conversations);
+void      load_conversations(GPtrArray *conversations);
+
+/* Writes the messages of an idle conversation to the user cache dir and
+ * frees them, returning the bytes released (0 if it was busy or already
+ * out). Saves still include them. conversation_restore() reads them back
+ * and is a no-op for conversations in memory. Main thread only. */
+gint64    conversation_spill(Conversation *conv);
+gboolean  conversation_restore(Conversation *conv);
+
+gchar*    load_preferred_model(void);
+void      save_preferred_model(const gchar *model);
+gboolean  load_theme_preference(void);
+void      save_theme_preference(gboolean dark_theme);
+gchar*    load_pref_string(const gchar *key, const gchar *fallback);
+gboolean  load_pref_boolean(const gchar *key, gboolean fallback);
+void      save_pref_boolean(const gchar *key, gboolean value);
+gdouble   load_pref_double(const gchar *key, gdouble fallback);
+
+void      telemetry_record_request(gboolean hedged, gboolean hedge_won, gint64 ttft_ms);
+void      telemetry_record_model_swap(gboolean model_load, guint evictions);
+void      telemetry_record_affinity(gboolean warned, gboolean delayed, gboolean rerouted);
+void      telemetry_observe_resident(gint64 bytes);
+void      telemetry_record_retrieval(gint64 embed_us, gint64 search_us);
+gint64    telemetry_ttft_percentile(gdouble percentile);
+void      load_telemetry(void);
+void      save_telemetry(void);
+
+/* ---------- Ollama client (ollama.c) ---------- */
+
+typedef struct {
+  gchar  *name;
+  gint64  size;        // Bytes the model occupies while loaded
+  gint64  size_vram;
+  gchar  *expires_at;
+} RunningModel;
+
+typedef enum {
+  AFFINITY_OFF,
+  AFFINITY_WARN,
+  AFFINITY_DELAY,
+  AFFINITY_REROUTE
+} AffinityPolicy;
+
+typedef struct {
+  /* Called on a worker thread for every piece of text from the winning leg. */
+  void (*delta)(const gchar *text, gpointer user_data);
+  /* Scheduler notes for the user; takes ownership of text, NULL clears. */
+  void (*note)(gchar *text, gpointer user_data);
+  /* Token counts from the final chunk, -1 when the server did not say. */
+  void (*usage)(gint64 prompt_tokens, gint64 completion_tokens, gpointer user_data);
+} StreamCallbacks;
+
+typedef struct {
+  const gchar    *base_url;         // Primary endpoint, NULL = OLLAMA_BASE_URL
+  gchar          *model;            // May be replaced by the affinity scheduler
+  const gchar    *hedge_url;        // Second endpoint, NULL = no hedging
+  const gchar    *keep_alive;
+  gdouble         hedge_percentile;
+  AffinityPolicy  affinity_policy;
+  gint64          server_memory;    // Bytes the server can keep resident (0 = unknown, not checked)
+  gint            server_max_models;
+} StreamRequest;
+
+/* Endpoints are http(s) URLs or unix:///path/to/socket; NULL means
+ * OLLAMA_BASE_URL. ollama_url() builds the request URL for a path on one. */
+gchar*         ollama_url(const gchar *base_url, const gchar *path);
+/* A new session that can reach base_url, for one-off requests. */
+SoupSession*   ollama_session_new(const gchar *base_url, guint timeout);
+/* Process-wide session for chat requests to base_url, so every caller
+ * shares one connection pool per transport. Safe to use from any thread. */
+SoupSession*   ollama_session(const gchar *base_url);
+
+/* ---------- Chat backends ----------
+ * The wire format a server speaks: how a chat request is written, how the
+ * streamed reply is decoded and where models are listed. Ollama streams
+ * NDJSON from /api/chat; OpenAI-compatible servers (vLLM, LM Studio,
+ * text-generation-webui) stream server-sent events from /chat/completions
+ * under their /v1 root. */
+
+typedef struct {
+  const gchar *delta;              // Text in this event; valid until the next feed
+  const gchar *error;              // Reported by the server; valid likewise
+  gboolean     done;
+  gboolean     has_usage;
+  gint64       prompt_tokens;      // -1 when the server did not say
+  gint64       completion_tokens;
+} StreamEvent;
+
+typedef struct _StreamDecoder StreamDecoder;
+
+typedef struct {
+  const gchar *name;
+  const gchar *chat_path;          // Appended to the endpoint URL
+  const gchar *models_path;
+  const gchar *embed_path;
+  gboolean     model_residency;    // Has /api/ps, /api/show and load requests
+  gchar*       (*build_chat_body)(const char *model, GArray *messages, const ContextPlan *plan,
+                                  const char *keep_alive);
+  /* One line of the response body without its terminator. Returns TRUE
+   * when the line completed an event, written to event. */
+  gboolean     (*decode_line)(StreamDecoder *decoder, const gchar *line, gsize len, StreamEvent *event);
+  /* Reply text of an unstreamed chat response. */
+  const gchar* (*reply_text)(JsonNode *root);
+  /* Appends the model names of a models_path response. */
+  void         (*parse_models)(JsonNode *root, GPtrArray *names);
+  /* The i-th vector of an embed_path response, or NULL. */
+  JsonArray*   (*embedding)(JsonNode *root, guint i);
+} ChatBackend;
+
+extern const ChatBackend OLLAMA_BACKEND;
+extern const ChatBackend OPENAI_BACKEND;
+
+/* CHAT_BACKEND when it names a backend, otherwise by URL: an endpoint
+ * ending in /v1 is OpenAI-compatible. NULL means OLLAMA_BASE_URL. */
+const ChatBackend* chat_backend_for_url(const gchar *base_url);
+
+StreamDecoder* stream_decoder_new(const ChatBackend *backend);
+void           stream_decoder_free(StreamDecoder *decoder);
+gboolean       stream_decoder_feed(StreamDecoder *decoder, const gchar *line, gsize len, StreamEvent *event);
+
+/* Blocking. Model names from the backend's model list; empty if the server
+ * is unreachable. */
+GPtrArray*     ollama_list_models(void);
+
+/* Blocking. Models resident on the server at base_url (/api/ps), NULL if
+ * unreachable or not an Ollama server. NULL base_url means OLLAMA_BASE_URL;
+ * session must be one for that endpoint. */
+GPtrArray*     fetch_running_models(SoupSession *session, const gchar *base_url);
+RunningModel*  find_running_model(GPtrArray *models, const gchar *name);
+
+/* Blocking. Asks Ollama at base_url to load the model without generating
+ * anything; does nothing on other backends. */
+void           ollama_load_model(SoupSession *session, const gchar *base_url, const gchar *model,
+                                 const gchar *keep_alive);
+
+AffinityPolicy parse_affinity_policy(const gchar *name);
+
+/* messages is a conversation_snapshot(); plan indices refer to it. */
+gchar*         build_ollama_chat_body(const char *model, GArray *messages, const ContextPlan *plan,
+                                      const char *keep_alive);
+gchar*         build_openai_chat_body(const char *model, GArray *messages, const ContextPlan *plan,
+                                      const char *keep_alive);
+const char*    extract_chunk_text(JsonNode *root);
+gboolean       chunk_is_done(JsonNode *root);
+
+/* Blocking. Runs one chat request over a conversation_snapshot(), in each
+ * endpoint's own format: applies the affinity policy, races the hedge
+ * endpoint if configured, streams text through callbacks->delta and records
+ * telemetry. Returns FALSE with error set unless the winning endpoint's
+ * reply ran through its done chunk; a stream that breaks off or ends early
+ * is an error (not on cancel). cancellable may be NULL. */
+gboolean       ollama_stream_chat(StreamRequest *req, GArray *messages, const ContextPlan *plan,
+                                  const StreamCallbacks *callbacks, gpointer user_data,
+                                  GCancellable *cancellable, GError **error);
+
+/* Blocking. Folds a compaction_request_new() text into a summary on the
+ * endpoint at base_url (NULL = OLLAMA_BASE_URL), in its format, or NULL.
+ * num_ctx and keep_alive are sent to Ollama servers only. */
+gchar*         ollama_summarize(const gchar *base_url, const gchar *model, const gchar *request,
+                                gint num_ctx, const gchar *keep_alive, GCancellable *cancellable);
+
+/* Blocking. Embeds n texts with model on the endpoint at base_url (NULL =
+ * OLLAMA_BASE_URL), returning n vectors of *dim floats back to back
+ * (g_free), or NULL with error set. */
+gfloat*        ollama_embed(const gchar *base_url, const gchar *model, const gchar * const *texts,
+                            guint n, guint *dim, GCancellable *cancellable, GError **error);
+
+/* ---------- Documents (rag.c) ----------
+ * Chunks of the user's files with their embeddings, in one file under the
+ * config dir that is searched through a read-only mapping. A RagIndex is
+ * immutable and any thread may search it; adding documents returns a new
+ * one. */
+
+typedef struct _RagIndex RagIndex;
+
+typedef struct {
+  const gchar  *source;    // Path of the file
+  guint         line;      // First line of the chunk, from 1
+  const gchar  *text;      // len bytes, not NUL-terminated
+  gsize         len;
+  const gfloat *vector;    // Unit length, rag_index_dim() floats
+} RagChunk;
+
+typedef struct {
+  RagChunk chunk;
+  gfloat   score;          // Cosine similarity to the query
+} RagHit;
+
+typedef struct {
+  guint  excerpts;         // Chunks put into the request
+  gint64 embed_us;         // Embedding the query
+  gint64 search_us;        // Searching the index
+} RagStats;
+
+/* Called between embedding batches on the building thread. */
+typedef void (*RagProgressFunc)(guint done, guint total, gpointer user_data);
+
+gchar*         get_documents_path(void);
+/* Maps the index at path: an empty index when there is no file, NULL with
+ * error set when it is unreadable or not an index. */
+RagIndex*      rag_index_open(const gchar *path, GError **error);
+RagIndex*      rag_index_ref(RagIndex *index);
+void           rag_index_unref(RagIndex *index);
+guint          rag_index_n_chunks(RagIndex *index);
+guint          rag_index_n_sources(RagIndex *index);
+guint          rag_index_dim(RagIndex *index);
+/* NULL for an empty index. */
+const gchar*   rag_index_model(RagIndex *index);
+void           rag_index_chunk(RagIndex *index, guint i, RagChunk *chunk);
+
+/* Writes chunks (vectors of unit length) as the index at path and opens
+ * it. Corpora of RAG_IVF_MIN_CHUNKS or more are clustered so searches scan
+ * only the lists nearest the query. */
+RagIndex*      rag_index_write(const gchar *path, const gchar *model, guint dim,
+                               const RagChunk *chunks, guint n_chunks, GError **error);
+/* Blocking. Chunks the files and folders in paths, embeds the chunks with
+ * model on base_url (NULL = OLLAMA_BASE_URL) and writes base plus them
+ * (replacing files base already had) as a new index at base's path, or
+ * get_documents_path() without a base. */
+RagIndex*      rag_index_add(RagIndex *base, const gchar * const *paths, const gchar *base_url,
+                             const gchar *model, RagProgressFunc progress, gpointer user_data,
+                             GCancellable *cancellable, GError **error);
+
+gfloat         rag_dot(const gfloat *a, const gfloat *b, guint n);
+/* Up to k chunks most similar to a unit-length query, best first. */
+guint          rag_index_search(RagIndex *index, const gfloat *query, guint k, RagHit *hits);
+/* Blocking. Embeds query on base_url (NULL = OLLAMA_BASE_URL) and formats
+ * the best RAG_TOP_K chunks scoring at least RAG_MIN_SCORE, in at most
+ * max_bytes, as a system message; NULL when none qualify. Records
+ * retrieval telemetry. */
+gchar*         rag_retrieve(RagIndex *index, const gchar *base_url, const gchar *query, gsize max_bytes,
+                            RagStats *stats, GCancellable *cancellable);
+
+/* ---------- Local API (service.c) ---------- */
+
+typedef struct _ApiService ApiService;
+
+typedef struct {
+  /* Fills in the endpoints and policies the app would use; req->model is
+   * already set when the client asked for one. */
+  void (*prepare)(StreamRequest *req, gint *num_ctx, gpointer user_data);
+  /* A conversation was created, got a new message or finished a reply. */
+  void (*changed)(Conversation *conv, gpointer user_data);
+  /* Adds what only the frontend can measure to GET /v1/memory. */
+  void (*memory)(MemoryReport *report, gpointer user_data);
+} ApiServiceHooks;
+
+/* Serves chat requests over HTTP on a Unix socket, appending to
+ * conversations. Runs on the thread-default main context. */
+ApiService*    api_service_new(const gchar *socket_path, GPtrArray *conversations,
+                               const ApiServiceHooks *hooks, gpointer user_data, GError **error);
+/* Cancels streams in flight and removes the socket. */
+void           api_service_free(ApiService *service);
+
+G_END_DECLS
+
+#endif /* GANESHA_CORE_H */
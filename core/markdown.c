@@ -0,0 +1,233 @@
+#include "ganesha-core.h"
+
+#include <string.h>
+
+/* ---------- Markdown ----------
+ * Line-oriented parse into blocks, kept separate from the widgets built from
+ * them so a parse can be cached, shared and done off the main thread. */
+
+static void md_block_clear(gpointer data) {
+  MdBlock *block = data;
+  g_free(block->text);
+  g_free(block->marker);
+}
+
+static void md_doc_add(MdDoc *doc, MdBlockType type, const gchar *text, gchar *marker) {
+  MdBlock block = { .type = type, .text = g_strdup(text), .marker = marker };
+  doc->bytes += sizeof(MdBlock) + (text ? strlen(text) + 1 : 0) + (marker ? strlen(marker) + 1 : 0);
+  g_array_append_val(doc->blocks, block);
+}
+
+MdDoc* md_parse(const gchar *text) {
+  gint64 trace_parse = TRACE_BEGIN();
+  MdDoc *doc = g_new0(MdDoc, 1);
+  doc->ref_count = 1;
+  doc->blocks = g_array_new(FALSE, FALSE, sizeof(MdBlock));
+  g_array_set_clear_func(doc->blocks, md_block_clear);
+  doc->bytes = sizeof(MdDoc);
+
+  gchar **lines = g_strsplit(text ? text : "", "\n", -1);
+  GString *code = NULL;
+  gchar *code_language = NULL;
+
+  for (gchar **line = lines; *line; line++) {
+    const gchar *lead = *line;
+    while (g_ascii_isspace(*lead)) lead++;
+
+    // Code blocks keep their indentation
+    if (g_str_has_prefix(lead, "```")) {
+      if (!code) {
+        code = g_string_new("");
+        code_language = g_strstrip(g_strdup(lead + 3));
+      } else {
+        md_doc_add(doc, MD_CODE, code->str, code_language);
+        g_string_free(code, TRUE);
+        code = NULL;
+        code_language = NULL;
+      }
+      continue;
+    }
+
+    if (code) {
+      gsize len = strlen(*line);
+      if (len > 0 && (*line)[len - 1] == '\r') len--;
+      if (code->len > 0) g_string_append_c(code, '\n');
+      g_string_append_len(code, *line, len);
+      continue;
+    }
+
+    gchar *trimmed = g_strstrip(*line);
+
+    if (strchr(trimmed, '`')) {
+      md_doc_add(doc, MD_INLINE_CODE, trimmed, NULL);
+    } else if (g_str_has_prefix(trimmed, "# ")) {
+      md_doc_add(doc, MD_HEADER_1, trimmed + 2, NULL);
+    } else if (g_str_has_prefix(trimmed, "## ")) {
+      md_doc_add(doc, MD_HEADER_2, trimmed + 3, NULL);
+    } else if (g_str_has_prefix(trimmed, "### ")) {
+      md_doc_add(doc, MD_HEADER_3, trimmed + 4, NULL);
+    } else if (g_str_has_prefix(trimmed, "> ")) {
+      md_doc_add(doc, MD_QUOTE, trimmed + 2, NULL);
+    } else if (g_str_has_prefix(trimmed, "- ") || g_str_has_prefix(trimmed, "* ")) {
+      md_doc_add(doc, MD_BULLET, trimmed + 2, NULL);
+    } else {
+      const gchar *dot = g_ascii_isdigit(*trimmed) ? strchr(trimmed, '.') : NULL;
+      if (dot && dot[1] == ' ') {
+        md_doc_add(doc, MD_NUMBERED, dot + 2, g_strndup(trimmed, dot - trimmed + 1));
+      } else {
+        md_doc_add(doc, *trimmed ? MD_PARAGRAPH : MD_SPACER, *trimmed ? trimmed : NULL, NULL);
+      }
+    }
+  }
+
+  // Unclosed fence: show what arrived so far
+  if (code) {
+    md_doc_add(doc, MD_CODE, code->str, code_language);
+    g_string_free(code, TRUE);
+  }
+
+  g_strfreev(lines);
+  TRACE_ENDF(trace_parse, "markdown", "%zu bytes, %u blocks", text ? strlen(text) : 0, doc->blocks->len);
+  return doc;
+}
+
+MdDoc* md_doc_ref(MdDoc *doc) {
+  g_atomic_int_inc(&doc->ref_count);
+  return doc;
+}
+
+void md_doc_unref(MdDoc *doc) {
+  if (!doc || !g_atomic_int_dec_and_test(&doc->ref_count)) return;
+  g_array_unref(doc->blocks);
+  g_free(doc);
+}
+
+/* ---------- Parse cache ---------- */
+
+typedef struct {
+  guint  serial;
+  gsize  len;
+  MdDoc *doc;
+  GList *link;      // In cache_lru, most recently used first
+} CacheEntry;
+
+typedef struct {
+  guint  serial;
+  gchar *content;   // GRefString held from the message
+} PrefetchJob;
+
+G_LOCK_DEFINE_STATIC(md_cache);
+static GHashTable  *cache_entries = NULL;   // serial -> CacheEntry
+static GQueue       cache_lru = G_QUEUE_INIT;
+static gsize        cache_bytes = 0;
+static GThreadPool *prefetch_pool = NULL;
+
+static void cache_entry_free(gpointer data) {
+  CacheEntry *entry = data;
+  memory_account(MEM_PARSE_CACHE, -(gssize)entry->doc->bytes, -1);
+  md_doc_unref(entry->doc);
+  g_free(entry);
+}
+
+/* Called with the lock held. */
+static void cache_remove(CacheEntry *entry) {
+  g_queue_delete_link(&cache_lru, entry->link);
+  cache_bytes -= entry->doc->bytes;
+  g_hash_table_remove(cache_entries, GUINT_TO_POINTER(entry->serial));
+}
+
+/* Called with the lock held. */
+static CacheEntry* cache_lookup(guint serial, gsize len) {
+  if (!cache_entries) return NULL;
+  CacheEntry *entry = g_hash_table_lookup(cache_entries, GUINT_TO_POINTER(serial));
+  return entry && entry->len == len ? entry : NULL;
+}
+
+static void cache_insert(guint serial, gsize len, MdDoc *doc) {
+  if (doc->bytes > MARKDOWN_CACHE_BYTES) return;
+
+  G_LOCK(md_cache);
+  if (!cache_entries) cache_entries = g_hash_table_new_full(NULL, NULL, NULL, cache_entry_free);
+
+  // One version per message: a newer length replaces the older parse
+  CacheEntry *old = g_hash_table_lookup(cache_entries, GUINT_TO_POINTER(serial));
+  if (old) cache_remove(old);
+
+  CacheEntry *entry = g_new0(CacheEntry, 1);
+  entry->serial = serial;
+  entry->len = len;
+  entry->doc = md_doc_ref(doc);
+  g_queue_push_head(&cache_lru, entry);
+  entry->link = cache_lru.head;
+  g_hash_table_insert(cache_entries, GUINT_TO_POINTER(serial), entry);
+  cache_bytes += doc->bytes;
+  memory_account(MEM_PARSE_CACHE, doc->bytes, 1);
+
+  while (cache_bytes > MARKDOWN_CACHE_BYTES) cache_remove(g_queue_peek_tail(&cache_lru));
+  G_UNLOCK(md_cache);
+}
+
+MdDoc* md_cache_get(guint serial, const gchar *content) {
+  if (!content) content = "";
+  if (!serial) return md_parse(content);
+
+  gsize len = strlen(content);
+  G_LOCK(md_cache);
+  CacheEntry *entry = cache_lookup(serial, len);
+  if (entry) {
+      g_queue_unlink(&cache_lru, entry->link);
+      g_queue_push_head_link(&cache_lru, entry->link);
+      MdDoc *doc = md_doc_ref(entry->doc);
+      G_UNLOCK(md_cache);
+      return doc;
+  }
+  G_UNLOCK(md_cache);
+
+  MdDoc *doc = md_parse(content);
+  cache_insert(serial, len, doc);
+  return doc;
+}
+
+static void prefetch_run(gpointer data, gpointer user_data) {
+  (void)user_data;
+  PrefetchJob *job = data;
+  gsize len = strlen(job->content);
+
+  G_LOCK(md_cache);
+  gboolean cached = cache_lookup(job->serial, len) != NULL;
+  G_UNLOCK(md_cache);
+
+  if (!cached) {
+      MdDoc *doc = md_parse(job->content);
+      cache_insert(job->serial, len, doc);
+      md_doc_unref(doc);
+  }
+  g_ref_string_release(job->content);
+  g_free(job);
+}
+
+void md_cache_prefetch(Conversation *conv) {
+  if (!conv) return;
+
+  G_LOCK(md_cache);
+  if (!prefetch_pool) prefetch_pool = g_thread_pool_new(prefetch_run, NULL, 1, FALSE, NULL);
+  for (guint i = 0; i < conv->messages->len; i++) {
+      Message *msg = g_ptr_array_index(conv->messages, i);
+      if (g_strcmp0(msg->role, "assistant") != 0 || !msg->content || !*msg->content) continue;
+      if (cache_lookup(msg->serial, strlen(msg->content))) continue;
+
+      PrefetchJob *job = g_new0(PrefetchJob, 1);
+      job->serial = msg->serial;
+      job->content = g_ref_string_acquire(msg->content);
+      g_thread_pool_push(prefetch_pool, job, NULL);
+  }
+  G_UNLOCK(md_cache);
+}
+
+void md_cache_clear(void) {
+  G_LOCK(md_cache);
+  g_queue_clear(&cache_lru);
+  g_clear_pointer(&cache_entries, g_hash_table_unref);
+  cache_bytes = 0;
+  G_UNLOCK(md_cache);
+}
@@ -0,0 +1,200 @@
+#include "ganesha-core.h"
+
+#include <string.h>
+
+/* ---------- Memory accounting ----------
+ * Conversations are measured by walking them, so the numbers cannot drift
+ * from the data. Buffers that come and go (parse caches, request bodies and
+ * stream buffers) are tracked with memory_account() counters instead. Sizes
+ * are payload bytes plus struct sizes; allocator overhead is not included. */
+
+static gssize live_bytes[MEM_N_CATEGORIES];   // Pointer-sized for g_atomic_pointer_add()
+static gint   live_count[MEM_N_CATEGORIES];
+static gint   pressure_events = 0;
+static gssize pressure_freed = 0;
+
+static const gchar *CATEGORY_NAMES[MEM_N_CATEGORIES] = {
+  [MEM_CONVERSATIONS] = "conversations",
+  [MEM_MESSAGE_TEXT]  = "message_text",
+  [MEM_IMAGES]        = "images",
+  [MEM_PARSE_CACHE]   = "parse_cache",
+  [MEM_WIDGETS]       = "widgets",
+  [MEM_NETWORK]       = "network_buffers",
+  [MEM_DOCUMENTS]     = "document_index",
+};
+
+const gchar* memory_category_name(MemCategory category) {
+  return CATEGORY_NAMES[category];
+}
+
+void memory_account(MemCategory category, gssize bytes, gint objects) {
+  g_atomic_pointer_add(&live_bytes[category], bytes);
+  g_atomic_int_add(&live_count[category], objects);
+}
+
+void memory_record_pressure(gint level, gint64 freed) {
+  g_atomic_int_inc(&pressure_events);
+  g_atomic_pointer_add(&pressure_freed, MAX(freed, 0));
+  g_message("Low-memory warning (level %d): %" G_GINT64_FORMAT " bytes freed", level, freed);
+}
+
+static gint64 string_bytes(const gchar *s) {
+  return s ? (gint64)strlen(s) + 1 : 0;
+}
+
+void conversation_memory(Conversation *conv, GHashTable *seen,
+                         gint64 *structure, gint64 *text, gint64 *images) {
+  gint64 s = sizeof(Conversation) + string_bytes(conv->id) + string_bytes(conv->title)
+           + sizeof(GPtrArray) + conv->messages->len * sizeof(gpointer);
+  gint64 t = string_bytes(conv->summary);
+  gint64 img = 0;
+
+  for (guint i = 0; i < conv->messages->len; i++) {
+      Message *msg = g_ptr_array_index(conv->messages, i);
+      if (seen && !g_hash_table_add(seen, msg)) continue;
+      s += sizeof(Message) + string_bytes(msg->role) + sizeof(GPtrArray)
+         + msg->images->len * sizeof(gpointer);
+      t += string_bytes(msg->content);
+      for (guint k = 0; k < msg->images->len; k++) {
+          img += string_bytes(g_ptr_array_index(msg->images, k));
+      }
+  }
+
+  if (structure) *structure = s;
+  if (text) *text = t;
+  if (images) *images = img;
+}
+
+static gint compare_conversation_bytes(gconstpointer a, gconstpointer b) {
+  gint64 x = ((const MemoryConversation*)a)->bytes, y = ((const MemoryConversation*)b)->bytes;
+  return x > y ? -1 : x < y ? 1 : 0;
+}
+
+void memory_report_init(MemoryReport *report) {
+  memset(report, 0, sizeof(*report));
+  report->top = g_array_new(FALSE, FALSE, sizeof(MemoryConversation));
+}
+
+void memory_report_clear(MemoryReport *report) {
+  for (guint i = 0; report->top && i < report->top->len; i++) {
+      g_free(g_array_index(report->top, MemoryConversation, i).title);
+  }
+  g_clear_pointer(&report->top, g_array_unref);
+}
+
+void memory_report_add_conversations(MemoryReport *report, GPtrArray *conversations) {
+  GHashTable *seen = g_hash_table_new(NULL, NULL);
+  for (guint i = 0; i < conversations->len; i++) {
+      Conversation *conv = g_ptr_array_index(conversations, i);
+      for (guint j = 0; j < conv->messages->len; j++) {
+          Message *msg = g_ptr_array_index(conv->messages, j);
+          if (g_hash_table_contains(seen, msg)) continue;
+          report->count[MEM_MESSAGE_TEXT]++;
+          report->count[MEM_IMAGES] += msg->images->len;
+      }
+      gint64 structure, text, images;
+      conversation_memory(conv, seen, &structure, &text, &images);
+
+      report->bytes[MEM_CONVERSATIONS] += structure;
+      report->count[MEM_CONVERSATIONS]++;
+      report->bytes[MEM_MESSAGE_TEXT] += text;
+      report->bytes[MEM_IMAGES] += images;
+
+      MemoryConversation entry = {
+        .title = g_strdup(conv->title ? conv->title : conv->id),
+        .messages = conv->messages->len,
+        .bytes = structure + text + images,
+      };
+      g_array_append_val(report->top, entry);
+  }
+  g_hash_table_unref(seen);
+
+  g_array_sort(report->top, compare_conversation_bytes);
+  while (report->top->len > MEMORY_REPORT_TOP) {
+      g_free(g_array_index(report->top, MemoryConversation, report->top->len - 1).title);
+      g_array_set_size(report->top, report->top->len - 1);
+  }
+}
+
+void memory_report_add_live(MemoryReport *report) {
+  for (guint i = 0; i < MEM_N_CATEGORIES; i++) {
+      report->bytes[i] += (gssize)g_atomic_pointer_get(&live_bytes[i]);
+      report->count[i] += g_atomic_int_get(&live_count[i]);
+  }
+  report->pressure_events = g_atomic_int_get(&pressure_events);
+  report->pressure_freed = (gssize)g_atomic_pointer_get(&pressure_freed);
+}
+
+gint64 memory_report_total(const MemoryReport *report) {
+  gint64 total = 0;
+  for (guint i = 0; i < MEM_N_CATEGORIES; i++) total += report->bytes[i];
+  return total;
+}
+
+gchar* memory_report_to_text(const MemoryReport *report) {
+  GString *out = g_string_new(NULL);
+  for (guint i = 0; i < MEM_N_CATEGORIES; i++) {
+      gchar *size = g_format_size(report->bytes[i]);
+      g_string_append_printf(out, "%-16s %10s  %" G_GINT64_FORMAT "\n",
+                             CATEGORY_NAMES[i], size, report->count[i]);
+      g_free(size);
+  }
+  gchar *total = g_format_size(memory_report_total(report));
+  g_string_append_printf(out, "%-16s %10s\n", "total", total);
+  g_free(total);
+
+  if (report->pressure_events > 0) {
+      gchar *freed = g_format_size(report->pressure_freed);
+      g_string_append_printf(out, "\nLow-memory warnings: %" G_GINT64_FORMAT ", %s freed\n",
+                             report->pressure_events, freed);
+      g_free(freed);
+  }
+
+  if (report->top && report->top->len > 0) {
+      g_string_append(out, "\nLargest conversations:\n");
+      for (guint i = 0; i < report->top->len; i++) {
+          MemoryConversation *c = &g_array_index(report->top, MemoryConversation, i);
+          gchar *size = g_format_size(c->bytes);
+          g_string_append_printf(out, "%10s  %4u msgs  %s\n", size, c->messages, c->title);
+          g_free(size);
+      }
+  }
+  return g_string_free(out, FALSE);
+}
+
+void memory_report_to_json(const MemoryReport *report, JsonBuilder *b) {
+  json_builder_begin_object(b);
+  for (guint i = 0; i < MEM_N_CATEGORIES; i++) {
+      json_builder_set_member_name(b, CATEGORY_NAMES[i]);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "bytes");
+      json_builder_add_int_value(b, report->bytes[i]);
+      json_builder_set_member_name(b, "count");
+      json_builder_add_int_value(b, report->count[i]);
+      json_builder_end_object(b);
+  }
+  json_builder_set_member_name(b, "total_bytes");
+  json_builder_add_int_value(b, memory_report_total(report));
+  json_builder_set_member_name(b, "pressure");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "events");
+  json_builder_add_int_value(b, report->pressure_events);
+  json_builder_set_member_name(b, "freed_bytes");
+  json_builder_add_int_value(b, report->pressure_freed);
+  json_builder_end_object(b);
+  json_builder_set_member_name(b, "largest_conversations");
+  json_builder_begin_array(b);
+  for (guint i = 0; report->top && i < report->top->len; i++) {
+      MemoryConversation *c = &g_array_index(report->top, MemoryConversation, i);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "title");
+      json_builder_add_string_value(b, c->title);
+      json_builder_set_member_name(b, "messages");
+      json_builder_add_int_value(b, c->messages);
+      json_builder_set_member_name(b, "bytes");
+      json_builder_add_int_value(b, c->bytes);
+      json_builder_end_object(b);
+  }
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+}
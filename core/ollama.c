@@ -0,0 +1,1342 @@
+#include "ganesha-core.h"
+
+#include <gio/gunixsocketaddress.h>
+#include <string.h>
+
+/* ---------- Transport ----------
+ * Endpoints are http(s) URLs or unix:///path/to/ollama.sock. Sessions for a
+ * Unix endpoint connect to the socket through "remote-connectable", and
+ * requests to it are addressed to http://localhost for the Host header. */
+
+static const gchar* unix_socket_path(const gchar *base_url) {
+  if (!base_url) base_url = OLLAMA_BASE_URL;
+  return g_str_has_prefix(base_url, "unix://") ? base_url + strlen("unix://") : NULL;
+}
+
+gchar* ollama_url(const gchar *base_url, const gchar *path) {
+  if (!base_url) base_url = OLLAMA_BASE_URL;
+  if (unix_socket_path(base_url)) return g_strconcat("http://localhost", path, NULL);
+  return g_strconcat(base_url, path, NULL);
+}
+
+SoupSession* ollama_session_new(const gchar *base_url, guint timeout) {
+  const gchar *socket_path = unix_socket_path(base_url);
+  GSocketAddress *address = socket_path ? g_unix_socket_address_new(socket_path) : NULL;
+  SoupSession *session = soup_session_new_with_options("timeout", timeout,
+                                                       "max-conns", SESSION_MAX_CONNS,
+                                                       "max-conns-per-host", SESSION_MAX_CONNS_PER_HOST,
+                                                       "remote-connectable", address,
+                                                       NULL);
+  if (address) g_object_unref(address);
+  return session;
+}
+
+G_LOCK_DEFINE_STATIC(sessions);
+static GHashTable *sessions = NULL;   // Socket path ("" for TCP) -> SoupSession
+
+SoupSession* ollama_session(const gchar *base_url) {
+  const gchar *socket_path = unix_socket_path(base_url);
+  const gchar *key = socket_path ? socket_path : "";
+  
+  G_LOCK(sessions);
+  if (!sessions) sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  SoupSession *session = g_hash_table_lookup(sessions, key);
+  if (!session) {
+      session = ollama_session_new(base_url, REQUEST_TIMEOUT);
+      g_hash_table_insert(sessions, g_strdup(key), session);
+  }
+  G_UNLOCK(sessions);
+  return session;
+}
+
+/* ---------- Models ---------- */
+
+GPtrArray* ollama_list_models(void) {
+  const ChatBackend *backend = chat_backend_for_url(OLLAMA_BASE_URL);
+  gchar *url = ollama_url(OLLAMA_BASE_URL, backend->models_path);
+  
+  SoupSession *session = ollama_session_new(OLLAMA_BASE_URL, 10);
+  
+  SoupMessage *msg = soup_message_new("GET", url);
+  GError *err = NULL;
+  GBytes *response_bytes = soup_session_send_and_read(session, msg, NULL, &err);
+  
+  GPtrArray *model_names = g_ptr_array_new_with_free_func(g_free);
+  
+  if (response_bytes && !err) {
+      gsize size;
+      gconstpointer data_ptr = g_bytes_get_data(response_bytes, &size);
+      
+      JsonParser *parser = json_parser_new();
+      if (json_parser_load_from_data(parser, data_ptr, size, NULL)) {
+          backend->parse_models(json_parser_get_root(parser), model_names);
+      }
+      g_object_unref(parser);
+      g_bytes_unref(response_bytes);
+  }
+  
+  if (err) g_error_free(err);
+  g_object_unref(session);
+  g_object_unref(msg);
+  g_free(url);
+  return model_names;
+}
+
+/* ---------- Resident models ---------- */
+
+static void running_model_free(RunningModel *rm) {
+  if (!rm) return;
+  g_free(rm->name);
+  g_free(rm->expires_at);
+  g_free(rm);
+}
+
+GPtrArray* fetch_running_models(SoupSession *session, const gchar *base_url) {
+  if (!chat_backend_for_url(base_url)->model_residency) return NULL;
+  
+  gchar *url = ollama_url(base_url, "/api/ps");
+  SoupMessage *msg = soup_message_new("GET", url);
+  GBytes *response_bytes = soup_session_send_and_read(session, msg, NULL, NULL);
+  GPtrArray *models = NULL;
+  
+  if (response_bytes) {
+      gsize size;
+      gconstpointer data_ptr = g_bytes_get_data(response_bytes, &size);
+      
+      JsonParser *parser = json_parser_new();
+      if (json_parser_load_from_data(parser, data_ptr, size, NULL)) {
+          JsonNode *root = json_parser_get_root(parser);
+          if (JSON_NODE_HOLDS_OBJECT(root)) {
+              JsonObject *obj = json_node_get_object(root);
+              models = g_ptr_array_new_with_free_func((GDestroyNotify)running_model_free);
+              if (json_object_has_member(obj, "models")) {
+                  JsonArray *arr = json_object_get_array_member(obj, "models");
+                  guint len = json_array_get_length(arr);
+                  for (guint i = 0; i < len; i++) {
+                      JsonObject *m = json_array_get_object_element(arr, i);
+                      RunningModel *rm = g_new0(RunningModel, 1);
+                      rm->name = g_strdup(json_object_get_string_member_with_default(m, "name", NULL));
+                      rm->size = json_object_get_int_member_with_default(m, "size", 0);
+                      rm->size_vram = json_object_get_int_member_with_default(m, "size_vram", 0);
+                      rm->expires_at = g_strdup(json_object_get_string_member_with_default(m, "expires_at", NULL));
+                      g_ptr_array_add(models, rm);
+                  }
+              }
+          }
+      }
+      g_object_unref(parser);
+      g_bytes_unref(response_bytes);
+  }
+  
+  g_object_unref(msg);
+  g_free(url);
+  return models;
+}
+
+RunningModel* find_running_model(GPtrArray *models, const gchar *name) {
+  if (!models) return NULL;
+  for (guint i = 0; i < models->len; i++) {
+      RunningModel *rm = g_ptr_array_index(models, i);
+      if (g_strcmp0(rm->name, name) == 0) return rm;
+  }
+  return NULL;
+}
+
+void ollama_load_model(SoupSession *session, const gchar *base_url, const gchar *model,
+                       const gchar *keep_alive) {
+  if (!chat_backend_for_url(base_url)->model_residency) return;
+  
+  // An empty message list makes Ollama load the model without generating
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, model);
+  json_builder_set_member_name(b, "messages");
+  json_builder_begin_array(b);
+  json_builder_end_array(b);
+  json_builder_set_member_name(b, "stream");
+  json_builder_add_boolean_value(b, FALSE);
+  if (keep_alive && *keep_alive) {
+      json_builder_set_member_name(b, "keep_alive");
+      json_builder_add_string_value(b, keep_alive);
+  }
+  json_builder_end_object(b);
+  
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gsize len = 0;
+  gchar *body_json = json_generator_to_data(gen, &len);
+  g_object_unref(gen);
+  json_node_free(root);
+  g_object_unref(b);
+  
+  gchar *url = ollama_url(base_url, "/api/chat");
+  SoupMessage *msg = soup_message_new("POST", url);
+  GBytes *body = g_bytes_new_take(body_json, len);
+  soup_message_set_request_body_from_bytes(msg, "application/json", body);
+  g_bytes_unref(body);
+  
+  GBytes *response = soup_session_send_and_read(session, msg, NULL, NULL);
+  if (response) g_bytes_unref(response);
+  g_object_unref(msg);
+  g_free(url);
+}
+
+/* ---------- Model Affinity ----------
+ * On a shared server, a request for a model that is not resident may evict
+ * another user's model and make them pay the load again. Before sending, the
+ * resident set from /api/ps is compared with the model's footprint (observed
+ * in /api/ps, or estimated from /api/show) and, depending on the
+ * "affinity_policy" pref, the request is sent anyway with a warning, held back
+ * until a resident model expires, or rerouted to a loaded equivalent. */
+
+typedef struct {
+  gint64    footprint;    // Bytes while loaded, 0 if unknown
+  gboolean  observed;     // footprint comes from /api/ps rather than an estimate
+  gchar    *family;
+} ModelInfo;
+
+static GHashTable *model_infos;   // name -> ModelInfo
+G_LOCK_DEFINE_STATIC(model_infos);
+
+static void model_info_free(ModelInfo *info) {
+  if (!info) return;
+  g_free(info->family);
+  g_free(info);
+}
+
+AffinityPolicy parse_affinity_policy(const gchar *name) {
+  if (g_strcmp0(name, "off") == 0) return AFFINITY_OFF;
+  if (g_strcmp0(name, "delay") == 0) return AFFINITY_DELAY;
+  if (g_strcmp0(name, "reroute") == 0) return AFFINITY_REROUTE;
+  return AFFINITY_WARN;
+}
+
+static ModelInfo* model_info_lookup_locked(const gchar *name) {
+  if (!model_infos) {
+      model_infos = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                          (GDestroyNotify)model_info_free);
+  }
+  ModelInfo *info = g_hash_table_lookup(model_infos, name);
+  if (!info) {
+      info = g_new0(ModelInfo, 1);
+      g_hash_table_insert(model_infos, g_strdup(name), info);
+  }
+  return info;
+}
+
+/* Records exact footprints for resident models and returns the total. */
+static gint64 observe_running_models(GPtrArray *running) {
+  gint64 total = 0;
+  if (!running) return 0;
+  
+  G_LOCK(model_infos);
+  for (guint i = 0; i < running->len; i++) {
+      RunningModel *rm = g_ptr_array_index(running, i);
+      if (!rm->name || rm->size <= 0) continue;
+      ModelInfo *info = model_info_lookup_locked(rm->name);
+      info->footprint = rm->size;
+      info->observed = TRUE;
+      total += rm->size;
+  }
+  G_UNLOCK(model_infos);
+  
+  telemetry_observe_resident(total);
+  return total;
+}
+
+static gdouble quantization_bits(const gchar *level) {
+  if (!level) return 5.0;
+  if (g_str_has_prefix(level, "Q2")) return 3.0;
+  if (g_str_has_prefix(level, "Q3")) return 3.9;
+  if (g_str_has_prefix(level, "Q4")) return 4.8;
+  if (g_str_has_prefix(level, "Q5")) return 5.7;
+  if (g_str_has_prefix(level, "Q6")) return 6.6;
+  if (g_str_has_prefix(level, "Q8")) return 8.5;
+  if (g_str_has_prefix(level, "F16") || g_str_has_prefix(level, "BF16")) return 16.0;
+  if (g_str_has_prefix(level, "F32")) return 32.0;
+  return 5.0;
+}
+
+/* "7.6B" -> 7.6e9, "350M" -> 3.5e8 */
+static gdouble parse_parameter_size(const gchar *text) {
+  if (!text) return 0;
+  gchar *end = NULL;
+  gdouble value = g_ascii_strtod(text, &end);
+  if (end == text) return 0;
+  switch (g_ascii_toupper(*end)) {
+    case 'T': return value * 1e12;
+    case 'B': return value * 1e9;
+    case 'M': return value * 1e6;
+    case 'K': return value * 1e3;
+    default:  return value;
+  }
+}
+
+/* Returns the model's footprint and family, asking /api/show on a miss. */
+static gint64 fetch_model_info(SoupSession *session, const gchar *base_url, const gchar *name,
+                               gchar **family) {
+  G_LOCK(model_infos);
+  ModelInfo *info = model_info_lookup_locked(name);
+  gint64 footprint = info->footprint;
+  gchar *cached_family = g_strdup(info->family);
+  G_UNLOCK(model_infos);
+  
+  if (footprint > 0 && cached_family) {
+      if (family) *family = cached_family; else g_free(cached_family);
+      return footprint;
+  }
+  g_free(cached_family);
+  
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, name);
+  json_builder_end_object(b);
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gsize len = 0;
+  gchar *body_json = json_generator_to_data(gen, &len);
+  g_object_unref(gen);
+  json_node_free(root);
+  g_object_unref(b);
+  
+  gchar *url = ollama_url(base_url, "/api/show");
+  SoupMessage *msg = soup_message_new("POST", url);
+  GBytes *body = g_bytes_new_take(body_json, len);
+  soup_message_set_request_body_from_bytes(msg, "application/json", body);
+  g_bytes_unref(body);
+  GBytes *response_bytes = soup_session_send_and_read(session, msg, NULL, NULL);
+  
+  gdouble params = 0;
+  const gchar *quant = NULL;
+  gchar *model_family = NULL;
+  JsonParser *parser = json_parser_new();
+  if (response_bytes) {
+      gsize size;
+      gconstpointer data_ptr = g_bytes_get_data(response_bytes, &size);
+      if (json_parser_load_from_data(parser, data_ptr, size, NULL)) {
+          JsonNode *show_root = json_parser_get_root(parser);
+          if (JSON_NODE_HOLDS_OBJECT(show_root)) {
+              JsonObject *obj = json_node_get_object(show_root);
+              if (json_object_has_member(obj, "details")) {
+                  JsonObject *details = json_object_get_object_member(obj, "details");
+                  quant = json_object_get_string_member_with_default(details, "quantization_level", NULL);
+                  model_family = g_strdup(json_object_get_string_member_with_default(details, "family", NULL));
+                  params = parse_parameter_size(
+                      json_object_get_string_member_with_default(details, "parameter_size", NULL));
+              }
+              if (json_object_has_member(obj, "model_info")) {
+                  JsonObject *mi = json_object_get_object_member(obj, "model_info");
+                  if (json_object_has_member(mi, "general.parameter_count")) {
+                      params = json_object_get_int_member(mi, "general.parameter_count");
+                  }
+              }
+          }
+      }
+      g_bytes_unref(response_bytes);
+  }
+  
+  // Weights plus ~20% for the KV cache and runtime buffers
+  gint64 estimate = (gint64)(params * quantization_bits(quant) / 8.0 * 1.2);
+  
+  G_LOCK(model_infos);
+  info = model_info_lookup_locked(name);
+  if (!info->observed && estimate > 0) info->footprint = estimate;
+  if (model_family && !info->family) info->family = g_strdup(model_family);
+  footprint = info->footprint;
+  G_UNLOCK(model_infos);
+  
+  if (family) *family = model_family; else g_free(model_family);
+  g_object_unref(parser);
+  g_object_unref(msg);
+  g_free(url);
+  return footprint;
+}
+
+static gint64 expires_at_to_real_time(const gchar *expires_at) {
+  if (!expires_at) return G_MAXINT64;
+  GDateTime *dt = g_date_time_new_from_iso8601(expires_at, NULL);
+  if (!dt) return G_MAXINT64;
+  gint64 t = g_date_time_to_unix(dt) * G_USEC_PER_SEC + g_date_time_get_microsecond(dt);
+  g_date_time_unref(dt);
+  return t;
+}
+
+static gint compare_expiry(gconstpointer a, gconstpointer b) {
+  const RunningModel *x = *(RunningModel* const*)a;
+  const RunningModel *y = *(RunningModel* const*)b;
+  gint64 tx = expires_at_to_real_time(x->expires_at);
+  gint64 ty = expires_at_to_real_time(y->expires_at);
+  return (tx > ty) - (tx < ty);
+}
+
+typedef struct {
+  gboolean   resident;     // Requested model is already loaded
+  GPtrArray *victims;      // Names the server would likely unload (soonest expiry first)
+  gchar     *suggestion;   // Resident model to use instead
+  gint64     wait_us;      // Until the first victim expires on its own
+} AffinityPlan;
+
+static void affinity_plan_clear(AffinityPlan *plan) {
+  if (plan->victims) g_ptr_array_unref(plan->victims);
+  g_free(plan->suggestion);
+  memset(plan, 0, sizeof(*plan));
+}
+
+static void affinity_plan_compute(SoupSession *session, const gchar *base_url, GPtrArray *running,
+                                  const gchar *model, gint64 capacity, gint max_models,
+                                  AffinityPlan *plan) {
+  memset(plan, 0, sizeof(*plan));
+  plan->victims = g_ptr_array_new_with_free_func(g_free);
+  
+  if (find_running_model(running, model)) {
+      plan->resident = TRUE;
+      return;
+  }
+  
+  // Only a configured capacity is checked: the largest resident set seen
+  // is a lower bound on the server's memory, not a ceiling
+  gint64 resident = observe_running_models(running);
+  gchar *family = NULL;
+  gint64 footprint = fetch_model_info(session, base_url, model, &family);
+  
+  // Ollama frees the models closest to expiry first
+  GPtrArray *by_expiry = g_ptr_array_new();
+  for (guint i = 0; i < running->len; i++) {
+      g_ptr_array_add(by_expiry, g_ptr_array_index(running, i));
+  }
+  g_ptr_array_sort(by_expiry, compare_expiry);
+  
+  guint count = running->len;
+  for (guint i = 0; i < by_expiry->len; i++) {
+      gboolean over_count = max_models > 0 && count >= (guint)max_models;
+      gboolean over_memory = capacity > 0 && footprint > 0 && resident + footprint > capacity;
+      if (!over_count && !over_memory) break;
+      
+      RunningModel *rm = g_ptr_array_index(by_expiry, i);
+      g_ptr_array_add(plan->victims, g_strdup(rm->name));
+      if (plan->victims->len == 1) {
+          gint64 expiry = expires_at_to_real_time(rm->expires_at);
+          plan->wait_us = expiry == G_MAXINT64 ? -1 : MAX(0, expiry - g_get_real_time());
+      }
+      resident -= rm->size;
+      count--;
+  }
+  
+  // Only a resident model of the same family stands in (the largest one);
+  // anything else, such as an embedding model, is no substitute
+  if (plan->victims->len > 0 && family) {
+      RunningModel *best = NULL;
+      for (guint i = 0; i < running->len; i++) {
+          RunningModel *rm = g_ptr_array_index(running, i);
+          gchar *rm_family = NULL;
+          fetch_model_info(session, base_url, rm->name, &rm_family);
+          if (g_strcmp0(family, rm_family) == 0 && (!best || rm->size > best->size)) best = rm;
+          g_free(rm_family);
+      }
+      if (best) plan->suggestion = g_strdup(best->name);
+  }
+  
+  g_ptr_array_unref(by_expiry);
+  g_free(family);
+}
+
+static void post_note(const StreamCallbacks *cb, gpointer user_data, gchar *text) {
+  if (cb && cb->note) cb->note(text, user_data);
+  else g_free(text);
+}
+
+/* Applies the affinity policy before a request. May replace *model.
+ * Returns the resident set seen at send time (or NULL if unknown) so the
+ * caller can count evictions once the request is done. */
+static GPtrArray* schedule_model_affinity(SoupSession *session, const gchar *base_url,
+                                          AffinityPolicy policy, gint64 capacity, gint max_models,
+                                          gchar **model, const StreamCallbacks *cb,
+                                          gpointer user_data, GCancellable *c) {
+  GPtrArray *running = fetch_running_models(session, base_url);
+  if (!running) return NULL;
+  
+  AffinityPlan plan;
+  affinity_plan_compute(session, base_url, running, *model, capacity, max_models, &plan);
+  gboolean warned = FALSE, delayed = FALSE, rerouted = FALSE;
+  
+  if (policy == AFFINITY_DELAY) {
+      gint64 give_up = g_get_monotonic_time() + AFFINITY_MAX_DELAY_S * G_USEC_PER_SEC;
+      while (plan.victims->len > 0 && plan.wait_us >= 0 &&
+             g_get_monotonic_time() < give_up && !g_cancellable_is_cancelled(c)) {
+          delayed = TRUE;
+          post_note(cb, user_data, g_strdup_printf("Waiting for %s to unload (%ds) so %s does not evict it",
+                                                  (gchar*)g_ptr_array_index(plan.victims, 0),
+                                                  (gint)(plan.wait_us / G_USEC_PER_SEC), *model));
+          gint64 until = g_get_monotonic_time() + MIN(plan.wait_us + G_USEC_PER_SEC, 5 * G_USEC_PER_SEC);
+          while (g_get_monotonic_time() < until && !g_cancellable_is_cancelled(c)) {
+              g_usleep(250 * 1000);
+          }
+          g_ptr_array_unref(running);
+          affinity_plan_clear(&plan);
+          running = fetch_running_models(session, base_url);
+          if (!running) return NULL;
+          affinity_plan_compute(session, base_url, running, *model, capacity, max_models, &plan);
+      }
+  }
+  
+  if (plan.victims->len > 0) {
+      GString *joined = g_string_new(NULL);
+      for (guint i = 0; i < plan.victims->len; i++) {
+          if (i > 0) g_string_append(joined, ", ");
+          g_string_append(joined, g_ptr_array_index(plan.victims, i));
+      }
+      gchar *victims = g_string_free(joined, FALSE);
+      if (policy == AFFINITY_REROUTE && plan.suggestion) {
+          rerouted = TRUE;
+          post_note(cb, user_data, g_strdup_printf("Using %s (already loaded) instead of %s to avoid evicting %s",
+                                                  plan.suggestion, *model, victims));
+          g_free(*model);
+          *model = g_strdup(plan.suggestion);
+      } else {
+          warned = TRUE;
+          post_note(cb, user_data, plan.suggestion
+              ? g_strdup_printf("%s will evict %s from the server; %s is already loaded", *model, victims, plan.suggestion)
+              : g_strdup_printf("%s will evict %s from the server", *model, victims));
+      }
+      g_free(victims);
+  } else {
+      post_note(cb, user_data, NULL);
+  }
+  
+  telemetry_record_affinity(warned, delayed, rerouted);
+  affinity_plan_clear(&plan);
+  return running;
+}
+
+static guint count_evictions(GPtrArray *before, GPtrArray *after, const gchar *model) {
+  guint evicted = 0;
+  if (!before || !after) return 0;
+  for (guint i = 0; i < before->len; i++) {
+      RunningModel *rm = g_ptr_array_index(before, i);
+      if (g_strcmp0(rm->name, model) != 0 && !find_running_model(after, rm->name)) evicted++;
+  }
+  return evicted;
+}
+
+/* ---------- Chat requests ---------- */
+
+typedef void (*AddMessageFunc)(JsonBuilder *b, const gchar *role, const gchar *content, GPtrArray *images);
+
+/* Writes the messages the plan includes (all of them without a plan), with
+ * the compaction summary as a system message in place of the turns it
+ * covers and retrieved document excerpts as one just before the last
+ * message. */
+static void add_planned_messages(JsonBuilder *b, GArray *messages, const ContextPlan *plan,
+                                 AddMessageFunc add_message) {
+  guint n_messages = plan ? plan->included->len : messages->len;
+  gboolean summary_pending = plan && plan->summary;
+  for (guint n = 0; n < n_messages; n++) {
+      guint i = plan ? g_array_index(plan->included, guint, n) : n;
+      const MessageSnapshot *msg = &g_array_index(messages, MessageSnapshot, i);
+      
+      if (summary_pending && i >= plan->summary_upto) {
+          gchar *summary = g_strdup_printf("Summary of the earlier conversation:\n%s", plan->summary);
+          add_message(b, "system", summary, NULL);
+          g_free(summary);
+          summary_pending = FALSE;
+      }
+      if (plan && plan->retrieved && n + 1 == n_messages) add_message(b, "system", plan->retrieved, NULL);
+      add_message(b, msg->role, msg->content, msg->images);
+  }
+}
+
+static gchar* builder_to_data(JsonBuilder *b) {
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gchar *data = json_generator_to_data(gen, NULL);
+  g_object_unref(gen);
+  json_node_free(root);
+  return data;
+}
+
+static void add_ollama_message(JsonBuilder *b, const gchar *role, const gchar *content, GPtrArray *images) {
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "role");
+  json_builder_add_string_value(b, role);
+  json_builder_set_member_name(b, "content");
+  json_builder_add_string_value(b, content);
+  
+  // Add images if present
+  if (images && images->len > 0) {
+      json_builder_set_member_name(b, "images");
+      json_builder_begin_array(b);
+      for (guint j = 0; j < images->len; j++) {
+          const gchar *img = g_ptr_array_index(images, j);
+          json_builder_add_string_value(b, img);
+      }
+      json_builder_end_array(b);
+  }
+  
+  json_builder_end_object(b);
+}
+
+gchar *build_ollama_chat_body(const char *model, GArray *messages, const ContextPlan *plan,
+                              const char *keep_alive) {
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, model);
+  json_builder_set_member_name(b, "stream");
+  json_builder_add_boolean_value(b, TRUE);
+  if (keep_alive && *keep_alive) {
+      json_builder_set_member_name(b, "keep_alive");
+      json_builder_add_string_value(b, keep_alive);
+  }
+  if (plan) {
+      json_builder_set_member_name(b, "options");
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "num_ctx");
+      json_builder_add_int_value(b, plan->budget);
+      json_builder_end_object(b);
+  }
+  json_builder_set_member_name(b, "messages");
+  json_builder_begin_array(b);
+  add_planned_messages(b, messages, plan, add_ollama_message);
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  
+  gchar *data = builder_to_data(b);
+  g_object_unref(b);
+  return data;
+}
+
+/* Images are stored as bare base64; OpenAI wants a data URL, so the type is
+ * read off the first bytes of the encoding. */
+static const gchar* image_mime_type(const gchar *base64) {
+  if (g_str_has_prefix(base64, "iVBORw0KGgo")) return "image/png";
+  if (g_str_has_prefix(base64, "R0lGOD")) return "image/gif";
+  if (g_str_has_prefix(base64, "UklGR")) return "image/webp";
+  return "image/jpeg";
+}
+
+static void add_openai_message(JsonBuilder *b, const gchar *role, const gchar *content, GPtrArray *images) {
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "role");
+  json_builder_add_string_value(b, role);
+  json_builder_set_member_name(b, "content");
+  if (!images || images->len == 0) {
+      json_builder_add_string_value(b, content);
+      json_builder_end_object(b);
+      return;
+  }
+  
+  // With images the content becomes a list of parts
+  json_builder_begin_array(b);
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "type");
+  json_builder_add_string_value(b, "text");
+  json_builder_set_member_name(b, "text");
+  json_builder_add_string_value(b, content);
+  json_builder_end_object(b);
+  for (guint j = 0; j < images->len; j++) {
+      const gchar *img = g_ptr_array_index(images, j);
+      gchar *url = g_strdup_printf("data:%s;base64,%s", image_mime_type(img), img);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "type");
+      json_builder_add_string_value(b, "image_url");
+      json_builder_set_member_name(b, "image_url");
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "url");
+      json_builder_add_string_value(b, url);
+      json_builder_end_object(b);
+      json_builder_end_object(b);
+      g_free(url);
+  }
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+}
+
+/* num_ctx and keep_alive are Ollama options: an OpenAI-compatible server's
+ * context length is fixed when it starts, so the plan only picks messages. */
+gchar *build_openai_chat_body(const char *model, GArray *messages, const ContextPlan *plan,
+                              const char *keep_alive) {
+  (void)keep_alive;
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, model);
+  json_builder_set_member_name(b, "stream");
+  json_builder_add_boolean_value(b, TRUE);
+  // Token counts arrive in one last chunk before [DONE]
+  json_builder_set_member_name(b, "stream_options");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "include_usage");
+  json_builder_add_boolean_value(b, TRUE);
+  json_builder_end_object(b);
+  json_builder_set_member_name(b, "messages");
+  json_builder_begin_array(b);
+  add_planned_messages(b, messages, plan, add_openai_message);
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  
+  gchar *data = builder_to_data(b);
+  g_object_unref(b);
+  return data;
+}
+
+const char* extract_chunk_text(JsonNode *root) {
+  if (!JSON_NODE_HOLDS_OBJECT(root)) return NULL;
+  JsonObject *obj = json_node_get_object(root);
+  if (json_object_has_member(obj, "message")) {
+      JsonObject *msg = json_object_get_object_member(obj, "message");
+      if (msg && json_object_has_member(msg, "content")) {
+          return json_object_get_string_member(msg, "content");
+      }
+  }
+  if (json_object_has_member(obj, "response")) {
+      return json_object_get_string_member(obj, "response");
+  }
+  return NULL;
+}
+
+gboolean chunk_is_done(JsonNode *root) {
+  if (!JSON_NODE_HOLDS_OBJECT(root)) return FALSE;
+  JsonObject *obj = json_node_get_object(root);
+  if (json_object_has_member(obj, "done")) {
+      return json_object_get_boolean_member(obj, "done");
+  }
+  return FALSE;
+}
+
+/* ---------- Stream decoding ----------
+ * Both formats are line based. A decoder keeps one JsonParser for the whole
+ * stream, so an event's strings stay valid until the next line is fed. */
+
+struct _StreamDecoder {
+  const ChatBackend *backend;
+  JsonParser        *parser;
+  GString           *data;      // "data:" lines of the SSE event being read
+};
+
+StreamDecoder* stream_decoder_new(const ChatBackend *backend) {
+  StreamDecoder *decoder = g_new0(StreamDecoder, 1);
+  decoder->backend = backend;
+  decoder->parser = json_parser_new();
+  decoder->data = g_string_new(NULL);
+  return decoder;
+}
+
+void stream_decoder_free(StreamDecoder *decoder) {
+  if (!decoder) return;
+  g_object_unref(decoder->parser);
+  g_string_free(decoder->data, TRUE);
+  g_free(decoder);
+}
+
+gboolean stream_decoder_feed(StreamDecoder *decoder, const gchar *line, gsize len, StreamEvent *event) {
+  *event = (StreamEvent){ .prompt_tokens = -1, .completion_tokens = -1 };
+  return decoder->backend->decode_line(decoder, line, len, event);
+}
+
+static const gchar* member_string(JsonObject *obj, const gchar *name) {
+  JsonNode *node = obj ? json_object_get_member(obj, name) : NULL;
+  return node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING
+      ? json_node_get_string(node) : NULL;
+}
+
+static JsonObject* member_object(JsonObject *obj, const gchar *name) {
+  JsonNode *node = obj ? json_object_get_member(obj, name) : NULL;
+  return node && JSON_NODE_HOLDS_OBJECT(node) ? json_node_get_object(node) : NULL;
+}
+
+static JsonObject* first_choice(JsonObject *obj) {
+  JsonNode *node = obj ? json_object_get_member(obj, "choices") : NULL;
+  JsonArray *choices = node && JSON_NODE_HOLDS_ARRAY(node) ? json_node_get_array(node) : NULL;
+  if (!choices || json_array_get_length(choices) == 0) return NULL;
+  node = json_array_get_element(choices, 0);
+  return JSON_NODE_HOLDS_OBJECT(node) ? json_node_get_object(node) : NULL;
+}
+
+/* Ollama: one JSON object per line, the last one with "done" and counts. */
+static gboolean decode_ndjson_line(StreamDecoder *decoder, const gchar *line, gsize len, StreamEvent *event) {
+  if (len == 0 || !json_parser_load_from_data(decoder->parser, line, len, NULL)) return FALSE;
+  JsonNode *root = json_parser_get_root(decoder->parser);
+  JsonObject *obj = JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+  
+  event->delta = extract_chunk_text(root);
+  event->error = member_string(obj, "error");
+  event->done = chunk_is_done(root);
+  if (event->done) {
+      event->has_usage = TRUE;
+      event->prompt_tokens = json_object_get_int_member_with_default(obj, "prompt_eval_count", -1);
+      event->completion_tokens = json_object_get_int_member_with_default(obj, "eval_count", -1);
+  }
+  return TRUE;
+}
+
+/* OpenAI: the data of one server-sent event, a chat.completion.chunk or
+ * [DONE]. With include_usage the counts come in a chunk with no choices. */
+static gboolean decode_openai_chunk(StreamDecoder *decoder, const gchar *data, gsize len, StreamEvent *event) {
+  if (len == 6 && memcmp(data, "[DONE]", 6) == 0) {
+      event->done = TRUE;
+      return TRUE;
+  }
+  if (!json_parser_load_from_data(decoder->parser, data, len, NULL)) return FALSE;
+  JsonNode *root = json_parser_get_root(decoder->parser);
+  JsonObject *obj = JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+  if (!obj) return FALSE;
+  
+  if (json_object_has_member(obj, "error")) {
+      event->error = member_string(member_object(obj, "error"), "message");
+      if (!event->error) event->error = member_string(obj, "error");
+      if (!event->error) event->error = "server error";
+  }
+  event->delta = member_string(member_object(first_choice(obj), "delta"), "content");
+  JsonObject *usage = member_object(obj, "usage");
+  if (usage) {
+      event->has_usage = TRUE;
+      event->prompt_tokens = json_object_get_int_member_with_default(usage, "prompt_tokens", -1);
+      event->completion_tokens = json_object_get_int_member_with_default(usage, "completion_tokens", -1);
+  }
+  return TRUE;
+}
+
+/* Server-sent events: "data:" lines collect until a blank line ends the
+ * event. Comments (":") and the other fields carry nothing we use. */
+static gboolean decode_sse_line(StreamDecoder *decoder, const gchar *line, gsize len, StreamEvent *event) {
+  if (len > 0) {
+      if (len >= 5 && memcmp(line, "data:", 5) == 0) {
+          line += 5;
+          len -= 5;
+          if (len > 0 && *line == ' ') {
+              line++;
+              len--;
+          }
+          if (decoder->data->len > 0) g_string_append_c(decoder->data, '\n');
+          g_string_append_len(decoder->data, line, len);
+      }
+      return FALSE;
+  }
+  if (decoder->data->len == 0) return FALSE;
+  
+  gboolean decoded = decode_openai_chunk(decoder, decoder->data->str, decoder->data->len, event);
+  g_string_truncate(decoder->data, 0);
+  return decoded;
+}
+
+/* ---------- Backends ---------- */
+
+static const gchar* openai_reply_text(JsonNode *root) {
+  JsonObject *obj = JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+  return member_string(member_object(first_choice(obj), "message"), "content");
+}
+
+static void add_model_names(JsonNode *root, const gchar *list, const gchar *key, GPtrArray *names) {
+  JsonObject *obj = JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+  JsonNode *node = obj ? json_object_get_member(obj, list) : NULL;
+  JsonArray *models = node && JSON_NODE_HOLDS_ARRAY(node) ? json_node_get_array(node) : NULL;
+  guint len = models ? json_array_get_length(models) : 0;
+  
+  for (guint i = 0; i < len; i++) {
+      JsonNode *model = json_array_get_element(models, i);
+      const gchar *name = JSON_NODE_HOLDS_OBJECT(model) ? member_string(json_node_get_object(model), key) : NULL;
+      if (name) g_ptr_array_add(names, g_strdup(name));
+  }
+}
+
+static void parse_ollama_models(JsonNode *root, GPtrArray *names) {
+  add_model_names(root, "models", "name", names);
+}
+
+static void parse_openai_models(JsonNode *root, GPtrArray *names) {
+  add_model_names(root, "data", "id", names);
+}
+
+static JsonArray* array_element(JsonNode *node, guint i) {
+  JsonArray *arr = node && JSON_NODE_HOLDS_ARRAY(node) ? json_node_get_array(node) : NULL;
+  JsonNode *element = arr && i < json_array_get_length(arr) ? json_array_get_element(arr, i) : NULL;
+  return element && JSON_NODE_HOLDS_ARRAY(element) ? json_node_get_array(element) : NULL;
+}
+
+/* {"embeddings": [[...], ...]} */
+static JsonArray* ollama_embedding(JsonNode *root, guint i) {
+  JsonObject *obj = JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+  return array_element(obj ? json_object_get_member(obj, "embeddings") : NULL, i);
+}
+
+/* {"data": [{"index": 0, "embedding": [...]}, ...]} */
+static JsonArray* openai_embedding(JsonNode *root, guint i) {
+  JsonObject *obj = JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+  JsonNode *node = obj ? json_object_get_member(obj, "data") : NULL;
+  JsonArray *data = node && JSON_NODE_HOLDS_ARRAY(node) ? json_node_get_array(node) : NULL;
+  
+  for (guint j = 0; data && j < json_array_get_length(data); j++) {
+      JsonNode *item = json_array_get_element(data, j);
+      JsonObject *entry = JSON_NODE_HOLDS_OBJECT(item) ? json_node_get_object(item) : NULL;
+      if (!entry || json_object_get_int_member_with_default(entry, "index", j) != i) continue;
+      JsonNode *embedding = json_object_get_member(entry, "embedding");
+      return embedding && JSON_NODE_HOLDS_ARRAY(embedding) ? json_node_get_array(embedding) : NULL;
+  }
+  return NULL;
+}
+
+const ChatBackend OLLAMA_BACKEND = {
+  .name = "ollama",
+  .chat_path = "/api/chat",
+  .models_path = "/api/tags",
+  .embed_path = "/api/embed",
+  .model_residency = TRUE,
+  .build_chat_body = build_ollama_chat_body,
+  .decode_line = decode_ndjson_line,
+  .reply_text = extract_chunk_text,
+  .parse_models = parse_ollama_models,
+  .embedding = ollama_embedding,
+};
+
+const ChatBackend OPENAI_BACKEND = {
+  .name = "openai",
+  .chat_path = "/chat/completions",
+  .models_path = "/models",
+  .embed_path = "/embeddings",
+  .model_residency = FALSE,
+  .build_chat_body = build_openai_chat_body,
+  .decode_line = decode_sse_line,
+  .reply_text = openai_reply_text,
+  .parse_models = parse_openai_models,
+  .embedding = openai_embedding,
+};
+
+const ChatBackend* chat_backend_for_url(const gchar *base_url) {
+  if (g_strcmp0(CHAT_BACKEND, OPENAI_BACKEND.name) == 0) return &OPENAI_BACKEND;
+  if (g_strcmp0(CHAT_BACKEND, OLLAMA_BACKEND.name) == 0) return &OLLAMA_BACKEND;
+  
+  // OpenAI-compatible servers are addressed by their /v1 root
+  if (!base_url) base_url = OLLAMA_BASE_URL;
+  gsize len = strlen(base_url);
+  while (len > 0 && base_url[len - 1] == '/') len--;
+  return len >= 3 && strncmp(base_url + len - 3, "/v1", 3) == 0 ? &OPENAI_BACKEND : &OLLAMA_BACKEND;
+}
+
+/* ---------- Hedged requests ----------
+ * The primary endpoint is always tried first. If it has not produced a token
+ * after the hedge delay (a percentile of recent TTFTs), the same body is sent
+ * to the hedge endpoint. The first leg to produce a token wins; the loser is
+ * cancelled through its own GCancellable. */
+
+typedef struct _HedgeRace HedgeRace;
+
+typedef struct {
+  HedgeRace    *race;
+  gint          index;
+  gchar        *base_url;
+  const ChatBackend *backend;
+  GBytes       *body;          // Shared by both legs when they speak the same format
+  GCancellable *cancellable;
+  GThread      *thread;
+  gboolean      finished;
+  gboolean      saw_done;      // The final chunk arrived
+  gchar        *error;
+} StreamLeg;
+
+struct _HedgeRace {
+  const StreamCallbacks *callbacks;
+  gpointer    user_data;
+  GMutex      lock;
+  GCond       cond;
+  gint        winner;      // Index of the winning leg, -1 until the first token
+  gint64      start_time;
+  gint64      ttft;
+  StreamLeg   legs[2];
+  guint       n_legs;
+};
+
+static gboolean hedge_race_claim(HedgeRace *race, StreamLeg *leg) {
+  gboolean won;
+  
+  g_mutex_lock(&race->lock);
+  if (race->winner < 0) {
+      race->winner = leg->index;
+      race->ttft = g_get_monotonic_time() - race->start_time;
+      for (guint i = 0; i < G_N_ELEMENTS(race->legs); i++) {
+          if (&race->legs[i] != leg) g_cancellable_cancel(race->legs[i].cancellable);
+      }
+      g_cond_broadcast(&race->cond);
+  }
+  won = race->winner == leg->index;
+  g_mutex_unlock(&race->lock);
+  return won;
+}
+
+static gpointer stream_leg_worker(gpointer data) {
+  StreamLeg *leg = (StreamLeg*)data;
+  HedgeRace *race = leg->race;
+  
+  gchar *url = ollama_url(leg->base_url, leg->backend->chat_path);
+  SoupSession *session = ollama_session(leg->base_url);
+  
+  SoupMessage *msg = soup_message_new("POST", url);
+  soup_message_headers_append(soup_message_get_request_headers(msg), "Content-Type", "application/json");
+  soup_message_set_request_body_from_bytes(msg, "application/json", leg->body);
+  GError *err = NULL;
+  gint64 trace_send = TRACE_BEGIN();
+  GInputStream *stream = soup_session_send(session, msg, leg->cancellable, &err);
+  TRACE_END(trace_send, "send", leg->base_url);
+  if (stream && !SOUP_STATUS_IS_SUCCESSFUL(soup_message_get_status(msg))) {
+      err = g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED, "HTTP %u %s", soup_message_get_status(msg),
+                        soup_message_get_reason_phrase(msg));
+      g_clear_object(&stream);
+  }
+  if (stream) {
+      GDataInputStream *din = g_data_input_stream_new(stream);
+      g_data_input_stream_set_newline_type(din, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+      gsize din_size = g_buffered_input_stream_get_buffer_size(G_BUFFERED_INPUT_STREAM(din));
+      memory_account(MEM_NETWORK, din_size, 1);
+      StreamDecoder *decoder = stream_decoder_new(leg->backend);
+      gboolean first_line = TRUE;
+      while (!g_cancellable_is_cancelled(leg->cancellable)) {
+          gsize len = 0;
+          gchar *line = g_data_input_stream_read_line_utf8(din, &len, leg->cancellable, &err);
+          if (!line) break;
+          if (first_line && len > 0) {
+              TRACE_INSTANT("first-byte", leg->base_url);
+              first_line = FALSE;
+          }
+          gint64 trace_decode = TRACE_BEGIN();
+          StreamEvent event;
+          gboolean stop = FALSE;
+          if (stream_decoder_feed(decoder, line, len, &event)) {
+              gboolean has_delta = event.delta && *event.delta;
+              
+              if (event.error) {
+                  err = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_FAILED, event.error);
+                  stop = TRUE;
+              } else if ((has_delta || event.done) && !hedge_race_claim(race, leg)) {
+                  stop = TRUE;
+              } else {
+                  if (has_delta && race->callbacks && race->callbacks->delta) {
+                      race->callbacks->delta(event.delta, race->user_data);
+                  }
+                  if (event.has_usage && race->callbacks && race->callbacks->usage) {
+                      race->callbacks->usage(event.prompt_tokens, event.completion_tokens, race->user_data);
+                  }
+                  stop = event.done;
+                  if (event.done) leg->saw_done = TRUE;
+              }
+              TRACE_END(trace_decode, "decode", NULL);
+          }
+          g_free(line);
+          if (stop) break;
+      }
+      stream_decoder_free(decoder);
+      g_object_unref(din);
+      memory_account(MEM_NETWORK, -(gssize)din_size, -1);
+      g_object_unref(stream);
+  }
+  
+  g_mutex_lock(&race->lock);
+  leg->finished = TRUE;
+  // A reply cut off by EOF is not a complete reply
+  if (!err && race->winner == leg->index && !leg->saw_done &&
+      !g_cancellable_is_cancelled(leg->cancellable)) {
+      err = g_error_new_literal(G_IO_ERROR, G_IO_ERROR_FAILED, "stream ended before done");
+  }
+  if (err) leg->error = g_strdup(err->message);
+  g_cond_broadcast(&race->cond);
+  g_mutex_unlock(&race->lock);
+  
+  if (err) g_error_free(err);
+  g_object_unref(msg);
+  g_free(url);
+  return NULL;
+}
+
+/* Must be called with race->lock held. */
+static void hedge_race_start_leg(HedgeRace *race, const gchar *base_url) {
+  StreamLeg *leg = &race->legs[race->n_legs];
+  leg->base_url = g_strdup(base_url);
+  leg->thread = g_thread_new(race->n_legs == 0 ? "ganesha-ollama" : "ganesha-hedge",
+                             stream_leg_worker, leg);
+  race->n_legs++;
+}
+
+static gboolean hedge_race_all_finished(HedgeRace *race) {
+  for (guint i = 0; i < race->n_legs; i++) {
+      if (!race->legs[i].finished) return FALSE;
+  }
+  return TRUE;
+}
+
+static void on_race_cancelled(GCancellable *cancellable, gpointer data) {
+  (void)cancellable;
+  HedgeRace *race = (HedgeRace*)data;
+  for (guint i = 0; i < G_N_ELEMENTS(race->legs); i++) {
+      g_cancellable_cancel(race->legs[i].cancellable);
+  }
+}
+
+static GBytes* build_chat_body_bytes(const ChatBackend *backend, StreamRequest *req, GArray *messages,
+                                     const ContextPlan *plan) {
+  gint64 trace_body = TRACE_BEGIN();
+  gchar *body_json = backend->build_chat_body(req->model, messages, plan, req->keep_alive);
+  gsize len = strlen(body_json);
+  TRACE_ENDF(trace_body, "build-body", "%s, %zu bytes", backend->name, len);
+  memory_account(MEM_NETWORK, len, 1);
+  return g_bytes_new_take(body_json, len);
+}
+
+static gint64 hedge_delay_ms(gdouble percentile) {
+  gint64 delay = telemetry_ttft_percentile(percentile);
+  if (delay < 0) return HEDGE_DEFAULT_DELAY_MS;
+  return CLAMP(delay, HEDGE_MIN_DELAY_MS, HEDGE_MAX_DELAY_MS);
+}
+
+gboolean ollama_stream_chat(StreamRequest *req, GArray *messages, const ContextPlan *plan,
+                            const StreamCallbacks *callbacks, gpointer user_data,
+                            GCancellable *c, GError **error) {
+  gint64 trace_request = TRACE_BEGIN();
+  const gchar *primary_url = req->base_url ? req->base_url : OLLAMA_BASE_URL;
+  SoupSession *probe = NULL;
+  GPtrArray *resident_before = NULL;
+  if (req->affinity_policy != AFFINITY_OFF) {
+      gint64 trace_affinity = TRACE_BEGIN();
+      probe = ollama_session_new(primary_url, 10);
+      resident_before = schedule_model_affinity(probe, primary_url, req->affinity_policy,
+                                                req->server_memory, req->server_max_models,
+                                                &req->model, callbacks, user_data, c);
+      TRACE_END(trace_affinity, "affinity", req->model);
+  }
+  
+  HedgeRace *race = g_new0(HedgeRace, 1);
+  race->callbacks = callbacks;
+  race->user_data = user_data;
+  // Each endpoint gets the body in its own format; one body when they agree
+  race->legs[0].backend = chat_backend_for_url(primary_url);
+  race->legs[0].body = build_chat_body_bytes(race->legs[0].backend, req, messages, plan);
+  race->legs[1].backend = req->hedge_url ? chat_backend_for_url(req->hedge_url) : race->legs[0].backend;
+  race->legs[1].body = race->legs[1].backend == race->legs[0].backend
+      ? g_bytes_ref(race->legs[0].body)
+      : build_chat_body_bytes(race->legs[1].backend, req, messages, plan);
+  race->winner = -1;
+  race->ttft = -1;
+  g_mutex_init(&race->lock);
+  g_cond_init(&race->cond);
+  for (guint i = 0; i < G_N_ELEMENTS(race->legs); i++) {
+      race->legs[i].race = race;
+      race->legs[i].index = i;
+      race->legs[i].cancellable = g_cancellable_new();
+  }
+  gulong cancel_id = c ? g_cancellable_connect(c, G_CALLBACK(on_race_cancelled), race, NULL) : 0;
+  
+  gint64 delay = hedge_delay_ms(req->hedge_percentile);
+  race->start_time = g_get_monotonic_time();
+  gint64 deadline = race->start_time + delay * G_TIME_SPAN_MILLISECOND;
+  
+  g_mutex_lock(&race->lock);
+  hedge_race_start_leg(race, primary_url);
+  while (race->winner < 0 && !g_cancellable_is_cancelled(c)) {
+      gboolean all_finished = hedge_race_all_finished(race);
+      if (req->hedge_url && race->n_legs == 1) {
+          // Hedge on timeout, or fail over at once if the primary already gave up
+          if (all_finished || g_get_monotonic_time() >= deadline) {
+              hedge_race_start_leg(race, req->hedge_url);
+              continue;
+          }
+          g_cond_wait_until(&race->cond, &race->lock, deadline);
+      } else {
+          if (all_finished) break;
+          g_cond_wait(&race->cond, &race->lock);
+      }
+  }
+  g_mutex_unlock(&race->lock);
+  
+  // The winner keeps streaming; wait for every leg to wind down
+  for (guint i = 0; i < race->n_legs; i++) {
+      g_thread_join(race->legs[i].thread);
+  }
+  if (c) g_cancellable_disconnect(c, cancel_id);
+  
+  // A winner that broke off mid-stream still counts as a failure
+  gboolean ok = (race->winner >= 0 && !race->legs[race->winner].error) || g_cancellable_is_cancelled(c);
+  if (!ok) {
+      const gchar *message = race->winner >= 0 ? race->legs[race->winner].error : NULL;
+      for (guint i = 0; i < race->n_legs && !message; i++) {
+          message = race->legs[i].error;
+      }
+      g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_FAILED, message ? message : "unknown");
+  }
+  
+  gboolean hedged = race->n_legs > 1;
+  telemetry_record_request(hedged, race->winner == 1,
+                           race->winner >= 0 ? race->ttft / G_TIME_SPAN_MILLISECOND : -1);
+  if (hedged) {
+      g_debug("hedge: delay %" G_GINT64_FORMAT " ms, winner leg %d", delay, race->winner);
+  }
+  
+  if (resident_before) {
+      GPtrArray *resident_after = fetch_running_models(probe, primary_url);
+      observe_running_models(resident_after);
+      telemetry_record_model_swap(!find_running_model(resident_before, req->model),
+                                  count_evictions(resident_before, resident_after, req->model));
+      if (resident_after) g_ptr_array_unref(resident_after);
+      g_ptr_array_unref(resident_before);
+  }
+  if (probe) g_object_unref(probe);
+  
+  for (guint i = 0; i < G_N_ELEMENTS(race->legs); i++) {
+      g_free(race->legs[i].base_url);
+      g_free(race->legs[i].error);
+      g_object_unref(race->legs[i].cancellable);
+      if (i == 0 || race->legs[i].body != race->legs[0].body) {
+          memory_account(MEM_NETWORK, -(gssize)g_bytes_get_size(race->legs[i].body), -1);
+      }
+      g_bytes_unref(race->legs[i].body);
+  }
+  g_mutex_clear(&race->lock);
+  g_cond_clear(&race->cond);
+  g_free(race);
+  TRACE_ENDF(trace_request, "request", "%s%s", req->model, ok ? "" : " (failed)");
+  return ok;
+}
+
+/* ---------- Summaries ---------- */
+
+static const char *COMPACTION_PROMPT =
+  "You maintain a running summary of a chat between a user and an assistant. "
+  "Merge the new turns into the current summary. Keep facts, decisions, names, "
+  "code identifiers and open questions; drop pleasantries. "
+  "Reply with the updated summary only.";
+
+gchar* ollama_summarize(const gchar *base_url, const gchar *model, const gchar *request, gint num_ctx,
+                        const gchar *keep_alive, GCancellable *cancellable) {
+  const ChatBackend *backend = chat_backend_for_url(base_url);
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, model);
+  json_builder_set_member_name(b, "stream");
+  json_builder_add_boolean_value(b, FALSE);
+  // The request was sized for num_ctx; without it Ollama would cut it at the model default
+  if (backend == &OLLAMA_BACKEND) {
+      if (keep_alive && *keep_alive) {
+          json_builder_set_member_name(b, "keep_alive");
+          json_builder_add_string_value(b, keep_alive);
+      }
+      json_builder_set_member_name(b, "options");
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "num_ctx");
+      json_builder_add_int_value(b, num_ctx);
+      json_builder_end_object(b);
+  }
+  json_builder_set_member_name(b, "messages");
+  json_builder_begin_array(b);
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "role");
+  json_builder_add_string_value(b, "system");
+  json_builder_set_member_name(b, "content");
+  json_builder_add_string_value(b, COMPACTION_PROMPT);
+  json_builder_end_object(b);
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "role");
+  json_builder_add_string_value(b, "user");
+  json_builder_set_member_name(b, "content");
+  json_builder_add_string_value(b, request);
+  json_builder_end_object(b);
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gsize len = 0;
+  gchar *body_json = json_generator_to_data(gen, &len);
+  g_object_unref(gen);
+  json_node_free(root);
+  g_object_unref(b);
+  
+  // Text-only, unstreamed: apart from the options the same body suits both formats
+  gchar *url = ollama_url(base_url, backend->chat_path);
+  SoupMessage *msg = soup_message_new("POST", url);
+  GBytes *body = g_bytes_new_take(body_json, len);
+  soup_message_set_request_body_from_bytes(msg, "application/json", body);
+  g_bytes_unref(body);
+  GBytes *response_bytes = soup_session_send_and_read(ollama_session(base_url), msg, cancellable, NULL);
+  
+  gchar *summary = NULL;
+  if (response_bytes) {
+      gsize size;
+      gconstpointer data_ptr = g_bytes_get_data(response_bytes, &size);
+      JsonParser *parser = json_parser_new();
+      if (json_parser_load_from_data(parser, data_ptr, size, NULL)) {
+          const char *text = backend->reply_text(json_parser_get_root(parser));
+          if (text) summary = g_strstrip(g_strdup(text));
+      }
+      g_object_unref(parser);
+      g_bytes_unref(response_bytes);
+  }
+  
+  g_object_unref(msg);
+  g_free(url);
+  return summary;
+}
+
+/* ---------- Embeddings ---------- */
+
+gfloat* ollama_embed(const gchar *base_url, const gchar *model, const gchar * const *texts, guint n,
+                     guint *dim, GCancellable *cancellable, GError **error) {
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, model);
+  json_builder_set_member_name(b, "input");
+  json_builder_begin_array(b);
+  for (guint i = 0; i < n; i++) json_builder_add_string_value(b, texts[i]);
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+  gchar *body_json = builder_to_data(b);
+  g_object_unref(b);
+  
+  // {"model", "input": [...]} is accepted by both formats
+  const ChatBackend *backend = chat_backend_for_url(base_url);
+  gchar *url = ollama_url(base_url, backend->embed_path);
+  SoupMessage *msg = soup_message_new("POST", url);
+  GBytes *body = g_bytes_new_take(body_json, strlen(body_json));
+  soup_message_set_request_body_from_bytes(msg, "application/json", body);
+  g_bytes_unref(body);
+  GBytes *response_bytes = soup_session_send_and_read(ollama_session(base_url), msg, cancellable, error);
+  
+  gfloat *vectors = NULL;
+  if (response_bytes && soup_message_get_status(msg) != SOUP_STATUS_OK) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Embedding with %s failed: HTTP %u",
+                  model, soup_message_get_status(msg));
+  } else if (response_bytes) {
+      gsize size;
+      gconstpointer data_ptr = g_bytes_get_data(response_bytes, &size);
+      JsonParser *parser = json_parser_new();
+      if (json_parser_load_from_data(parser, data_ptr, size, error)) {
+          JsonNode *root = json_parser_get_root(parser);
+          JsonArray *first = n > 0 ? backend->embedding(root, 0) : NULL;
+          guint d = first ? json_array_get_length(first) : 0;
+          if (d > 0) vectors = g_new(gfloat, (gsize)n * d);
+          
+          for (guint i = 0; vectors && i < n; i++) {
+              JsonArray *v = backend->embedding(root, i);
+              if (!v || json_array_get_length(v) != d) {
+                  g_clear_pointer(&vectors, g_free);
+                  break;
+              }
+              for (guint k = 0; k < d; k++) vectors[(gsize)i * d + k] = json_array_get_double_element(v, k);
+          }
+          if (vectors) {
+              *dim = d;
+          } else {
+              g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s returned no embeddings", model);
+          }
+      }
+      g_object_unref(parser);
+  }
+  
+  if (response_bytes) g_bytes_unref(response_bytes);
+  g_object_unref(msg);
+  g_free(url);
+  return vectors;
+}
@@ -0,0 +1,764 @@
+#include "ganesha-core.h"
+
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* ---------- Documents ----------
+ * Retrieval over local files. Files are split into chunks of whole lines on
+ * a thread pool, embedded through the backend's embedding endpoint and
+ * written to one index file, which searches read through a read-only
+ * mapping. An index is never modified: adding documents writes a new file
+ * and opens it as a new RagIndex, so a search can keep using the old one.
+ *
+ * File layout, in host byte order:
+ *   RagHeader
+ *   centroids    n_lists x dim floats (IVF only)
+ *   list_start   n_lists + 1 guint32 (IVF only)
+ *   vectors      n_chunks x dim floats of unit length, grouped by list
+ *   padding to 8 bytes
+ *   chunks       n_chunks x RagChunkRecord
+ *   sources      n_sources x guint64, offsets of NUL-terminated paths in text
+ *   text         chunk texts, then source paths */
+
+#define RAG_MAGIC              "GNSHRAG1"
+#define RAG_MAX_DIM            8192
+#define RAG_IVF_TRAIN_PER_LIST 64     // k-means sample size per list
+#define RAG_EMBED_BATCH_MAX    256
+#define RAG_TOP_K_MAX          32
+
+typedef struct {
+  gchar   magic[8];
+  guint32 dim;
+  guint32 n_chunks;
+  guint32 n_sources;
+  guint32 n_lists;
+  guint64 text_bytes;
+  gchar   model[64];      // Embedding model the vectors came from
+} RagHeader;
+
+typedef struct {
+  guint64 text_offset;
+  guint32 text_len;
+  guint32 source;
+  guint32 line;
+  guint32 reserved;
+} RagChunkRecord;
+
+typedef struct {
+  gsize centroids;
+  gsize list_start;
+  gsize vectors;
+  gsize chunks;
+  gsize sources;
+  gsize text;
+  gsize end;
+} RagLayout;
+
+struct _RagIndex {
+  gint                  ref_count;
+  gchar                *path;
+  GMappedFile          *file;      // NULL for an empty index
+  const RagHeader      *header;
+  const gfloat         *centroids;
+  const guint32        *list_start;
+  const gfloat         *vectors;
+  const RagChunkRecord *chunks;
+  const guint64        *sources;
+  const gchar          *text;
+};
+
+static void rag_layout(guint dim, guint n_chunks, guint n_sources, guint n_lists, guint64 text_bytes,
+                       RagLayout *layout) {
+  layout->centroids = sizeof(RagHeader);
+  layout->list_start = layout->centroids + (gsize)n_lists * dim * sizeof(gfloat);
+  layout->vectors = layout->list_start + (n_lists ? (gsize)(n_lists + 1) * sizeof(guint32) : 0);
+  layout->chunks = (layout->vectors + (gsize)n_chunks * dim * sizeof(gfloat) + 7) & ~(gsize)7;
+  layout->sources = layout->chunks + (gsize)n_chunks * sizeof(RagChunkRecord);
+  layout->text = layout->sources + (gsize)n_sources * sizeof(guint64);
+  layout->end = layout->text + text_bytes;
+}
+
+gchar* get_documents_path(void) {
+  gchar *app_dir = g_build_filename(g_get_user_config_dir(), "ganesha", NULL);
+  g_mkdir_with_parents(app_dir, 0755);
+  gchar *path = g_build_filename(app_dir, DOCUMENTS_FILE, NULL);
+  g_free(app_dir);
+  return path;
+}
+
+/* ---------- Similarity ----------
+ * Vectors are stored at unit length, so the dot product is the cosine
+ * similarity. The kernel uses GCC vector extensions, which compile to SSE
+ * or NEON on any target; on x86-64 with glibc an AVX2 clone is picked at
+ * load time when the CPU has it. Other compilers get the scalar loop. */
+
+#if defined(__GNUC__)
+typedef gfloat RagVec8 __attribute__((vector_size(32)));
+#if defined(__x86_64__) && defined(__GLIBC__)
+#define RAG_TARGET_CLONES __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef RAG_TARGET_CLONES
+#define RAG_TARGET_CLONES
+#endif
+
+RAG_TARGET_CLONES
+gfloat rag_dot(const gfloat *a, const gfloat *b, guint n) {
+  gfloat sum = 0.0f;
+  guint i = 0;
+#if defined(__GNUC__)
+  RagVec8 acc0 = { 0 }, acc1 = { 0 };
+  for (; i + 16 <= n; i += 16) {
+      RagVec8 a0, a1, b0, b1;
+      // memcpy compiles to unaligned loads; the mapping only guarantees 4-byte alignment
+      memcpy(&a0, a + i, sizeof(a0));
+      memcpy(&b0, b + i, sizeof(b0));
+      memcpy(&a1, a + i + 8, sizeof(a1));
+      memcpy(&b1, b + i + 8, sizeof(b1));
+      acc0 += a0 * b0;
+      acc1 += a1 * b1;
+  }
+  RagVec8 acc = acc0 + acc1;
+  for (guint k = 0; k < 8; k++) sum += acc[k];
+#endif
+  for (; i < n; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+static void normalize(gfloat *v, guint dim) {
+  gfloat norm = sqrtf(rag_dot(v, v, dim));
+  if (norm <= 0.0f) return;
+  for (guint i = 0; i < dim; i++) v[i] /= norm;
+}
+
+static guint nearest_centroid(const gfloat *centroids, guint n_lists, const gfloat *v, guint dim) {
+  guint best = 0;
+  gfloat best_score = -G_MAXFLOAT;
+  for (guint c = 0; c < n_lists; c++) {
+      gfloat score = rag_dot(centroids + (gsize)c * dim, v, dim);
+      if (score > best_score) {
+          best_score = score;
+          best = c;
+      }
+  }
+  return best;
+}
+
+/* ---------- Opening ---------- */
+
+static RagIndex* rag_index_new_empty(const gchar *path) {
+  RagIndex *index = g_new0(RagIndex, 1);
+  index->ref_count = 1;
+  index->path = g_strdup(path);
+  return index;
+}
+
+static gboolean rag_index_map(RagIndex *index, GMappedFile *file) {
+  gsize size = g_mapped_file_get_length(file);
+  const gchar *data = g_mapped_file_get_contents(file);
+  if (size < sizeof(RagHeader)) return FALSE;
+
+  const RagHeader *header = (const RagHeader*)data;
+  if (memcmp(header->magic, RAG_MAGIC, sizeof(header->magic)) != 0) return FALSE;
+  if (header->dim == 0 || header->dim > RAG_MAX_DIM || header->model[sizeof(header->model) - 1]) return FALSE;
+  // Bounded before the layout is computed so it cannot overflow
+  if (header->text_bytes > size || header->n_chunks > size / sizeof(RagChunkRecord) ||
+      header->n_sources > size / sizeof(guint64) || header->n_lists > header->n_chunks) return FALSE;
+
+  RagLayout layout;
+  rag_layout(header->dim, header->n_chunks, header->n_sources, header->n_lists, header->text_bytes, &layout);
+  if (layout.end != size) return FALSE;
+
+  index->header = header;
+  index->centroids = header->n_lists ? (const gfloat*)(data + layout.centroids) : NULL;
+  index->list_start = header->n_lists ? (const guint32*)(data + layout.list_start) : NULL;
+  index->vectors = (const gfloat*)(data + layout.vectors);
+  index->chunks = (const RagChunkRecord*)(data + layout.chunks);
+  index->sources = (const guint64*)(data + layout.sources);
+  index->text = data + layout.text;
+
+  // Every offset is checked once here so searches can trust them
+  if (header->n_sources > 0 && (header->text_bytes == 0 || index->text[header->text_bytes - 1])) return FALSE;
+  for (guint i = 0; i < header->n_sources; i++) {
+      if (index->sources[i] >= header->text_bytes) return FALSE;
+  }
+  for (guint i = 0; i < header->n_chunks; i++) {
+      const RagChunkRecord *rec = &index->chunks[i];
+      if (rec->source >= header->n_sources || rec->text_offset > header->text_bytes ||
+          rec->text_len > header->text_bytes - rec->text_offset) return FALSE;
+  }
+  for (guint i = 0; i < header->n_lists; i++) {
+      if (index->list_start[i] > index->list_start[i + 1]) return FALSE;
+  }
+  if (header->n_lists && (index->list_start[0] != 0 || index->list_start[header->n_lists] != header->n_chunks)) {
+      return FALSE;
+  }
+  return TRUE;
+}
+
+RagIndex* rag_index_open(const gchar *path, GError **error) {
+  GError *local_error = NULL;
+  GMappedFile *file = g_mapped_file_new(path, FALSE, &local_error);
+  if (!file) {
+      if (g_error_matches(local_error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+          g_error_free(local_error);
+          return rag_index_new_empty(path);
+      }
+      g_propagate_error(error, local_error);
+      return NULL;
+  }
+
+  RagIndex *index = rag_index_new_empty(path);
+  if (!rag_index_map(index, file)) {
+      g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s is not a document index", path);
+      g_mapped_file_unref(file);
+      rag_index_unref(index);
+      return NULL;
+  }
+  index->file = file;
+  memory_account(MEM_DOCUMENTS, g_mapped_file_get_length(file), 1);
+  return index;
+}
+
+RagIndex* rag_index_ref(RagIndex *index) {
+  g_atomic_int_inc(&index->ref_count);
+  return index;
+}
+
+void rag_index_unref(RagIndex *index) {
+  if (!index || !g_atomic_int_dec_and_test(&index->ref_count)) return;
+  if (index->file) {
+      memory_account(MEM_DOCUMENTS, -(gssize)g_mapped_file_get_length(index->file), -1);
+      g_mapped_file_unref(index->file);
+  }
+  g_free(index->path);
+  g_free(index);
+}
+
+guint rag_index_n_chunks(RagIndex *index) {
+  return index->header ? index->header->n_chunks : 0;
+}
+
+guint rag_index_n_sources(RagIndex *index) {
+  return index->header ? index->header->n_sources : 0;
+}
+
+guint rag_index_dim(RagIndex *index) {
+  return index->header ? index->header->dim : 0;
+}
+
+const gchar* rag_index_model(RagIndex *index) {
+  return index->header ? index->header->model : NULL;
+}
+
+void rag_index_chunk(RagIndex *index, guint i, RagChunk *chunk) {
+  const RagChunkRecord *rec = &index->chunks[i];
+  chunk->source = index->text + index->sources[rec->source];
+  chunk->line = rec->line;
+  chunk->text = index->text + rec->text_offset;
+  chunk->len = rec->text_len;
+  chunk->vector = index->vectors + (gsize)i * index->header->dim;
+}
+
+/* ---------- Writing ---------- */
+
+typedef struct {
+  FILE    *out;
+  gboolean ok;
+} RagWriter;
+
+static void write_bytes(RagWriter *w, gconstpointer data, gsize len) {
+  if (w->ok && len > 0 && fwrite(data, 1, len, w->out) != len) w->ok = FALSE;
+}
+
+static void write_padding(RagWriter *w, gsize from, gsize to) {
+  static const gchar zeros[8] = { 0 };
+  write_bytes(w, zeros, to - from);
+}
+
+/* Spherical k-means over a sample of the vectors. Returns the list of
+ * every chunk and fills n_lists x dim unit centroids. */
+static guint32* ivf_train(const RagChunk *chunks, guint n_chunks, guint dim, guint n_lists, gfloat *centroids) {
+  for (guint c = 0; c < n_lists; c++) {
+      memcpy(centroids + (gsize)c * dim, chunks[(gsize)c * n_chunks / n_lists].vector, dim * sizeof(gfloat));
+  }
+
+  guint stride = MAX(1, n_chunks / (n_lists * RAG_IVF_TRAIN_PER_LIST));
+  gfloat *sums = g_new(gfloat, (gsize)n_lists * dim);
+  guint *counts = g_new(guint, n_lists);
+  for (guint iter = 0; iter < RAG_IVF_ITERATIONS; iter++) {
+      memset(sums, 0, (gsize)n_lists * dim * sizeof(gfloat));
+      memset(counts, 0, n_lists * sizeof(guint));
+      for (guint i = 0; i < n_chunks; i += stride) {
+          guint c = nearest_centroid(centroids, n_lists, chunks[i].vector, dim);
+          gfloat *sum = sums + (gsize)c * dim;
+          for (guint k = 0; k < dim; k++) sum[k] += chunks[i].vector[k];
+          counts[c]++;
+      }
+      // A list that lost all its members keeps its old centroid
+      for (guint c = 0; c < n_lists; c++) {
+          if (counts[c] == 0) continue;
+          memcpy(centroids + (gsize)c * dim, sums + (gsize)c * dim, dim * sizeof(gfloat));
+          normalize(centroids + (gsize)c * dim, dim);
+      }
+  }
+  g_free(counts);
+  g_free(sums);
+
+  guint32 *lists = g_new(guint32, n_chunks);
+  for (guint i = 0; i < n_chunks; i++) {
+      lists[i] = nearest_centroid(centroids, n_lists, chunks[i].vector, dim);
+  }
+  return lists;
+}
+
+RagIndex* rag_index_write(const gchar *path, const gchar *model, guint dim,
+                          const RagChunk *chunks, guint n_chunks, GError **error) {
+  gint64 trace_write = TRACE_BEGIN();
+  if (dim == 0 || dim > RAG_MAX_DIM || strlen(model) >= sizeof(((RagHeader*)NULL)->model)) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Unsupported embeddings (%u dimensions from %s)",
+                  dim, model);
+      return NULL;
+  }
+
+  // Sources in order of first use
+  GHashTable *source_ids = g_hash_table_new(g_str_hash, g_str_equal);
+  GPtrArray *sources = g_ptr_array_new();
+  guint32 *chunk_source = g_new(guint32, MAX(n_chunks, 1));
+  guint64 text_bytes = 0;
+  for (guint i = 0; i < n_chunks; i++) {
+      gpointer id;
+      if (!g_hash_table_lookup_extended(source_ids, chunks[i].source, NULL, &id)) {
+          id = GUINT_TO_POINTER(sources->len);
+          g_hash_table_insert(source_ids, (gpointer)chunks[i].source, id);
+          g_ptr_array_add(sources, (gpointer)chunks[i].source);
+          text_bytes += strlen(chunks[i].source) + 1;
+      }
+      chunk_source[i] = GPOINTER_TO_UINT(id);
+      text_bytes += chunks[i].len;
+  }
+
+  // Large corpora are split into lists; order holds the chunks list by list
+  guint n_lists = n_chunks >= RAG_IVF_MIN_CHUNKS ? (guint)sqrt((double)n_chunks) : 0;
+  gfloat *centroids = n_lists ? g_new(gfloat, (gsize)n_lists * dim) : NULL;
+  guint32 *list_start = n_lists ? g_new0(guint32, n_lists + 1) : NULL;
+  guint32 *order = g_new(guint32, MAX(n_chunks, 1));
+  if (n_lists) {
+      guint32 *lists = ivf_train(chunks, n_chunks, dim, n_lists, centroids);
+      for (guint i = 0; i < n_chunks; i++) list_start[lists[i] + 1]++;
+      for (guint c = 0; c < n_lists; c++) list_start[c + 1] += list_start[c];
+      guint32 *fill = g_memdup2(list_start, n_lists * sizeof(guint32));
+      for (guint i = 0; i < n_chunks; i++) order[fill[lists[i]]++] = i;
+      g_free(fill);
+      g_free(lists);
+  } else {
+      for (guint i = 0; i < n_chunks; i++) order[i] = i;
+  }
+
+  RagHeader header = { .dim = dim, .n_chunks = n_chunks, .n_sources = sources->len,
+                       .n_lists = n_lists, .text_bytes = text_bytes };
+  memcpy(header.magic, RAG_MAGIC, sizeof(header.magic));
+  g_strlcpy(header.model, model, sizeof(header.model));
+  RagLayout layout;
+  rag_layout(dim, n_chunks, sources->len, n_lists, text_bytes, &layout);
+
+  // Written next to the old file and renamed over it; a mapping of the old one stays valid
+  gchar *tmp_path = g_strconcat(path, ".tmp", NULL);
+  RagWriter w = { .out = g_fopen(tmp_path, "wb"), .ok = TRUE };
+  if (!w.out) {
+      w.ok = FALSE;
+  } else {
+      write_bytes(&w, &header, sizeof(header));
+      if (n_lists) {
+          write_bytes(&w, centroids, (gsize)n_lists * dim * sizeof(gfloat));
+          write_bytes(&w, list_start, (n_lists + 1) * sizeof(guint32));
+      }
+      for (guint i = 0; i < n_chunks; i++) {
+          write_bytes(&w, chunks[order[i]].vector, dim * sizeof(gfloat));
+      }
+      write_padding(&w, layout.vectors + (gsize)n_chunks * dim * sizeof(gfloat), layout.chunks);
+
+      guint64 offset = 0;
+      for (guint i = 0; i < n_chunks; i++) {
+          const RagChunk *chunk = &chunks[order[i]];
+          RagChunkRecord rec = { .text_offset = offset, .text_len = (guint32)chunk->len,
+                                 .source = chunk_source[order[i]], .line = chunk->line };
+          write_bytes(&w, &rec, sizeof(rec));
+          offset += chunk->len;
+      }
+      for (guint s = 0; s < sources->len; s++) {
+          write_bytes(&w, &offset, sizeof(offset));
+          offset += strlen(g_ptr_array_index(sources, s)) + 1;
+      }
+      for (guint i = 0; i < n_chunks; i++) {
+          write_bytes(&w, chunks[order[i]].text, chunks[order[i]].len);
+      }
+      for (guint s = 0; s < sources->len; s++) {
+          const gchar *source = g_ptr_array_index(sources, s);
+          write_bytes(&w, source, strlen(source) + 1);
+      }
+      if (fclose(w.out) != 0) w.ok = FALSE;
+  }
+
+  RagIndex *index = NULL;
+  if (!w.ok || g_rename(tmp_path, path) != 0) {
+      gint saved_errno = errno;
+      g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno), "Could not write %s: %s",
+                  path, g_strerror(saved_errno));
+      g_unlink(tmp_path);
+  } else {
+      index = rag_index_open(path, error);
+  }
+
+  g_free(tmp_path);
+  g_free(order);
+  g_free(list_start);
+  g_free(centroids);
+  g_free(chunk_source);
+  g_ptr_array_unref(sources);
+  g_hash_table_unref(source_ids);
+  TRACE_ENDF(trace_write, "index-write", "%u chunks, %u lists", n_chunks, n_lists);
+  return index;
+}
+
+/* ---------- Search ---------- */
+
+/* Keeps hits sorted best first; returns the new count. */
+static guint insert_hit(RagHit *hits, guint count, guint k, gfloat score, guint chunk) {
+  if (count == k && score <= hits[k - 1].score) return count;
+  guint pos = count < k ? count++ : k - 1;
+  while (pos > 0 && hits[pos - 1].score < score) {
+      hits[pos] = hits[pos - 1];
+      pos--;
+  }
+  hits[pos].score = score;
+  hits[pos].chunk.line = chunk;   // Index until rag_index_search fills the hit in
+  return count;
+}
+
+static guint scan_range(RagIndex *index, const gfloat *query, guint from, guint to,
+                        RagHit *hits, guint count, guint k) {
+  guint dim = index->header->dim;
+  for (guint i = from; i < to; i++) {
+      count = insert_hit(hits, count, k, rag_dot(index->vectors + (gsize)i * dim, query, dim), i);
+  }
+  return count;
+}
+
+guint rag_index_search(RagIndex *index, const gfloat *query, guint k, RagHit *hits) {
+  if (!index->header || index->header->n_chunks == 0 || k == 0) return 0;
+  guint count = 0;
+  guint n_lists = index->header->n_lists;
+
+  if (n_lists == 0) {
+      count = scan_range(index, query, 0, index->header->n_chunks, hits, count, k);
+  } else {
+      // Probe the lists whose centroids are closest to the query
+      guint probes = MIN(RAG_IVF_PROBES, n_lists);
+      RagHit *nearest = g_new(RagHit, probes);
+      guint n_nearest = 0;
+      guint dim = index->header->dim;
+      for (guint c = 0; c < n_lists; c++) {
+          n_nearest = insert_hit(nearest, n_nearest, probes, rag_dot(index->centroids + (gsize)c * dim, query, dim), c);
+      }
+      for (guint p = 0; p < n_nearest; p++) {
+          guint c = nearest[p].chunk.line;
+          count = scan_range(index, query, index->list_start[c], index->list_start[c + 1], hits, count, k);
+      }
+      g_free(nearest);
+  }
+
+  for (guint i = 0; i < count; i++) {
+      gfloat score = hits[i].score;
+      rag_index_chunk(index, hits[i].chunk.line, &hits[i].chunk);
+      hits[i].score = score;
+  }
+  return count;
+}
+
+/* ---------- Ingestion ---------- */
+
+typedef struct {
+  GMutex     lock;
+  GArray    *chunks;      // RagChunk; text owned in texts
+  GPtrArray *texts;
+} ChunkJobs;
+
+static gboolean is_text(const gchar *contents, gsize length) {
+  return memchr(contents, '\0', length) == NULL && g_utf8_validate(contents, length, NULL);
+}
+
+static void add_chunk(GArray *out, GPtrArray *texts, const gchar *source, guint line,
+                      const gchar *start, gsize len) {
+  while (len > 0 && g_ascii_isspace(start[len - 1])) len--;
+  gsize lead = 0;
+  while (lead < len && g_ascii_isspace(start[lead])) lead++;
+  if (lead == len) return;
+
+  gchar *text = g_strndup(start, len);
+  g_ptr_array_add(texts, text);
+  RagChunk chunk = { .source = source, .line = line, .text = text, .len = len };
+  g_array_append_val(out, chunk);
+}
+
+/* Whole lines up to RAG_CHUNK_BYTES, each chunk repeating the last few
+ * lines of the one before. A line longer than a chunk is cut on character
+ * boundaries. */
+static void chunk_text(GArray *out, GPtrArray *texts, const gchar *source, const gchar *contents, gsize length) {
+  GArray *starts = g_array_new(FALSE, FALSE, sizeof(gsize));
+  gsize zero = 0;
+  g_array_append_val(starts, zero);
+  for (gsize i = 0; i < length; i++) {
+      if (contents[i] == '\n' && i + 1 < length) {
+          gsize next = i + 1;
+          g_array_append_val(starts, next);
+      }
+  }
+  guint n_lines = starts->len;
+  g_array_append_val(starts, length);
+  const gsize *at = (const gsize*)starts->data;
+
+  guint first = 0;
+  while (first < n_lines) {
+      guint last = first + 1;
+      while (last < n_lines && at[last + 1] - at[first] <= RAG_CHUNK_BYTES) last++;
+
+      if (at[last] - at[first] > RAG_CHUNK_BYTES) {
+          const gchar *p = contents + at[first], *end = contents + at[last];
+          while (p < end) {
+              const gchar *cut = p + MIN((gsize)(end - p), RAG_CHUNK_BYTES);
+              if (cut < end) cut = g_utf8_find_prev_char(p, cut + 1);
+              if (!cut || cut <= p) cut = end;
+              add_chunk(out, texts, source, first + 1, p, cut - p);
+              p = cut;
+          }
+      } else {
+          add_chunk(out, texts, source, first + 1, contents + at[first], at[last] - at[first]);
+      }
+      if (last >= n_lines) break;
+      // Short chunks are not overlapped, or each line would be embedded twice
+      first = last - first > 2 * RAG_CHUNK_OVERLAP_LINES ? last - RAG_CHUNK_OVERLAP_LINES : last;
+  }
+  g_array_unref(starts);
+}
+
+static void chunk_file_job(gpointer data, gpointer user_data) {
+  const gchar *path = data;
+  ChunkJobs *jobs = user_data;
+  gchar *contents = NULL;
+  gsize length = 0;
+
+  if (!g_file_get_contents(path, &contents, &length, NULL)) return;
+  if (length > 0 && length <= RAG_MAX_FILE_BYTES && is_text(contents, length)) {
+      GArray *chunks = g_array_new(FALSE, FALSE, sizeof(RagChunk));
+      GPtrArray *texts = g_ptr_array_new();
+      chunk_text(chunks, texts, path, contents, length);
+
+      g_mutex_lock(&jobs->lock);
+      g_array_append_vals(jobs->chunks, chunks->data, chunks->len);
+      g_ptr_array_extend_and_steal(jobs->texts, texts);
+      g_mutex_unlock(&jobs->lock);
+      g_array_unref(chunks);
+  }
+  g_free(contents);
+}
+
+/* Regular files under path, skipping hidden entries and symlinks inside
+ * folders. */
+static void collect_files(const gchar *path, GPtrArray *files) {
+  if (g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+      g_ptr_array_add(files, g_strdup(path));
+      return;
+  }
+
+  GDir *dir = g_dir_open(path, 0, NULL);
+  if (!dir) return;
+  const gchar *name;
+  while ((name = g_dir_read_name(dir))) {
+      if (name[0] == '.' || g_strcmp0(name, "node_modules") == 0) continue;
+      gchar *child = g_build_filename(path, name, NULL);
+      if (!g_file_test(child, G_FILE_TEST_IS_SYMLINK)) collect_files(child, files);
+      g_free(child);
+  }
+  g_dir_close(dir);
+}
+
+static gint compare_chunks(gconstpointer a, gconstpointer b) {
+  const RagChunk *x = a, *y = b;
+  gint by_source = strcmp(x->source, y->source);
+  if (by_source) return by_source;
+  return (x->line > y->line) - (x->line < y->line);
+}
+
+RagIndex* rag_index_add(RagIndex *base, const gchar * const *paths, const gchar *base_url,
+                        const gchar *model, RagProgressFunc progress, gpointer user_data,
+                        GCancellable *cancellable, GError **error) {
+  gint64 trace_add = TRACE_BEGIN();
+  GPtrArray *files = g_ptr_array_new_with_free_func(g_free);
+  for (const gchar * const *p = paths; *p; p++) {
+      gchar *absolute = g_canonicalize_filename(*p, NULL);
+      collect_files(absolute, files);
+      g_free(absolute);
+  }
+
+  // Chunking is CPU bound: one job per file across the cores
+  ChunkJobs jobs = { .chunks = g_array_new(FALSE, FALSE, sizeof(RagChunk)),
+                     .texts = g_ptr_array_new_with_free_func(g_free) };
+  g_mutex_init(&jobs.lock);
+  gint64 trace_chunk = TRACE_BEGIN();
+  GThreadPool *pool = g_thread_pool_new(chunk_file_job, &jobs, (gint)g_get_num_processors(), FALSE, NULL);
+  for (guint i = 0; i < files->len; i++) {
+      g_thread_pool_push(pool, g_ptr_array_index(files, i), NULL);
+  }
+  g_thread_pool_free(pool, FALSE, TRUE);
+  g_mutex_clear(&jobs.lock);
+  g_array_sort(jobs.chunks, compare_chunks);
+  TRACE_ENDF(trace_chunk, "chunk", "%u files, %u chunks", files->len, jobs.chunks->len);
+
+  // Chunks of files being added again are replaced
+  GHashTable *added = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i < files->len; i++) g_hash_table_add(added, g_ptr_array_index(files, i));
+  gboolean same_model = base && g_strcmp0(rag_index_model(base), model) == 0;
+  guint n_new = jobs.chunks->len;
+  GArray *all = g_array_new(FALSE, FALSE, sizeof(RagChunk));
+  for (guint i = 0; base && i < rag_index_n_chunks(base); i++) {
+      RagChunk chunk;
+      rag_index_chunk(base, i, &chunk);
+      if (g_hash_table_contains(added, chunk.source)) continue;
+      if (!same_model) chunk.vector = NULL;   // Embedded again with the new model
+      g_array_append_val(all, chunk);
+  }
+  g_array_append_vals(all, jobs.chunks->data, jobs.chunks->len);
+  g_hash_table_unref(added);
+
+  // Embeddings, a batch per request
+  RagChunk *chunks = (RagChunk*)all->data;
+  GPtrArray *vectors = g_ptr_array_new_with_free_func(g_free);
+  guint dim = same_model ? rag_index_dim(base) : 0;
+  guint total = 0, done = 0;
+  for (guint i = 0; i < all->len; i++) {
+      if (!chunks[i].vector) total++;
+  }
+  gboolean ok = TRUE;
+  gint64 trace_embed = TRACE_BEGIN();
+  for (guint i = 0; i < all->len && ok;) {
+      guint members[RAG_EMBED_BATCH_MAX];
+      guint n = 0;
+      for (; i < all->len && n < MIN(RAG_EMBED_BATCH, RAG_EMBED_BATCH_MAX); i++) {
+          if (chunks[i].vector) continue;
+          members[n++] = i;
+      }
+      if (n == 0) break;
+
+      // Texts from the mapping are not NUL-terminated, so each input is a copy;
+      // the file name gives the model some context for the chunk
+      gchar **inputs = g_new0(gchar*, n + 1);
+      for (guint m = 0; m < n; m++) {
+          const RagChunk *chunk = &chunks[members[m]];
+          gchar *name = g_path_get_basename(chunk->source);
+          inputs[m] = g_strdup_printf("%s\n%.*s", name, (gint)chunk->len, chunk->text);
+          g_free(name);
+      }
+      guint batch_dim = 0;
+      gfloat *embedded = ollama_embed(base_url, model, (const gchar * const *)inputs, n, &batch_dim,
+                                       cancellable, error);
+      g_strfreev(inputs);
+
+      if (!embedded) {
+          ok = FALSE;
+      } else if (dim && batch_dim != dim) {
+          g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s returned %u dimensions, expected %u",
+                      model, batch_dim, dim);
+          g_free(embedded);
+          ok = FALSE;
+      } else {
+          dim = batch_dim;
+          g_ptr_array_add(vectors, embedded);
+          for (guint m = 0; m < n; m++) {
+              gfloat *v = embedded + (gsize)m * dim;
+              normalize(v, dim);
+              chunks[members[m]].vector = v;
+          }
+          done += n;
+          if (progress) progress(done, total, user_data);
+      }
+  }
+  TRACE_ENDF(trace_embed, "embed", "%u chunks", done);
+
+  RagIndex *index = NULL;
+  if (ok && all->len == 0) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, "No text files found");
+  } else if (ok) {
+      gchar *path = base ? g_strdup(base->path) : get_documents_path();
+      index = rag_index_write(path, model, dim, chunks, all->len, error);
+      g_free(path);
+  }
+
+  g_debug("documents: %u files, %u new chunks, %u chunks in the index", files->len, n_new,
+          index ? rag_index_n_chunks(index) : 0);
+  g_ptr_array_unref(vectors);
+  g_array_unref(all);
+  g_array_unref(jobs.chunks);
+  g_ptr_array_unref(jobs.texts);
+  g_ptr_array_unref(files);
+  TRACE_END(trace_add, "documents-add", model);
+  return index;
+}
+
+/* ---------- Retrieval ---------- */
+
+gchar* rag_retrieve(RagIndex *index, const gchar *base_url, const gchar *query, gsize max_bytes,
+                    RagStats *stats, GCancellable *cancellable) {
+  if (stats) *stats = (RagStats){ 0 };
+  if (!index || rag_index_n_chunks(index) == 0 || !query || !*query) return NULL;
+
+  gint64 trace_retrieve = TRACE_BEGIN();
+  gint64 start = g_get_monotonic_time();
+  guint dim = 0;
+  GError *error = NULL;
+  gfloat *vector = ollama_embed(base_url, rag_index_model(index), &query, 1, &dim, cancellable, &error);
+  gint64 embedded = g_get_monotonic_time();
+  if (!vector || dim != rag_index_dim(index)) {
+      g_debug("documents: query not embedded: %s", error ? error->message : "dimensions differ");
+      g_clear_error(&error);
+      g_free(vector);
+      return NULL;
+  }
+  normalize(vector, dim);
+
+  RagHit hits[RAG_TOP_K_MAX];
+  guint n_hits = rag_index_search(index, vector, MIN(RAG_TOP_K, RAG_TOP_K_MAX), hits);
+  gint64 searched = g_get_monotonic_time();
+  g_free(vector);
+
+  GString *out = g_string_new("Excerpts from the user's documents that may be relevant. "
+                              "Name the file when you use one.\n");
+  gsize intro = out->len;
+  guint used = 0;
+  for (guint i = 0; i < n_hits && hits[i].score >= RAG_MIN_SCORE; i++) {
+      gchar *piece = g_strdup_printf("\n--- %s, line %u ---\n%.*s\n", hits[i].chunk.source, hits[i].chunk.line,
+                                     (gint)hits[i].chunk.len, hits[i].chunk.text);
+      if (out->len + strlen(piece) <= max_bytes) {
+          g_string_append(out, piece);
+          used++;
+      }
+      g_free(piece);
+  }
+
+  if (stats) {
+      stats->excerpts = used;
+      stats->embed_us = embedded - start;
+      stats->search_us = searched - embedded;
+  }
+  telemetry_record_retrieval(embedded - start, searched - embedded);
+  TRACE_ENDF(trace_retrieve, "retrieve", "%u of %u excerpts, search %" G_GINT64_FORMAT " us",
+             used, n_hits, searched - embedded);
+  if (out->len == intro) {
+      g_string_free(out, TRUE);
+      return NULL;
+  }
+  return g_string_free(out, FALSE);
+}
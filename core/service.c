@@ -0,0 +1,509 @@
+#include "ganesha-core.h"
+
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+/* ---------- Local API ----------
+ * A small HTTP service on a Unix socket so scripts and editors can chat
+ * through the app's endpoints, scheduler and conversation history:
+ *
+ *   GET  /v1/conversations        [{"id", "title", "timestamp", "messages"}]
+ *   GET  /v1/conversations/<id>   {"id", "title", "messages": [{"role", "content"}]}
+ *   POST /v1/chat                 {"content", "conversation"?, "model"?, "images"?}
+ *   GET  /v1/memory               {"<category>": {"bytes", "count"}, ..., "total_bytes"}
+ *
+ * /v1/chat streams NDJSON: a {"conversation", "model"} header line, then
+ * Ollama-style {"message": {...}, "done": false} chunks, then a final
+ * {"done": true} line with token counts or an "error". Replies are appended
+ * to the conversation as they arrive. All state is touched on the main
+ * context; only ollama_stream_chat() runs on a worker thread. */
+
+struct _ApiService {
+  SoupServer            *server;
+  gchar                 *socket_path;
+  GPtrArray             *conversations;
+  const ApiServiceHooks *hooks;
+  gpointer               user_data;
+  GList                 *streams;       // ApiStream in flight
+};
+
+typedef struct {
+  gint               ref_count;
+  ApiService        *service;       // NULL once the service is gone
+  SoupServerMessage *msg;           // NULL once the client went away
+  GPtrArray         *conversations; // Keeps conv alive for the worker
+  Conversation      *conv;
+  Message           *reply;
+  GString           *text;          // Reply so far; reply->content is swapped per delta
+  GArray            *snapshot;      // What the worker builds the request from
+  StreamRequest      req;
+  gchar             *base_url;      // Owned copies of the strings in req
+  gchar             *hedge_url;
+  gchar             *keep_alive;
+  ContextPlan       *plan;
+  GCancellable      *cancellable;
+  gint64             prompt_tokens;
+  gint64             completion_tokens;
+  gchar             *error;
+} ApiStream;
+
+typedef struct {
+  ApiStream *stream;
+  gchar     *text;
+} ApiDelta;
+
+static ApiStream* api_stream_ref(ApiStream *s) {
+  g_atomic_int_inc(&s->ref_count);
+  return s;
+}
+
+static void api_stream_unref(ApiStream *s) {
+  if (!g_atomic_int_dec_and_test(&s->ref_count)) return;
+  if (s->msg) {
+      g_signal_handlers_disconnect_by_data(s->msg, s);
+      g_object_unref(s->msg);
+  }
+  g_ptr_array_unref(s->conversations);
+  g_free(s->req.model);
+  g_free(s->base_url);
+  g_free(s->hedge_url);
+  g_free(s->keep_alive);
+  context_plan_free(s->plan);
+  g_array_unref(s->snapshot);
+  g_string_free(s->text, TRUE);
+  g_object_unref(s->cancellable);
+  g_free(s->error);
+  g_free(s);
+}
+
+/* ---------- Responses ---------- */
+
+static gchar* builder_to_line(JsonBuilder *b, gsize *len) {
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  gchar *data = json_generator_to_data(gen, NULL);
+  gchar *line = g_strconcat(data, "\n", NULL);
+  if (len) *len = strlen(line);
+  g_free(data);
+  json_node_free(root);
+  g_object_unref(gen);
+  return line;
+}
+
+static void respond_json(SoupServerMessage *msg, guint status, JsonBuilder *b) {
+  gsize len = 0;
+  gchar *data = builder_to_line(b, &len);
+  soup_server_message_set_status(msg, status, NULL);
+  soup_server_message_set_response(msg, "application/json", SOUP_MEMORY_TAKE, data, len);
+}
+
+static void respond_error(SoupServerMessage *msg, guint status, const gchar *error) {
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "error");
+  json_builder_add_string_value(b, error);
+  json_builder_end_object(b);
+  respond_json(msg, status, b);
+  g_object_unref(b);
+}
+
+/* Appends one NDJSON line to a streaming response and lets libsoup send it. */
+static void api_stream_write(ApiStream *s, JsonBuilder *b, gboolean last) {
+  if (!s->msg) return;
+  gsize len = 0;
+  gchar *line = builder_to_line(b, &len);
+  SoupMessageBody *body = soup_server_message_get_response_body(s->msg);
+  soup_message_body_append(body, SOUP_MEMORY_TAKE, line, len);
+  if (last) soup_message_body_complete(body);
+  soup_server_message_unpause(s->msg);
+}
+
+static Conversation* find_conversation(ApiService *service, const gchar *id) {
+  for (guint i = 0; i < service->conversations->len; i++) {
+      Conversation *conv = g_ptr_array_index(service->conversations, i);
+      // Spilled under memory pressure: bring the messages back before use
+      if (g_strcmp0(conv->id, id) == 0) return conversation_restore(conv) ? conv : NULL;
+  }
+  return NULL;
+}
+
+/* ---------- Streaming ---------- */
+
+static gboolean api_delta_cb(gpointer data) {
+  ApiDelta *d = data;
+  ApiStream *s = d->stream;
+
+  if (s->service) {
+      g_string_append(s->text, d->text);
+      message_set_content(s->reply, s->text->str, s->text->len);
+  }
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "message");
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "role");
+  json_builder_add_string_value(b, "assistant");
+  json_builder_set_member_name(b, "content");
+  json_builder_add_string_value(b, d->text);
+  json_builder_end_object(b);
+  json_builder_set_member_name(b, "done");
+  json_builder_add_boolean_value(b, FALSE);
+  json_builder_end_object(b);
+  api_stream_write(s, b, FALSE);
+  g_object_unref(b);
+
+  api_stream_unref(s);
+  g_free(d->text);
+  g_free(d);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean api_finish_cb(gpointer data) {
+  ApiStream *s = data;
+  ApiService *service = s->service;
+
+  if (service) {
+      s->conv->streaming = FALSE;
+      if (s->error && !*s->reply->content) g_ptr_array_remove(s->conv->messages, s->reply);
+      service->streams = g_list_remove(service->streams, s);
+      if (service->hooks && service->hooks->changed) service->hooks->changed(s->conv, service->user_data);
+  }
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  if (service) {
+      json_builder_set_member_name(b, "conversation");
+      json_builder_add_string_value(b, s->conv->id);
+  }
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, s->req.model);
+  json_builder_set_member_name(b, "done");
+  json_builder_add_boolean_value(b, TRUE);
+  if (s->prompt_tokens >= 0) {
+      json_builder_set_member_name(b, "prompt_eval_count");
+      json_builder_add_int_value(b, s->prompt_tokens);
+  }
+  if (s->completion_tokens >= 0) {
+      json_builder_set_member_name(b, "eval_count");
+      json_builder_add_int_value(b, s->completion_tokens);
+  }
+  if (s->error) {
+      json_builder_set_member_name(b, "error");
+      json_builder_add_string_value(b, s->error);
+  }
+  json_builder_end_object(b);
+  api_stream_write(s, b, TRUE);
+  g_object_unref(b);
+
+  api_stream_unref(s);
+  return G_SOURCE_REMOVE;
+}
+
+static void on_api_delta(const gchar *text, gpointer user_data) {
+  ApiDelta *d = g_new0(ApiDelta, 1);
+  d->stream = api_stream_ref(user_data);
+  d->text = g_strdup(text);
+  g_idle_add(api_delta_cb, d);
+}
+
+static void on_api_usage(gint64 prompt_tokens, gint64 completion_tokens, gpointer user_data) {
+  ApiStream *s = user_data;
+  s->prompt_tokens = prompt_tokens;
+  s->completion_tokens = completion_tokens;
+}
+
+static const StreamCallbacks api_callbacks = {
+  .delta = on_api_delta,
+  .usage = on_api_usage,
+};
+
+static gpointer api_stream_worker(gpointer data) {
+  ApiStream *s = data;
+  GError *error = NULL;
+  if (!ollama_stream_chat(&s->req, s->snapshot, s->plan, &api_callbacks, s, s->cancellable, &error)) {
+      s->error = g_strdup(error->message);
+      g_error_free(error);
+  }
+  g_idle_add(api_finish_cb, s);   // Hands over the worker's reference
+  return NULL;
+}
+
+static void on_api_client_finished(SoupServerMessage *msg, gpointer user_data) {
+  ApiStream *s = user_data;
+  g_signal_handlers_disconnect_by_data(msg, s);
+  g_clear_object(&s->msg);
+  g_cancellable_cancel(s->cancellable);
+}
+
+/* ---------- Handlers ---------- */
+
+static JsonObject* parse_request(SoupServerMessage *msg, JsonParser *parser) {
+  SoupMessageBody *body = soup_server_message_get_request_body(msg);
+  if (!body || !body->data) return NULL;
+  if (!json_parser_load_from_data(parser, body->data, body->length, NULL)) return NULL;
+  JsonNode *root = json_parser_get_root(parser);
+  return JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+}
+
+/* "images" is optional, but when present it must be an array of strings. */
+static gboolean images_valid(JsonObject *body) {
+  JsonNode *node = json_object_get_member(body, "images");
+  if (!node) return TRUE;
+  if (!JSON_NODE_HOLDS_ARRAY(node)) return FALSE;
+  JsonArray *images = json_node_get_array(node);
+  for (guint i = 0; i < json_array_get_length(images); i++) {
+      JsonNode *element = json_array_get_element(images, i);
+      if (!JSON_NODE_HOLDS_VALUE(element) || json_node_get_value_type(element) != G_TYPE_STRING) return FALSE;
+  }
+  return TRUE;
+}
+
+static void conversations_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                                  GHashTable *query, gpointer user_data) {
+  (void)server; (void)query;
+  ApiService *service = user_data;
+
+  if (g_strcmp0(soup_server_message_get_method(msg), "GET") != 0) {
+      soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+      return;
+  }
+
+  const gchar *id = path + strlen("/v1/conversations");
+  if (*id == '/') id++;
+
+  JsonBuilder *b = json_builder_new();
+  if (!*id) {
+      json_builder_begin_array(b);
+      for (guint i = 0; i < service->conversations->len; i++) {
+          Conversation *conv = g_ptr_array_index(service->conversations, i);
+          json_builder_begin_object(b);
+          json_builder_set_member_name(b, "id");
+          json_builder_add_string_value(b, conv->id);
+          json_builder_set_member_name(b, "title");
+          json_builder_add_string_value(b, conv->title ? conv->title : "");
+          json_builder_set_member_name(b, "timestamp");
+          json_builder_add_int_value(b, conv->timestamp);
+          json_builder_set_member_name(b, "messages");
+          json_builder_add_int_value(b, conv->messages->len + conv->spilled_messages);
+          if (conv->parent_id) {
+              json_builder_set_member_name(b, "parent");
+              json_builder_add_string_value(b, conv->parent_id);
+          }
+          json_builder_end_object(b);
+      }
+      json_builder_end_array(b);
+      respond_json(msg, SOUP_STATUS_OK, b);
+  } else {
+      Conversation *conv = find_conversation(service, id);
+      if (!conv) {
+          respond_error(msg, SOUP_STATUS_NOT_FOUND, "conversation not found");
+          g_object_unref(b);
+          return;
+      }
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "id");
+      json_builder_add_string_value(b, conv->id);
+      json_builder_set_member_name(b, "title");
+      json_builder_add_string_value(b, conv->title ? conv->title : "");
+      json_builder_set_member_name(b, "messages");
+      json_builder_begin_array(b);
+      for (guint i = 0; i < conv->messages->len; i++) {
+          Message *m = g_ptr_array_index(conv->messages, i);
+          json_builder_begin_object(b);
+          json_builder_set_member_name(b, "role");
+          json_builder_add_string_value(b, m->role);
+          json_builder_set_member_name(b, "content");
+          json_builder_add_string_value(b, m->content);
+          json_builder_end_object(b);
+      }
+      json_builder_end_array(b);
+      json_builder_end_object(b);
+      respond_json(msg, SOUP_STATUS_OK, b);
+  }
+  g_object_unref(b);
+}
+
+static void memory_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                           GHashTable *query, gpointer user_data) {
+  (void)server; (void)path; (void)query;
+  ApiService *service = user_data;
+
+  if (g_strcmp0(soup_server_message_get_method(msg), "GET") != 0) {
+      soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+      return;
+  }
+
+  MemoryReport report;
+  memory_report_init(&report);
+  memory_report_add_conversations(&report, service->conversations);
+  memory_report_add_live(&report);
+  if (service->hooks && service->hooks->memory) {
+      service->hooks->memory(&report, service->user_data);
+  }
+
+  JsonBuilder *b = json_builder_new();
+  memory_report_to_json(&report, b);
+  respond_json(msg, SOUP_STATUS_OK, b);
+  g_object_unref(b);
+  memory_report_clear(&report);
+}
+
+static void chat_handler(SoupServer *server, SoupServerMessage *msg, const char *path,
+                         GHashTable *query, gpointer user_data) {
+  (void)server; (void)path; (void)query;
+  ApiService *service = user_data;
+
+  if (g_strcmp0(soup_server_message_get_method(msg), "POST") != 0) {
+      soup_server_message_set_status(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, NULL);
+      return;
+  }
+
+  JsonParser *parser = json_parser_new();
+  JsonObject *body = parse_request(msg, parser);
+  const gchar *content = body ? json_object_get_string_member_with_default(body, "content", NULL) : NULL;
+  if (!content || !*content) {
+      respond_error(msg, SOUP_STATUS_BAD_REQUEST, "\"content\" is required");
+      g_object_unref(parser);
+      return;
+  }
+  if (!images_valid(body)) {
+      respond_error(msg, SOUP_STATUS_BAD_REQUEST, "\"images\" must be an array of strings");
+      g_object_unref(parser);
+      return;
+  }
+
+  const gchar *id = json_object_get_string_member_with_default(body, "conversation", NULL);
+  Conversation *conv = NULL;
+  if (id) {
+      conv = find_conversation(service, id);
+      if (!conv) {
+          respond_error(msg, SOUP_STATUS_NOT_FOUND, "conversation not found");
+          g_object_unref(parser);
+          return;
+      }
+      if (conv->streaming) {
+          respond_error(msg, SOUP_STATUS_CONFLICT, "a reply is already streaming into this conversation");
+          g_object_unref(parser);
+          return;
+      }
+  } else {
+      conv = conversation_new();
+      g_ptr_array_add(service->conversations, conv);
+  }
+
+  conversation_add_message(conv, "user", content);
+  if (json_object_has_member(body, "images")) {
+      Message *user_msg = g_ptr_array_index(conv->messages, conv->messages->len - 1);
+      JsonArray *images = json_object_get_array_member(body, "images");
+      for (guint i = 0; i < json_array_get_length(images); i++) {
+          g_ptr_array_add(user_msg->images, g_strdup(json_array_get_string_element(images, i)));
+      }
+  }
+
+  ApiStream *s = g_new0(ApiStream, 1);
+  s->ref_count = 1;
+  s->service = service;
+  s->msg = g_object_ref(msg);
+  s->conversations = g_ptr_array_ref(service->conversations);
+  s->conv = conv;
+  s->cancellable = g_cancellable_new();
+  s->prompt_tokens = -1;
+  s->completion_tokens = -1;
+  s->req.model = g_strdup(json_object_get_string_member_with_default(body, "model", NULL));
+
+  gint num_ctx = DEFAULT_NUM_CTX;
+  if (service->hooks && service->hooks->prepare) service->hooks->prepare(&s->req, &num_ctx, service->user_data);
+  if (!s->req.model) s->req.model = g_strdup(DEFAULT_MODEL);
+  s->req.base_url = s->base_url = g_strdup(s->req.base_url);
+  s->req.hedge_url = s->hedge_url = g_strdup(s->req.hedge_url);
+  s->req.keep_alive = s->keep_alive = g_strdup(s->req.keep_alive);
+
+  s->plan = context_plan_new(conv, conv->messages->len, lookup_tokenizer(s->req.model), num_ctx);
+  s->snapshot = conversation_snapshot(conv, conv->messages->len);
+  s->text = g_string_new("");
+  conversation_add_message(conv, "assistant", "");
+  s->reply = g_ptr_array_index(conv->messages, conv->messages->len - 1);
+  conv->streaming = TRUE;
+  service->streams = g_list_prepend(service->streams, s);
+  if (service->hooks && service->hooks->changed) service->hooks->changed(conv, service->user_data);
+
+  SoupMessageHeaders *headers = soup_server_message_get_response_headers(msg);
+  soup_message_headers_set_encoding(headers, SOUP_ENCODING_CHUNKED);
+  soup_message_headers_set_content_type(headers, "application/x-ndjson", NULL);
+  soup_server_message_set_status(msg, SOUP_STATUS_OK, NULL);
+  g_signal_connect(msg, "finished", G_CALLBACK(on_api_client_finished), s);
+  soup_server_message_pause(msg);
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "conversation");
+  json_builder_add_string_value(b, conv->id);
+  json_builder_set_member_name(b, "model");
+  json_builder_add_string_value(b, s->req.model);
+  json_builder_end_object(b);
+  api_stream_write(s, b, FALSE);
+  g_object_unref(b);
+
+  g_thread_unref(g_thread_new("ganesha-api", api_stream_worker, api_stream_ref(s)));
+  api_stream_unref(s);
+  g_object_unref(parser);
+}
+
+/* ---------- Lifecycle ---------- */
+
+ApiService* api_service_new(const gchar *socket_path, GPtrArray *conversations,
+                            const ApiServiceHooks *hooks, gpointer user_data, GError **error) {
+  gchar *dir = g_path_get_dirname(socket_path);
+  g_mkdir_with_parents(dir, 0700);
+  g_free(dir);
+
+  // Only one primary instance runs per session, so a socket left here is stale
+  g_unlink(socket_path);
+
+  ApiService *service = g_new0(ApiService, 1);
+  service->server = soup_server_new("server-header", "ganesha ", NULL);
+  service->socket_path = g_strdup(socket_path);
+  service->conversations = g_ptr_array_ref(conversations);
+  service->hooks = hooks;
+  service->user_data = user_data;
+
+  soup_server_add_handler(service->server, "/v1/conversations", conversations_handler, service, NULL);
+  soup_server_add_handler(service->server, "/v1/chat", chat_handler, service, NULL);
+  soup_server_add_handler(service->server, "/v1/memory", memory_handler, service, NULL);
+
+  GSocketAddress *address = g_unix_socket_address_new(socket_path);
+  gboolean ok = soup_server_listen(service->server, address, 0, error);
+  g_object_unref(address);
+  if (!ok) {
+      api_service_free(service);
+      return NULL;
+  }
+  g_chmod(socket_path, 0600);
+  return service;
+}
+
+void api_service_free(ApiService *service) {
+  if (!service) return;
+
+  for (GList *l = service->streams; l; l = l->next) {
+      ApiStream *s = l->data;
+      s->service = NULL;
+      s->conv->streaming = FALSE;
+      g_cancellable_cancel(s->cancellable);
+      if (s->msg) {
+          g_signal_handlers_disconnect_by_data(s->msg, s);
+          g_clear_object(&s->msg);
+      }
+  }
+  g_list_free(service->streams);
+
+  soup_server_disconnect(service->server);
+  g_object_unref(service->server);
+  g_unlink(service->socket_path);
+  g_free(service->socket_path);
+  g_ptr_array_unref(service->conversations);
+  g_free(service);
+}
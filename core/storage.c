@@ -0,0 +1,710 @@
+#include "ganesha-core.h"
+
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---------- Persistence ---------- */
+
+gchar* get_conversations_path(void) {
+  const gchar *config_dir = g_get_user_config_dir();
+  gchar *app_dir = g_build_filename(config_dir, "ganesha", NULL);
+  g_mkdir_with_parents(app_dir, 0755);
+  gchar *path = g_build_filename(app_dir, CONVERSATIONS_FILE, NULL);
+  g_free(app_dir);
+  return path;
+}
+
+static void build_messages(JsonBuilder *builder, GPtrArray *messages, guint from) {
+  json_builder_begin_array(builder);
+  for (guint j = from; j < messages->len; j++) {
+      Message *msg = g_ptr_array_index(messages, j);
+      json_builder_begin_object(builder);
+      json_builder_set_member_name(builder, "role");
+      json_builder_add_string_value(builder, msg->role);
+      json_builder_set_member_name(builder, "content");
+      json_builder_add_string_value(builder, msg->content);
+      
+      // Save images if present
+      if (msg->images && msg->images->len > 0) {
+          json_builder_set_member_name(builder, "images");
+          json_builder_begin_array(builder);
+          for (guint k = 0; k < msg->images->len; k++) {
+              const gchar *img = g_ptr_array_index(msg->images, k);
+              json_builder_add_string_value(builder, img);
+          }
+          json_builder_end_array(builder);
+      }
+      
+      json_builder_end_object(builder);
+  }
+  json_builder_end_array(builder);
+}
+
+static void parse_messages(JsonArray *msgs_array, GPtrArray *messages) {
+  guint msgs_len = json_array_get_length(msgs_array);
+  
+  for (guint j = 0; j < msgs_len; j++) {
+      JsonObject *msg_obj = json_array_get_object_element(msgs_array, j);
+      Message *msg = message_new(
+          json_object_get_string_member(msg_obj, "role"),
+          json_object_get_string_member(msg_obj, "content")
+      );
+      
+      // Load images if present
+      if (json_object_has_member(msg_obj, "images")) {
+          JsonArray *imgs_array = json_object_get_array_member(msg_obj, "images");
+          guint imgs_len = json_array_get_length(imgs_array);
+          for (guint k = 0; k < imgs_len; k++) {
+              const gchar *img = json_array_get_string_element(imgs_array, k);
+              g_ptr_array_add(msg->images, g_strdup(img));
+          }
+      }
+      
+      g_ptr_array_add(messages, msg);
+  }
+}
+
+/* Parses a spill file back into a messages node; NULL if it is unreadable. */
+static JsonNode* load_spilled_messages(Conversation *conv) {
+  JsonParser *parser = json_parser_new();
+  JsonNode *node = NULL;
+  if (json_parser_load_from_file(parser, conv->spill_path, NULL)) {
+      JsonNode *root = json_parser_get_root(parser);
+      if (JSON_NODE_HOLDS_ARRAY(root)) node = json_node_copy(root);
+  }
+  g_object_unref(parser);
+  return node;
+}
+
+/* The messages node and branch point conv had in the conversations file as
+ * last saved, or NULL. The file is parsed once per save, into *previous. */
+static JsonNode* load_saved_messages(Conversation *conv, JsonParser **previous, guint *branch_point) {
+  if (!*previous) {
+      *previous = json_parser_new();
+      gchar *path = get_conversations_path();
+      json_parser_load_from_file(*previous, path, NULL);
+      g_free(path);
+  }
+  
+  JsonNode *root = json_parser_get_root(*previous);
+  JsonObject *obj = root && JSON_NODE_HOLDS_OBJECT(root) ? json_node_get_object(root) : NULL;
+  JsonNode *list = obj ? json_object_get_member(obj, "conversations") : NULL;
+  JsonArray *saved = list && JSON_NODE_HOLDS_ARRAY(list) ? json_node_get_array(list) : NULL;
+  for (guint i = 0; saved && i < json_array_get_length(saved); i++) {
+      JsonNode *item = json_array_get_element(saved, i);
+      JsonObject *entry = JSON_NODE_HOLDS_OBJECT(item) ? json_node_get_object(item) : NULL;
+      if (!entry || g_strcmp0(json_object_get_string_member_with_default(entry, "id", NULL), conv->id) != 0) {
+          continue;
+      }
+      JsonNode *messages = json_object_get_member(entry, "messages");
+      if (!messages || !JSON_NODE_HOLDS_ARRAY(messages)) return NULL;
+      *branch_point = json_object_get_int_member_with_default(entry, "branch_point", 0);
+      return json_node_copy(messages);
+  }
+  return NULL;
+}
+
+/* How many leading messages conv shares with its parent by reference. */
+static guint shared_prefix(Conversation *conv, GHashTable *by_id) {
+  Conversation *parent = conv->parent_id ? g_hash_table_lookup(by_id, conv->parent_id) : NULL;
+  if (!parent) return 0;
+  
+  guint n = 0;
+  while (n < conv->messages->len && n < parent->messages->len
+         && g_ptr_array_index(conv->messages, n) == g_ptr_array_index(parent->messages, n)) {
+      n++;
+  }
+  return n;
+}
+
+/* Branches are stored as their parent's id, the length of the prefix they
+ * share with it and their own messages only. */
+void save_conversations(GPtrArray *conversations) {
+  if (!conversations) return;
+  gint64 trace_save = TRACE_BEGIN();
+  
+  GHashTable *by_id = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i < conversations->len; i++) {
+      Conversation *conv = g_ptr_array_index(conversations, i);
+      g_hash_table_insert(by_id, conv->id, conv);
+  }
+  
+  JsonParser *previous = NULL;
+  gboolean complete = TRUE;
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "conversations");
+  json_builder_begin_array(builder);
+  
+  for (guint i = 0; i < conversations->len; i++) {
+      Conversation *conv = g_ptr_array_index(conversations, i);
+      
+      // A spilled conversation's messages array is empty and must never be
+      // written: they come from the spill file, or else from the last save
+      guint branch_point = shared_prefix(conv, by_id);
+      JsonNode *spilled = NULL;
+      if (conv->spill_path) {
+          spilled = load_spilled_messages(conv);
+          if (!spilled) {
+              g_warning("Could not read spilled conversation %s; keeping its last saved copy", conv->spill_path);
+              spilled = load_saved_messages(conv, &previous, &branch_point);
+          }
+          if (!spilled) {
+              g_warning("No saved copy of conversation %s; history not saved", conv->id);
+              complete = FALSE;
+              break;
+          }
+      }
+      
+      json_builder_begin_object(builder);
+      
+      json_builder_set_member_name(builder, "id");
+      json_builder_add_string_value(builder, conv->id);
+      
+      json_builder_set_member_name(builder, "title");
+      json_builder_add_string_value(builder, conv->title ? conv->title : "New Chat");
+      
+      json_builder_set_member_name(builder, "timestamp");
+      json_builder_add_int_value(builder, conv->timestamp);
+      
+      if (conv->summary) {
+          json_builder_set_member_name(builder, "summary");
+          json_builder_add_string_value(builder, conv->summary);
+          json_builder_set_member_name(builder, "summary_upto");
+          json_builder_add_int_value(builder, conv->summary_upto);
+      }
+      
+      if (conv->parent_id) {
+          json_builder_set_member_name(builder, "parent");
+          json_builder_add_string_value(builder, conv->parent_id);
+          json_builder_set_member_name(builder, "branch_point");
+          json_builder_add_int_value(builder, branch_point);
+      }
+      
+      json_builder_set_member_name(builder, "messages");
+      if (spilled) {
+          json_builder_add_value(builder, spilled);
+      } else {
+          build_messages(builder, conv->messages, branch_point);
+      }
+      json_builder_end_object(builder);
+  }
+  g_hash_table_unref(by_id);
+  g_clear_object(&previous);
+  
+  json_builder_end_array(builder);
+  json_builder_end_object(builder);
+  if (!complete) {
+      g_object_unref(builder);
+      return;
+  }
+  
+  JsonGenerator *gen = json_generator_new();
+  json_generator_set_pretty(gen, TRUE);
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(gen, root);
+  
+  gchar *json_data = json_generator_to_data(gen, NULL);
+  gchar *path = get_conversations_path();
+  
+  g_file_set_contents(path, json_data, -1, NULL);
+  TRACE_ENDF(trace_save, "save-conversations", "%u conversations, %zu bytes",
+             conversations->len, strlen(json_data));
+  
+  g_free(json_data);
+  g_free(path);
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(builder);
+}
+
+/* Puts the parent's shared messages in front of a loaded branch, resolving
+ * the parent first. Each branch leaves pending before it recurses, so a
+ * cycle in a damaged file ends instead of looping. */
+static void resolve_branch(Conversation *conv, GHashTable *by_id, GHashTable *pending) {
+  gpointer value;
+  if (!g_hash_table_steal_extended(pending, conv, NULL, &value)) return;
+  
+  Conversation *parent = g_hash_table_lookup(by_id, conv->parent_id);
+  if (!parent) return;
+  resolve_branch(parent, by_id, pending);
+  
+  guint upto = MIN(GPOINTER_TO_UINT(value), parent->messages->len);
+  for (guint i = 0; i < upto; i++) {
+      g_ptr_array_insert(conv->messages, i, message_ref(g_ptr_array_index(parent->messages, i)));
+  }
+}
+
+/* Appends the stored conversations to the array. */
+void load_conversations(GPtrArray *conversations) {
+  if (!conversations) return;
+  gint64 trace_load = TRACE_BEGIN();
+  
+  gchar *path = get_conversations_path();
+  gchar *contents = NULL;
+  
+  if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+      g_free(path);
+      return;
+  }
+  
+  JsonParser *parser = json_parser_new();
+  if (!json_parser_load_from_data(parser, contents, -1, NULL)) {
+      g_object_unref(parser);
+      g_free(contents);
+      g_free(path);
+      return;
+  }
+  
+  JsonNode *root = json_parser_get_root(parser);
+  if (!JSON_NODE_HOLDS_OBJECT(root)) {
+      g_object_unref(parser);
+      g_free(contents);
+      g_free(path);
+      return;
+  }
+  
+  JsonObject *obj = json_node_get_object(root);
+  if (!json_object_has_member(obj, "conversations")) {
+      g_object_unref(parser);
+      g_free(contents);
+      g_free(path);
+      return;
+  }
+  
+  JsonArray *convs_array = json_object_get_array_member(obj, "conversations");
+  guint len = json_array_get_length(convs_array);
+  GHashTable *by_id = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTable *pending = g_hash_table_new(NULL, NULL);   // Conversation -> shared prefix length
+  
+  for (guint i = 0; i < len; i++) {
+      JsonObject *conv_obj = json_array_get_object_element(convs_array, i);
+      
+      Conversation *conv = g_new0(Conversation, 1);
+      conv->id = g_strdup(json_object_get_string_member(conv_obj, "id"));
+      conv->title = g_strdup(json_object_get_string_member(conv_obj, "title"));
+      conv->timestamp = json_object_get_int_member(conv_obj, "timestamp");
+      conv->summary = g_strdup(json_object_get_string_member_with_default(conv_obj, "summary", NULL));
+      conv->summary_upto = json_object_get_int_member_with_default(conv_obj, "summary_upto", 0);
+      conv->parent_id = g_strdup(json_object_get_string_member_with_default(conv_obj, "parent", NULL));
+      conv->messages = g_ptr_array_new_with_free_func((GDestroyNotify)message_unref);
+      
+      parse_messages(json_object_get_array_member(conv_obj, "messages"), conv->messages);
+      g_ptr_array_add(conversations, conv);
+      
+      g_hash_table_insert(by_id, conv->id, conv);
+      guint branch_point = json_object_get_int_member_with_default(conv_obj, "branch_point", 0);
+      if (conv->parent_id && branch_point > 0) {
+          g_hash_table_insert(pending, conv, GUINT_TO_POINTER(branch_point));
+      }
+  }
+  
+  // Parents may come after their branches in the file
+  GHashTableIter iter;
+  gpointer key;
+  while (g_hash_table_size(pending) > 0) {
+      g_hash_table_iter_init(&iter, pending);
+      g_hash_table_iter_next(&iter, &key, NULL);
+      resolve_branch(key, by_id, pending);
+  }
+  g_hash_table_unref(pending);
+  g_hash_table_unref(by_id);
+  TRACE_ENDF(trace_load, "load-conversations", "%u conversations", len);
+  
+  g_object_unref(parser);
+  g_free(contents);
+  g_free(path);
+}
+
+/* ---------- Spilling ---------- */
+
+gint64 conversation_spill(Conversation *conv) {
+  if (conv->spill_path || conv->streaming || conv->compacting || conv->messages->len == 0) return 0;
+  
+  // Messages shared with a branch stay where they are
+  for (guint i = 0; i < conv->messages->len; i++) {
+      if (g_atomic_int_get(&((Message*)g_ptr_array_index(conv->messages, i))->ref_count) > 1) return 0;
+  }
+  
+  gint64 structure, text, images;
+  conversation_memory(conv, NULL, &structure, &text, &images);
+  
+  gchar *dir = g_build_filename(g_get_user_cache_dir(), "ganesha", "spill", NULL);
+  g_mkdir_with_parents(dir, 0700);
+  gchar *filename = g_strconcat(conv->id, ".json", NULL);
+  gchar *path = g_build_filename(dir, filename, NULL);
+  g_free(filename);
+  g_free(dir);
+  
+  JsonBuilder *builder = json_builder_new();
+  build_messages(builder, conv->messages, 0);
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(gen, root);
+  gboolean ok = json_generator_to_file(gen, path, NULL);
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(builder);
+  
+  if (!ok) {
+      g_free(path);
+      return 0;
+  }
+  
+  conv->spill_path = path;
+  conv->spilled_messages = conv->messages->len;
+  g_ptr_array_set_size(conv->messages, 0);
+  return text + images + (gint64)conv->spilled_messages * sizeof(Message);
+}
+
+gboolean conversation_restore(Conversation *conv) {
+  if (!conv->spill_path) return TRUE;
+  
+  JsonNode *node = load_spilled_messages(conv);
+  if (!node) {
+      g_warning("Could not read spilled conversation %s", conv->spill_path);
+      return FALSE;
+  }
+  parse_messages(json_node_get_array(node), conv->messages);
+  json_node_unref(node);
+  
+  g_unlink(conv->spill_path);
+  g_clear_pointer(&conv->spill_path, g_free);
+  conv->spilled_messages = 0;
+  return TRUE;
+}
+
+/* ---------- Preferences ---------- */
+
+static gchar* get_prefs_path(void) {
+  const gchar *config_dir = g_get_user_config_dir();
+  gchar *app_dir = g_build_filename(config_dir, "ganesha", NULL);
+  g_mkdir_with_parents(app_dir, 0755);
+  gchar *path = g_build_filename(app_dir, PREFS_FILE, NULL);
+  g_free(app_dir);
+  return path;
+}
+
+/* The prefs file is parsed on first use and kept; saves go through the
+ * cache, so startup reads it once no matter how many keys it looks up. */
+G_LOCK_DEFINE_STATIC(prefs);
+static JsonNode *prefs_root = NULL;
+static gboolean  prefs_loaded = FALSE;
+
+static void prefs_ensure_loaded(void) {
+  if (prefs_loaded) return;
+  prefs_loaded = TRUE;
+  
+  gchar *path = get_prefs_path();
+  gchar *contents = NULL;
+  if (g_file_get_contents(path, &contents, NULL, NULL)) {
+      JsonParser *parser = json_parser_new();
+      if (json_parser_load_from_data(parser, contents, -1, NULL)) {
+          JsonNode *root = json_parser_get_root(parser);
+          if (JSON_NODE_HOLDS_OBJECT(root)) prefs_root = json_node_copy(root);
+      }
+      g_object_unref(parser);
+      g_free(contents);
+  }
+  g_free(path);
+}
+
+static JsonNode* load_pref_member(const gchar *key) {
+  JsonNode *value = NULL;
+  
+  G_LOCK(prefs);
+  prefs_ensure_loaded();
+  if (prefs_root) {
+      JsonObject *obj = json_node_get_object(prefs_root);
+      if (json_object_has_member(obj, key)) {
+          value = json_node_copy(json_object_get_member(obj, key));
+      }
+  }
+  G_UNLOCK(prefs);
+  return value;
+}
+
+/* Sets one key, keeping the others, and writes the file. Takes ownership of value. */
+static void save_pref_member(const gchar *key, JsonNode *value) {
+  G_LOCK(prefs);
+  prefs_ensure_loaded();
+  if (!prefs_root) prefs_root = json_node_init_object(json_node_alloc(), json_object_new());
+  json_object_set_member(json_node_get_object(prefs_root), key, value);
+  
+  JsonGenerator *gen = json_generator_new();
+  json_generator_set_pretty(gen, TRUE);
+  json_generator_set_root(gen, prefs_root);
+  gchar *json_data = json_generator_to_data(gen, NULL);
+  gchar *path = get_prefs_path();
+  g_file_set_contents(path, json_data, -1, NULL);
+  G_UNLOCK(prefs);
+  
+  g_free(json_data);
+  g_free(path);
+  g_object_unref(gen);
+}
+
+gchar* load_preferred_model(void) {
+  return load_pref_string("preferred_model", DEFAULT_MODEL);
+}
+
+void save_preferred_model(const gchar *model) {
+  if (!model) return;
+  
+  JsonNode *value = json_node_new(JSON_NODE_VALUE);
+  json_node_set_string(value, model);
+  save_pref_member("preferred_model", value);
+}
+
+gboolean load_theme_preference(void) {
+  return load_pref_boolean("dark_theme", TRUE);
+}
+
+void save_theme_preference(gboolean dark_theme) {
+  JsonNode *value = json_node_new(JSON_NODE_VALUE);
+  json_node_set_boolean(value, dark_theme);
+  save_pref_member("dark_theme", value);
+}
+
+void save_pref_boolean(const gchar *key, gboolean value) {
+  JsonNode *node = json_node_new(JSON_NODE_VALUE);
+  json_node_set_boolean(node, value);
+  save_pref_member(key, node);
+}
+
+gchar* load_pref_string(const gchar *key, const gchar *fallback) {
+  JsonNode *node = load_pref_member(key);
+  gchar *value = NULL;
+
+  if (node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_STRING) {
+      value = g_strdup(json_node_get_string(node));
+  }
+  if (node) json_node_free(node);
+  return value ? value : g_strdup(fallback);
+}
+
+gboolean load_pref_boolean(const gchar *key, gboolean fallback) {
+  JsonNode *node = load_pref_member(key);
+  gboolean value = fallback;
+
+  if (node && JSON_NODE_HOLDS_VALUE(node) && json_node_get_value_type(node) == G_TYPE_BOOLEAN) {
+      value = json_node_get_boolean(node);
+  }
+  if (node) json_node_free(node);
+  return value;
+}
+
+gdouble load_pref_double(const gchar *key, gdouble fallback) {
+  JsonNode *node = load_pref_member(key);
+  gdouble value = fallback;
+
+  if (node && JSON_NODE_HOLDS_VALUE(node)) {
+      GType type = json_node_get_value_type(node);
+      if (type == G_TYPE_DOUBLE || type == G_TYPE_INT64) {
+          value = json_node_get_double(node);
+      }
+  }
+  if (node) json_node_free(node);
+  return value;
+}
+
+/* ---------- Telemetry ---------- */
+
+#define TTFT_WINDOW 64
+
+typedef struct {
+  guint64 requests;
+  guint64 hedged;       // Requests that started a second leg
+  guint64 hedge_wins;   // Hedged requests where the second leg won
+  guint64 model_loads;  // Requests for a model that was not resident
+  guint64 evictions;    // Models that left memory while one of our requests ran
+  guint64 affinity_warnings;
+  guint64 affinity_delays;
+  guint64 affinity_reroutes;
+  gint64  max_resident_bytes;   // Largest total /api/ps size seen
+  guint64 retrievals;           // Requests that searched the documents
+  gint64  retrieval_embed_ms;   // Time spent embedding their queries, summed
+  gint64  retrieval_search_us;  // Time spent searching the index, summed
+  gint64  ttft_ms[TTFT_WINDOW];
+  guint   ttft_count;
+  guint   ttft_next;
+} Telemetry;
+
+static Telemetry telemetry;
+G_LOCK_DEFINE_STATIC(telemetry);
+
+static gchar* get_telemetry_path(void) {
+  const gchar *config_dir = g_get_user_config_dir();
+  gchar *app_dir = g_build_filename(config_dir, "ganesha", NULL);
+  g_mkdir_with_parents(app_dir, 0755);
+  gchar *path = g_build_filename(app_dir, TELEMETRY_FILE, NULL);
+  g_free(app_dir);
+  return path;
+}
+
+void telemetry_record_request(gboolean hedged, gboolean hedge_won, gint64 ttft_ms) {
+  G_LOCK(telemetry);
+  telemetry.requests++;
+  if (hedged) telemetry.hedged++;
+  if (hedge_won) telemetry.hedge_wins++;
+  if (ttft_ms >= 0) {
+      telemetry.ttft_ms[telemetry.ttft_next] = ttft_ms;
+      telemetry.ttft_next = (telemetry.ttft_next + 1) % TTFT_WINDOW;
+      if (telemetry.ttft_count < TTFT_WINDOW) telemetry.ttft_count++;
+  }
+  G_UNLOCK(telemetry);
+}
+
+void telemetry_record_model_swap(gboolean model_load, guint evictions) {
+  G_LOCK(telemetry);
+  if (model_load) telemetry.model_loads++;
+  telemetry.evictions += evictions;
+  G_UNLOCK(telemetry);
+}
+
+void telemetry_record_affinity(gboolean warned, gboolean delayed, gboolean rerouted) {
+  G_LOCK(telemetry);
+  if (warned) telemetry.affinity_warnings++;
+  if (delayed) telemetry.affinity_delays++;
+  if (rerouted) telemetry.affinity_reroutes++;
+  G_UNLOCK(telemetry);
+}
+
+void telemetry_observe_resident(gint64 bytes) {
+  G_LOCK(telemetry);
+  telemetry.max_resident_bytes = MAX(telemetry.max_resident_bytes, bytes);
+  G_UNLOCK(telemetry);
+}
+
+void telemetry_record_retrieval(gint64 embed_us, gint64 search_us) {
+  G_LOCK(telemetry);
+  telemetry.retrievals++;
+  telemetry.retrieval_embed_ms += embed_us / 1000;
+  telemetry.retrieval_search_us += search_us;
+  G_UNLOCK(telemetry);
+}
+
+static gint compare_gint64(gconstpointer a, gconstpointer b) {
+  gint64 x = *(const gint64*)a;
+  gint64 y = *(const gint64*)b;
+  return (x > y) - (x < y);
+}
+
+/* Returns -1 until enough samples have been collected. */
+gint64 telemetry_ttft_percentile(gdouble percentile) {
+  gint64 samples[TTFT_WINDOW];
+  guint count;
+
+  G_LOCK(telemetry);
+  count = telemetry.ttft_count;
+  memcpy(samples, telemetry.ttft_ms, sizeof(samples));
+  G_UNLOCK(telemetry);
+
+  if (count < HEDGE_MIN_SAMPLES) return -1;
+
+  qsort(samples, count, sizeof(gint64), compare_gint64);
+  guint idx = (guint)(CLAMP(percentile, 0.0, 1.0) * (count - 1) + 0.5);
+  return samples[idx];
+}
+
+void load_telemetry(void) {
+  gchar *path = get_telemetry_path();
+  gchar *contents = NULL;
+
+  if (g_file_get_contents(path, &contents, NULL, NULL)) {
+      JsonParser *parser = json_parser_new();
+      if (json_parser_load_from_data(parser, contents, -1, NULL)) {
+          JsonNode *root = json_parser_get_root(parser);
+          if (JSON_NODE_HOLDS_OBJECT(root)) {
+              JsonObject *obj = json_node_get_object(root);
+              G_LOCK(telemetry);
+              telemetry.requests = json_object_get_int_member_with_default(obj, "requests", 0);
+              telemetry.hedged = json_object_get_int_member_with_default(obj, "hedged", 0);
+              telemetry.hedge_wins = json_object_get_int_member_with_default(obj, "hedge_wins", 0);
+              telemetry.model_loads = json_object_get_int_member_with_default(obj, "model_loads", 0);
+              telemetry.evictions = json_object_get_int_member_with_default(obj, "evictions", 0);
+              telemetry.affinity_warnings = json_object_get_int_member_with_default(obj, "affinity_warnings", 0);
+              telemetry.affinity_delays = json_object_get_int_member_with_default(obj, "affinity_delays", 0);
+              telemetry.affinity_reroutes = json_object_get_int_member_with_default(obj, "affinity_reroutes", 0);
+              telemetry.max_resident_bytes = json_object_get_int_member_with_default(obj, "max_resident_bytes", 0);
+              telemetry.retrievals = json_object_get_int_member_with_default(obj, "retrievals", 0);
+              telemetry.retrieval_embed_ms = json_object_get_int_member_with_default(obj, "retrieval_embed_ms", 0);
+              telemetry.retrieval_search_us = json_object_get_int_member_with_default(obj, "retrieval_search_us", 0);
+              if (json_object_has_member(obj, "ttft_ms")) {
+                  JsonArray *arr = json_object_get_array_member(obj, "ttft_ms");
+                  guint len = MIN(json_array_get_length(arr), TTFT_WINDOW);
+                  for (guint i = 0; i < len; i++) {
+                      telemetry.ttft_ms[i] = json_array_get_int_element(arr, i);
+                  }
+                  telemetry.ttft_count = len;
+                  telemetry.ttft_next = len % TTFT_WINDOW;
+              }
+              G_UNLOCK(telemetry);
+          }
+      }
+      g_object_unref(parser);
+      g_free(contents);
+  }
+
+  g_free(path);
+}
+
+void save_telemetry(void) {
+  JsonBuilder *builder = json_builder_new();
+  json_builder_begin_object(builder);
+
+  G_LOCK(telemetry);
+  json_builder_set_member_name(builder, "requests");
+  json_builder_add_int_value(builder, telemetry.requests);
+  json_builder_set_member_name(builder, "hedged");
+  json_builder_add_int_value(builder, telemetry.hedged);
+  json_builder_set_member_name(builder, "hedge_wins");
+  json_builder_add_int_value(builder, telemetry.hedge_wins);
+  json_builder_set_member_name(builder, "model_loads");
+  json_builder_add_int_value(builder, telemetry.model_loads);
+  json_builder_set_member_name(builder, "evictions");
+  json_builder_add_int_value(builder, telemetry.evictions);
+  json_builder_set_member_name(builder, "affinity_warnings");
+  json_builder_add_int_value(builder, telemetry.affinity_warnings);
+  json_builder_set_member_name(builder, "affinity_delays");
+  json_builder_add_int_value(builder, telemetry.affinity_delays);
+  json_builder_set_member_name(builder, "affinity_reroutes");
+  json_builder_add_int_value(builder, telemetry.affinity_reroutes);
+  json_builder_set_member_name(builder, "max_resident_bytes");
+  json_builder_add_int_value(builder, telemetry.max_resident_bytes);
+  json_builder_set_member_name(builder, "retrievals");
+  json_builder_add_int_value(builder, telemetry.retrievals);
+  json_builder_set_member_name(builder, "retrieval_embed_ms");
+  json_builder_add_int_value(builder, telemetry.retrieval_embed_ms);
+  json_builder_set_member_name(builder, "retrieval_search_us");
+  json_builder_add_int_value(builder, telemetry.retrieval_search_us);
+
+  // Oldest sample first so a reload keeps the window order
+  json_builder_set_member_name(builder, "ttft_ms");
+  json_builder_begin_array(builder);
+  guint first = telemetry.ttft_count < TTFT_WINDOW ? 0 : telemetry.ttft_next;
+  for (guint i = 0; i < telemetry.ttft_count; i++) {
+      json_builder_add_int_value(builder, telemetry.ttft_ms[(first + i) % TTFT_WINDOW]);
+  }
+  json_builder_end_array(builder);
+  G_UNLOCK(telemetry);
+
+  json_builder_end_object(builder);
+
+  JsonGenerator *gen = json_generator_new();
+  json_generator_set_pretty(gen, TRUE);
+  JsonNode *root = json_builder_get_root(builder);
+  json_generator_set_root(gen, root);
+
+  gchar *json_data = json_generator_to_data(gen, NULL);
+  gchar *path = get_telemetry_path();
+  g_file_set_contents(path, json_data, -1, NULL);
+
+  g_free(json_data);
+  g_free(path);
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(builder);
+}
+
@@ -0,0 +1,167 @@
+#include "ganesha-core.h"
+
+#ifdef GANESHA_HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+/* ---------- Tracing ----------
+ * Spans go to Sysprof as capture marks when the process runs under it, or
+ * are buffered and written as a Chrome trace (chrome://tracing, Perfetto)
+ * to $GANESHA_TRACE on trace_shutdown(). With neither, trace_active stays
+ * FALSE and the TRACE_* macros only test it. */
+
+gboolean trace_active = FALSE;
+
+typedef struct {
+  gchar  *name;
+  gchar  *detail;
+  gint64  ts;         // Microseconds since trace_init()
+  gint64  dur;        // -1 for instants
+  guint   tid;
+} TraceEvent;
+
+G_LOCK_DEFINE_STATIC(trace);
+static GArray *trace_events = NULL;   // TraceEvent, Chrome export only
+static gchar  *trace_path = NULL;
+static gint64  trace_origin = 0;
+static gboolean trace_sysprof = FALSE;
+static gint     trace_next_tid = 0;
+static GPrivate trace_tid;
+
+static void trace_event_clear(gpointer data) {
+  TraceEvent *ev = data;
+  g_free(ev->name);
+  g_free(ev->detail);
+}
+
+static guint current_tid(void) {
+  guint tid = GPOINTER_TO_UINT(g_private_get(&trace_tid));
+  if (!tid) {
+      tid = (guint)g_atomic_int_add(&trace_next_tid, 1) + 1;
+      g_private_set(&trace_tid, GUINT_TO_POINTER(tid));
+  }
+  return tid;
+}
+
+void trace_init(void) {
+#ifdef GANESHA_HAVE_SYSPROF
+  if (sysprof_collector_is_active()) {
+      trace_sysprof = TRUE;
+      trace_active = TRUE;
+      return;
+  }
+#endif
+  const gchar *path = g_getenv("GANESHA_TRACE");
+  if (!path || !*path) return;
+
+  trace_path = g_strdup(path);
+  trace_origin = g_get_monotonic_time();
+  trace_events = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+  g_array_set_clear_func(trace_events, trace_event_clear);
+  trace_active = TRUE;
+}
+
+static void trace_record(const gchar *name, gint64 begin, gint64 dur, const gchar *detail) {
+#ifdef GANESHA_HAVE_SYSPROF
+  if (trace_sysprof) {
+      sysprof_collector_mark(begin * 1000, MAX(dur, 0) * 1000, "Ganesha", name, detail);
+      return;
+  }
+#endif
+  TraceEvent ev = {
+    .name = g_strdup(name),
+    .detail = g_strdup(detail),
+    .ts = begin - trace_origin,
+    .dur = dur,
+    .tid = current_tid(),
+  };
+  G_LOCK(trace);
+  if (trace_events) g_array_append_val(trace_events, ev);
+  else trace_event_clear(&ev);
+  G_UNLOCK(trace);
+}
+
+void trace_span(const gchar *name, gint64 begin, const gchar *detail) {
+  trace_record(name, begin, g_get_monotonic_time() - begin, detail);
+}
+
+void trace_span_printf(const gchar *name, gint64 begin, const gchar *format, ...) {
+  gint64 end = g_get_monotonic_time();
+  va_list args;
+  va_start(args, format);
+  gchar *detail = g_strdup_vprintf(format, args);
+  va_end(args);
+  trace_record(name, begin, end - begin, detail);
+  g_free(detail);
+}
+
+void trace_instant(const gchar *name, const gchar *detail) {
+  trace_record(name, g_get_monotonic_time(), -1, detail);
+}
+
+void trace_shutdown(void) {
+  if (!trace_active) return;
+  trace_active = FALSE;
+  if (trace_sysprof) return;
+
+  G_LOCK(trace);
+  GArray *events = g_steal_pointer(&trace_events);
+  G_UNLOCK(trace);
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "displayTimeUnit");
+  json_builder_add_string_value(b, "ms");
+  json_builder_set_member_name(b, "traceEvents");
+  json_builder_begin_array(b);
+  for (guint i = 0; i < events->len; i++) {
+      TraceEvent *ev = &g_array_index(events, TraceEvent, i);
+      json_builder_begin_object(b);
+      json_builder_set_member_name(b, "name");
+      json_builder_add_string_value(b, ev->name);
+      json_builder_set_member_name(b, "cat");
+      json_builder_add_string_value(b, "ganesha");
+      json_builder_set_member_name(b, "ph");
+      json_builder_add_string_value(b, ev->dur < 0 ? "i" : "X");
+      json_builder_set_member_name(b, "ts");
+      json_builder_add_int_value(b, ev->ts);
+      if (ev->dur >= 0) {
+          json_builder_set_member_name(b, "dur");
+          json_builder_add_int_value(b, ev->dur);
+      } else {
+          json_builder_set_member_name(b, "s");
+          json_builder_add_string_value(b, "t");
+      }
+      json_builder_set_member_name(b, "pid");
+      json_builder_add_int_value(b, 1);
+      json_builder_set_member_name(b, "tid");
+      json_builder_add_int_value(b, ev->tid);
+      if (ev->detail) {
+          json_builder_set_member_name(b, "args");
+          json_builder_begin_object(b);
+          json_builder_set_member_name(b, "detail");
+          json_builder_add_string_value(b, ev->detail);
+          json_builder_end_object(b);
+      }
+      json_builder_end_object(b);
+  }
+  json_builder_end_array(b);
+  json_builder_end_object(b);
+
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  GError *error = NULL;
+  if (!json_generator_to_file(gen, trace_path, &error)) {
+      g_warning("Could not write trace to %s: %s", trace_path, error->message);
+      g_error_free(error);
+  } else {
+      g_message("Wrote %u trace events to %s", events->len, trace_path);
+  }
+
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(b);
+  g_array_unref(events);
+  g_clear_pointer(&trace_path, g_free);
+}
@@ -4,27 +4,20 @@
 #include <libsoup/soup.h>
 #include <json-glib/json-glib.h>
 #include <gtksourceview/gtksource.h>
+#include <glib/gstdio.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
-/* ================== Config ================== */
-static const char *OLLAMA_BASE_URL = "http://192.168.0.3:11434";
-static const char *DEFAULT_MODEL   = "llama3.2:3b";
-static const int   REQUEST_TIMEOUT = 300;
-static const char *PREFS_FILE      = "ganesha-prefs.json";
-static const char *CONVERSATIONS_FILE = "ganesha-conversations.json";
-/* ============================================ */
+#include "core/ganesha-core.h"
 
+/* Bubbles built for a conversation, with the state they were built from. */
 typedef struct {
-  gchar *role;
-  gchar *content;
-  GPtrArray *images; // Array de imagens em base64
-} Message;
-
-typedef struct {
-  gchar *id;
-  gchar *title;
-  GPtrArray *messages;
-  gint64 timestamp;
-} Conversation;
+  Conversation *conv;
+  GPtrArray    *bubbles;      // GtkWidget refs while detached, in display order
+  guint         n_messages;
+  gsize         last_len;     // Length of the last message's content
+} RenderedConversation;
 
 typedef struct {
   GtkBox        *chat_box;
@@ -49,8 +42,46 @@ typedef struct {
   GPtrArray     *pending_images; // Imagens pendentes para anexar
   
   GtkWidget     *current_assistant_box;
+  GString       *stream_text;      // Reply being streamed; copied into the message once per frame
+  guint          stream_flush_source;  // Power-saver flush timeout (0 = none)
+  guint          stream_flush_tick;    // Frame-clock flush callback on chat_box (0 = none)
   GtkWidget     *theme_btn;
   gboolean       dark_theme;
+  
+  gchar         *hedge_url;        // Second endpoint for hedged requests (NULL = off)
+  gdouble        hedge_percentile;
+  
+  gchar         *keep_alive;
+  gboolean       warmup_on_typing;
+  gchar         *warming_model;    // Model with a warm-up request in flight
+  gboolean       model_loaded;     // Last /api/ps answer for selected_model
+  gboolean       prompt_empty;
+  GtkLabel      *model_status;
+  
+  gint           affinity_policy;  // AffinityPolicy, from "affinity_policy"
+  gint64         server_memory;    // Bytes the server can keep resident (0 = unknown, not checked)
+  gint           server_max_models;
+  GtkLabel      *scheduler_note;
+  
+  gint           num_ctx;
+  GtkLabel      *context_label;
+  gchar         *compaction_model;  // Summarizes old turns (NULL = off)
+  GCancellable  *compaction_cancellable;   // Cancelled when the window closes
+  
+  ApiService    *api_service;       // Local API socket (NULL = off)
+  gboolean       history_loaded;    // Set once hydrate_history_cb has run
+  
+  RagIndex      *documents;         // Searched before each request (NULL until the history loads)
+  gboolean       search_documents;  // "search_documents"
+  gboolean       indexing;          // Documents are being added
+  gchar         *embedding_model;
+  
+  RenderedConversation *shown;      // What chat_box holds (NULL = not a cached build)
+  GQueue         rendered;          // Detached RenderedConversation, most recent first
+  GMemoryMonitor *memory_monitor;
+  GPowerProfileMonitor *power_monitor;   // NULL when GANESHA_POWER_SAVER overrides it
+  gboolean       follow_bottom;     // The chat stays scrolled to its end as it grows
+  guint          editing_serial;    // User message being edited: sending branches before it
 } AppWidgets;
 
 /* ---------- CSS Styling ---------- */
@@ -170,6 +201,7 @@ static const char *DARK_CSS =
 ".loading-dot:nth-child(1) { animation-delay: 0s; }"
 ".loading-dot:nth-child(2) { animation-delay: 0.2s; }"
 ".loading-dot:nth-child(3) { animation-delay: 0.4s; }"
+".power-saver .loading-dot { animation: none; opacity: 0.6; }"
 "@keyframes blink {"
 "  0%, 100% { opacity: 0.3; transform: scale(0.8); }"
 "  50% { opacity: 1; transform: scale(1.2); }"
@@ -239,6 +271,13 @@ static const char *DARK_CSS =
 "  border-radius: 8px;"
 "  padding: 8px;"
 "  margin: 8px 0;"
+"}"
+".model-status {"
+"  font-size: 12px;"
+"  color: #a0a0a0;"
+"}"
+".model-status.loaded {"
+"  color: #6fd38f;"
 "}";
 
 static const char *LIGHT_CSS = 
@@ -356,6 +395,7 @@ static const char *LIGHT_CSS =
 ".loading-dot:nth-child(1) { animation-delay: 0s; }"
 ".loading-dot:nth-child(2) { animation-delay: 0.2s; }"
 ".loading-dot:nth-child(3) { animation-delay: 0.4s; }"
+".power-saver .loading-dot { animation: none; opacity: 0.6; }"
 "@keyframes blink {"
 "  0%, 100% { opacity: 0.3; transform: scale(0.8); }"
 "  50% { opacity: 1; transform: scale(1.2); }"
@@ -425,627 +465,507 @@ static const char *LIGHT_CSS =
 "  border-radius: 8px;"
 "  padding: 8px;"
 "  margin: 8px 0;"
+"}"
+".model-status {"
+"  font-size: 12px;"
+"  color: #6c757d;"
+"}"
+".model-status.loaded {"
+"  color: #2f9e55;"
 "}";
 
-/* ---------- Message/Conversation helpers ---------- */
+/* ---------- UI Message Bubbles ---------- */
 
-static Message* message_new(const gchar *role, const gchar *content) {
-  Message *msg = g_new0(Message, 1);
-  msg->role = g_strdup(role);
-  msg->content = g_strdup(content);
-  msg->images = g_ptr_array_new_with_free_func(g_free);
-  return msg;
+static GtkWidget* create_loading_bubble(void) {
+  GtkWidget *bubble = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+  gtk_widget_add_css_class(bubble, "message-bubble");
+  gtk_widget_add_css_class(bubble, "assistant-message");
+  gtk_widget_set_halign(bubble, GTK_ALIGN_START);
+  
+  GtkWidget *loading_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+  gtk_widget_set_halign(loading_box, GTK_ALIGN_START);
+  
+  for (int i = 0; i < 3; i++) {
+    GtkWidget *dot = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_widget_set_size_request(dot, 8, 8);
+    gtk_widget_add_css_class(dot, "loading-dot");
+    gtk_box_append(GTK_BOX(loading_box), dot);
+  }
+  
+  gtk_box_append(GTK_BOX(bubble), loading_box);
+  return bubble;
 }
 
-static void message_free(Message *msg) {
-  if (!msg) return;
-  g_free(msg->role);
-  g_free(msg->content);
-  if (msg->images) g_ptr_array_unref(msg->images);
-  g_free(msg);
-}
-
-static Conversation* conversation_new(void) {
-  Conversation *conv = g_new0(Conversation, 1);
-  conv->id = g_uuid_string_random();
-  conv->title = NULL;
-  conv->messages = g_ptr_array_new_with_free_func((GDestroyNotify)message_free);
-  conv->timestamp = g_get_real_time();
-  return conv;
+/* ---------- Enhanced Markdown Parsing ---------- */
+
+static GtkWidget* markdown_label(const gchar *text, const gchar *css_class) {
+  GtkWidget *label = gtk_label_new(text);
+  gtk_label_set_wrap(GTK_LABEL(label), TRUE);
+  gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+  gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+  gtk_widget_add_css_class(label, css_class);
+  return label;
 }
 
-static void conversation_free(Conversation *conv) {
-  if (!conv) return;
-  g_free(conv->id);
-  g_free(conv->title);
-  g_ptr_array_unref(conv->messages);
-  g_free(conv);
+static GtkWidget* markdown_list_item(const gchar *marker, const gchar *text) {
+  GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+  GtkWidget *bullet = gtk_label_new(marker);
+  gtk_widget_add_css_class(bullet, "list-bullet");
+  gtk_box_append(GTK_BOX(hbox), bullet);
+  
+  GtkWidget *label = markdown_label(text, "list-item");
+  gtk_widget_set_hexpand(label, TRUE);
+  gtk_box_append(GTK_BOX(hbox), label);
+  return hbox;
 }
 
-static void conversation_add_message(Conversation *conv, const gchar *role, const gchar *content) {
-  if (!conv) return;
-  Message *msg = message_new(role, content);
-  g_ptr_array_add(conv->messages, msg);
+/* ---------- Code Blocks ----------
+ * Fences render in a GtkSourceView. Each fence tag is resolved to a
+ * language once. Highlighting stays off until the block comes within a
+ * screen of the viewport. Text longer than CODE_INSERT_CHUNK goes into the
+ * buffer one chunk per frame, and only while the block is mapped. */
+
+static GHashTable *code_languages = NULL;   // Lowercased tag -> GtkSourceLanguage, NULL = plain text
+static GPtrArray  *code_pending = NULL;     // GWeakRef to views not highlighted yet
+
+static const struct { const gchar *tag; const gchar *id; } CODE_ALIASES[] = {
+  { "py", "python3" },  { "python", "python3" }, { "javascript", "js" },  { "ts", "typescript" },
+  { "bash", "sh" },     { "shell", "sh" },       { "zsh", "sh" },         { "console", "sh" },
+  { "c++", "cpp" },     { "rs", "rust" },        { "yml", "yaml" },       { "md", "markdown" },
+  { "golang", "go" },   { "cs", "c-sharp" },     { "csharp", "c-sharp" }, { "rb", "ruby" },
+};
+
+static GtkSourceLanguage* code_language_for(const gchar *tag) {
+  if (!tag || !*tag) return NULL;
+  if (!code_languages) code_languages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  
+  // "python title=x" -> "python"
+  gchar *key = g_ascii_strdown(tag, strcspn(tag, " \t{"));
+  gpointer cached = NULL;
+  if (g_hash_table_lookup_extended(code_languages, key, NULL, &cached)) {
+      g_free(key);
+      return cached;
+  }
   
-  if (!conv->title && g_strcmp0(role, "user") == 0) {
-      gchar *title = g_strdup(content);
-      if (strlen(title) > 50) {
-          title[47] = '.';
-          title[48] = '.';
-          title[49] = '.';
-          title[50] = '\0';
+  const gchar *id = key;
+  for (guint i = 0; i < G_N_ELEMENTS(CODE_ALIASES); i++) {
+      if (g_strcmp0(key, CODE_ALIASES[i].tag) == 0) id = CODE_ALIASES[i].id;
+  }
+  GtkSourceLanguageManager *manager = gtk_source_language_manager_get_default();
+  GtkSourceLanguage *language = gtk_source_language_manager_get_language(manager, id);
+  if (!language) {
+      gchar *filename = g_strconcat("snippet.", key, NULL);
+      language = gtk_source_language_manager_guess_language(manager, filename, NULL);
+      g_free(filename);
+  }
+  g_hash_table_insert(code_languages, key, language);
+  return language;
+}
+
+static GtkSourceStyleScheme* code_scheme(gboolean dark) {
+  static GtkSourceStyleScheme *schemes[2] = { NULL, NULL };
+  if (!schemes[dark]) {
+      GtkSourceStyleSchemeManager *manager = gtk_source_style_scheme_manager_get_default();
+      schemes[dark] = gtk_source_style_scheme_manager_get_scheme(manager, dark ? "Adwaita-dark" : "Adwaita");
+      if (!schemes[dark]) {
+          schemes[dark] = gtk_source_style_scheme_manager_get_scheme(manager, dark ? "classic-dark" : "classic");
       }
-      conv->title = title;
   }
+  return schemes[dark];
 }
 
-/* ---------- Persistence ---------- */
+static void on_code_theme_changed(AdwStyleManager *style, GParamSpec *pspec, gpointer user_data) {
+  (void)pspec;
+  gtk_source_buffer_set_style_scheme(GTK_SOURCE_BUFFER(user_data), code_scheme(adw_style_manager_get_dark(style)));
+}
 
-static gchar* get_conversations_path(void) {
-  const gchar *config_dir = g_get_user_config_dir();
-  gchar *app_dir = g_build_filename(config_dir, "ganesha", NULL);
-  g_mkdir_with_parents(app_dir, 0755);
-  gchar *path = g_build_filename(app_dir, CONVERSATIONS_FILE, NULL);
-  g_free(app_dir);
-  return path;
+typedef struct {
+  gchar *text;
+  gsize  offset;
+  gsize  len;
+} CodeInsert;
+
+static void code_insert_free(gpointer data) {
+  CodeInsert *ci = data;
+  g_free(ci->text);
+  g_free(ci);
 }
 
-static void save_conversations(AppWidgets *aw) {
-  if (!aw || !aw->conversations) return;
+static gboolean code_insert_tick(GtkWidget *view, GdkFrameClock *clock, gpointer data) {
+  (void)clock;
+  CodeInsert *ci = data;
+  const gchar *start = ci->text + ci->offset;
+  const gchar *end = ci->text + MIN(ci->offset + CODE_INSERT_CHUNK, ci->len);
+  
+  if (*end) {
+      // Break after a newline if the chunk has one, never inside a character
+      const gchar *nl = g_strrstr_len(start, end - start, "\n");
+      if (nl) end = nl + 1;
+      else while (end > start && ((guchar)*end & 0xC0) == 0x80) end--;
+  }
   
-  JsonBuilder *builder = json_builder_new();
-  json_builder_begin_object(builder);
-  json_builder_set_member_name(builder, "conversations");
-  json_builder_begin_array(builder);
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(view));
+  GtkTextIter iter;
+  gtk_text_buffer_get_end_iter(buffer, &iter);
+  gtk_text_buffer_insert(buffer, &iter, start, end - start);
+  ci->offset = end - ci->text;
+  return ci->offset < ci->len ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void code_weak_ref_free(gpointer data) {
+  g_weak_ref_clear(data);
+  g_free(data);
+}
+
+/* Where a widget sits relative to the chat viewport, in viewport heights:
+ * 0 when it overlaps it, G_MAXFLOAT when it is not in the chat at all. */
+static gfloat viewport_distance(GtkWidget *widget, GtkWidget *scroller) {
+  graphene_rect_t bounds;
+  gfloat height = MAX(gtk_widget_get_height(scroller), 1);
+  if (!gtk_widget_get_mapped(widget) || !gtk_widget_compute_bounds(widget, scroller, &bounds)) {
+      return G_MAXFLOAT;
+  }
+  if (bounds.origin.y + bounds.size.height < 0) return -(bounds.origin.y + bounds.size.height) / height;
+  if (bounds.origin.y > height) return (bounds.origin.y - height) / height;
+  return 0;
+}
+
+/* Switches highlighting on for pending blocks within a screen of the viewport. */
+static void highlight_visible_code(GtkWidget *scroller) {
+  if (!code_pending) return;
   
-  for (guint i = 0; i < aw->conversations->len; i++) {
-      Conversation *conv = g_ptr_array_index(aw->conversations, i);
-      json_builder_begin_object(builder);
-      
-      json_builder_set_member_name(builder, "id");
-      json_builder_add_string_value(builder, conv->id);
-      
-      json_builder_set_member_name(builder, "title");
-      json_builder_add_string_value(builder, conv->title ? conv->title : "New Chat");
-      
-      json_builder_set_member_name(builder, "timestamp");
-      json_builder_add_int_value(builder, conv->timestamp);
-      
-      json_builder_set_member_name(builder, "messages");
-      json_builder_begin_array(builder);
-      
-      for (guint j = 0; j < conv->messages->len; j++) {
-          Message *msg = g_ptr_array_index(conv->messages, j);
-          json_builder_begin_object(builder);
-          json_builder_set_member_name(builder, "role");
-          json_builder_add_string_value(builder, msg->role);
-          json_builder_set_member_name(builder, "content");
-          json_builder_add_string_value(builder, msg->content);
-          
-          // Save images if present
-          if (msg->images && msg->images->len > 0) {
-              json_builder_set_member_name(builder, "images");
-              json_builder_begin_array(builder);
-              for (guint k = 0; k < msg->images->len; k++) {
-                  const gchar *img = g_ptr_array_index(msg->images, k);
-                  json_builder_add_string_value(builder, img);
-              }
-              json_builder_end_array(builder);
-          }
-          
-          json_builder_end_object(builder);
+  for (guint i = 0; i < code_pending->len; ) {
+      GtkWidget *view = g_weak_ref_get(g_ptr_array_index(code_pending, i));
+      if (!view) {
+          g_ptr_array_remove_index_fast(code_pending, i);
+          continue;
       }
       
-      json_builder_end_array(builder);
-      json_builder_end_object(builder);
+      if (viewport_distance(view, scroller) <= 1) {
+          GtkSourceBuffer *buffer = GTK_SOURCE_BUFFER(gtk_text_view_get_buffer(GTK_TEXT_VIEW(view)));
+          gtk_source_buffer_set_highlight_syntax(buffer, TRUE);
+          g_ptr_array_remove_index_fast(code_pending, i);
+      } else {
+          i++;
+      }
+      g_object_unref(view);
   }
-  
-  json_builder_end_array(builder);
-  json_builder_end_object(builder);
-  
-  JsonGenerator *gen = json_generator_new();
-  json_generator_set_pretty(gen, TRUE);
-  JsonNode *root = json_builder_get_root(builder);
-  json_generator_set_root(gen, root);
-  
-  gchar *json_data = json_generator_to_data(gen, NULL);
-  gchar *path = get_conversations_path();
-  
-  g_file_set_contents(path, json_data, -1, NULL);
-  
-  g_free(json_data);
-  g_free(path);
-  json_node_free(root);
-  g_object_unref(gen);
-  g_object_unref(builder);
 }
 
-static void load_conversations(AppWidgets *aw) {
-  if (!aw) return;
+static GtkWidget* markdown_code_block(const MdBlock *block) {
+  GtkWidget *code_scroll = gtk_scrolled_window_new();
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(code_scroll),
+                                GTK_POLICY_AUTOMATIC,
+                                GTK_POLICY_AUTOMATIC);
+  gtk_widget_set_size_request(code_scroll, -1, 200);
   
-  gchar *path = get_conversations_path();
-  gchar *contents = NULL;
+  GtkSourceBuffer *buffer = gtk_source_buffer_new(NULL);
+  gtk_source_buffer_set_highlight_syntax(buffer, FALSE);
+  gtk_source_buffer_set_highlight_matching_brackets(buffer, FALSE);
+  gtk_source_buffer_set_language(buffer, code_language_for(block->marker));
   
-  if (!g_file_get_contents(path, &contents, NULL, NULL)) {
-      g_free(path);
-      return;
+  AdwStyleManager *style = adw_style_manager_get_default();
+  gtk_source_buffer_set_style_scheme(buffer, code_scheme(adw_style_manager_get_dark(style)));
+  g_signal_connect_object(style, "notify::dark", G_CALLBACK(on_code_theme_changed), buffer, 0);
+  
+  GtkWidget *code_view = gtk_source_view_new_with_buffer(buffer);
+  g_object_unref(buffer);
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(code_view), FALSE);
+  gtk_text_view_set_monospace(GTK_TEXT_VIEW(code_view), TRUE);
+  gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(code_view), GTK_WRAP_NONE);
+  gtk_widget_add_css_class(code_view, "code-block");
+  
+  gsize len = strlen(block->text);
+  if (len <= CODE_INSERT_CHUNK) {
+      gtk_text_buffer_set_text(GTK_TEXT_BUFFER(buffer), block->text, len);
+  } else {
+      CodeInsert *ci = g_new0(CodeInsert, 1);
+      ci->text = g_strdup(block->text);
+      ci->len = len;
+      gtk_widget_add_tick_callback(code_view, code_insert_tick, ci, code_insert_free);
   }
   
-  JsonParser *parser = json_parser_new();
-  if (!json_parser_load_from_data(parser, contents, -1, NULL)) {
-      g_object_unref(parser);
-      g_free(contents);
-      g_free(path);
-      return;
+  if (gtk_source_buffer_get_language(buffer)) {
+      if (!code_pending) code_pending = g_ptr_array_new_with_free_func(code_weak_ref_free);
+      GWeakRef *ref = g_new0(GWeakRef, 1);
+      g_weak_ref_init(ref, code_view);
+      g_ptr_array_add(code_pending, ref);
   }
   
-  JsonNode *root = json_parser_get_root(parser);
-  if (!JSON_NODE_HOLDS_OBJECT(root)) {
-      g_object_unref(parser);
-      g_free(contents);
-      g_free(path);
-      return;
-  }
+  gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(code_scroll), code_view);
+  return code_scroll;
+}
+
+static GtkWidget* markdown_inline_code(const gchar *text) {
+  GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+  gchar **parts = g_strsplit(text, "`", -1);
+  gboolean is_code = FALSE;
   
-  JsonObject *obj = json_node_get_object(root);
-  if (!json_object_has_member(obj, "conversations")) {
-      g_object_unref(parser);
-      g_free(contents);
-      g_free(path);
-      return;
+  for (gchar **part = parts; *part; part++) {
+    if (**part) {
+      GtkWidget *label = gtk_label_new(*part);
+      gtk_label_set_wrap(GTK_LABEL(label), TRUE);
+      gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+      gtk_widget_add_css_class(label, is_code ? "inline-code" : "message-content");
+      gtk_box_append(GTK_BOX(hbox), label);
+    }
+    is_code = !is_code;
   }
   
-  JsonArray *convs_array = json_object_get_array_member(obj, "conversations");
-  guint len = json_array_get_length(convs_array);
-  
-  for (guint i = 0; i < len; i++) {
-      JsonObject *conv_obj = json_array_get_object_element(convs_array, i);
-      
-      Conversation *conv = g_new0(Conversation, 1);
-      conv->id = g_strdup(json_object_get_string_member(conv_obj, "id"));
-      conv->title = g_strdup(json_object_get_string_member(conv_obj, "title"));
-      conv->timestamp = json_object_get_int_member(conv_obj, "timestamp");
-      conv->messages = g_ptr_array_new_with_free_func((GDestroyNotify)message_free);
-      
-      JsonArray *msgs_array = json_object_get_array_member(conv_obj, "messages");
-      guint msgs_len = json_array_get_length(msgs_array);
-      
-      for (guint j = 0; j < msgs_len; j++) {
-          JsonObject *msg_obj = json_array_get_object_element(msgs_array, j);
-          Message *msg = message_new(
-              json_object_get_string_member(msg_obj, "role"),
-              json_object_get_string_member(msg_obj, "content")
-          );
-          
-          // Load images if present
-          if (json_object_has_member(msg_obj, "images")) {
-              JsonArray *imgs_array = json_object_get_array_member(msg_obj, "images");
-              guint imgs_len = json_array_get_length(imgs_array);
-              for (guint k = 0; k < imgs_len; k++) {
-                  const gchar *img = json_array_get_string_element(imgs_array, k);
-                  g_ptr_array_add(msg->images, g_strdup(img));
-              }
-          }
-          
-          g_ptr_array_add(conv->messages, msg);
-      }
-      
-      g_ptr_array_add(aw->conversations, conv);
+  g_strfreev(parts);
+  return hbox;
+}
+
+static GtkWidget* markdown_block_widget(const MdBlock *block) {
+  GtkWidget *child = NULL;
+  
+  switch (block->type) {
+    case MD_CODE:
+      child = markdown_code_block(block);
+      break;
+    case MD_INLINE_CODE:
+      child = markdown_inline_code(block->text);
+      break;
+    case MD_HEADER_1:
+      child = markdown_label(block->text, "header-1");
+      break;
+    case MD_HEADER_2:
+      child = markdown_label(block->text, "header-2");
+      break;
+    case MD_HEADER_3:
+      child = markdown_label(block->text, "header-3");
+      break;
+    case MD_QUOTE:
+      child = markdown_label(block->text, "blockquote");
+      gtk_widget_set_margin_start(child, 12);
+      break;
+    case MD_BULLET:
+      child = markdown_list_item("•", block->text);
+      break;
+    case MD_NUMBERED:
+      child = markdown_list_item(block->marker, block->text);
+      break;
+    case MD_PARAGRAPH:
+      child = markdown_label(block->text, "message-content");
+      gtk_label_set_wrap_mode(GTK_LABEL(child), PANGO_WRAP_WORD_CHAR);
+      break;
+    case MD_SPACER:
+    default:
+      child = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+      gtk_widget_set_size_request(child, -1, 8);
+      break;
   }
-  
-  g_object_unref(parser);
-  g_free(contents);
-  g_free(path);
+  return child;
 }
 
-/* ---------- Preferences ---------- */
+/* ---------- Paged Messages ----------
+ * A message with more than two MESSAGE_PAGE_BYTES of text is split into
+ * pages of whole blocks. Only the first page is built up front. Every other
+ * page is an empty box sized to an estimate, which is built when it comes
+ * within a screen of the viewport and emptied again (keeping its measured
+ * height) once it is three screens away. "Copy message" copies the whole
+ * text, whichever pages exist at the time. */
 
-static gchar* get_prefs_path(void) {
-  const gchar *config_dir = g_get_user_config_dir();
-  gchar *app_dir = g_build_filename(config_dir, "ganesha", NULL);
-  g_mkdir_with_parents(app_dir, 0755);
-  gchar *path = g_build_filename(app_dir, PREFS_FILE, NULL);
-  g_free(app_dir);
-  return path;
+typedef struct {
+  MdDoc    *doc;
+  guint     first;      // Block range [first, last)
+  guint     last;
+  gint      height;     // Estimated, then measured when released
+  gboolean  built;
+} MessagePage;
+
+static GPtrArray *page_slots = NULL;     // GWeakRef to the boxes of paged messages
+static GPtrArray *released_bubbles = NULL;   // GWeakRef to bubbles emptied under memory pressure
+static guint      viewport_scan_id = 0;
+
+static void refill_released_bubbles(AppWidgets *aw);
+
+static void message_page_free(gpointer data) {
+  MessagePage *page = data;
+  md_doc_unref(page->doc);
+  g_free(page);
 }
 
-static gchar* load_preferred_model(void) {
-  gchar *path = get_prefs_path();
-  gchar *contents = NULL;
-  gchar *model = NULL;
-  
-  if (g_file_get_contents(path, &contents, NULL, NULL)) {
-      JsonParser *parser = json_parser_new();
-      if (json_parser_load_from_data(parser, contents, -1, NULL)) {
-          JsonNode *root = json_parser_get_root(parser);
-          if (JSON_NODE_HOLDS_OBJECT(root)) {
-              JsonObject *obj = json_node_get_object(root);
-              if (json_object_has_member(obj, "preferred_model")) {
-                  model = g_strdup(json_object_get_string_member(obj, "preferred_model"));
-              }
-          }
-      }
-      g_object_unref(parser);
-      g_free(contents);
+static gint estimate_block_height(const MdBlock *block) {
+  switch (block->type) {
+    case MD_CODE:   return 216;   // Fixed-height scroller plus margins
+    case MD_SPACER: return 12;
+    default:        return 22 * (1 + (gint)(strlen(block->text) / 90)) + 4;
   }
-  
-  g_free(path);
-  return model ? model : g_strdup(DEFAULT_MODEL);
 }
 
-static void save_preferred_model(const gchar *model) {
-  if (!model) return;
-  
-  gchar *path = get_prefs_path();
-  gchar *contents = NULL;
-  JsonParser *parser = json_parser_new();
-  JsonNode *root = NULL;
-  
-  // Load existing preferences
-  if (g_file_get_contents(path, &contents, NULL, NULL)) {
-      if (json_parser_load_from_data(parser, contents, -1, NULL)) {
-          root = json_parser_get_root(parser);
-          if (root) json_node_ref(root);
-      }
-      g_free(contents);
-  }
-  
-  JsonBuilder *builder = json_builder_new();
-  json_builder_begin_object(builder);
-  
-  // Copy existing preferences
-  if (root && JSON_NODE_HOLDS_OBJECT(root)) {
-      JsonObject *obj = json_node_get_object(root);
-      GList *members = json_object_get_members(obj);
-      for (GList *l = members; l; l = l->next) {
-          const gchar *key = l->data;
-          if (g_strcmp0(key, "preferred_model") != 0) {
-              json_builder_set_member_name(builder, key);
-              JsonNode *value = json_object_get_member(obj, key);
-              json_builder_add_value(builder, value);
-          }
-      }
-      g_list_free(members);
+static void message_page_build(GtkWidget *slot, MessagePage *page) {
+  for (guint i = page->first; i < page->last; i++) {
+    gtk_box_append(GTK_BOX(slot), markdown_block_widget(&g_array_index(page->doc->blocks, MdBlock, i)));
   }
-  
-  // Add model preference
-  json_builder_set_member_name(builder, "preferred_model");
-  json_builder_add_string_value(builder, model);
-  
-  json_builder_end_object(builder);
-  
-  JsonGenerator *gen = json_generator_new();
-  json_generator_set_pretty(gen, TRUE);
-  JsonNode *new_root = json_builder_get_root(builder);
-  json_generator_set_root(gen, new_root);
-  
-  gchar *json_data = json_generator_to_data(gen, NULL);
-  g_file_set_contents(path, json_data, -1, NULL);
-  
-  g_free(json_data);
-  g_free(path);
-  if (root) json_node_unref(root);
-  json_node_free(new_root);
-  g_object_unref(gen);
-  g_object_unref(builder);
-  g_object_unref(parser);
+  gtk_widget_set_size_request(slot, -1, -1);
+  page->built = TRUE;
 }
 
-static gboolean load_theme_preference(void) {
-  gchar *path = get_prefs_path();
-  gchar *contents = NULL;
-  gboolean dark_theme = TRUE;
-  
-  if (g_file_get_contents(path, &contents, NULL, NULL)) {
-      JsonParser *parser = json_parser_new();
-      if (json_parser_load_from_data(parser, contents, -1, NULL)) {
-          JsonNode *root = json_parser_get_root(parser);
-          if (JSON_NODE_HOLDS_OBJECT(root)) {
-              JsonObject *obj = json_node_get_object(root);
-              if (json_object_has_member(obj, "dark_theme")) {
-                  dark_theme = json_object_get_boolean_member(obj, "dark_theme");
-              }
-          }
-      }
-      g_object_unref(parser);
-      g_free(contents);
-  }
-  
-  g_free(path);
-  return dark_theme;
+static void message_page_release(GtkWidget *slot, MessagePage *page) {
+  page->height = gtk_widget_get_height(slot);
+  GtkWidget *child;
+  while ((child = gtk_widget_get_first_child(slot))) gtk_box_remove(GTK_BOX(slot), child);
+  gtk_widget_set_size_request(slot, -1, page->height);
+  page->built = FALSE;
 }
 
-static void save_theme_preference(gboolean dark_theme) {
-  gchar *path = get_prefs_path();
-  gchar *contents = NULL;
-  JsonParser *parser = json_parser_new();
-  JsonNode *root = NULL;
-  
-  // Load existing preferences
-  if (g_file_get_contents(path, &contents, NULL, NULL)) {
-      if (json_parser_load_from_data(parser, contents, -1, NULL)) {
-          root = json_parser_get_root(parser);
-          if (root) json_node_ref(root);
+static void page_visible_messages(GtkWidget *scroller) {
+  if (!page_slots) return;
+  
+  for (guint i = 0; i < page_slots->len; ) {
+      GtkWidget *slot = g_weak_ref_get(g_ptr_array_index(page_slots, i));
+      if (!slot) {
+          g_ptr_array_remove_index_fast(page_slots, i);
+          continue;
       }
-      g_free(contents);
-  }
-  
-  JsonBuilder *builder = json_builder_new();
-  json_builder_begin_object(builder);
-  
-  // Copy existing preferences
-  if (root && JSON_NODE_HOLDS_OBJECT(root)) {
-      JsonObject *obj = json_node_get_object(root);
-      GList *members = json_object_get_members(obj);
-      for (GList *l = members; l; l = l->next) {
-          const gchar *key = l->data;
-          if (g_strcmp0(key, "dark_theme") != 0) {
-              json_builder_set_member_name(builder, key);
-              JsonNode *value = json_object_get_member(obj, key);
-              json_builder_add_value(builder, value);
-          }
+      
+      MessagePage *page = g_object_get_data(G_OBJECT(slot), "message-page");
+      gfloat distance = viewport_distance(slot, scroller);
+      if (!page->built && distance <= 1) {
+          message_page_build(slot, page);
+      } else if (page->built && distance > 3 && distance != G_MAXFLOAT) {
+          message_page_release(slot, page);
       }
-      g_list_free(members);
+      g_object_unref(slot);
+      i++;
   }
-  
-  // Add theme preference
-  json_builder_set_member_name(builder, "dark_theme");
-  json_builder_add_boolean_value(builder, dark_theme);
-  
-  json_builder_end_object(builder);
-  
-  JsonGenerator *gen = json_generator_new();
-  json_generator_set_pretty(gen, TRUE);
-  JsonNode *new_root = json_builder_get_root(builder);
-  json_generator_set_root(gen, new_root);
-  
-  gchar *json_data = json_generator_to_data(gen, NULL);
-  g_file_set_contents(path, json_data, -1, NULL);
-  
-  g_free(json_data);
-  g_free(path);
-  if (root) json_node_unref(root);
-  json_node_free(new_root);
-  g_object_unref(gen);
-  g_object_unref(builder);
-  g_object_unref(parser);
 }
 
-/* ---------- UI Message Bubbles ---------- */
-
-static GtkWidget* create_loading_bubble(void) {
-  GtkWidget *bubble = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-  gtk_widget_add_css_class(bubble, "message-bubble");
-  gtk_widget_add_css_class(bubble, "assistant-message");
-  gtk_widget_set_halign(bubble, GTK_ALIGN_START);
-  
-  GtkWidget *loading_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
-  gtk_widget_set_halign(loading_box, GTK_ALIGN_START);
-  
-  for (int i = 0; i < 3; i++) {
-    GtkWidget *dot = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
-    gtk_widget_set_size_request(dot, 8, 8);
-    gtk_widget_add_css_class(dot, "loading-dot");
-    gtk_box_append(GTK_BOX(loading_box), dot);
-  }
-  
-  gtk_box_append(GTK_BOX(bubble), loading_box);
-  return bubble;
+static gboolean scan_chat_viewport(gpointer data) {
+  AppWidgets *aw = (AppWidgets*)data;
+  viewport_scan_id = 0;
+  if (!aw->alive) return G_SOURCE_REMOVE;
+  
+  gint64 trace_scan = TRACE_BEGIN();
+  refill_released_bubbles(aw);
+  page_visible_messages(GTK_WIDGET(aw->chat_scroller));
+  highlight_visible_code(GTK_WIDGET(aw->chat_scroller));
+  TRACE_END(trace_scan, "viewport-scan", NULL);
+  return G_SOURCE_REMOVE;
 }
 
-/* ---------- Enhanced Markdown Parsing ---------- */
+static void on_chat_viewport_changed(GtkAdjustment *adj, gpointer user_data) {
+  (void)adj;
+  gboolean pending = (code_pending && code_pending->len > 0) || (page_slots && page_slots->len > 0)
+                  || (released_bubbles && released_bubbles->len > 0);
+  if (!viewport_scan_id && pending) viewport_scan_id = g_idle_add(scan_chat_viewport, user_data);
+}
 
-static GtkWidget* parse_markdown(const gchar *text) {
+/* Builds the widgets for a parsed message (see core/markdown.c). */
+static GtkWidget* build_markdown_widget(const MdDoc *doc) {
   GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
-  gchar **lines = g_strsplit(text, "\n", -1);
   
-  gboolean in_code_block = FALSE;
-  GString *code_block_content = NULL;
-  gchar *code_language = NULL;
-  GtkWidget *code_scroll = NULL;
-  GtkWidget *code_view = NULL;
+  gsize text_bytes = 0;
+  for (guint i = 0; i < doc->blocks->len; i++) {
+    const gchar *text = g_array_index(doc->blocks, MdBlock, i).text;
+    text_bytes += text ? strlen(text) : 0;
+  }
   
-  for (gchar **line = lines; *line; line++) {
-    gchar *trimmed = g_strstrip(g_strdup(*line));
-    
-    // Code blocks
-    if (g_str_has_prefix(trimmed, "```")) {
-      if (!in_code_block) {
-        in_code_block = TRUE;
-        code_block_content = g_string_new("");
-        code_language = g_strdup(trimmed + 3);
-        
-        // Create scrollable code block
-        code_scroll = gtk_scrolled_window_new();
-        gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(code_scroll),
-                                      GTK_POLICY_AUTOMATIC,
-                                      GTK_POLICY_AUTOMATIC);
-        gtk_widget_set_size_request(code_scroll, -1, 200);
-        
-        code_view = gtk_text_view_new();
-        gtk_text_view_set_editable(GTK_TEXT_VIEW(code_view), FALSE);
-        gtk_text_view_set_monospace(GTK_TEXT_VIEW(code_view), TRUE);
-        gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(code_view), GTK_WRAP_NONE);
-        gtk_widget_add_css_class(code_view, "code-block");
-        gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(code_scroll), code_view);
-      } else {
-        in_code_block = FALSE;
-        
-        GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(code_view));
-        gtk_text_buffer_set_text(buffer, code_block_content->str, -1);
-        gtk_box_append(GTK_BOX(box), code_scroll);
-        
-        g_string_free(code_block_content, TRUE);
-        g_free(code_language);
-        code_block_content = NULL;
-        code_language = NULL;
-      }
-      g_free(trimmed);
-      continue;
-    }
-    
-    if (in_code_block) {
-      if (code_block_content->len > 0) {
-        g_string_append(code_block_content, "\n");
-      }
-      g_string_append(code_block_content, trimmed);
-      g_free(trimmed);
-      continue;
-    }
-    
-    // Inline code
-    if (g_strrstr(trimmed, "`")) {
-      GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
-      gchar **parts = g_strsplit(trimmed, "`", -1);
-      gboolean is_code = FALSE;
-      
-      for (gchar **part = parts; *part; part++) {
-        if (**part) {
-          GtkWidget *label = gtk_label_new(*part);
-          gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-          gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-          
-          if (is_code) {
-            gtk_widget_add_css_class(label, "inline-code");
-          } else {
-            gtk_widget_add_css_class(label, "message-content");
-          }
-          gtk_box_append(GTK_BOX(hbox), label);
-        }
-        is_code = !is_code;
-      }
-      
-      g_strfreev(parts);
-      gtk_box_append(GTK_BOX(box), hbox);
-      g_free(trimmed);
-      continue;
-    }
-    
-    // Headers
-    if (g_str_has_prefix(trimmed, "# ")) {
-      GtkWidget *label = gtk_label_new(trimmed + 2);
-      gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-      gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-      gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-      gtk_widget_add_css_class(label, "header-1");
-      gtk_box_append(GTK_BOX(box), label);
-      g_free(trimmed);
-      continue;
-    }
-    
-    if (g_str_has_prefix(trimmed, "## ")) {
-      GtkWidget *label = gtk_label_new(trimmed + 3);
-      gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-      gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-      gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-      gtk_widget_add_css_class(label, "header-2");
-      gtk_box_append(GTK_BOX(box), label);
-      g_free(trimmed);
-      continue;
-    }
-    
-    if (g_str_has_prefix(trimmed, "### ")) {
-      GtkWidget *label = gtk_label_new(trimmed + 4);
-      gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-      gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-      gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-      gtk_widget_add_css_class(label, "header-3");
-      gtk_box_append(GTK_BOX(box), label);
-      g_free(trimmed);
-      continue;
+  if (text_bytes <= 2 * MESSAGE_PAGE_BYTES) {
+    for (guint i = 0; i < doc->blocks->len; i++) {
+      gtk_box_append(GTK_BOX(box), markdown_block_widget(&g_array_index(doc->blocks, MdBlock, i)));
     }
+    return box;
+  }
+  
+  if (!page_slots) page_slots = g_ptr_array_new_with_free_func(code_weak_ref_free);
+  guint first = 0;
+  while (first < doc->blocks->len) {
+    MessagePage *page = g_new0(MessagePage, 1);
+    page->doc = md_doc_ref((MdDoc*)doc);
+    page->first = first;
     
-    // Blockquotes
-    if (g_str_has_prefix(trimmed, "> ")) {
-      GtkWidget *label = gtk_label_new(trimmed + 2);
-      gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-      gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-      gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-      gtk_widget_add_css_class(label, "blockquote");
-      gtk_widget_set_margin_start(label, 12);
-      gtk_box_append(GTK_BOX(box), label);
-      g_free(trimmed);
-      continue;
+    gsize page_bytes = 0;
+    guint last = first;
+    while (last < doc->blocks->len && (last == first || page_bytes < MESSAGE_PAGE_BYTES)) {
+      const MdBlock *block = &g_array_index(doc->blocks, MdBlock, last);
+      page_bytes += block->text ? strlen(block->text) : 0;
+      page->height += estimate_block_height(block);
+      last++;
     }
+    page->last = last;
     
-    // Lists
-    if (g_str_has_prefix(trimmed, "- ") || g_str_has_prefix(trimmed, "* ")) {
-      GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
-      GtkWidget *bullet = gtk_label_new("•");
-      gtk_widget_add_css_class(bullet, "list-bullet");
-      gtk_box_append(GTK_BOX(hbox), bullet);
-      
-      GtkWidget *label = gtk_label_new(trimmed + 2);
-      gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-      gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-      gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-      gtk_widget_set_hexpand(label, TRUE);
-      gtk_widget_add_css_class(label, "list-item");
-      gtk_box_append(GTK_BOX(hbox), label);
-      
-      gtk_box_append(GTK_BOX(box), hbox);
-      g_free(trimmed);
-      continue;
+    GtkWidget *slot = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
+    g_object_set_data_full(G_OBJECT(slot), "message-page", page, message_page_free);
+    if (first == 0) {
+      message_page_build(slot, page);
+    } else {
+      gtk_widget_set_size_request(slot, -1, page->height);
     }
     
-    // Numbered lists
-    if (g_ascii_isdigit(*trimmed)) {
-      const gchar *dot = strchr(trimmed, '.');
-      if (dot && *(dot+1) == ' ') {
-        GtkWidget *hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
-        
-        gchar *number = g_strndup(trimmed, dot - trimmed + 1);
-        GtkWidget *num_label = gtk_label_new(number);
-        gtk_widget_add_css_class(num_label, "list-bullet");
-        gtk_box_append(GTK_BOX(hbox), num_label);
-        g_free(number);
-        
-        GtkWidget *label = gtk_label_new(dot + 2);
-        gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-        gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-        gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-        gtk_widget_set_hexpand(label, TRUE);
-        gtk_widget_add_css_class(label, "list-item");
-        gtk_box_append(GTK_BOX(hbox), label);
-        
-        gtk_box_append(GTK_BOX(box), hbox);
-        g_free(trimmed);
-        continue;
+    GWeakRef *ref = g_new0(GWeakRef, 1);
+    g_weak_ref_init(ref, slot);
+    g_ptr_array_add(page_slots, ref);
+    gtk_box_append(GTK_BOX(box), slot);
+    first = last;
+  }
+  
+  return box;
+}
+
+static void on_copy_message(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+  (void)action;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  guint serial = g_variant_get_uint32(parameter);
+  if (!aw->current_conversation) return;
+  
+  for (guint i = 0; i < aw->current_conversation->messages->len; i++) {
+      Message *msg = g_ptr_array_index(aw->current_conversation->messages, i);
+      if (msg->serial == serial) {
+          gdk_clipboard_set_text(gtk_widget_get_clipboard(GTK_WIDGET(aw->chat_box)), msg->content);
+          return;
       }
-    }
+  }
+}
+
+static GtkWidget* message_action_button(const gchar *icon, const gchar *tooltip,
+                                        const gchar *action, guint serial) {
+  GtkWidget *button = gtk_button_new_from_icon_name(icon);
+  gtk_widget_add_css_class(button, "flat");
+  gtk_widget_set_tooltip_text(button, tooltip);
+  gtk_actionable_set_action_name(GTK_ACTIONABLE(button), action);
+  gtk_actionable_set_action_target(GTK_ACTIONABLE(button), "u", serial);
+  return button;
+}
+
+static void fill_message_bubble(GtkWidget *bubble, const gchar *role, const gchar *content, guint serial) {
+  if (g_strcmp0(role, "assistant") == 0 && content && *content) {
+    MdDoc *doc = md_cache_get(serial, content);
+    gtk_box_append(GTK_BOX(bubble), build_markdown_widget(doc));
+    md_doc_unref(doc);
     
-    // Regular text
-    if (*trimmed != '\0') {
-      GtkWidget *label = gtk_label_new(trimmed);
-      gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-      gtk_label_set_wrap_mode(GTK_LABEL(label), PANGO_WRAP_WORD_CHAR);
-      gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-      gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-      gtk_widget_add_css_class(label, "message-content");
-      gtk_box_append(GTK_BOX(box), label);
-    } else {
-      GtkWidget *spacer = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-      gtk_widget_set_size_request(spacer, -1, 8);
-      gtk_box_append(GTK_BOX(box), spacer);
+    if (serial) {
+      GtkWidget *actions = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+      gtk_widget_set_halign(actions, GTK_ALIGN_END);
+      gtk_box_append(GTK_BOX(actions), message_action_button("view-refresh-symbolic", "Regenerate",
+                                                             "win.regenerate-message", serial));
+      gtk_box_append(GTK_BOX(actions), message_action_button("edit-copy-symbolic", "Copy message",
+                                                             "win.copy-message", serial));
+      gtk_box_append(GTK_BOX(bubble), actions);
     }
+  } else {
+    GtkWidget *label = gtk_label_new(content);
+    gtk_label_set_wrap(GTK_LABEL(label), TRUE);
+    gtk_label_set_wrap_mode(GTK_LABEL(label), PANGO_WRAP_WORD_CHAR);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+    gtk_widget_add_css_class(label, "message-content");
+    gtk_box_append(GTK_BOX(bubble), label);
     
-    g_free(trimmed);
-  }
-  
-  // Handle unclosed code block
-  if (in_code_block && code_block_content) {
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(code_view));
-    gtk_text_buffer_set_text(buffer, code_block_content->str, -1);
-    gtk_box_append(GTK_BOX(box), code_scroll);
-    g_string_free(code_block_content, TRUE);
-    g_free(code_language);
+    if (serial && g_strcmp0(role, "user") == 0) {
+      GtkWidget *edit = message_action_button("document-edit-symbolic", "Edit and resend",
+                                              "win.edit-message", serial);
+      gtk_widget_set_halign(edit, GTK_ALIGN_END);
+      gtk_box_append(GTK_BOX(bubble), edit);
+    }
   }
-  
-  g_strfreev(lines);
-  return box;
 }
 
-static GtkWidget* create_message_bubble(const gchar *role, const gchar *content) {
+/* serial is the Message's, or 0 for text that should not be cached (stream
+ * chunks rebuild the bubble on every delta). */
+static GtkWidget* create_message_bubble(const gchar *role, const gchar *content, guint serial) {
+  gint64 trace_build = TRACE_BEGIN();
   GtkWidget *bubble = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
   gtk_widget_add_css_class(bubble, "message-bubble");
   
@@ -1057,50 +977,247 @@ static GtkWidget* create_message_bubble(const gchar *role, const gchar *content)
       gtk_widget_set_halign(bubble, GTK_ALIGN_START);
   }
   
-  if (g_strcmp0(role, "assistant") == 0 && content && *content) {
-    GtkWidget *content_box = parse_markdown(content);
-    gtk_box_append(GTK_BOX(bubble), content_box);
-  } else {
-    GtkWidget *label = gtk_label_new(content);
-    gtk_label_set_wrap(GTK_LABEL(label), TRUE);
-    gtk_label_set_wrap_mode(GTK_LABEL(label), PANGO_WRAP_WORD_CHAR);
-    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-    gtk_label_set_selectable(GTK_LABEL(label), TRUE);
-    gtk_widget_add_css_class(label, "message-content");
-    gtk_box_append(GTK_BOX(bubble), label);
-  }
+  fill_message_bubble(bubble, role, content, serial);
+  if (serial) g_object_set_data(G_OBJECT(bubble), "message-serial", GUINT_TO_POINTER(serial));
   
+  TRACE_END(trace_build, "widget-build", role);
   return bubble;
 }
 
-static void append_message_bubble(AppWidgets *aw, const gchar *role, const gchar *content) {
-  if (!aw || !aw->chat_box) return;
-  
-  GtkWidget *bubble = create_message_bubble(role, content);
-  gtk_box_append(aw->chat_box, bubble);
-  
+/* ---------- Chat Scrolling ----------
+ * The chat follows its end until the user scrolls away from it. Following
+ * happens on the adjustment's "changed", which fires once per layout, so a
+ * burst of appends scrolls once per frame instead of once per token. */
+
+static void scroll_chat_to_bottom(AppWidgets *aw) {
+  aw->follow_bottom = TRUE;
   GtkAdjustment *vadj = gtk_scrolled_window_get_vadjustment(aw->chat_scroller);
-  gtk_adjustment_set_value(vadj, gtk_adjustment_get_upper(vadj));
+  gtk_adjustment_set_value(vadj, gtk_adjustment_get_upper(vadj) - gtk_adjustment_get_page_size(vadj));
 }
 
-static void clear_chat_display(AppWidgets *aw) {
-  if (!aw || !aw->chat_box) return;
-  
-  GtkWidget *child;
-  while ((child = gtk_widget_get_first_child(GTK_WIDGET(aw->chat_box)))) {
-      gtk_box_remove(aw->chat_box, child);
-  }
+static void on_chat_bounds_changed(GtkAdjustment *adj, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (aw->follow_bottom) gtk_adjustment_set_value(adj, gtk_adjustment_get_upper(adj) - gtk_adjustment_get_page_size(adj));
 }
 
-static void display_conversation(AppWidgets *aw, Conversation *conv) {
+static void on_chat_scrolled(GtkAdjustment *adj, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  aw->follow_bottom = gtk_adjustment_get_value(adj)
+                      >= gtk_adjustment_get_upper(adj) - gtk_adjustment_get_page_size(adj) - 1;
+}
+
+static void append_message_bubble(AppWidgets *aw, const gchar *role, const gchar *content, guint serial) {
+  if (!aw || !aw->chat_box) return;
+  
+  GtkWidget *bubble = create_message_bubble(role, content, serial);
+  gtk_box_append(aw->chat_box, bubble);
+  scroll_chat_to_bottom(aw);
+}
+
+/* ---------- Rendered Conversations ----------
+ * The bubbles of the last RENDERED_CONVERSATIONS conversations shown are
+ * kept detached, so switching back reattaches them instead of rebuilding.
+ * They are reused only if the conversation has the same number of messages
+ * and the same last-message length as when they were built. */
+
+static gsize conversation_last_len(Conversation *conv) {
+  if (conv->messages->len == 0) return 0;
+  Message *last = g_ptr_array_index(conv->messages, conv->messages->len - 1);
+  return last->content ? strlen(last->content) : 0;
+}
+
+static void rendered_conversation_free(RenderedConversation *rc) {
+  if (!rc) return;
+  if (rc->bubbles) g_ptr_array_unref(rc->bubbles);
+  g_free(rc);
+}
+
+static RenderedConversation* take_rendered(AppWidgets *aw, Conversation *conv) {
+  for (GList *l = aw->rendered.head; l; l = l->next) {
+      RenderedConversation *rc = l->data;
+      if (rc->conv == conv) {
+          g_queue_delete_link(&aw->rendered, l);
+          return rc;
+      }
+  }
+  return NULL;
+}
+
+static void clear_chat_display(AppWidgets *aw) {
+  if (!aw || !aw->chat_box) return;
+  
+  RenderedConversation *rc = g_steal_pointer(&aw->shown);
+  if (rc) rc->bubbles = g_ptr_array_new_with_free_func(g_object_unref);
+  
+  GtkWidget *child;
+  while ((child = gtk_widget_get_first_child(GTK_WIDGET(aw->chat_box)))) {
+      if (rc) g_ptr_array_add(rc->bubbles, g_object_ref(child));
+      gtk_box_remove(aw->chat_box, child);
+  }
+  
+  if (rc) {
+      g_queue_push_head(&aw->rendered, rc);
+      while (aw->rendered.length > RENDERED_CONVERSATIONS) {
+          rendered_conversation_free(g_queue_pop_tail(&aw->rendered));
+      }
+  }
+}
+
+/* ---------- Branches ----------
+ * Editing a prompt or regenerating a reply starts a branch: a conversation
+ * whose parent_id names the one it came from and which holds the messages
+ * before that point by reference (see conversation_branch). Only the tree's
+ * root is listed in the sidebar. Where the conversations of a tree differ,
+ * the message is preceded by a "‹ k / n ›" navigator; variants are told
+ * apart by message identity, since shared messages are the same objects. */
+
+static Conversation* find_conversation_by_id(AppWidgets *aw, const gchar *id) {
+  for (guint i = 0; i < aw->conversations->len; i++) {
+      Conversation *conv = g_ptr_array_index(aw->conversations, i);
+      if (g_strcmp0(conv->id, id) == 0) return conv;
+  }
+  return NULL;
+}
+
+static Conversation* branch_root(AppWidgets *aw, Conversation *conv) {
+  for (guint depth = 0; conv->parent_id && depth < aw->conversations->len; depth++) {
+      Conversation *parent = find_conversation_by_id(aw, conv->parent_id);
+      if (!parent) break;
+      conv = parent;
+  }
+  return conv;
+}
+
+/* The conversations with the same root as conv, in creation order. */
+static GPtrArray* branch_tree(AppWidgets *aw, Conversation *conv) {
+  Conversation *root = branch_root(aw, conv);
+  GPtrArray *tree = g_ptr_array_new();
+  for (guint i = 0; i < aw->conversations->len; i++) {
+      Conversation *other = g_ptr_array_index(aw->conversations, i);
+      if (other == root || (other->parent_id && branch_root(aw, other) == root)) {
+          g_ptr_array_add(tree, other);
+      }
+  }
+  return tree;
+}
+
+/* Whether other holds conv's first index messages and has one at index. */
+static gboolean shares_prefix(Conversation *other, Conversation *conv, guint index) {
+  if (other->messages->len <= index) return FALSE;
+  return index == 0 || g_ptr_array_index(other->messages, index - 1) == g_ptr_array_index(conv->messages, index - 1);
+}
+
+static void append_branch_navigator(AppWidgets *aw, GPtrArray *tree, Conversation *conv, guint index) {
+  GPtrArray *variants = g_ptr_array_new();
+  for (guint i = 0; i < tree->len; i++) {
+      Conversation *other = g_ptr_array_index(tree, i);
+      if (!shares_prefix(other, conv, index)) continue;
+      Message *msg = g_ptr_array_index(other->messages, index);
+      if (!g_ptr_array_find(variants, msg, NULL)) g_ptr_array_add(variants, msg);
+  }
+  
+  guint k;
+  Message *current = g_ptr_array_index(conv->messages, index);
+  if (variants->len > 1 && g_ptr_array_find(variants, current, &k)) {
+      GtkWidget *nav = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+      gtk_widget_set_halign(nav, g_strcmp0(current->role, "user") == 0 ? GTK_ALIGN_END : GTK_ALIGN_START);
+      gtk_widget_set_margin_start(nav, 16);
+      gtk_widget_set_margin_end(nav, 16);
+      
+      GtkWidget *prev = gtk_button_new_from_icon_name("go-previous-symbolic");
+      GtkWidget *next = gtk_button_new_from_icon_name("go-next-symbolic");
+      gtk_widget_set_tooltip_text(prev, "Previous branch");
+      gtk_widget_set_tooltip_text(next, "Next branch");
+      Message *targets[2] = { k > 0 ? g_ptr_array_index(variants, k - 1) : NULL,
+                              k + 1 < variants->len ? g_ptr_array_index(variants, k + 1) : NULL };
+      GtkWidget *buttons[2] = { prev, next };
+      for (guint b = 0; b < 2; b++) {
+          gtk_widget_add_css_class(buttons[b], "flat");
+          gtk_actionable_set_action_name(GTK_ACTIONABLE(buttons[b]), "win.switch-branch");
+          gtk_actionable_set_action_target(GTK_ACTIONABLE(buttons[b]), "(uu)", index,
+                                           targets[b] ? targets[b]->serial : 0);
+          gtk_widget_set_sensitive(buttons[b], targets[b] != NULL);
+      }
+      
+      gchar *position = g_strdup_printf("%u / %u", k + 1, variants->len);
+      GtkWidget *label = gtk_label_new(position);
+      gtk_widget_add_css_class(label, "dim-label");
+      g_free(position);
+      
+      gtk_box_append(GTK_BOX(nav), prev);
+      gtk_box_append(GTK_BOX(nav), label);
+      gtk_box_append(GTK_BOX(nav), next);
+      gtk_box_append(aw->chat_box, nav);
+  }
+  g_ptr_array_unref(variants);
+}
+
+static void display_conversation(AppWidgets *aw, Conversation *conv);
+
+static gboolean find_message_index(Conversation *conv, guint serial, guint *index) {
+  for (guint i = 0; i < conv->messages->len; i++) {
+      if (((Message*)g_ptr_array_index(conv->messages, i))->serial == serial) {
+          *index = i;
+          return TRUE;
+      }
+  }
+  return FALSE;
+}
+
+static void stop_editing(AppWidgets *aw) {
+  if (!aw->editing_serial) return;
+  aw->editing_serial = 0;
+  gtk_widget_set_visible(GTK_WIDGET(aw->scheduler_note), FALSE);
+}
+
+static void show_new_branch(AppWidgets *aw, Conversation *branch) {
+  g_ptr_array_add(aw->conversations, branch);
+  aw->current_conversation = branch;
+  display_conversation(aw, branch);
+  // Kept renderings of this tree lack the new variant in their navigators
+  g_queue_clear_full(&aw->rendered, (GDestroyNotify)rendered_conversation_free);
+}
+
+static void display_conversation(AppWidgets *aw, Conversation *conv) {
   if (!aw || !conv) return;
+  gint64 trace_display = TRACE_BEGIN();
+  conversation_restore(conv);
   
   clear_chat_display(aw);
   
-  for (guint i = 0; i < conv->messages->len; i++) {
-      Message *msg = g_ptr_array_index(conv->messages, i);
-      append_message_bubble(aw, msg->role, msg->content);
+  RenderedConversation *rc = take_rendered(aw, conv);
+  gboolean reused = rc && rc->n_messages == conv->messages->len
+                       && rc->last_len == conversation_last_len(conv);
+  if (reused) {
+      for (guint i = 0; i < rc->bubbles->len; i++) {
+          gtk_box_append(aw->chat_box, g_ptr_array_index(rc->bubbles, i));
+      }
+      g_clear_pointer(&rc->bubbles, g_ptr_array_unref);
+      scroll_chat_to_bottom(aw);
+  } else {
+      rendered_conversation_free(rc);
+      GPtrArray *tree = branch_tree(aw, conv);
+      for (guint i = 0; i < conv->messages->len; i++) {
+          Message *msg = g_ptr_array_index(conv->messages, i);
+          if (tree->len > 1) append_branch_navigator(aw, tree, conv, i);
+          append_message_bubble(aw, msg->role, msg->content, msg->serial);
+      }
+      g_ptr_array_unref(tree);
+      rc = g_new0(RenderedConversation, 1);
+      rc->conv = conv;
+      rc->n_messages = conv->messages->len;
+      rc->last_len = conversation_last_len(conv);
+  }
+  aw->shown = rc;
+  
+  // Neighbours in the sidebar are the likeliest next picks
+  guint index;
+  if (g_ptr_array_find(aw->conversations, conv, &index)) {
+      if (index > 0) md_cache_prefetch(g_ptr_array_index(aw->conversations, index - 1));
+      if (index + 1 < aw->conversations->len) md_cache_prefetch(g_ptr_array_index(aw->conversations, index + 1));
   }
+  TRACE_ENDF(trace_display, "display-conversation", "%u messages%s",
+             conv->messages->len, reused ? " (reused)" : "");
 }
 
 static void update_action_button(AppWidgets *aw) {
@@ -1137,9 +1254,19 @@ static void set_streaming_state(AppWidgets *aw, gboolean running) {
 
 /* ---------- worker: Ollama streaming (forward decls used later) ---------- */
 typedef struct {
-  AppWidgets *aw;
-  char       *prompt_copy;
-  char       *model_copy;
+  AppWidgets   *aw;
+  GArray       *snapshot;     // The messages the request is built from
+  char         *model_copy;
+  char         *hedge_url_copy;
+  char         *keep_alive_copy;
+  gdouble       hedge_percentile;
+  gint          affinity_policy;
+  gint64        server_memory;
+  gint          server_max_models;
+  GCancellable *cancellable;
+  ContextPlan  *plan;
+  RagIndex     *documents;    // NULL = no retrieval
+  gsize         documents_room;   // Bytes of excerpts the plan has room for
 } WorkerArgs;
 
 static void on_action_btn_clicked(GtkButton *btn, gpointer user_data); /* <-- forward decl */
@@ -1181,60 +1308,463 @@ on_prompt_key_pressed(GtkEventControllerKey *controller,
 }
 
 
+/* ---------- End-to-end Probe ---------- */
+
+/* Enabled with GANESHA_E2E_PROMPT: once the window is up the prompt is sent,
+ * time to first visible token, idle-callback lag and dropped frames are
+ * measured, a JSON report goes to GANESHA_E2E_REPORT (stdout when unset) and
+ * the app quits. bench/e2e.sh drives this against bench/mock-ollama.c.
+ * GANESHA_E2E_FRAMES=0 skips frame counting, which keeps the frame clock
+ * running (bench/wakeups.sh). */
+typedef struct {
+  gchar  *prompt;
+  gchar  *report_path;
+  gint64  sent_at;
+  gint64  first_chunk_at;
+  guint   chunks;
+  gint64  lag_total;
+  gint64  lag_max;
+  gint64  frame_interval;    /* µs, from the monitor refresh rate */
+  gint64  last_frame;
+  guint   frames;
+  guint   dropped_frames;
+  guint   tick_id;
+} E2EProbe;
+
+static E2EProbe *e2e_probe = NULL;
+
+static void e2e_probe_chunk(gint64 posted_at) {
+  gint64 now = g_get_monotonic_time();
+  if (!e2e_probe || !e2e_probe->sent_at) return;
+
+  if (!e2e_probe->first_chunk_at) e2e_probe->first_chunk_at = now;
+  e2e_probe->chunks++;
+  gint64 lag = now - posted_at;
+  e2e_probe->lag_total += lag;
+  e2e_probe->lag_max = MAX(e2e_probe->lag_max, lag);
+}
+
+static gboolean e2e_probe_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+  (void)widget; (void)user_data;
+  gint64 frame_time = gdk_frame_clock_get_frame_time(clock);
+
+  if (e2e_probe->sent_at && e2e_probe->last_frame) {
+      gint64 gap = frame_time - e2e_probe->last_frame;
+      e2e_probe->frames++;
+      if (gap > e2e_probe->frame_interval * 3 / 2) {
+          e2e_probe->dropped_frames += (guint)((gap + e2e_probe->frame_interval / 2) / e2e_probe->frame_interval) - 1;
+      }
+  }
+  e2e_probe->last_frame = frame_time;
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean e2e_probe_send(gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (!aw->alive) return G_SOURCE_REMOVE;
+
+  GtkTextBuffer *buffer = gtk_text_view_get_buffer(aw->prompt_text_view);
+  gtk_text_buffer_set_text(buffer, e2e_probe->prompt, -1);
+  e2e_probe->sent_at = g_get_monotonic_time();
+  on_action_btn_clicked(GTK_BUTTON(aw->action_btn), aw);
+  return G_SOURCE_REMOVE;
+}
+
+static void e2e_probe_setup(AppWidgets *aw, GtkWidget *win) {
+  const gchar *prompt = g_getenv("GANESHA_E2E_PROMPT");
+  if (!prompt || !*prompt) return;
+
+  e2e_probe = g_new0(E2EProbe, 1);
+  e2e_probe->prompt = g_strdup(prompt);
+  e2e_probe->report_path = g_strdup(g_getenv("GANESHA_E2E_REPORT"));
+  e2e_probe->frame_interval = G_USEC_PER_SEC / 60;
+
+  GdkSurface *surface = gtk_native_get_surface(GTK_NATIVE(win));
+  GdkMonitor *monitor = surface
+      ? gdk_display_get_monitor_at_surface(gtk_widget_get_display(win), surface) : NULL;
+  if (monitor && gdk_monitor_get_refresh_rate(monitor) > 0) {
+      e2e_probe->frame_interval = (gint64)G_USEC_PER_SEC * 1000 / gdk_monitor_get_refresh_rate(monitor);
+  }
+
+  // The tick callback keeps the frame clock running so gaps show up as drops
+  if (g_strcmp0(g_getenv("GANESHA_E2E_FRAMES"), "0") != 0) {
+      e2e_probe->tick_id = gtk_widget_add_tick_callback(win, e2e_probe_tick, NULL, NULL);
+  }
+  g_timeout_add(1000, e2e_probe_send, aw);
+}
+
+static void e2e_probe_finish(AppWidgets *aw) {
+  gint64 now = g_get_monotonic_time();
+  GtkWidget *win = GTK_WIDGET(gtk_widget_get_root(GTK_WIDGET(aw->chat_box)));
+  if (win && e2e_probe->tick_id) gtk_widget_remove_tick_callback(win, e2e_probe->tick_id);
+
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "ttft_ms");
+  json_builder_add_double_value(b, e2e_probe->first_chunk_at
+      ? (e2e_probe->first_chunk_at - e2e_probe->sent_at) / 1000.0 : -1);
+  json_builder_set_member_name(b, "total_ms");
+  json_builder_add_double_value(b, (now - e2e_probe->sent_at) / 1000.0);
+  json_builder_set_member_name(b, "chunks");
+  json_builder_add_int_value(b, e2e_probe->chunks);
+  json_builder_set_member_name(b, "ui_lag_mean_ms");
+  json_builder_add_double_value(b, e2e_probe->chunks
+      ? e2e_probe->lag_total / 1000.0 / e2e_probe->chunks : 0);
+  json_builder_set_member_name(b, "ui_lag_max_ms");
+  json_builder_add_double_value(b, e2e_probe->lag_max / 1000.0);
+  json_builder_set_member_name(b, "frames");
+  json_builder_add_int_value(b, e2e_probe->frames);
+  json_builder_set_member_name(b, "dropped_frames");
+  json_builder_add_int_value(b, e2e_probe->dropped_frames);
+  json_builder_set_member_name(b, "frame_interval_ms");
+  json_builder_add_double_value(b, e2e_probe->frame_interval / 1000.0);
+  json_builder_end_object(b);
+
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  json_generator_set_pretty(gen, TRUE);
+  if (e2e_probe->report_path) {
+      GError *error = NULL;
+      if (!json_generator_to_file(gen, e2e_probe->report_path, &error)) {
+          g_warning("e2e report: %s", error->message);
+          g_error_free(error);
+      }
+  } else {
+      gchar *text = json_generator_to_data(gen, NULL);
+      g_print("%s\n", text);
+      g_free(text);
+  }
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(b);
+
+  g_clear_pointer(&e2e_probe->prompt, g_free);
+  g_clear_pointer(&e2e_probe->report_path, g_free);
+  g_clear_pointer(&e2e_probe, g_free);
+  g_application_quit(g_application_get_default());
+}
+
+/* ---------- Stall Monitor ---------- */
+
+/* Enabled with GANESHA_STALL_MONITOR=<budget ms> (0 = one and a half frames).
+ * Callbacks posted with ui_idle_add() and handlers connected with
+ * ui_signal_connect() are timed, and the frame clock is watched. A frame
+ * that misses the budget is logged with the slowest callback that ran since
+ * the previous frame and shown in an overlay; the slowest callbacks overall
+ * are printed when the window closes. When the variable is unset both
+ * wrappers fall through to plain GLib and no tick callback is installed. */
+#define STALL_TOP_N 10
+
+typedef struct {
+  const gchar *name;
+  const gchar *source;     /* "idle" or "signal" */
+  gint64       duration;
+  gint64       queued;     /* µs between posting and dispatch, idle only */
+} StallSample;
+
+typedef struct {
+  gint64       budget;     /* µs; 0 until the first frame when derived */
+  gint64       last_frame;
+  StallSample  worst_since_frame;
+  GArray      *slowest;    /* StallSample, longest first */
+  GArray      *guards;     /* gint64 start times of the signal handlers running */
+  guint        frames;
+  guint        dropped;
+  gint64       worst_gap;
+  GtkLabel    *overlay;
+} StallMonitor;
+
+static StallMonitor *stall_monitor = NULL;
+
+static void stall_monitor_record(const gchar *name, const gchar *source, gint64 duration, gint64 queued) {
+  StallMonitor *m = stall_monitor;
+  StallSample sample = { name, source, duration, queued };
+
+  if (duration > m->worst_since_frame.duration) m->worst_since_frame = sample;
+
+  guint i = 0;
+  while (i < m->slowest->len && g_array_index(m->slowest, StallSample, i).duration >= duration) i++;
+  if (i < STALL_TOP_N) {
+      g_array_insert_val(m->slowest, i, sample);
+      if (m->slowest->len > STALL_TOP_N) g_array_set_size(m->slowest, STALL_TOP_N);
+  }
+}
+
+typedef struct {
+  GSourceFunc  func;
+  gpointer     data;
+  const gchar *name;
+  gint64       posted_at;
+} TimedIdle;
+
+static gboolean timed_idle_dispatch(gpointer data) {
+  TimedIdle *ti = (TimedIdle*)data;
+  gint64 start = g_get_monotonic_time();
+  gboolean again = ti->func(ti->data);
+  gint64 end = g_get_monotonic_time();
+  stall_monitor_record(ti->name, "idle", end - start, start - ti->posted_at);
+  ti->posted_at = end;
+  return again;
+}
+
+/* g_idle_add() that the stall monitor can attribute. Safe from any thread. */
+#define ui_idle_add(func, data) ui_idle_add_named(#func, (func), (data))
+
+static guint ui_idle_add_named(const gchar *name, GSourceFunc func, gpointer data) {
+  if (G_LIKELY(!stall_monitor)) return g_idle_add(func, data);
+
+  TimedIdle *ti = g_new0(TimedIdle, 1);
+  ti->func = func;
+  ti->data = data;
+  ti->name = name;
+  ti->posted_at = g_get_monotonic_time();
+  return g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, timed_idle_dispatch, ti, g_free);
+}
+
+static void stall_guard_pre(gpointer data, GClosure *closure) {
+  (void)data; (void)closure;
+  gint64 start = g_get_monotonic_time();
+  g_array_append_val(stall_monitor->guards, start);
+}
+
+static void stall_guard_post(gpointer data, GClosure *closure) {
+  (void)closure;
+  GArray *guards = stall_monitor->guards;
+  gint64 start = g_array_index(guards, gint64, guards->len - 1);
+  g_array_set_size(guards, guards->len - 1);
+  stall_monitor_record((const gchar*)data, "signal", g_get_monotonic_time() - start, 0);
+}
+
+/* g_signal_connect() whose handler the stall monitor times. */
+#define ui_signal_connect(instance, signal, handler, data) \
+  ui_signal_connect_named((instance), (signal), #handler, G_CALLBACK(handler), (data))
+
+static gulong ui_signal_connect_named(gpointer instance, const gchar *signal, const gchar *name,
+                                      GCallback handler, gpointer data) {
+  if (G_LIKELY(!stall_monitor)) return g_signal_connect(instance, signal, handler, data);
+
+  GClosure *closure = g_cclosure_new(handler, data, NULL);
+  g_closure_add_marshal_guards(closure, (gpointer)name, stall_guard_pre, (gpointer)name, stall_guard_post);
+  return g_signal_connect_closure(instance, signal, closure, FALSE);
+}
+
+static gboolean stall_monitor_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+  (void)user_data;
+  StallMonitor *m = stall_monitor;
+  gint64 frame_time = gdk_frame_clock_get_frame_time(clock);
+
+  if (!m->budget) {
+      gint64 interval = G_USEC_PER_SEC / 60;
+      GdkSurface *surface = gtk_native_get_surface(gtk_widget_get_native(widget));
+      GdkMonitor *monitor = surface
+          ? gdk_display_get_monitor_at_surface(gtk_widget_get_display(widget), surface) : NULL;
+      if (monitor && gdk_monitor_get_refresh_rate(monitor) > 0) {
+          interval = (gint64)G_USEC_PER_SEC * 1000 / gdk_monitor_get_refresh_rate(monitor);
+      }
+      m->budget = interval * 3 / 2;
+  }
+
+  if (m->last_frame) {
+      gint64 gap = frame_time - m->last_frame;
+      m->frames++;
+      if (gap > m->budget) {
+          StallSample *w = &m->worst_since_frame;
+          m->dropped++;
+          m->worst_gap = MAX(m->worst_gap, gap);
+          TRACE_ENDF(m->last_frame, "frame-over-budget", "%s", w->name ? w->name : "untracked");
+
+          gchar *text = w->name
+              ? g_strdup_printf("frame took %.1f ms (budget %.1f): %s %s ran %.1f ms",
+                                gap / 1000.0, m->budget / 1000.0, w->source, w->name, w->duration / 1000.0)
+              : g_strdup_printf("frame took %.1f ms (budget %.1f): no tracked callback, likely layout or paint",
+                                gap / 1000.0, m->budget / 1000.0);
+          g_message("stall: %s", text);
+          if (m->overlay) {
+              gchar *label = g_strdup_printf("%u/%u frames over budget · worst %.1f ms\n%s",
+                                             m->dropped, m->frames, m->worst_gap / 1000.0, text);
+              gtk_label_set_text(m->overlay, label);
+              g_free(label);
+          }
+          g_free(text);
+      }
+  }
+  m->last_frame = frame_time;
+  m->worst_since_frame = (StallSample){ 0 };
+  return G_SOURCE_CONTINUE;
+}
+
+/* Must run before any ui_signal_connect() it should see. */
+static void stall_monitor_init(void) {
+  const gchar *budget = g_getenv("GANESHA_STALL_MONITOR");
+  if (stall_monitor || !budget || !*budget) return;
+
+  stall_monitor = g_new0(StallMonitor, 1);
+  stall_monitor->budget = g_ascii_strtoll(budget, NULL, 10) * 1000;
+  stall_monitor->slowest = g_array_new(FALSE, FALSE, sizeof(StallSample));
+  stall_monitor->guards = g_array_new(FALSE, FALSE, sizeof(gint64));
+}
+
+/* Wraps content in an overlay for the monitor's status and starts watching
+ * the window's frame clock. Returns content unchanged when disabled. */
+static GtkWidget* stall_monitor_attach(GtkWidget *win, GtkWidget *content) {
+  if (!stall_monitor) return content;
+
+  GtkWidget *overlay = gtk_overlay_new();
+  gtk_overlay_set_child(GTK_OVERLAY(overlay), content);
+  GtkWidget *label = gtk_label_new("Stall monitor: no frames over budget yet");
+  gtk_widget_add_css_class(label, "osd");
+  gtk_widget_add_css_class(label, "caption");
+  gtk_widget_set_halign(label, GTK_ALIGN_END);
+  gtk_widget_set_valign(label, GTK_ALIGN_START);
+  gtk_widget_set_margin_top(label, 8);
+  gtk_widget_set_margin_end(label, 8);
+  gtk_widget_set_can_target(label, FALSE);
+  gtk_overlay_add_overlay(GTK_OVERLAY(overlay), label);
+  stall_monitor->overlay = GTK_LABEL(label);
+
+  // Keeps the frame clock running so that gaps are visible at all
+  gtk_widget_add_tick_callback(win, stall_monitor_tick, NULL, NULL);
+  return overlay;
+}
+
+static void stall_monitor_report(void) {
+  if (!stall_monitor) return;
+  StallMonitor *m = stall_monitor;
+
+  g_printerr("stall monitor: %u of %u frames over %.1f ms, worst %.1f ms\n",
+             m->dropped, m->frames, m->budget / 1000.0, m->worst_gap / 1000.0);
+  for (guint i = 0; i < m->slowest->len; i++) {
+      StallSample *s = &g_array_index(m->slowest, StallSample, i);
+      g_printerr("  %8.1f ms  %-6s %s", s->duration / 1000.0, s->source, s->name);
+      if (s->queued) g_printerr(" (queued %.1f ms)", s->queued / 1000.0);
+      g_printerr("\n");
+  }
+  m->overlay = NULL;
+}
+
+/* ---------- Power Saving ----------
+ * Nothing in the window runs on a timer, so with no reply streaming there
+ * are no sources or tick callbacks left and the frame clock stops. A
+ * streaming bubble is rebuilt at most once per frame. In power-saver mode
+ * (from GPowerProfileMonitor, or forced with GANESHA_POWER_SAVER=1/0) it is
+ * rebuilt every STREAM_FLUSH_POWER_SAVER_MS and the loading dots stand still. */
+
+static gboolean power_saver = FALSE;
+
+static void apply_power_saver(AppWidgets *aw, gboolean enabled) {
+  power_saver = enabled;
+  GtkWidget *win = GTK_WIDGET(gtk_widget_get_root(GTK_WIDGET(aw->chat_box)));
+  if (!win) return;
+  if (enabled) {
+      gtk_widget_add_css_class(win, "power-saver");
+  } else {
+      gtk_widget_remove_css_class(win, "power-saver");
+  }
+}
+
+static void on_power_saver_changed(GPowerProfileMonitor *monitor, GParamSpec *pspec, gpointer user_data) {
+  (void)pspec;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (aw->alive) apply_power_saver(aw, g_power_profile_monitor_get_power_saver_enabled(monitor));
+}
+
+/* Call once the chat is inside the window. */
+static void power_saver_setup(AppWidgets *aw) {
+  const gchar *forced = g_getenv("GANESHA_POWER_SAVER");
+  if (forced && *forced) {
+      apply_power_saver(aw, g_strcmp0(forced, "0") != 0);
+      return;
+  }
+  aw->power_monitor = g_power_profile_monitor_dup_default();
+  ui_signal_connect(aw->power_monitor, "notify::power-saver-enabled", on_power_saver_changed, aw);
+  apply_power_saver(aw, g_power_profile_monitor_get_power_saver_enabled(aw->power_monitor));
+}
+
+/* The assistant message a reply is streaming into, if any. */
+static Message* streaming_message(AppWidgets *aw) {
+  GPtrArray *messages = aw->current_conversation ? aw->current_conversation->messages : NULL;
+  if (!messages || messages->len == 0) return NULL;
+  Message *last = g_ptr_array_index(messages, messages->len - 1);
+  return g_strcmp0(last->role, "assistant") == 0 ? last : NULL;
+}
+
+/* Rebuilds the reply bubble from stream_text. While streaming it is built
+ * without a serial, so partial replies stay out of the parse cache and get
+ * no actions; the final build uses the message's serial. */
+static void stream_flush(AppWidgets *aw, gboolean final) {
+  if (!aw->alive || !aw->current_assistant_box) return;
+  Message *msg = streaming_message(aw);
+  if (!msg) return;
+  
+  message_set_content(msg, aw->stream_text->str, aw->stream_text->len);
+  GtkWidget *parent = gtk_widget_get_parent(aw->current_assistant_box);
+  GtkWidget *prev_sibling = gtk_widget_get_prev_sibling(aw->current_assistant_box);
+  GtkWidget *new_bubble = create_message_bubble("assistant", msg->content, final ? msg->serial : 0);
+  
+  gtk_box_remove(GTK_BOX(parent), aw->current_assistant_box);
+  if (prev_sibling) {
+      gtk_box_insert_child_after(GTK_BOX(parent), new_bubble, prev_sibling);
+  } else {
+      gtk_box_prepend(GTK_BOX(parent), new_bubble);
+  }
+  aw->current_assistant_box = new_bubble;
+}
+
+/* A flush is pending while either id is set; each callback clears its own
+ * id before flushing, and the final flush removes whichever is left. */
+static gboolean stream_flush_tick_cb(GtkWidget *widget, GdkFrameClock *clock, gpointer user_data) {
+  (void)widget; (void)clock;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  aw->stream_flush_tick = 0;
+  stream_flush(aw, FALSE);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean stream_flush_timeout(gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  aw->stream_flush_source = 0;
+  stream_flush(aw, FALSE);
+  return G_SOURCE_REMOVE;
+}
+
+static void stream_schedule_flush(AppWidgets *aw) {
+  if (aw->stream_flush_source || aw->stream_flush_tick) return;
+  if (power_saver) {
+      aw->stream_flush_source = g_timeout_add(STREAM_FLUSH_POWER_SAVER_MS, stream_flush_timeout, aw);
+  } else {
+      aw->stream_flush_tick = gtk_widget_add_tick_callback(GTK_WIDGET(aw->chat_box), stream_flush_tick_cb, aw, NULL);
+  }
+}
+
+static void stream_cancel_flush(AppWidgets *aw) {
+  g_clear_handle_id(&aw->stream_flush_source, g_source_remove);
+  if (aw->stream_flush_tick) {
+      gtk_widget_remove_tick_callback(GTK_WIDGET(aw->chat_box), aw->stream_flush_tick);
+      aw->stream_flush_tick = 0;
+  }
+}
+
 /* ---------- Callback postados no main loop ---------- */
 
 typedef struct {
   AppWidgets *aw;
   char       *chunk;
+  gint64      posted_at;
 } AppendChunkData;
 
 static gboolean ui_append_chunk_cb(gpointer data) {
   AppendChunkData *d = (AppendChunkData*)data;
+  gint64 trace_append = TRACE_BEGIN();
+  if (e2e_probe) e2e_probe_chunk(d->posted_at);
   if (d->aw && d->aw->alive && d->aw->current_assistant_box) {
-      GtkWidget *first_child = gtk_widget_get_first_child(d->aw->current_assistant_box);
-      if (first_child && gtk_widget_has_css_class(first_child, "loading-dot")) {
-          GtkWidget *new_bubble = create_message_bubble("assistant", d->chunk);
-          gtk_widget_set_hexpand(new_bubble, TRUE);
-          
-          GtkWidget *parent = gtk_widget_get_parent(d->aw->current_assistant_box);
-          GtkWidget *prev_sibling = gtk_widget_get_prev_sibling(d->aw->current_assistant_box);
-          
-          gtk_box_remove(GTK_BOX(parent), d->aw->current_assistant_box);
-          if (prev_sibling) {
-              gtk_box_insert_child_after(GTK_BOX(parent), new_bubble, prev_sibling);
-          } else {
-              gtk_box_prepend(GTK_BOX(parent), new_bubble);
-          }
-          
-          d->aw->current_assistant_box = new_bubble;
-      } else {
-          if (d->aw->current_conversation && d->aw->current_conversation->messages->len > 0) {
-              Message *last_msg = g_ptr_array_index(d->aw->current_conversation->messages, 
-                                                  d->aw->current_conversation->messages->len - 1);
-              if (g_strcmp0(last_msg->role, "assistant") == 0) {
-                  gchar *new_content = g_strconcat(last_msg->content, d->chunk, NULL);
-                  
-                  GtkWidget *parent = gtk_widget_get_parent(d->aw->current_assistant_box);
-                  GtkWidget *prev_sibling = gtk_widget_get_prev_sibling(d->aw->current_assistant_box);
-                  
-                  GtkWidget *new_bubble = create_message_bubble("assistant", new_content);
-                  gtk_box_remove(GTK_BOX(parent), d->aw->current_assistant_box);
-                  if (prev_sibling) {
-                      gtk_box_insert_child_after(GTK_BOX(parent), new_bubble, prev_sibling);
-                  } else {
-                      gtk_box_prepend(GTK_BOX(parent), new_bubble);
-                  }
-                  
-                  d->aw->current_assistant_box = new_bubble;
-                  g_free(last_msg->content);
-                  last_msg->content = new_content;
-              }
-          }
+      if (streaming_message(d->aw)) {
+          g_string_append(d->aw->stream_text, d->chunk);
+          stream_schedule_flush(d->aw);
       }
-      
-      GtkAdjustment *vadj = gtk_scrolled_window_get_vadjustment(d->aw->chat_scroller);
-      gtk_adjustment_set_value(vadj, gtk_adjustment_get_upper(vadj));
   }
+  TRACE_ENDF(trace_append, "ui-append", "%zu bytes, queued %" G_GINT64_FORMAT " us",
+             strlen(d->chunk), trace_append - d->posted_at);
   g_free(d->chunk);
   g_free(d);
   return G_SOURCE_REMOVE;
@@ -1248,24 +1778,36 @@ static gboolean ui_append_assistant_prefix_cb(gpointer data) {
       aw->current_assistant_box = bubble;
       
       if (aw->current_conversation) {
+          g_string_truncate(aw->stream_text, 0);
           conversation_add_message(aw->current_conversation, "assistant", "");
       }
-      
-      GtkAdjustment *vadj = gtk_scrolled_window_get_vadjustment(aw->chat_scroller);
-      gtk_adjustment_set_value(vadj, gtk_adjustment_get_upper(vadj));
+      scroll_chat_to_bottom(aw);
   }
   return G_SOURCE_REMOVE;
 }
 
 static void update_conversations_list(AppWidgets *aw);
+static void start_model_warmup(AppWidgets *aw, gboolean load);
+static void maybe_start_compaction(AppWidgets *aw, Conversation *conv);
 
 static gboolean ui_finish_stream_cb(gpointer data) {
   AppWidgets *aw = (AppWidgets*)data;
   if (aw && aw->alive) {
+      // Always rebuilt once more, with the serial that gives it its actions
+      stream_cancel_flush(aw);
+      stream_flush(aw, TRUE);
       aw->current_assistant_box = NULL;
       set_streaming_state(aw, FALSE);
-      save_conversations(aw);
+      if (aw->current_conversation) aw->current_conversation->streaming = FALSE;
+      // A reply in a branch gets its navigator by rebuilding the view
+      if (aw->current_conversation && branch_root(aw, aw->current_conversation) != aw->current_conversation) {
+          display_conversation(aw, aw->current_conversation);
+      }
+      save_conversations(aw->conversations);
       update_conversations_list(aw);
+      start_model_warmup(aw, FALSE);
+      maybe_start_compaction(aw, aw->current_conversation);
+      if (e2e_probe) e2e_probe_finish(aw);
   }
   if (aw && aw->cancellable) g_clear_object(&aw->cancellable);
   return G_SOURCE_REMOVE;
@@ -1316,256 +1858,728 @@ static gpointer load_models_worker(gpointer data) {
   
   if (!aw || !aw->alive) return NULL;
   
-  gchar *url = g_strdup_printf("%s/api/tags", OLLAMA_BASE_URL);
+  GPtrArray *model_names = ollama_list_models();
   
-  SoupSession *session = soup_session_new();
-  g_object_set(session, "timeout", 10, NULL);
+  if (model_names->len == 0) {
+      g_ptr_array_add(model_names, g_strdup(DEFAULT_MODEL));
+  }
   
-  SoupMessage *msg = soup_message_new("GET", url);
-  GError *err = NULL;
-  GBytes *response_bytes = soup_session_send_and_read(session, msg, NULL, &err);
+  ModelsLoadedData *mld = g_new0(ModelsLoadedData, 1);
+  mld->aw = aw;
+  mld->model_names = model_names;
   
-  GPtrArray *model_names = g_ptr_array_new_with_free_func(g_free);
+  ui_idle_add(ui_models_loaded_cb, mld);
   
-  if (response_bytes && !err) {
-      gsize size;
-      gconstpointer data_ptr = g_bytes_get_data(response_bytes, &size);
-      
-      JsonParser *parser = json_parser_new();
-      if (json_parser_load_from_data(parser, data_ptr, size, NULL)) {
-          JsonNode *root = json_parser_get_root(parser);
-          if (JSON_NODE_HOLDS_OBJECT(root)) {
-              JsonObject *obj = json_node_get_object(root);
-              if (json_object_has_member(obj, "models")) {
-                  JsonArray *models = json_object_get_array_member(obj, "models");
-                  guint len = json_array_get_length(models);
-                  
-                  for (guint i = 0; i < len; i++) {
-                      JsonObject *model = json_array_get_object_element(models, i);
-                      if (json_object_has_member(model, "name")) {
-                          const gchar *name = json_object_get_string_member(model, "name");
-                          g_ptr_array_add(model_names, g_strdup(name));
-                      }
-                  }
-              }
+  return NULL;
+}
+
+/* ---------- Model Warm-up ---------- */
+
+typedef enum {
+  MODEL_STATUS_UNKNOWN,
+  MODEL_STATUS_LOADING,
+  MODEL_STATUS_LOADED,
+  MODEL_STATUS_UNLOADED,
+  MODEL_STATUS_OFFLINE
+} ModelStatus;
+
+static void set_model_status(AppWidgets *aw, ModelStatus status) {
+  if (!aw || !aw->model_status) return;
+  
+  const gchar *text = "";
+  const gchar *tooltip = NULL;
+  switch (status) {
+    case MODEL_STATUS_LOADING:
+      text = "◌ Loading…";
+      tooltip = "Warming up the model on the server";
+      break;
+    case MODEL_STATUS_LOADED:
+      text = "● Loaded";
+      tooltip = "Model is in memory; the first token will come quickly";
+      break;
+    case MODEL_STATUS_UNLOADED:
+      text = "○ Not loaded";
+      tooltip = "The next message will wait for the model to load";
+      break;
+    case MODEL_STATUS_OFFLINE:
+      text = "Offline";
+      tooltip = "Could not reach the server";
+      break;
+    case MODEL_STATUS_UNKNOWN:
+    default:
+      break;
+  }
+  
+  gtk_label_set_text(aw->model_status, text);
+  gtk_widget_set_tooltip_text(GTK_WIDGET(aw->model_status), tooltip);
+  if (status == MODEL_STATUS_LOADED) {
+      gtk_widget_add_css_class(GTK_WIDGET(aw->model_status), "loaded");
+  } else {
+      gtk_widget_remove_css_class(GTK_WIDGET(aw->model_status), "loaded");
+  }
+}
+
+typedef struct {
+  AppWidgets *aw;
+  gchar      *model;
+  gchar      *keep_alive;
+  gboolean    load;        // FALSE only refreshes the loaded status
+} WarmupArgs;
+
+typedef struct {
+  AppWidgets *aw;
+  gchar      *model;
+  gboolean    was_warmup;
+  gboolean    reachable;
+  gboolean    loaded;
+} ModelStatusData;
+
+static gboolean ui_model_status_cb(gpointer data) {
+  ModelStatusData *sd = (ModelStatusData*)data;
+  AppWidgets *aw = sd->aw;
+  
+  if (aw && aw->alive) {
+      if (sd->was_warmup && g_strcmp0(aw->warming_model, sd->model) == 0) {
+          g_clear_pointer(&aw->warming_model, g_free);
+      }
+      if (g_strcmp0(aw->selected_model, sd->model) == 0) {
+          aw->model_loaded = sd->loaded;
+          if (aw->warming_model && g_strcmp0(aw->warming_model, sd->model) == 0) {
+              set_model_status(aw, MODEL_STATUS_LOADING);
+          } else if (!sd->reachable) {
+              set_model_status(aw, MODEL_STATUS_OFFLINE);
+          } else {
+              set_model_status(aw, sd->loaded ? MODEL_STATUS_LOADED : MODEL_STATUS_UNLOADED);
           }
       }
-      g_object_unref(parser);
-      g_bytes_unref(response_bytes);
   }
   
-  if (err) g_error_free(err);
+  g_free(sd->model);
+  g_free(sd);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer model_warmup_worker(gpointer data) {
+  WarmupArgs *wa = (WarmupArgs*)data;
+  
+  SoupSession *session = ollama_session_new(OLLAMA_BASE_URL, REQUEST_TIMEOUT);
+  
+  if (wa->load) ollama_load_model(session, NULL, wa->model, wa->keep_alive);
+  
+  GPtrArray *running = fetch_running_models(session, NULL);
+  
+  ModelStatusData *sd = g_new0(ModelStatusData, 1);
+  sd->aw = wa->aw;
+  sd->model = g_strdup(wa->model);
+  sd->was_warmup = wa->load;
+  sd->reachable = running != NULL;
+  sd->loaded = find_running_model(running, wa->model) != NULL;
+  ui_idle_add(ui_model_status_cb, sd);
+  
+  if (running) g_ptr_array_unref(running);
   g_object_unref(session);
-  g_object_unref(msg);
-  g_free(url);
+  g_free(wa->model);
+  g_free(wa->keep_alive);
+  g_free(wa);
+  return NULL;
+}
+
+/* Fires a background request that loads the selected model (or, with
+ * load == FALSE, only refreshes the loaded indicator from /api/ps). */
+static void start_model_warmup(AppWidgets *aw, gboolean load) {
+  if (!aw || !aw->alive || !aw->selected_model) return;
   
-  if (model_names->len == 0) {
-      g_ptr_array_add(model_names, g_strdup(DEFAULT_MODEL));
+  if (load) {
+      if (g_strcmp0(aw->warming_model, aw->selected_model) == 0) return;
+      g_free(aw->warming_model);
+      aw->warming_model = g_strdup(aw->selected_model);
+      set_model_status(aw, MODEL_STATUS_LOADING);
   }
   
-  ModelsLoadedData *mld = g_new0(ModelsLoadedData, 1);
-  mld->aw = aw;
-  mld->model_names = model_names;
+  WarmupArgs *args = g_new0(WarmupArgs, 1);
+  args->aw = aw;
+  args->model = g_strdup(aw->selected_model);
+  args->keep_alive = g_strdup(aw->keep_alive);
+  args->load = load;
+  g_thread_unref(g_thread_new("ganesha-warmup", model_warmup_worker, args));
+}
+
+/* ---------- Scheduler Notes ---------- */
+
+typedef struct {
+  AppWidgets *aw;
+  gchar      *text;
+} SchedulerNoteData;
+
+static gboolean ui_scheduler_note_cb(gpointer data) {
+  SchedulerNoteData *nd = (SchedulerNoteData*)data;
+  if (nd->aw && nd->aw->alive && nd->aw->scheduler_note) {
+      gtk_label_set_text(nd->aw->scheduler_note, nd->text ? nd->text : "");
+      gtk_widget_set_visible(GTK_WIDGET(nd->aw->scheduler_note), nd->text != NULL);
+  }
+  g_free(nd->text);
+  g_free(nd);
+  return G_SOURCE_REMOVE;
+}
+
+/* StreamCallbacks.note: runs on the request thread. */
+static void post_scheduler_note(gchar *text, gpointer user_data) {
+  SchedulerNoteData *nd = g_new0(SchedulerNoteData, 1);
+  nd->aw = (AppWidgets*)user_data;
+  nd->text = text;
+  ui_idle_add(ui_scheduler_note_cb, nd);
+}
+
+/* ---------- worker: Ollama streaming ---------- */
+
+typedef struct {
+  AppWidgets *aw;
+  RagStats    stats;
+} RetrievalData;
+
+/* Adds the excerpts and the time retrieval took to the context label. */
+static gboolean ui_retrieval_cb(gpointer data) {
+  RetrievalData *rd = (RetrievalData*)data;
+  AppWidgets *aw = rd->aw;
+  if (aw && aw->alive && aw->context_label) {
+      gint64 total_us = rd->stats.embed_us + rd->stats.search_us;
+      gchar *text = g_strdup_printf("%s · %u excerpts (%.0f ms)", gtk_label_get_text(aw->context_label),
+                                    rd->stats.excerpts, total_us / 1000.0);
+      gchar *tooltip = g_strdup_printf("Documents: embedding the prompt took %.1f ms, "
+                                       "searching the index %.2f ms",
+                                       rd->stats.embed_us / 1000.0, rd->stats.search_us / 1000.0);
+      gtk_label_set_text(aw->context_label, text);
+      gtk_widget_set_tooltip_text(GTK_WIDGET(aw->context_label), tooltip);
+      g_free(tooltip);
+      g_free(text);
+  }
+  g_free(rd);
+  return G_SOURCE_REMOVE;
+}
+
+/* StreamCallbacks.delta: runs on the winning leg's thread. */
+static void post_stream_delta(const gchar *text, gpointer user_data) {
+  AppendChunkData *chunk = g_new0(AppendChunkData, 1);
+  chunk->aw = (AppWidgets*)user_data;
+  chunk->chunk = g_strdup(text);
+  chunk->posted_at = g_get_monotonic_time();
+  ui_idle_add(ui_append_chunk_cb, chunk);
+}
+
+static const StreamCallbacks stream_callbacks = {
+  .delta = post_stream_delta,
+  .note  = post_scheduler_note,
+};
+
+static gpointer ollama_stream_worker(gpointer data) {
+  WorkerArgs *wa = (WorkerArgs*)data;
+  AppWidgets *aw = wa->aw;
+  if (!aw || !aw->alive) {
+      g_array_unref(wa->snapshot);
+      g_free(wa->model_copy);
+      g_free(wa->hedge_url_copy);
+      g_free(wa->keep_alive_copy);
+      g_clear_object(&wa->cancellable);
+      context_plan_free(wa->plan);
+      rag_index_unref(wa->documents);
+      g_free(wa);
+      return NULL;
+  }
+  ui_idle_add(ui_append_assistant_prefix_cb, aw);
+  
+  StreamRequest req = {
+    .model = wa->model_copy,
+    .hedge_url = wa->hedge_url_copy,
+    .keep_alive = wa->keep_alive_copy,
+    .hedge_percentile = wa->hedge_percentile,
+    .affinity_policy = wa->affinity_policy,
+    .server_memory = wa->server_memory,
+    .server_max_models = wa->server_max_models,
+  };
+  
+  // Excerpts are looked up for the message being answered, on the request's endpoint
+  if (wa->documents && wa->snapshot->len > 0) {
+      const MessageSnapshot *last = &g_array_index(wa->snapshot, MessageSnapshot, wa->snapshot->len - 1);
+      RetrievalData *rd = g_new0(RetrievalData, 1);
+      rd->aw = aw;
+      wa->plan->retrieved = rag_retrieve(wa->documents, req.base_url, last->content, wa->documents_room,
+                                         &rd->stats, wa->cancellable);
+      ui_idle_add(ui_retrieval_cb, rd);
+  }
   
-  g_idle_add(ui_models_loaded_cb, mld);
+  GError *error = NULL;
+  if (!ollama_stream_chat(&req, wa->snapshot, wa->plan, &stream_callbacks, aw,
+                          wa->cancellable, &error)) {
+      AppendChunkData *chunk = g_new0(AppendChunkData, 1);
+      chunk->aw = aw;
+      chunk->chunk = g_strdup_printf("[network error] %s", error->message);
+      chunk->posted_at = g_get_monotonic_time();
+      ui_idle_add(ui_append_chunk_cb, chunk);
+      g_error_free(error);
+  }
+  wa->model_copy = req.model;   // The scheduler may have rerouted it
+  
+  ui_idle_add(ui_finish_stream_cb, aw);
+  
+  g_array_unref(wa->snapshot);
+  g_free(wa->model_copy);
+  g_free(wa->hedge_url_copy);
+  g_free(wa->keep_alive_copy);
+  g_object_unref(wa->cancellable);
+  context_plan_free(wa->plan);
+  rag_index_unref(wa->documents);
+  g_free(wa);
+  return NULL;
+}
+
+/* ---------- Conversation Compaction ---------- */
+
+typedef struct {
+  AppWidgets   *aw;
+  Conversation *conv;
+  gchar        *model;
+  gchar        *request;   // Current summary plus the turns to fold in
+  guint         upto;
+  gint          num_ctx;
+  gchar        *keep_alive;
+  GCancellable *cancellable;
+} CompactionArgs;
+
+typedef struct {
+  AppWidgets   *aw;
+  Conversation *conv;
+  gchar        *summary;
+  guint         upto;
+} CompactionResult;
+
+static gboolean ui_compaction_done_cb(gpointer data) {
+  CompactionResult *cr = (CompactionResult*)data;
+  AppWidgets *aw = cr->aw;
+  
+  if (aw && aw->alive && g_ptr_array_find(aw->conversations, cr->conv, NULL)) {
+      cr->conv->compacting = FALSE;
+      if (cr->summary && *cr->summary && cr->upto <= cr->conv->messages->len) {
+          g_free(cr->conv->summary);
+          cr->conv->summary = g_steal_pointer(&cr->summary);
+          cr->conv->summary_upto = cr->upto;
+          save_conversations(aw->conversations);
+      }
+  }
   
+  g_free(cr->summary);
+  g_free(cr);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer compaction_worker(gpointer data) {
+  CompactionArgs *ca = (CompactionArgs*)data;
+  
+  CompactionResult *cr = g_new0(CompactionResult, 1);
+  cr->aw = ca->aw;
+  cr->conv = ca->conv;
+  cr->upto = ca->upto;
+  // Summarized where the window's chat requests go (no base_url)
+  cr->summary = ollama_summarize(NULL, ca->model, ca->request, ca->num_ctx, ca->keep_alive,
+                                 ca->cancellable);
+  ui_idle_add(ui_compaction_done_cb, cr);
+  
+  g_free(ca->model);
+  g_free(ca->request);
+  g_free(ca->keep_alive);
+  g_object_unref(ca->cancellable);
+  g_free(ca);
   return NULL;
 }
 
-/* ---------- worker: Ollama streaming ---------- */
+static void maybe_start_compaction(AppWidgets *aw, Conversation *conv) {
+  if (!aw || !aw->compaction_model) return;
+  
+  guint upto = 0;
+  gchar *request = compaction_request_new(conv, lookup_tokenizer(aw->selected_model),
+                                          aw->num_ctx, &upto);
+  if (!request) return;
+  
+  CompactionArgs *ca = g_new0(CompactionArgs, 1);
+  ca->aw = aw;
+  ca->conv = conv;
+  ca->model = g_strdup(aw->compaction_model);
+  ca->request = request;
+  ca->upto = upto;
+  ca->num_ctx = aw->num_ctx;
+  ca->keep_alive = g_strdup(aw->keep_alive);
+  if (!aw->compaction_cancellable) aw->compaction_cancellable = g_cancellable_new();
+  ca->cancellable = g_object_ref(aw->compaction_cancellable);
+  conv->compacting = TRUE;
+  g_thread_unref(g_thread_new("ganesha-compact", compaction_worker, ca));
+}
+
+/* ---------- Memory Report ---------- */
+
+/* Widgets are estimated from their instance sizes plus the text they hold;
+ * render nodes, Pango layouts and textures are not counted. */
+static void measure_widget_tree(GtkWidget *widget, MemoryReport *report) {
+  GTypeQuery query;
+  g_type_query(G_OBJECT_TYPE(widget), &query);
+  report->bytes[MEM_WIDGETS] += query.instance_size;
+  report->count[MEM_WIDGETS]++;
+  
+  if (GTK_IS_LABEL(widget)) {
+      report->bytes[MEM_WIDGETS] += strlen(gtk_label_get_label(GTK_LABEL(widget))) + 1;
+  } else if (GTK_IS_TEXT_VIEW(widget)) {
+      GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(widget));
+      report->bytes[MEM_WIDGETS] += gtk_text_buffer_get_char_count(buffer);
+  }
+  
+  for (GtkWidget *child = gtk_widget_get_first_child(widget); child;
+       child = gtk_widget_get_next_sibling(child)) {
+      measure_widget_tree(child, report);
+  }
+}
+
+static void measure_widgets(MemoryReport *report, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (!aw->alive) return;
+  GtkRoot *root = gtk_widget_get_root(GTK_WIDGET(aw->chat_box));
+  if (root) measure_widget_tree(GTK_WIDGET(root), report);
+  
+  for (GList *l = aw->rendered.head; l; l = l->next) {
+      RenderedConversation *rc = l->data;
+      for (guint i = 0; i < rc->bubbles->len; i++) {
+          measure_widget_tree(g_ptr_array_index(rc->bubbles, i), report);
+      }
+  }
+}
+
+static gchar* build_memory_report(AppWidgets *aw) {
+  MemoryReport report;
+  memory_report_init(&report);
+  memory_report_add_conversations(&report, aw->conversations);
+  memory_report_add_live(&report);
+  measure_widgets(&report, aw);
+  gchar *text = memory_report_to_text(&report);
+  memory_report_clear(&report);
+  return text;
+}
+
+static void on_memory_refresh(GtkButton *btn, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  GtkLabel *label = GTK_LABEL(g_object_get_data(G_OBJECT(btn), "report-label"));
+  gchar *text = build_memory_report(aw);
+  gtk_label_set_text(label, text);
+  g_free(text);
+}
+
+static gboolean on_memory_shortcut(GtkWidget *widget, GVariant *args, gpointer user_data) {
+  (void)args;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  
+  GtkWidget *dialog = gtk_window_new();
+  gtk_window_set_title(GTK_WINDOW(dialog), "Memory");
+  gtk_window_set_transient_for(GTK_WINDOW(dialog), GTK_WINDOW(widget));
+  gtk_window_set_default_size(GTK_WINDOW(dialog), 460, 360);
+  
+  GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+  gtk_widget_set_margin_top(box, 12);
+  gtk_widget_set_margin_bottom(box, 12);
+  gtk_widget_set_margin_start(box, 12);
+  gtk_widget_set_margin_end(box, 12);
+  
+  GtkWidget *label = gtk_label_new(NULL);
+  gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+  gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+  gtk_label_set_yalign(GTK_LABEL(label), 0.0);
+  gtk_widget_add_css_class(label, "monospace");
+  GtkWidget *scroller = gtk_scrolled_window_new();
+  gtk_widget_set_vexpand(scroller, TRUE);
+  gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scroller), label);
+  
+  GtkWidget *refresh = gtk_button_new_with_label("Refresh");
+  gtk_widget_set_halign(refresh, GTK_ALIGN_END);
+  g_object_set_data(G_OBJECT(refresh), "report-label", label);
+  ui_signal_connect(refresh, "clicked", on_memory_refresh, aw);
+  
+  gtk_box_append(GTK_BOX(box), scroller);
+  gtk_box_append(GTK_BOX(box), refresh);
+  gtk_window_set_child(GTK_WINDOW(dialog), box);
+  
+  on_memory_refresh(GTK_BUTTON(refresh), aw);
+  gtk_window_present(GTK_WINDOW(dialog));
+  return TRUE;
+}
+
+/* `ganesha --memory-report` prints the footprint of the stored history and
+ * exits without opening a window. */
+static gint on_handle_local_options(GApplication *app, GVariantDict *options, gpointer user_data) {
+  (void)app; (void)user_data;
+  if (!g_variant_dict_contains(options, "memory-report")) return -1;
+  
+  GPtrArray *conversations = g_ptr_array_new_with_free_func((GDestroyNotify)conversation_free);
+  load_conversations(conversations);
+  
+  MemoryReport report;
+  memory_report_init(&report);
+  memory_report_add_conversations(&report, conversations);
+  memory_report_add_live(&report);
+  gchar *text = memory_report_to_text(&report);
+  g_print("%s", text);
+  g_free(text);
+  memory_report_clear(&report);
+  g_ptr_array_unref(conversations);
+  return 0;
+}
 
-static gchar *build_ollama_chat_body(const char *model, Conversation *conv) {
-  JsonBuilder *b = json_builder_new();
-  json_builder_begin_object(b);
-  json_builder_set_member_name(b, "model");
-  json_builder_add_string_value(b, model);
-  json_builder_set_member_name(b, "stream");
-  json_builder_add_boolean_value(b, TRUE);
-  json_builder_set_member_name(b, "messages");
-  json_builder_begin_array(b);
+/* ---------- Memory Pressure ----------
+ * GMemoryMonitor warnings shed memory in steps. Low: parse cache, detached
+ * conversations and message pages off screen. Medium: also off-screen
+ * bubbles, and idle conversations other than the current one are spilled
+ * to disk. Critical: everything not in the viewport. Emptied pages and
+ * bubbles keep their height and are rebuilt as they scroll back in. */
+
+static Message* find_shown_message(AppWidgets *aw, guint serial) {
+  if (!aw->current_conversation) return NULL;
+  for (guint i = 0; i < aw->current_conversation->messages->len; i++) {
+      Message *msg = g_ptr_array_index(aw->current_conversation->messages, i);
+      if (msg->serial == serial) return msg;
+  }
+  return NULL;
+}
+
+static void refill_released_bubbles(AppWidgets *aw) {
+  if (!released_bubbles) return;
   
-  for (guint i = 0; i < conv->messages->len; i++) {
-      Message *msg = g_ptr_array_index(conv->messages, i);
-      json_builder_begin_object(b);
-      json_builder_set_member_name(b, "role");
-      json_builder_add_string_value(b, msg->role);
-      json_builder_set_member_name(b, "content");
-      json_builder_add_string_value(b, msg->content);
+  for (guint i = 0; i < released_bubbles->len; ) {
+      GtkWidget *bubble = g_weak_ref_get(g_ptr_array_index(released_bubbles, i));
+      if (!bubble) {
+          g_ptr_array_remove_index_fast(released_bubbles, i);
+          continue;
+      }
       
-      // Add images if present
-      if (msg->images && msg->images->len > 0) {
-          json_builder_set_member_name(b, "images");
-          json_builder_begin_array(b);
-          for (guint j = 0; j < msg->images->len; j++) {
-              const gchar *img = g_ptr_array_index(msg->images, j);
-              json_builder_add_string_value(b, img);
+      if (viewport_distance(bubble, GTK_WIDGET(aw->chat_scroller)) <= 1) {
+          guint serial = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(bubble), "message-serial"));
+          Message *msg = find_shown_message(aw, serial);
+          if (msg) {
+              gtk_widget_set_size_request(bubble, -1, -1);
+              fill_message_bubble(bubble, msg->role, msg->content, msg->serial);
           }
-          json_builder_end_array(b);
+          g_object_unref(bubble);
+          g_ptr_array_remove_index_fast(released_bubbles, i);
+          continue;
       }
-      
-      json_builder_end_object(b);
+      g_object_unref(bubble);
+      i++;
   }
-  
-  json_builder_end_array(b);
-  json_builder_end_object(b);
-  JsonGenerator *gen = json_generator_new();
-  JsonNode *root = json_builder_get_root(b);
-  json_generator_set_root(gen, root);
-  gsize len = 0;
-  gchar *data = json_generator_to_data(gen, &len);
-  g_object_unref(gen);
-  json_node_free(root);
-  g_object_unref(b);
-  return data;
 }
 
-static const char* extract_chunk_text(JsonNode *root) {
-  if (!JSON_NODE_HOLDS_OBJECT(root)) return NULL;
-  JsonObject *obj = json_node_get_object(root);
-  if (json_object_has_member(obj, "message")) {
-      JsonObject *msg = json_object_get_object_member(obj, "message");
-      if (msg && json_object_has_member(msg, "content")) {
-          return json_object_get_string_member(msg, "content");
-      }
+/* Empties pages and bubbles further than margin viewport heights away. */
+static void release_offscreen(AppWidgets *aw, gfloat margin, gboolean bubbles) {
+  GtkWidget *scroller = GTK_WIDGET(aw->chat_scroller);
+  
+  for (guint i = 0; page_slots && i < page_slots->len; i++) {
+      GtkWidget *slot = g_weak_ref_get(g_ptr_array_index(page_slots, i));
+      if (!slot) continue;
+      MessagePage *page = g_object_get_data(G_OBJECT(slot), "message-page");
+      gfloat distance = viewport_distance(slot, scroller);
+      if (page->built && distance > margin && distance != G_MAXFLOAT) message_page_release(slot, page);
+      g_object_unref(slot);
   }
-  if (json_object_has_member(obj, "response")) {
-      return json_object_get_string_member(obj, "response");
+  
+  if (!bubbles) return;
+  if (!released_bubbles) released_bubbles = g_ptr_array_new_with_free_func(code_weak_ref_free);
+  for (GtkWidget *bubble = gtk_widget_get_first_child(GTK_WIDGET(aw->chat_box)); bubble;
+       bubble = gtk_widget_get_next_sibling(bubble)) {
+      // Bubbles without a serial are live (streaming or just sent)
+      if (!g_object_get_data(G_OBJECT(bubble), "message-serial")) continue;
+      if (!gtk_widget_get_first_child(bubble) || viewport_distance(bubble, scroller) <= margin) continue;
+      
+      gint height = gtk_widget_get_height(bubble);
+      GtkWidget *child;
+      while ((child = gtk_widget_get_first_child(bubble))) gtk_box_remove(GTK_BOX(bubble), child);
+      gtk_widget_set_size_request(bubble, -1, height);
+      
+      GWeakRef *ref = g_new0(GWeakRef, 1);
+      g_weak_ref_init(ref, bubble);
+      g_ptr_array_add(released_bubbles, ref);
   }
-  return NULL;
 }
 
-static gboolean chunk_is_done(JsonNode *root) {
-  if (!JSON_NODE_HOLDS_OBJECT(root)) return FALSE;
-  JsonObject *obj = json_node_get_object(root);
-  if (json_object_has_member(obj, "done")) {
-      return json_object_get_boolean_member(obj, "done");
-  }
-  return FALSE;
+static gint64 measure_total(AppWidgets *aw) {
+  MemoryReport report;
+  memory_report_init(&report);
+  memory_report_add_conversations(&report, aw->conversations);
+  memory_report_add_live(&report);
+  measure_widgets(&report, aw);
+  gint64 total = memory_report_total(&report);
+  memory_report_clear(&report);
+  return total;
 }
 
-static gpointer ollama_stream_worker(gpointer data) {
-  WorkerArgs *wa = (WorkerArgs*)data;
-  AppWidgets *aw = wa->aw;
-  if (!aw || !aw->alive) {
-      g_free(wa->prompt_copy);
-      g_free(wa->model_copy);
-      g_free(wa);
-      return NULL;
-  }
-  GCancellable *c = aw->cancellable;
-  g_idle_add(ui_append_assistant_prefix_cb, aw);
-  gchar *url = g_strdup_printf("%s/api/chat", OLLAMA_BASE_URL);
-  gchar *body_json = build_ollama_chat_body(wa->model_copy, aw->current_conversation);
-  SoupSession *session = soup_session_new();
-  g_object_set(session, "timeout", REQUEST_TIMEOUT, NULL);
-  
-  SoupMessage *msg = soup_message_new("POST", url);
-  soup_message_headers_append(soup_message_get_request_headers(msg), "Content-Type", "application/json");
-  GBytes *body = g_bytes_new_take(body_json, strlen(body_json));
-  soup_message_set_request_body_from_bytes(msg, "application/json", body);
-  g_bytes_unref(body);
-  GError *err = NULL;
-  GInputStream *stream = soup_session_send(session, msg, c, &err);
-  if (!stream) {
-      AppendChunkData *chunk = g_new0(AppendChunkData, 1);
-      chunk->aw = aw;
-      chunk->chunk = g_strdup_printf("[network error] %s", err ? err->message : "unknown");
-      g_idle_add(ui_append_chunk_cb, chunk);
-      if (err) g_error_free(err);
-      g_object_unref(session);
-      g_object_unref(msg);
-      g_free(url);
-      g_free(wa->prompt_copy);
-      g_free(wa->model_copy);
-      g_free(wa);
-      g_idle_add(ui_finish_stream_cb, aw);
-      return NULL;
-  }
-  GDataInputStream *din = g_data_input_stream_new(stream);
-  g_data_input_stream_set_newline_type(din, G_DATA_STREAM_NEWLINE_TYPE_ANY);
-  while (aw->alive && !g_cancellable_is_cancelled(c)) {
-      gsize len = 0;
-      gchar *line = g_data_input_stream_read_line_utf8(din, &len, c, &err);
-      if (!line) break;
-      if (len == 0) {
-          g_free(line);
-          continue;
-      }
-      JsonParser *parser = json_parser_new();
-      if (json_parser_load_from_data(parser, line, -1, NULL)) {
-          JsonNode *root = json_parser_get_root(parser);
-          const char *delta = extract_chunk_text(root);
-          if (delta && *delta) {
-              AppendChunkData *chunk = g_new0(AppendChunkData, 1);
-              chunk->aw = aw;
-              chunk->chunk = g_strdup(delta);
-              g_idle_add(ui_append_chunk_cb, chunk);
-          }
-          if (chunk_is_done(root)) {
-              g_object_unref(parser);
-              g_free(line);
-              break;
-          }
+static void on_low_memory_warning(GMemoryMonitor *monitor, GMemoryMonitorWarningLevel level, gpointer user_data) {
+  (void)monitor;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (!aw->alive || !aw->history_loaded) return;
+  gint64 trace_shed = TRACE_BEGIN();
+  gint64 before = measure_total(aw);
+  
+  gboolean critical = level >= G_MEMORY_MONITOR_WARNING_LEVEL_CRITICAL;
+  md_cache_clear();
+  g_queue_clear_full(&aw->rendered, (GDestroyNotify)rendered_conversation_free);
+  release_offscreen(aw, critical ? 0 : 1, level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM);
+  
+  guint spilled = 0;
+  if (level >= G_MEMORY_MONITOR_WARNING_LEVEL_MEDIUM) {
+      for (guint i = 0; i < aw->conversations->len; i++) {
+          Conversation *conv = g_ptr_array_index(aw->conversations, i);
+          if (conv != aw->current_conversation && conversation_spill(conv) > 0) spilled++;
       }
-      g_object_unref(parser);
-      g_free(line);
   }
-  g_idle_add(ui_finish_stream_cb, aw);
-  g_object_unref(din);
-  g_object_unref(stream);
-  g_object_unref(session);
-  g_object_unref(msg);
-  g_free(url);
-  g_free(wa->prompt_copy);
-  g_free(wa->model_copy);
-  g_free(wa);
-  return NULL;
+  
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+  
+  gint64 freed = before - measure_total(aw);
+  memory_record_pressure(level, freed);
+  TRACE_ENDF(trace_shed, "memory-pressure", "level %d, %" G_GINT64_FORMAT " bytes freed, %u conversations spilled",
+             level, freed, spilled);
+}
+
+/* ---------- Local API ---------- */
+
+/* Requests from the socket go out with the same settings as the window's. */
+static void api_prepare_request(StreamRequest *req, gint *num_ctx, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (!req->model && aw->selected_model) req->model = g_strdup(aw->selected_model);
+  req->hedge_url = aw->hedge_url;
+  req->keep_alive = aw->keep_alive;
+  req->hedge_percentile = aw->hedge_percentile;
+  req->affinity_policy = aw->affinity_policy;
+  req->server_memory = aw->server_memory;
+  req->server_max_models = aw->server_max_models;
+  *num_ctx = aw->num_ctx;
+}
+
+static void api_conversation_changed(Conversation *conv, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (!aw->alive) return;
+  
+  save_conversations(aw->conversations);
+  update_conversations_list(aw);
+  if (conv == aw->current_conversation && !aw->in_progress) display_conversation(aw, conv);
+  if (!conv->streaming) maybe_start_compaction(aw, conv);
+}
+
+static const ApiServiceHooks api_hooks = {
+  .prepare = api_prepare_request,
+  .changed = api_conversation_changed,
+  .memory = measure_widgets,
+};
+
+static void start_local_api(AppWidgets *aw) {
+  gchar *path = g_build_filename(g_get_user_runtime_dir(), "ganesha", API_SOCKET_NAME, NULL);
+  GError *error = NULL;
+  aw->api_service = api_service_new(path, aw->conversations, &api_hooks, aw, &error);
+  if (!aw->api_service) {
+      g_warning("Local API disabled: %s", error->message);
+      g_error_free(error);
+  }
+  g_free(path);
 }
 
 /* ---------- callbacks UI ---------- */
 
+static void update_context_label(AppWidgets *aw, const ContextPlan *plan) {
+  if (!aw->context_label) return;
+  
+  guint included = plan->included->len;
+  gchar *text;
+  if (plan->summary) {
+      text = g_strdup_printf("Context: summary + %u of %u messages · %.1fk/%.1fk tokens",
+                             included, plan->considered, plan->tokens / 1000.0, plan->budget / 1000.0);
+  } else if (included == plan->considered) {
+      text = g_strdup_printf("Context: all %u messages · %.1fk/%.1fk tokens",
+                             included, plan->tokens / 1000.0, plan->budget / 1000.0);
+  } else {
+      text = g_strdup_printf("Context: last %u of %u messages · %.1fk/%.1fk tokens",
+                             included, plan->considered, plan->tokens / 1000.0, plan->budget / 1000.0);
+  }
+  gtk_label_set_text(aw->context_label, text);
+  gtk_widget_set_tooltip_text(GTK_WIDGET(aw->context_label),
+                              "Older messages that don't fit num_ctx are left out of the request");
+  g_free(text);
+}
+
+/* Sends user_text, or with NULL asks for a reply to the conversation as it
+ * stands (regenerate: the last message is the prompt). */
 static void start_ollama_stream(AppWidgets *aw, const char *user_text) {
-  if (!aw || !aw->alive || aw->in_progress) return;
+  if (!aw || !aw->alive || aw->in_progress || !aw->history_loaded) return;
   
   if (!aw->current_conversation) {
       aw->current_conversation = conversation_new();
       g_ptr_array_add(aw->conversations, aw->current_conversation);
   }
+  if (aw->current_conversation->streaming) {
+      gtk_label_set_text(aw->scheduler_note, "Another client is replying in this conversation");
+      gtk_widget_set_visible(GTK_WIDGET(aw->scheduler_note), TRUE);
+      return;
+  }
   
-  Message *msg = message_new("user", user_text);
-  
-  // Add pending images
-  if (aw->pending_images && aw->pending_images->len > 0) {
-      for (guint i = 0; i < aw->pending_images->len; i++) {
-          gchar *img = g_ptr_array_index(aw->pending_images, i);
-          g_ptr_array_add(msg->images, g_strdup(img));
+  if (user_text && aw->editing_serial) {
+      guint index;
+      if (find_message_index(aw->current_conversation, aw->editing_serial, &index)) {
+          show_new_branch(aw, conversation_branch(aw->current_conversation, index));
       }
-      g_ptr_array_remove_range(aw->pending_images, 0, aw->pending_images->len);
+      stop_editing(aw);
   }
   
-  g_ptr_array_add(aw->current_conversation->messages, msg);
-  
-  if (!aw->current_conversation->title) {
-      gchar *title = g_strdup(user_text);
-      if (strlen(title) > 50) {
-          title[47] = '.';
-          title[48] = '.';
-          title[49] = '.';
-          title[50] = '\0';
+  if (user_text) {
+      Message *msg = message_new("user", user_text);
+      
+      // Add pending images
+      if (aw->pending_images && aw->pending_images->len > 0) {
+          for (guint i = 0; i < aw->pending_images->len; i++) {
+              gchar *img = g_ptr_array_index(aw->pending_images, i);
+              g_ptr_array_add(msg->images, g_strdup(img));
+          }
+          g_ptr_array_remove_range(aw->pending_images, 0, aw->pending_images->len);
       }
-      aw->current_conversation->title = title;
+      
+      g_ptr_array_add(aw->current_conversation->messages, msg);
+      conversation_set_title_from(aw->current_conversation, user_text);
+      
+      append_message_bubble(aw, "user", user_text, msg->serial);
   }
   
-  append_message_bubble(aw, "user", user_text);
+  const gchar *model = aw->selected_model ? aw->selected_model : DEFAULT_MODEL;
+  ContextPlan *plan = context_plan_new(aw->current_conversation, aw->current_conversation->messages->len,
+                                       lookup_tokenizer(model), aw->num_ctx);
+  update_context_label(aw, plan);
   
   if (aw->cancellable) g_clear_object(&aw->cancellable);
   aw->cancellable = g_cancellable_new();
   set_streaming_state(aw, TRUE);
+  aw->current_conversation->streaming = TRUE;
   WorkerArgs *args = g_new0(WorkerArgs, 1);
   args->aw = aw;
-  args->prompt_copy = g_strdup(user_text);
-  args->model_copy = g_strdup(aw->selected_model ? aw->selected_model : DEFAULT_MODEL);
-  g_thread_new("ganesha-ollama", ollama_stream_worker, args);
+  args->snapshot = conversation_snapshot(aw->current_conversation, aw->current_conversation->messages->len);
+  args->model_copy = g_strdup(model);
+  args->plan = plan;
+  args->hedge_url_copy = g_strdup(aw->hedge_url);
+  args->keep_alive_copy = g_strdup(aw->keep_alive);
+  args->affinity_policy = aw->affinity_policy;
+  args->server_memory = aw->server_memory;
+  args->server_max_models = aw->server_max_models;
+  args->hedge_percentile = aw->hedge_percentile;
+  args->cancellable = g_object_ref(aw->cancellable);
+  if (aw->search_documents && aw->documents && rag_index_n_chunks(aw->documents) > 0) {
+      // Excerpts only get the room the history left, at the planner's 4 bytes per token
+      gint room = plan->budget - MIN(RESPONSE_RESERVE_TOKENS, plan->budget / 2) - plan->tokens
+                  - MESSAGE_OVERHEAD_TOKENS;
+      if (room > 0) {
+          args->documents = rag_index_ref(aw->documents);
+          args->documents_room = (gsize)room * 4;
+      }
+  }
+  g_thread_new("ganesha-request", ollama_stream_worker, args);
 }
 
 static void on_action_btn_clicked(GtkButton *btn, gpointer user_data) {
@@ -1593,6 +2607,64 @@ static void on_action_btn_clicked(GtkButton *btn, gpointer user_data) {
   }
 }
 
+/* Branch actions (see Branches above) */
+
+static void on_edit_message(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+  (void)action;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  guint index;
+  if (aw->in_progress || !aw->current_conversation
+      || !find_message_index(aw->current_conversation, g_variant_get_uint32(parameter), &index)) return;
+  
+  Message *msg = g_ptr_array_index(aw->current_conversation->messages, index);
+  aw->editing_serial = msg->serial;
+  for (guint i = 0; i < msg->images->len; i++) {
+      g_ptr_array_add(aw->pending_images, g_strdup(g_ptr_array_index(msg->images, i)));
+  }
+  gtk_text_buffer_set_text(gtk_text_view_get_buffer(aw->prompt_text_view), msg->content, -1);
+  gtk_widget_grab_focus(GTK_WIDGET(aw->prompt_text_view));
+  gtk_label_set_text(aw->scheduler_note, "Editing an earlier message: sending it starts a new branch");
+  gtk_widget_set_visible(GTK_WIDGET(aw->scheduler_note), TRUE);
+}
+
+static void on_regenerate_message(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+  (void)action;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  Conversation *conv = aw->current_conversation;
+  guint index;
+  if (aw->in_progress || !aw->history_loaded || !conv || conv->streaming
+      || !find_message_index(conv, g_variant_get_uint32(parameter), &index) || index == 0) return;
+  
+  Message *prompt = g_ptr_array_index(conv->messages, index - 1);
+  if (g_strcmp0(prompt->role, "user") != 0) return;
+  
+  stop_editing(aw);
+  show_new_branch(aw, conversation_branch(conv, index));
+  start_ollama_stream(aw, NULL);
+}
+
+static void on_switch_branch(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+  (void)action;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  Conversation *conv = aw->current_conversation;
+  guint index, serial;
+  g_variant_get(parameter, "(uu)", &index, &serial);
+  if (aw->in_progress || !conv || index > conv->messages->len) return;
+  
+  GPtrArray *tree = branch_tree(aw, conv);
+  for (guint i = 0; i < tree->len; i++) {
+      Conversation *other = g_ptr_array_index(tree, i);
+      if (shares_prefix(other, conv, index)
+          && ((Message*)g_ptr_array_index(other->messages, index))->serial == serial) {
+          stop_editing(aw);
+          aw->current_conversation = other;
+          display_conversation(aw, other);
+          break;
+      }
+  }
+  g_ptr_array_unref(tree);
+}
+
 static void on_attach_clicked(GtkButton *btn, gpointer user_data);
 static void on_audio_clicked(GtkButton *btn, gpointer user_data);
 static void on_new_chat_clicked(GtkButton *btn, gpointer user_data);
@@ -1639,9 +2711,11 @@ static void on_image_selected(GtkFileDialog *dialog, GAsyncResult *result, gpoin
     GtkTextIter end;
     gtk_text_buffer_get_end_iter(buffer, &end);
     
-    gchar *markup = g_strdup_printf("\n[Image: %s attached]\n", g_path_get_basename(filepath));
+    gchar *basename = g_path_get_basename(filepath);
+    gchar *markup = g_strdup_printf("\n[Image: %s attached]\n", basename);
     gtk_text_buffer_insert(buffer, &end, markup, -1);
     g_free(markup);
+    g_free(basename);
   }
   
   g_free(filepath);
@@ -1675,6 +2749,168 @@ static void on_attach_clicked(GtkButton *btn, gpointer user_data) {
   g_object_unref(filter);
 }
 
+/* ---------- Documents ----------
+ * Files and folders from the documents menu are chunked and embedded on a
+ * worker thread, with progress in the scheduler note. The new index
+ * replaces aw->documents once it is written; requests already running keep
+ * the one they started with. */
+
+typedef struct {
+  AppWidgets *aw;
+  RagIndex   *base;      // Index the files are added to (NULL = none yet)
+  gchar     **paths;
+  gchar      *model;
+} DocumentsJob;
+
+typedef struct {
+  AppWidgets *aw;
+  RagIndex   *index;     // NULL on failure
+  gchar      *error;
+} DocumentsResult;
+
+static void show_documents_note(AppWidgets *aw, const gchar *text) {
+  gtk_label_set_text(aw->scheduler_note, text);
+  gtk_widget_set_visible(GTK_WIDGET(aw->scheduler_note), TRUE);
+}
+
+/* RagProgressFunc: runs on the documents thread. */
+static void post_documents_progress(guint done, guint total, gpointer user_data) {
+  post_scheduler_note(g_strdup_printf("Documents: embedded %u of %u chunks", done, total), user_data);
+}
+
+static gboolean ui_documents_added_cb(gpointer data) {
+  DocumentsResult *dr = (DocumentsResult*)data;
+  AppWidgets *aw = dr->aw;
+  
+  if (aw->alive) {
+      aw->indexing = FALSE;
+      gchar *note;
+      if (dr->index) {
+          rag_index_unref(aw->documents);
+          aw->documents = g_steal_pointer(&dr->index);
+          note = g_strdup_printf("Documents: %u chunks from %u files", rag_index_n_chunks(aw->documents),
+                                 rag_index_n_sources(aw->documents));
+      } else {
+          note = g_strdup_printf("Documents not added: %s", dr->error);
+      }
+      show_documents_note(aw, note);
+      g_free(note);
+  }
+  
+  rag_index_unref(dr->index);
+  g_free(dr->error);
+  g_free(dr);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer documents_worker(gpointer data) {
+  DocumentsJob *job = (DocumentsJob*)data;
+  DocumentsResult *dr = g_new0(DocumentsResult, 1);
+  dr->aw = job->aw;
+  
+  GError *error = NULL;
+  // Embedded where the window's chat requests go (no base_url)
+  dr->index = rag_index_add(job->base, (const gchar * const *)job->paths, NULL, job->model,
+                            post_documents_progress, job->aw, NULL, &error);
+  if (!dr->index) {
+      dr->error = g_strdup(error ? error->message : "unknown error");
+      g_clear_error(&error);
+  }
+  ui_idle_add(ui_documents_added_cb, dr);
+  
+  rag_index_unref(job->base);
+  g_strfreev(job->paths);
+  g_free(job->model);
+  g_free(job);
+  return NULL;
+}
+
+static void start_documents_add(AppWidgets *aw, GListModel *files) {
+  if (!aw->alive || aw->indexing || !aw->history_loaded) return;
+  
+  GPtrArray *paths = g_ptr_array_new();
+  for (guint i = 0; i < g_list_model_get_n_items(files); i++) {
+      GFile *file = g_list_model_get_item(files, i);
+      gchar *path = g_file_get_path(file);
+      if (path) g_ptr_array_add(paths, path);
+      g_object_unref(file);
+  }
+  if (paths->len == 0) {
+      g_ptr_array_free(paths, TRUE);
+      return;
+  }
+  g_ptr_array_add(paths, NULL);
+  
+  DocumentsJob *job = g_new0(DocumentsJob, 1);
+  job->aw = aw;
+  job->base = aw->documents ? rag_index_ref(aw->documents) : NULL;
+  job->paths = (gchar**)g_ptr_array_free(paths, FALSE);
+  job->model = g_strdup(aw->embedding_model);
+  aw->indexing = TRUE;
+  show_documents_note(aw, "Documents: reading files…");
+  g_thread_unref(g_thread_new("ganesha-documents", documents_worker, job));
+}
+
+static void on_documents_files_chosen(GtkFileDialog *dialog, GAsyncResult *result, gpointer user_data) {
+  GListModel *files = gtk_file_dialog_open_multiple_finish(dialog, result, NULL);
+  if (!files) return;
+  start_documents_add((AppWidgets*)user_data, files);
+  g_object_unref(files);
+}
+
+static void on_documents_folders_chosen(GtkFileDialog *dialog, GAsyncResult *result, gpointer user_data) {
+  GListModel *folders = gtk_file_dialog_select_multiple_folders_finish(dialog, result, NULL);
+  if (!folders) return;
+  start_documents_add((AppWidgets*)user_data, folders);
+  g_object_unref(folders);
+}
+
+static void on_documents_add_files(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+  (void)action; (void)parameter;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (aw->indexing) return;
+  
+  GtkFileDialog *dialog = gtk_file_dialog_new();
+  gtk_file_dialog_set_title(dialog, "Add Documents");
+  GtkWindow *window = GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(aw->chat_box)));
+  gtk_file_dialog_open_multiple(dialog, window, NULL,
+                                (GAsyncReadyCallback)on_documents_files_chosen, aw);
+  g_object_unref(dialog);
+}
+
+static void on_documents_add_folder(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+  (void)action; (void)parameter;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (aw->indexing) return;
+  
+  GtkFileDialog *dialog = gtk_file_dialog_new();
+  gtk_file_dialog_set_title(dialog, "Add Document Folders");
+  GtkWindow *window = GTK_WINDOW(gtk_widget_get_root(GTK_WIDGET(aw->chat_box)));
+  gtk_file_dialog_select_multiple_folders(dialog, window, NULL,
+                                          (GAsyncReadyCallback)on_documents_folders_chosen, aw);
+  g_object_unref(dialog);
+}
+
+static void on_documents_clear(GSimpleAction *action, GVariant *parameter, gpointer user_data) {
+  (void)action; (void)parameter;
+  AppWidgets *aw = (AppWidgets*)user_data;
+  if (aw->indexing || !aw->history_loaded) return;
+  
+  gchar *path = get_documents_path();
+  g_unlink(path);
+  rag_index_unref(aw->documents);
+  aw->documents = rag_index_open(path, NULL);
+  g_free(path);
+  show_documents_note(aw, "Documents cleared");
+}
+
+static void on_search_documents_changed(GSimpleAction *action, GVariant *value, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  aw->search_documents = g_variant_get_boolean(value);
+  g_simple_action_set_state(action, value);
+  save_pref_boolean("search_documents", aw->search_documents);
+}
+
 /* ---------- Audio Handling (Placeholder) ---------- */
 
 static void on_audio_response(GtkDialog *dialog, gint response_id, gpointer user_data) {
@@ -1705,6 +2941,13 @@ static void on_audio_clicked(GtkButton *btn, gpointer user_data) {
 
 /* ---------- Conversations List UI ---------- */
 
+static void on_conversation_hovered(GtkEventControllerMotion *motion, gdouble x, gdouble y,
+                                    gpointer user_data) {
+  (void)x; (void)y; (void)user_data;
+  GtkWidget *row = gtk_event_controller_get_widget(GTK_EVENT_CONTROLLER(motion));
+  md_cache_prefetch(g_object_get_data(G_OBJECT(row), "conversation"));
+}
+
 static void update_conversations_list(AppWidgets *aw) {
   if (!aw || !aw->conversations_list) return;
   
@@ -1713,8 +2956,10 @@ static void update_conversations_list(AppWidgets *aw) {
       gtk_list_box_remove(aw->conversations_list, child);
   }
   
+  Conversation *current_root = aw->current_conversation ? branch_root(aw, aw->current_conversation) : NULL;
   for (gint i = aw->conversations->len - 1; i >= 0; i--) {
       Conversation *conv = g_ptr_array_index(aw->conversations, i);
+      if (conv->parent_id && branch_root(aw, conv) != conv) continue;   // Reached through its navigator
       
       GtkWidget *row = gtk_list_box_row_new();
       gtk_widget_add_css_class(row, "conversation-item");
@@ -1731,31 +2976,71 @@ static void update_conversations_list(AppWidgets *aw) {
       gtk_list_box_row_set_child(GTK_LIST_BOX_ROW(row), label);
       gtk_list_box_append(aw->conversations_list, row);
       
-      if (conv == aw->current_conversation) {
+      GtkEventController *motion = gtk_event_controller_motion_new();
+      ui_signal_connect(motion, "enter", on_conversation_hovered, aw);
+      gtk_widget_add_controller(row, motion);
+      
+      if (conv == current_root) {
           gtk_list_box_select_row(aw->conversations_list, GTK_LIST_BOX_ROW(row));
       }
   }
 }
 
-/* ---------- Theme Management ---------- */
+/* ---------- Theme Management ----------
+ * Both stylesheets are parsed once. A switch swaps which provider is
+ * installed, so the display holds a single app provider and the widget tree
+ * is restyled once, at the next frame, together with the Adwaita scheme
+ * change. The time from the switch to that frame being painted is logged
+ * (G_MESSAGES_DEBUG) and traced as "theme-switch". */
+
+static GtkCssProvider *theme_providers[2] = { NULL, NULL };   // Light, dark
+static GtkCssProvider *theme_installed = NULL;
+static gint64          theme_switch_start = 0;
+static gulong          theme_paint_handler = 0;
+
+static void on_theme_painted(GdkFrameClock *clock, gpointer user_data) {
+  AppWidgets *aw = (AppWidgets*)user_data;
+  g_signal_handler_disconnect(clock, theme_paint_handler);
+  theme_paint_handler = 0;
+  
+  guint bubbles = 0;
+  for (GtkWidget *child = gtk_widget_get_first_child(GTK_WIDGET(aw->chat_box)); child;
+       child = gtk_widget_get_next_sibling(child)) {
+      bubbles++;
+  }
+  g_debug("Theme switch painted after %.1f ms (%u bubbles)",
+          (g_get_monotonic_time() - theme_switch_start) / 1000.0, bubbles);
+  TRACE_ENDF(theme_switch_start, "theme-switch", "%u bubbles", bubbles);
+}
 
 static void apply_theme(AppWidgets *aw, gboolean dark_theme) {
-  GtkCssProvider *css_provider = gtk_css_provider_new();
-  AdwStyleManager *style = adw_style_manager_get_default();
-  adw_style_manager_set_color_scheme(style, dark_theme ? ADW_COLOR_SCHEME_FORCE_DARK : ADW_COLOR_SCHEME_FORCE_LIGHT);
+  if (!theme_providers[0]) {
+      theme_providers[0] = gtk_css_provider_new();
+      gtk_css_provider_load_from_string(theme_providers[0], LIGHT_CSS);
+      theme_providers[1] = gtk_css_provider_new();
+      gtk_css_provider_load_from_string(theme_providers[1], DARK_CSS);
+  }
   
-  if (dark_theme) {
-    gtk_css_provider_load_from_string(css_provider, DARK_CSS);
-  } else {
-    gtk_css_provider_load_from_string(css_provider, LIGHT_CSS);
+  GtkCssProvider *provider = theme_providers[dark_theme ? 1 : 0];
+  if (provider != theme_installed) {
+      GtkWidget *win = GTK_WIDGET(gtk_widget_get_root(GTK_WIDGET(aw->chat_box)));
+      if (win && !theme_paint_handler) {
+          theme_switch_start = g_get_monotonic_time();
+          theme_paint_handler = g_signal_connect(gtk_widget_get_frame_clock(win), "after-paint",
+                                                 G_CALLBACK(on_theme_painted), aw);
+      }
+      
+      GdkDisplay *display = gdk_display_get_default();
+      if (theme_installed) {
+          gtk_style_context_remove_provider_for_display(display, GTK_STYLE_PROVIDER(theme_installed));
+      }
+      gtk_style_context_add_provider_for_display(display, GTK_STYLE_PROVIDER(provider),
+                                                 GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+      theme_installed = provider;
   }
   
-  GdkDisplay *display = gdk_display_get_default();
-  gtk_style_context_add_provider_for_display(
-      display,
-      GTK_STYLE_PROVIDER(css_provider),
-      GTK_STYLE_PROVIDER_PRIORITY_APPLICATION
-  );
+  AdwStyleManager *style = adw_style_manager_get_default();
+  adw_style_manager_set_color_scheme(style, dark_theme ? ADW_COLOR_SCHEME_FORCE_DARK : ADW_COLOR_SCHEME_FORCE_LIGHT);
   
   if (aw->theme_btn) {
     if (dark_theme) {
@@ -1764,13 +3049,6 @@ static void apply_theme(AppWidgets *aw, gboolean dark_theme) {
       gtk_button_set_icon_name(GTK_BUTTON(aw->theme_btn), "weather-clear-symbolic");
     }
   }
-  
-  if (aw->chat_box) {
-    gtk_widget_queue_draw(GTK_WIDGET(aw->chat_box));
-  }
-  if (aw->conversations_list) {
-    gtk_widget_queue_draw(GTK_WIDGET(aw->conversations_list));
-  }
 }
 
 static void on_theme_toggled(GtkButton *btn, gpointer user_data) {
@@ -1788,14 +3066,15 @@ static void on_theme_toggled(GtkButton *btn, gpointer user_data) {
 static void on_new_chat_clicked(GtkButton *btn, gpointer user_data) {
   (void)btn;
   AppWidgets *aw = (AppWidgets*)user_data;
-  if (!aw || aw->in_progress) return;
+  if (!aw || aw->in_progress || !aw->history_loaded) return;
   
+  stop_editing(aw);
   aw->current_conversation = conversation_new();
   g_ptr_array_add(aw->conversations, aw->current_conversation);
   
   clear_chat_display(aw);
   update_conversations_list(aw);
-  save_conversations(aw);
+  save_conversations(aw->conversations);
 }
 
 static void on_conversation_selected(GtkListBox *box, GtkListBoxRow *row, gpointer user_data) {
@@ -1805,6 +3084,7 @@ static void on_conversation_selected(GtkListBox *box, GtkListBoxRow *row, gpoint
   
   Conversation *conv = g_object_get_data(G_OBJECT(row), "conversation");
   if (conv) {
+      stop_editing(aw);
       aw->current_conversation = conv;
       display_conversation(aw, conv);
   }
@@ -1818,9 +3098,13 @@ static void on_model_selected(GtkDropDown *dropdown, GParamSpec *pspec, gpointer
   GtkStringObject *str_obj = GTK_STRING_OBJECT(gtk_drop_down_get_selected_item(dropdown));
   if (str_obj) {
       const gchar *model_name = gtk_string_object_get_string(str_obj);
+      if (g_strcmp0(aw->selected_model, model_name) == 0 && aw->model_loaded) return;
       g_free(aw->selected_model);
       aw->selected_model = g_strdup(model_name);
+      aw->model_loaded = FALSE;
       save_preferred_model(model_name);
+      start_model_warmup(aw, TRUE);
+      start_tokenizer_fetch(model_name);
   }
 }
 
@@ -1830,8 +3114,16 @@ static void on_window_destroy(GtkWidget *w, gpointer user_data) {
   if (!aw) return;
   aw->alive = FALSE;
   if (aw->cancellable) g_cancellable_cancel(aw->cancellable);
+  if (aw->compaction_cancellable) g_cancellable_cancel(aw->compaction_cancellable);
+  // chat_box may already be gone; its tick callbacks go with it
+  g_clear_handle_id(&aw->stream_flush_source, g_source_remove);
+  aw->stream_flush_tick = 0;
+  g_clear_pointer(&aw->api_service, api_service_free);
   
-  save_conversations(aw);
+  // Closed before the history arrived: the file on disk is still the truth
+  if (aw->history_loaded) save_conversations(aw->conversations);
+  save_telemetry();
+  stall_monitor_report();
   
   if (aw->conversations) {
       g_ptr_array_unref(aw->conversations);
@@ -1841,7 +3133,27 @@ static void on_window_destroy(GtkWidget *w, gpointer user_data) {
       g_ptr_array_unref(aw->pending_images);
   }
   
+  g_queue_clear_full(&aw->rendered, (GDestroyNotify)rendered_conversation_free);
+  g_clear_pointer(&aw->shown, rendered_conversation_free);
+  
+  if (aw->memory_monitor) {
+      g_signal_handlers_disconnect_by_data(aw->memory_monitor, aw);
+      g_clear_object(&aw->memory_monitor);
+  }
+  if (aw->power_monitor) {
+      g_signal_handlers_disconnect_by_data(aw->power_monitor, aw);
+      g_clear_object(&aw->power_monitor);
+  }
+  
+  g_string_free(aw->stream_text, TRUE);
   g_free(aw->selected_model);
+  g_free(aw->hedge_url);
+  g_free(aw->keep_alive);
+  g_free(aw->warming_model);
+  g_free(aw->compaction_model);
+  g_clear_object(&aw->compaction_cancellable);
+  g_free(aw->embedding_model);
+  rag_index_unref(aw->documents);
 }
 
 /* ---------- Text View Auto-resize ---------- */
@@ -1850,6 +3162,14 @@ static void on_text_buffer_changed(GtkTextBuffer *buffer, gpointer user_data) {
   AppWidgets *aw = (AppWidgets*)user_data;
   if (!aw || !aw->prompt_scroller) return;
   
+  // Warm the model on the first keystroke of a new prompt if it was unloaded
+  gboolean empty = gtk_text_buffer_get_char_count(buffer) == 0;
+  if (aw->prompt_empty && !empty && aw->warmup_on_typing &&
+      !aw->model_loaded && !aw->in_progress) {
+      start_model_warmup(aw, TRUE);
+  }
+  aw->prompt_empty = empty;
+  
   GtkTextIter start, end;
   gtk_text_buffer_get_bounds(buffer, &start, &end);
   gint line_count = gtk_text_iter_get_line(&end) + 1;
@@ -1864,10 +3184,144 @@ static void on_text_buffer_changed(GtkTextBuffer *buffer, gpointer user_data) {
   }
 }
 
+/* ---------- Staged Startup ----------
+ * on_activate builds and presents the window shell with nothing but the
+ * prefs behind it. History and telemetry are read on a worker thread and
+ * models on another; hydrate_history_cb then fills the window. Startup is
+ * timed from main() to the first painted frame and to the history landing;
+ * GANESHA_STARTUP_REPORT=<file> writes both as JSON and quits. */
+
+typedef struct {
+  gint64  origin;            // g_get_monotonic_time() at main()
+  gint64  first_frame;       // Monotonic, 0 until painted
+  gint64  first_frame_real;  // Wall clock, so scripts can add exec time
+  gint64  history_ready;
+  guint   conversations;
+  gulong  paint_handler;
+} StartupTiming;
+
+static StartupTiming startup;
+
+typedef struct {
+  AppWidgets *aw;
+  GPtrArray  *conversations;
+  RagIndex   *documents;
+} HistoryLoadedData;
+
+static void startup_maybe_report(void) {
+  if (!startup.first_frame || !startup.history_ready) return;
+  
+  gdouble first_frame_ms = (startup.first_frame - startup.origin) / 1000.0;
+  gdouble history_ms = (startup.history_ready - startup.origin) / 1000.0;
+  g_debug("startup: first frame %.1f ms, history %.1f ms (%u conversations)",
+          first_frame_ms, history_ms, startup.conversations);
+  
+  const gchar *path = g_getenv("GANESHA_STARTUP_REPORT");
+  if (!path || !*path) return;
+  
+  JsonBuilder *b = json_builder_new();
+  json_builder_begin_object(b);
+  json_builder_set_member_name(b, "first_frame_ms");
+  json_builder_add_double_value(b, first_frame_ms);
+  json_builder_set_member_name(b, "first_frame_unix_us");
+  json_builder_add_int_value(b, startup.first_frame_real);
+  json_builder_set_member_name(b, "history_ms");
+  json_builder_add_double_value(b, history_ms);
+  json_builder_set_member_name(b, "conversations");
+  json_builder_add_int_value(b, startup.conversations);
+  json_builder_end_object(b);
+  
+  JsonGenerator *gen = json_generator_new();
+  JsonNode *root = json_builder_get_root(b);
+  json_generator_set_root(gen, root);
+  json_generator_set_pretty(gen, TRUE);
+  GError *error = NULL;
+  if (!json_generator_to_file(gen, path, &error)) {
+      g_warning("startup report: %s", error->message);
+      g_error_free(error);
+  }
+  json_node_free(root);
+  g_object_unref(gen);
+  g_object_unref(b);
+  g_application_quit(g_application_get_default());
+}
+
+static void on_first_paint(GdkFrameClock *clock, gpointer user_data) {
+  (void)user_data;
+  g_signal_handler_disconnect(clock, startup.paint_handler);
+  startup.first_frame = g_get_monotonic_time();
+  startup.first_frame_real = g_get_real_time();
+  TRACE_INSTANT("first-frame", NULL);
+  startup_maybe_report();
+}
+
+static gboolean hydrate_history_cb(gpointer data) {
+  HistoryLoadedData *hld = (HistoryLoadedData*)data;
+  AppWidgets *aw = hld->aw;
+  
+  if (!aw->alive) {
+      g_ptr_array_unref(hld->conversations);
+      rag_index_unref(hld->documents);
+      g_free(hld);
+      return G_SOURCE_REMOVE;
+  }
+  
+  gint64 trace_hydrate = TRACE_BEGIN();
+  g_ptr_array_extend_and_steal(aw->conversations, hld->conversations);
+  aw->history_loaded = TRUE;
+  aw->documents = hld->documents;
+  
+  apply_theme(aw, aw->dark_theme);
+  if (aw->conversations->len == 0) {
+      aw->current_conversation = conversation_new();
+      g_ptr_array_add(aw->conversations, aw->current_conversation);
+  } else {
+      aw->current_conversation = g_ptr_array_index(aw->conversations, aw->conversations->len - 1);
+      display_conversation(aw, aw->current_conversation);
+  }
+  update_conversations_list(aw);
+  gtk_widget_set_sensitive(GTK_WIDGET(aw->action_btn), TRUE);
+  gtk_widget_set_sensitive(GTK_WIDGET(aw->new_chat_btn), TRUE);
+  
+  if (load_pref_boolean("local_api", TRUE)) start_local_api(aw);
+  e2e_probe_setup(aw, GTK_WIDGET(gtk_widget_get_root(GTK_WIDGET(aw->chat_box))));
+  TRACE_ENDF(trace_hydrate, "hydrate", "%u conversations", aw->conversations->len);
+  
+  startup.history_ready = g_get_monotonic_time();
+  startup.conversations = aw->conversations->len;
+  startup_maybe_report();
+  
+  g_free(hld);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer load_history_worker(gpointer data) {
+  HistoryLoadedData *hld = g_new0(HistoryLoadedData, 1);
+  hld->aw = (AppWidgets*)data;
+  hld->conversations = g_ptr_array_new_with_free_func((GDestroyNotify)conversation_free);
+  
+  load_telemetry();
+  load_conversations(hld->conversations);
+  
+  // Only mapped here; pages are read as searches touch them
+  gchar *documents_path = get_documents_path();
+  GError *error = NULL;
+  hld->documents = rag_index_open(documents_path, &error);
+  if (!hld->documents) {
+      g_warning("Documents: %s", error->message);
+      g_error_free(error);
+  }
+  g_free(documents_path);
+  
+  ui_idle_add(hydrate_history_cb, hld);
+  return NULL;
+}
+
 /* ---------- bootstrap ---------- */
 
 static void on_activate(GApplication *app, gpointer user_data) {
   (void)user_data;
+  stall_monitor_init();
   
   AdwApplicationWindow *win = ADW_APPLICATION_WINDOW(
       adw_application_window_new(GTK_APPLICATION(app))
@@ -1942,8 +3396,22 @@ static void on_activate(GApplication *app, gpointer user_data) {
   GtkWidget *model_dropdown = gtk_drop_down_new(G_LIST_MODEL(models_store), NULL);
   gtk_widget_set_hexpand(model_dropdown, TRUE);
   
+  GtkWidget *model_status = gtk_label_new("");
+  gtk_widget_add_css_class(model_status, "model-status");
+  
+  GtkWidget *scheduler_note = gtk_label_new("");
+  gtk_widget_add_css_class(scheduler_note, "model-status");
+  gtk_label_set_ellipsize(GTK_LABEL(scheduler_note), PANGO_ELLIPSIZE_END);
+  gtk_widget_set_visible(scheduler_note, FALSE);
+  
+  GtkWidget *context_label = gtk_label_new("");
+  gtk_widget_add_css_class(context_label, "model-status");
+  
   gtk_box_append(GTK_BOX(model_hbox), model_label);
   gtk_box_append(GTK_BOX(model_hbox), model_dropdown);
+  gtk_box_append(GTK_BOX(model_hbox), model_status);
+  gtk_box_append(GTK_BOX(model_hbox), scheduler_note);
+  gtk_box_append(GTK_BOX(model_hbox), context_label);
   
   // Chat area
   GtkWidget *chat_scroller = gtk_scrolled_window_new();
@@ -1994,6 +3462,25 @@ static void on_activate(GApplication *app, gpointer user_data) {
   gtk_widget_add_css_class(attach_btn, "flat");
   gtk_widget_set_tooltip_text(attach_btn, "Attach image");
   
+  GMenu *documents_menu = g_menu_new();
+  GMenu *documents_add = g_menu_new();
+  g_menu_append(documents_add, "Add Files…", "win.documents-add-files");
+  g_menu_append(documents_add, "Add Folder…", "win.documents-add-folder");
+  g_menu_append_section(documents_menu, NULL, G_MENU_MODEL(documents_add));
+  GMenu *documents_use = g_menu_new();
+  g_menu_append(documents_use, "Search Documents", "win.search-documents");
+  g_menu_append(documents_use, "Clear Documents", "win.documents-clear");
+  g_menu_append_section(documents_menu, NULL, G_MENU_MODEL(documents_use));
+  
+  GtkWidget *documents_btn = gtk_menu_button_new();
+  gtk_menu_button_set_icon_name(GTK_MENU_BUTTON(documents_btn), "folder-documents-symbolic");
+  gtk_menu_button_set_menu_model(GTK_MENU_BUTTON(documents_btn), G_MENU_MODEL(documents_menu));
+  gtk_widget_add_css_class(documents_btn, "flat");
+  gtk_widget_set_tooltip_text(documents_btn, "Documents");
+  g_object_unref(documents_use);
+  g_object_unref(documents_add);
+  g_object_unref(documents_menu);
+  
   GtkWidget *audio_btn = gtk_button_new_from_icon_name("audio-input-microphone-symbolic");
   gtk_widget_add_css_class(audio_btn, "flat");
   gtk_widget_set_tooltip_text(audio_btn, "Voice input (coming soon)");
@@ -2002,6 +3489,7 @@ static void on_activate(GApplication *app, gpointer user_data) {
   gtk_widget_add_css_class(action_btn, "suggested-action");
   
   gtk_box_append(GTK_BOX(button_box), attach_btn);
+  gtk_box_append(GTK_BOX(button_box), documents_btn);
   gtk_box_append(GTK_BOX(button_box), audio_btn);
   gtk_box_append(GTK_BOX(button_box), action_btn);
   
@@ -2032,6 +3520,12 @@ static void on_activate(GApplication *app, gpointer user_data) {
   aw->conversations_list = GTK_LIST_BOX(conversations_list);
   aw->models_store = models_store;
   aw->cancellable = NULL;
+  // Point at another server (e.g. bench/mock-ollama.c) without recompiling
+  const gchar *env_url = g_getenv("GANESHA_OLLAMA_URL");
+  if (env_url && *env_url) OLLAMA_BASE_URL = env_url;
+  const gchar *env_backend = g_getenv("GANESHA_BACKEND");
+  if (env_backend && *env_backend) CHAT_BACKEND = env_backend;
+  
   aw->in_progress = FALSE;
   aw->alive = TRUE;
   aw->selected_model = load_preferred_model();
@@ -2041,55 +3535,124 @@ static void on_activate(GApplication *app, gpointer user_data) {
   aw->theme_btn = theme_btn;
   aw->dark_theme = load_theme_preference();
   aw->pending_images = g_ptr_array_new_with_free_func(g_free);
-  
-  load_conversations(aw);
-  
-  if (aw->conversations->len == 0) {
-      aw->current_conversation = conversation_new();
-      g_ptr_array_add(aw->conversations, aw->current_conversation);
-  } else {
-      aw->current_conversation = g_ptr_array_index(aw->conversations, aw->conversations->len - 1);
-      display_conversation(aw, aw->current_conversation);
-  }
-  
-  apply_theme(aw, aw->dark_theme);
+  aw->stream_text = g_string_new("");
+  aw->hedge_url = load_pref_string("hedge_url", NULL);
+  if (aw->hedge_url && !*aw->hedge_url) g_clear_pointer(&aw->hedge_url, g_free);
+  aw->hedge_percentile = load_pref_double("hedge_percentile", HEDGE_PERCENTILE);
+  aw->keep_alive = load_pref_string("keep_alive", KEEP_ALIVE);
+  aw->warmup_on_typing = load_pref_boolean("warmup_on_typing", FALSE);
+  aw->prompt_empty = TRUE;
+  aw->model_status = GTK_LABEL(model_status);
+  
+  gchar *affinity = load_pref_string("affinity_policy", "warn");
+  aw->affinity_policy = parse_affinity_policy(affinity);
+  g_free(affinity);
+  aw->server_memory = (gint64)load_pref_double("server_memory_bytes", 0);
+  aw->server_max_models = (gint)load_pref_double("server_max_loaded_models", 0);
+  aw->scheduler_note = GTK_LABEL(scheduler_note);
+  aw->num_ctx = (gint)load_pref_double("num_ctx", DEFAULT_NUM_CTX);
+  aw->context_label = GTK_LABEL(context_label);
+  aw->compaction_model = load_pref_string("compaction_model", NULL);
+  if (aw->compaction_model && !*aw->compaction_model) g_clear_pointer(&aw->compaction_model, g_free);
+  aw->search_documents = load_pref_boolean("search_documents", TRUE);
+  aw->embedding_model = load_pref_string("embedding_model", EMBEDDING_MODEL);
+  
+  // The shell only needs the color scheme; app CSS and history come with hydrate_history_cb
+  adw_style_manager_set_color_scheme(adw_style_manager_get_default(),
+      aw->dark_theme ? ADW_COLOR_SCHEME_FORCE_DARK : ADW_COLOR_SCHEME_FORCE_LIGHT);
+  gtk_widget_set_sensitive(action_btn, FALSE);
+  gtk_widget_set_sensitive(new_chat_btn, FALSE);
   
   // Connect signals
-  g_signal_connect(action_btn, "clicked", G_CALLBACK(on_action_btn_clicked), aw);
-  g_signal_connect(attach_btn, "clicked", G_CALLBACK(on_attach_clicked), aw);
-  g_signal_connect(audio_btn, "clicked", G_CALLBACK(on_audio_clicked), aw);
-  g_signal_connect(new_chat_btn, "clicked", G_CALLBACK(on_new_chat_clicked), aw);
-  g_signal_connect(model_dropdown, "notify::selected", G_CALLBACK(on_model_selected), aw);
-  g_signal_connect(conversations_list, "row-activated", G_CALLBACK(on_conversation_selected), aw);
-  g_signal_connect(theme_btn, "clicked", G_CALLBACK(on_theme_toggled), aw);
+  ui_signal_connect(action_btn, "clicked", on_action_btn_clicked, aw);
+  ui_signal_connect(attach_btn, "clicked", on_attach_clicked, aw);
+  ui_signal_connect(audio_btn, "clicked", on_audio_clicked, aw);
+  ui_signal_connect(new_chat_btn, "clicked", on_new_chat_clicked, aw);
+  ui_signal_connect(model_dropdown, "notify::selected", on_model_selected, aw);
+  ui_signal_connect(conversations_list, "row-activated", on_conversation_selected, aw);
+  ui_signal_connect(theme_btn, "clicked", on_theme_toggled, aw);
+  
+  // Code blocks start highlighting as they scroll into view
+  GtkAdjustment *chat_vadj = gtk_scrolled_window_get_vadjustment(aw->chat_scroller);
+  ui_signal_connect(chat_vadj, "value-changed", on_chat_viewport_changed, aw);
+  ui_signal_connect(chat_vadj, "changed", on_chat_viewport_changed, aw);
+  ui_signal_connect(chat_vadj, "value-changed", on_chat_scrolled, aw);
+  ui_signal_connect(chat_vadj, "changed", on_chat_bounds_changed, aw);
   
   // Connect text buffer change signal for auto-resize
   GtkTextBuffer *buffer = gtk_text_view_get_buffer(aw->prompt_text_view);
-  g_signal_connect(buffer, "changed", G_CALLBACK(on_text_buffer_changed), aw);
+  ui_signal_connect(buffer, "changed", on_text_buffer_changed, aw);
 
   // Controller de teclado: REGISTRAR APÓS aw->prompt_text_view estar definido
   GtkEventController *key_ctrl = gtk_event_controller_key_new();
-  g_signal_connect(key_ctrl, "key-pressed", G_CALLBACK(on_prompt_key_pressed), aw);
+  ui_signal_connect(key_ctrl, "key-pressed", on_prompt_key_pressed, aw);
   gtk_widget_add_controller(GTK_WIDGET(aw->prompt_text_view), key_ctrl);
   
   g_signal_connect(win, "destroy", G_CALLBACK(on_window_destroy), aw);
   
-  update_conversations_list(aw);
-  
-  adw_toolbar_view_set_content(view, paned);
+  aw->memory_monitor = g_memory_monitor_dup_default();
+  ui_signal_connect(aw->memory_monitor, "low-memory-warning", on_low_memory_warning, aw);
+  
+  static const struct { const gchar *name, *type, *handler_name; GCallback handler; } window_actions[] = {
+    { "copy-message",         "u",    "on_copy_message",         G_CALLBACK(on_copy_message) },
+    { "edit-message",         "u",    "on_edit_message",         G_CALLBACK(on_edit_message) },
+    { "regenerate-message",   "u",    "on_regenerate_message",   G_CALLBACK(on_regenerate_message) },
+    { "switch-branch",        "(uu)", "on_switch_branch",        G_CALLBACK(on_switch_branch) },
+    { "documents-add-files",  NULL,   "on_documents_add_files",  G_CALLBACK(on_documents_add_files) },
+    { "documents-add-folder", NULL,   "on_documents_add_folder", G_CALLBACK(on_documents_add_folder) },
+    { "documents-clear",      NULL,   "on_documents_clear",      G_CALLBACK(on_documents_clear) },
+  };
+  for (guint i = 0; i < G_N_ELEMENTS(window_actions); i++) {
+      const GVariantType *type = window_actions[i].type ? G_VARIANT_TYPE(window_actions[i].type) : NULL;
+      GSimpleAction *action = g_simple_action_new(window_actions[i].name, type);
+      ui_signal_connect_named(action, "activate", window_actions[i].handler_name,
+                              window_actions[i].handler, aw);
+      g_action_map_add_action(G_ACTION_MAP(win), G_ACTION(action));
+      g_object_unref(action);
+  }
+  GSimpleAction *search_documents = g_simple_action_new_stateful("search-documents", NULL,
+                                                                 g_variant_new_boolean(aw->search_documents));
+  ui_signal_connect(search_documents, "change-state", on_search_documents_changed, aw);
+  g_action_map_add_action(G_ACTION_MAP(win), G_ACTION(search_documents));
+  g_object_unref(search_documents);
+  
+  // Ctrl+Shift+M opens the memory report
+  GtkEventController *shortcuts = gtk_shortcut_controller_new();
+  gtk_shortcut_controller_add_shortcut(GTK_SHORTCUT_CONTROLLER(shortcuts),
+      gtk_shortcut_new(gtk_shortcut_trigger_parse_string("<Control><Shift>m"),
+                       gtk_callback_action_new(on_memory_shortcut, aw, NULL)));
+  gtk_widget_add_controller(GTK_WIDGET(win), shortcuts);
+  
+  adw_toolbar_view_set_content(view, stall_monitor_attach(GTK_WIDGET(win), paned));
   adw_application_window_set_content(win, GTK_WIDGET(view));
+  power_saver_setup(aw);
   gtk_window_present(GTK_WINDOW(win));
+  startup.paint_handler = g_signal_connect(gtk_widget_get_frame_clock(GTK_WIDGET(win)), "after-paint",
+                                           G_CALLBACK(on_first_paint), NULL);
   
+  g_thread_unref(g_thread_new("ganesha-history", load_history_worker, aw));
   g_thread_new("ganesha-models", load_models_worker, aw);
 }
 
 int main(int argc, char **argv) {
+  startup.origin = g_get_monotonic_time();
+  trace_init();
   adw_init();
+  // Bench runs must not hand their activation to an instance already running
+  GApplicationFlags flags = G_APPLICATION_DEFAULT_FLAGS;
+  if (g_getenv("GANESHA_E2E_PROMPT") || g_getenv("GANESHA_E2E_REPORT") ||
+      g_getenv("GANESHA_STARTUP_REPORT")) {
+      flags |= G_APPLICATION_NON_UNIQUE;
+  }
   AdwApplication *app = ADW_APPLICATION(
-      adw_application_new("org.hangell.ganesha", G_APPLICATION_DEFAULT_FLAGS)
+      adw_application_new("org.hangell.ganesha", flags)
   );
+  g_application_add_main_option(G_APPLICATION(app), "memory-report", 0, G_OPTION_FLAG_NONE,
+                                G_OPTION_ARG_NONE, "Print the memory used by the stored history and exit", NULL);
+  g_signal_connect(app, "handle-local-options", G_CALLBACK(on_handle_local_options), NULL);
   g_signal_connect(app, "activate", G_CALLBACK(on_activate), NULL);
   int status = g_application_run(G_APPLICATION(app), argc, argv);
   g_object_unref(app);
+  trace_shutdown();
   return status;
-}
\ No newline at end of file
+}